@@ -0,0 +1,119 @@
+/*
+Monotonic arena memory resource
+
+Allocations bump a pointer through a list of blocks and are never freed one at
+a time. reset() forgets everything in O(1) and keeps the blocks so the next
+round of allocations (the next chunk decoded) reuses the same memory without
+going back to the heap, release() returns the blocks to the heap.
+
+Objects placed in an arena do not get their destructors run, so it is meant for
+data that only owns memory from the same arena (like NBT trees decoded with
+TAG::decode(data,len,&arena)). Not thread safe, use one arena per thread.
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <new>
+#include <vector>
+
+namespace mclib
+{
+
+class Arena: public std::pmr::memory_resource
+{
+private:
+    struct _block
+    {
+        char *data;
+        size_t size;
+    };
+    std::vector<_block> blocks;
+    // blocks[0,cur) have been used since the last reset, the free space in
+    // blocks[cur-1] is [ptr,end)
+    size_t cur;
+    char *ptr, *end;
+    // size for the next new block, doubles up to max_block
+    size_t next_size;
+    size_t max_block;
+    // bytes in blocks before blocks[cur-1]
+    size_t used_before;
+    void *_grow(size_t bytes, size_t align)
+    {
+        size_t need = bytes + align;
+        if (cur)
+            used_before += ptr - blocks[cur-1].data;
+        // reuse the next kept block that is big enough
+        while (cur < blocks.size() && blocks[cur].size < need)
+            used_before += blocks[cur++].size;
+        if (cur == blocks.size())
+        {
+            size_t size = next_size > need ? next_size : need;
+            blocks.push_back({(char*)::operator new(size),size});
+            if (next_size < max_block)
+                next_size *= 2;
+        }
+        ptr = blocks[cur].data;
+        end = ptr + blocks[cur].size;
+        ++cur;
+        return do_allocate(bytes,align);
+    }
+protected:
+    void *do_allocate(size_t bytes, size_t align) override
+    {
+        uintptr_t p = ((uintptr_t)ptr + align - 1) & ~(uintptr_t)(align - 1);
+        if (__builtin_expect(ptr && p + bytes <= (uintptr_t)end,1))
+        {
+            ptr = (char*)(p + bytes);
+            return (void*)p;
+        }
+        return _grow(bytes,align);
+    }
+    void do_deallocate(void*, size_t, size_t) override {}
+    bool do_is_equal(const std::pmr::memory_resource &o) const noexcept override
+    {
+        return this == &o;
+    }
+public:
+    // first block of block_size bytes (allocated on first use), later blocks
+    // double in size up to max_block (larger requests get their own block)
+    Arena(size_t block_size = 1 << 16, size_t max_block = 1 << 24):
+            cur(0), ptr(nullptr), end(nullptr),
+            next_size(block_size ? block_size : 1), max_block(max_block),
+            used_before(0) {}
+    Arena(const Arena&) = delete;
+    Arena &operator=(const Arena&) = delete;
+    ~Arena() { release(); }
+    // free everything allocated so far, keeping the blocks for reuse
+    void reset()
+    {
+        cur = 0;
+        ptr = end = nullptr;
+        used_before = 0;
+    }
+    // free everything and return the blocks to the heap
+    void release()
+    {
+        for (_block &b : blocks)
+            ::operator delete(b.data);
+        blocks.clear();
+        reset();
+    }
+    // bytes of blocks owned
+    size_t capacity() const
+    {
+        size_t ret = 0;
+        for (const _block &b : blocks)
+            ret += b.size;
+        return ret;
+    }
+    // bytes used since the last reset (including alignment and block tails)
+    size_t used() const
+    {
+        return cur ? used_before + (ptr - blocks[cur-1].data) : 0;
+    }
+};
+
+}
@@ -0,0 +1,75 @@
+/*
+Blocking bounded queue
+
+A fixed capacity FIFO for pipelines of thread groups: push() blocks while the
+queue is full (backpressure on the producers) and pop() blocks while it is
+empty. close() wakes everyone, later pushes fail and pops drain what is left
+before failing, so consumers stop once the producers are done.
+*/
+
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+namespace mclib
+{
+
+template <typename T>
+class BoundedQueue
+{
+private:
+    std::deque<T> items;
+    size_t cap;
+    bool closed;
+    std::mutex lock;
+    std::condition_variable not_full, not_empty;
+public:
+    BoundedQueue(size_t capacity): cap(capacity ? capacity : 1),
+            closed(false) {}
+    BoundedQueue(const BoundedQueue&) = delete;
+    BoundedQueue &operator=(const BoundedQueue&) = delete;
+    // false (and value is not moved) if the queue is closed
+    bool push(T &&value)
+    {
+        std::unique_lock<std::mutex> lk(lock);
+        not_full.wait(lk,[this]{ return closed || items.size() < cap; });
+        if (closed)
+            return false;
+        items.push_back(std::move(value));
+        lk.unlock();
+        not_empty.notify_one();
+        return true;
+    }
+    // false once the queue is closed and empty
+    bool pop(T &value)
+    {
+        std::unique_lock<std::mutex> lk(lock);
+        not_empty.wait(lk,[this]{ return closed || !items.empty(); });
+        if (items.empty())
+            return false;
+        value = std::move(items.front());
+        items.pop_front();
+        lk.unlock();
+        not_full.notify_one();
+        return true;
+    }
+    void close()
+    {
+        {
+            std::lock_guard<std::mutex> g(lock);
+            closed = true;
+        }
+        not_full.notify_all();
+        not_empty.notify_all();
+    }
+    size_t size()
+    {
+        std::lock_guard<std::mutex> g(lock);
+        return items.size();
+    }
+    size_t capacity() const { return cap; }
+};
+
+}
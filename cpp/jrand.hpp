@@ -7,11 +7,16 @@ floating point results use java.lang.StrictMath
 
 #pragma once
 
+#include <array>
 #include <cmath>
 #include <cstdint>
 #include <cstdlib>
 #include <ctime>
 
+#if defined(__AVX2__) || defined(__AVX512F__)
+#include <immintrin.h>
+#endif
+
 // macros for optimization
 #define likely(x)   __builtin_expect(!!(x),1)
 #define unlikely(x) __builtin_expect(!!(x),0)
@@ -33,6 +38,87 @@ const size_t _ss = 48;
 const int64_t _su_init = 8682522807148012L;
 const int64_t _su_mult = 181783497276652981L;
 
+// affine map x -> (mult*x + add) mod 2^48, k lcg steps compose into one map
+struct _lcg_affine
+{
+    uint64_t mult;
+    uint64_t add;
+    // map equivalent to applying this map, then o
+    constexpr _lcg_affine then(const _lcg_affine &o) const
+    {
+        return { (o.mult*mult) & ((1uLL << _ss) - 1),
+                 (o.mult*add + o.add) & ((1uLL << _ss) - 1) };
+    }
+    constexpr uint64_t apply(uint64_t x) const
+    {
+        return (mult*x + add) & ((1uLL << _ss) - 1);
+    }
+};
+
+// table[i] advances the lcg by 2^i steps, built at compile time
+constexpr std::array<_lcg_affine,_ss> _make_skip_table()
+{
+    std::array<_lcg_affine,_ss> table{};
+    table[0] = { (uint64_t)_mult, (uint64_t)_add };
+    for (size_t i = 1; i < _ss; ++i)
+        table[i] = table[i-1].then(table[i-1]);
+    return table;
+}
+
+constexpr std::array<_lcg_affine,_ss> _skip_table = _make_skip_table();
+
+// affine map for n lcg steps, n is taken mod 2^48 (the period)
+// so negative n steps backward
+constexpr _lcg_affine _lcg_steps(int64_t n)
+{
+    uint64_t k = (uint64_t)n & ((1uLL << _ss) - 1);
+    _lcg_affine ret = { 1, 0 };
+    for (size_t i = 0; k; ++i, k >>= 1)
+        if (k & 1)
+            ret = ret.then(_skip_table[i]);
+    return ret;
+}
+
+// one lcg step on a 48 bit state
+static inline uint64_t _lcg_step(uint64_t s)
+{
+    return (s*_mult + _add) & ((1uLL << _ss) - 1);
+}
+
+static_assert(_lcg_steps(1).mult == (uint64_t)_mult);
+static_assert(_lcg_steps(-1).then(_lcg_steps(1)).mult == 1);
+static_assert(_lcg_steps(-1).then(_lcg_steps(1)).add == 0);
+
+// nextInt(n) bound analysis done once for repeated sampling, the modulo is a
+// fixed point reciprocal multiply (Lemire, Kaser and Kurz 2019 fastmod)
+class IntBound
+{
+    friend class Random;
+private:
+    int32_t n;
+    bool pow2;
+    // largest bits - bits%n accepted, java rejects when bits - val + (n-1)
+    // overflows a 32 bit int
+    uint32_t limit;
+    // ceil(2^64/n)
+    uint64_t recip;
+    // bits % n for bits < 2^32
+    uint32_t _mod(uint32_t bits) const
+    {
+        return (uint32_t)(((__uint128_t)(recip*bits) * (uint32_t)n) >> 64);
+    }
+public:
+    IntBound(int32_t n): n(n)
+    {
+        if (unlikely(n <= 0))
+            throw "bound must be positive";
+        pow2 = (n & -n) == n;
+        limit = 0x80000000u - (uint32_t)n;
+        recip = UINT64_MAX / (uint32_t)n + 1;
+    }
+    int32_t bound() const { return n; }
+};
+
 class Random
 {
 private:
@@ -43,13 +129,14 @@ private:
     // uses higher bits to increase period length
     int32_t _next(size_t bits)
     {
-        state = (state*_mult + _add) & ((1LL << _ss) - 1);
+        // unsigned arithmetic, the 64 bit product overflows
+        state = ((uint64_t)state*_mult + _add) & ((1LL << _ss) - 1);
         return state >> (_ss - bits);
     }
     // seed uniquifier function
     static int64_t _su()
     {
-        static int64_t su = _su_init;
+        static uint64_t su = _su_init;
         return su *= _su_mult;
     }
 public:
@@ -68,23 +155,55 @@ public:
         state = (seed ^ _mult) & ((1LL << _ss) - 1);
         has_g = false;
     }
+    // internal 48 bit state (after the setSeed scramble)
+    int64_t getState() const { return state; }
+    // set internal 48 bit state directly (no scramble)
+    void setState(int64_t s)
+    {
+        state = s & ((1LL << _ss) - 1);
+        has_g = false;
+    }
+    // advance by n calls to _next() in O(log n), negative n goes backward
+    // methods use 1 step each except nextLong/nextDouble (2), nextInt(n)
+    // (1 or more when rejecting) and nextGaussian (variable)
+    void skip(int64_t n)
+    {
+        state = _lcg_steps(n).apply(state);
+        has_g = false;
+    }
+    // copy of this generator advanced by n steps
+    Random jump(int64_t n) const
+    {
+        Random ret(*this);
+        ret.skip(n);
+        return ret;
+    }
+    // copy positioned at the start of block i when the stream is carved into
+    // disjoint blocks of len steps, thread i of K uses substream(i,len) and
+    // must consume at most len steps to stay disjoint from thread i+1
+    Random substream(uint64_t i, uint64_t len) const
+    {
+        return jump((int64_t)(i*len));
+    }
     // write `len` random bytes to `arr`
     void nextBytes(int8_t *arr, size_t len)
     {
-        size_t mult4len = len & (-4uL);
-        int32_t *ptr = (int32_t*) arr;
-        int32_t *mult4end = (int32_t*) (arr + mult4len);
-        while (ptr < mult4end)
-            *(ptr++) = _next(32);
-        int8_t *ptre = (int8_t*) mult4end;
-        if (ptre < arr + len)
+        // java stores each int low byte first, the shifts compile to plain
+        // 4 byte stores on little endian hosts without unaligned int writes
+        size_t i = 0;
+        for (; i + 4 <= len; i += 4)
         {
-            int32_t last_bytes = _next(32);
-            while (ptre < arr + len)
-            {
-                *(ptre++) = (last_bytes & 0xFF);
-                last_bytes >>= 8;
-            }
+            uint32_t r = _next(32);
+            arr[i] = (int8_t)r;
+            arr[i+1] = (int8_t)(r >> 8);
+            arr[i+2] = (int8_t)(r >> 16);
+            arr[i+3] = (int8_t)(r >> 24);
+        }
+        if (i < len)
+        {
+            uint32_t r = _next(32);
+            for (; i < len; ++i, r >>= 8)
+                arr[i] = (int8_t)r;
         }
     }
     // next 32 bit integer
@@ -96,21 +215,123 @@ public:
             throw "bound must be positive";
         if ((n & -n) == n)
             return (int32_t)((n * (int64_t)_next(31)) >> 31);
-        int32_t bits, val;
+        // java rejects when bits - val + (n-1) overflows an int, signed
+        // overflow is undefined here so compare in unsigned arithmetic
+        uint32_t bits, val;
+        do
+        {
+            bits = _next(31);
+            val = bits % (uint32_t)n;
+        }
+        while (unlikely(bits - val > 0x80000000u - (uint32_t)n));
+        return val;
+    }
+    // random integer in [0,b.bound())
+    int32_t nextInt(const IntBound &b)
+    {
+        if (b.pow2)
+            return (int32_t)((b.n * (int64_t)_next(31)) >> 31);
+        uint32_t bits, val;
         do
         {
             bits = _next(31);
-            val = bits % n;
+            val = b._mod(bits);
         }
-        while (unlikely(bits - val + (n - 1) < 0));
+        while (unlikely(bits - val > b.limit));
         return val;
     }
+    // bulk versions of the methods below, output matches calling the single
+    // value method count times, the state is kept in a register meanwhile
+    void nextInts(int32_t *out, size_t count)
+    {
+        uint64_t s = state;
+        for (size_t i = 0; i < count; ++i)
+        {
+            s = _lcg_step(s);
+            out[i] = (int32_t)(s >> (_ss - 32));
+        }
+        state = s;
+    }
+    void nextInts(int32_t *out, size_t count, int32_t n)
+    {
+        nextInts(out,count,IntBound(n));
+    }
+    void nextInts(int32_t *out, size_t count, const IntBound &b)
+    {
+        uint64_t s = state;
+        if (b.pow2)
+            for (size_t i = 0; i < count; ++i)
+            {
+                s = _lcg_step(s);
+                out[i] = (int32_t)((b.n * (int64_t)(s >> (_ss - 31))) >> 31);
+            }
+        else
+            for (size_t i = 0; i < count; ++i)
+            {
+                uint32_t bits, val;
+                do
+                {
+                    s = _lcg_step(s);
+                    bits = (uint32_t)(s >> (_ss - 31));
+                    val = b._mod(bits);
+                }
+                while (unlikely(bits - val > b.limit));
+                out[i] = val;
+            }
+        state = s;
+    }
+    void nextLongs(int64_t *out, size_t count)
+    {
+        uint64_t s = state;
+        for (size_t i = 0; i < count; ++i)
+        {
+            s = _lcg_step(s);
+            uint64_t hi = (uint64_t)(int64_t)(int32_t)(s >> (_ss - 32));
+            s = _lcg_step(s);
+            uint64_t lo = (uint64_t)(int64_t)(int32_t)(s >> (_ss - 32));
+            out[i] = (int64_t)((hi << 32) + lo);
+        }
+        state = s;
+    }
+    void nextBools(bool *out, size_t count)
+    {
+        uint64_t s = state;
+        for (size_t i = 0; i < count; ++i)
+        {
+            s = _lcg_step(s);
+            out[i] = s >> (_ss - 1);
+        }
+        state = s;
+    }
+    void nextFloats(float *out, size_t count)
+    {
+        uint64_t s = state;
+        for (size_t i = 0; i < count; ++i)
+        {
+            s = _lcg_step(s);
+            out[i] = (int32_t)(s >> (_ss - 24)) / (float) 0x1000000;
+        }
+        state = s;
+    }
+    void nextDoubles(double *out, size_t count)
+    {
+        uint64_t s = state;
+        for (size_t i = 0; i < count; ++i)
+        {
+            s = _lcg_step(s);
+            uint64_t hi = s >> (_ss - 26);
+            s = _lcg_step(s);
+            uint64_t lo = s >> (_ss - 27);
+            out[i] = (int64_t)((hi << 27) + lo) / (double) 0x20000000000000L;
+        }
+        state = s;
+    }
     // next 64 bit integer
     int64_t nextLong()
     {
         int32_t hi = _next(32);
         int32_t lo = _next(32);
-        return ((int64_t)hi << 32) + lo;
+        return (int64_t)(((uint64_t)(int64_t)hi << 32) + lo);
     }
     // next boolean
     bool nextBool() { return _next(1); }
@@ -136,7 +357,10 @@ public:
         {
             v1 = 2.0*nextDouble() - 1.0;
             v2 = 2.0*nextDouble() - 1.0;
-            s = v1*v1 + v2*v2;
+            // round the squares separately like java, otherwise the compiler
+            // may fuse this into a multiply add (-march with FMA)
+            volatile double sq1 = v1*v1, sq2 = v2*v2;
+            s = sq1 + sq2;
         }
         while (s >= 1.0);
         // not using java.lang.StrictMath sqrt and log so results differ a bit
@@ -147,6 +371,181 @@ public:
     }
 };
 
+// N independent java.util.Random generators stepped together, lane i of every
+// output matches a Random with the same seed making the same calls
+// uses AVX-512 (N multiple of 8) or AVX2 when enabled at compile time
+template <size_t N>
+class RandomLanes
+{
+    static_assert(N == 4 || N == 8 || N == 16);
+private:
+    alignas(64) uint64_t state[N];
+    // advance every lane one step
+    void _step()
+    {
+#if defined(__AVX512F__) && defined(__AVX512DQ__)
+        if constexpr (N % 8 == 0)
+        {
+            const __m512i m = _mm512_set1_epi64(_mult);
+            const __m512i a = _mm512_set1_epi64(_add);
+            const __m512i k = _mm512_set1_epi64((1LL << _ss) - 1);
+            for (size_t i = 0; i < N; i += 8)
+            {
+                __m512i s = _mm512_load_si512((const void*)(state+i));
+                s = _mm512_add_epi64(_mm512_mullo_epi64(s,m),a);
+                _mm512_store_si512((void*)(state+i),_mm512_and_si512(s,k));
+            }
+            return;
+        }
+#endif
+#if defined(__AVX2__)
+        // no 64 bit multiply, build it from 32x32->64 products
+        // (sh*2^32 + sl)*(mh*2^32 + ml) = sl*ml + ((sh*ml + sl*mh) << 32)
+        const __m256i ml = _mm256_set1_epi64x(_mult & 0xFFFFFFFFLL);
+        const __m256i mh = _mm256_set1_epi64x(_mult >> 32);
+        const __m256i a = _mm256_set1_epi64x(_add);
+        const __m256i k = _mm256_set1_epi64x((1LL << _ss) - 1);
+        for (size_t i = 0; i < N; i += 4)
+        {
+            __m256i s = _mm256_load_si256((const __m256i*)(state+i));
+            __m256i lo = _mm256_mul_epu32(s,ml);
+            __m256i hi = _mm256_add_epi64(
+                    _mm256_mul_epu32(_mm256_srli_epi64(s,32),ml),
+                    _mm256_mul_epu32(s,mh));
+            s = _mm256_add_epi64(lo,_mm256_slli_epi64(hi,32));
+            s = _mm256_and_si256(_mm256_add_epi64(s,a),k);
+            _mm256_store_si256((__m256i*)(state+i),s);
+        }
+#else
+        for (size_t i = 0; i < N; ++i)
+            state[i] = (state[i]*_mult + _add) & ((1uLL << _ss) - 1);
+#endif
+    }
+    // advance the lanes with their bit set in mask
+    void _step(uint32_t mask)
+    {
+        for (size_t i = 0; i < N; ++i)
+        {
+            uint64_t s = (state[i]*_mult + _add) & ((1uLL << _ss) - 1);
+            state[i] = ((mask >> i) & 1) ? s : state[i];
+        }
+    }
+    // next bits (up to 32) for every lane
+    void _next(int32_t *out, size_t bits)
+    {
+        _step();
+        for (size_t i = 0; i < N; ++i)
+            out[i] = (int32_t)(state[i] >> (_ss - bits));
+    }
+public:
+    static const size_t lanes = N;
+    // initialize lane i with seeds[i]
+    RandomLanes(const int64_t *seeds) { setSeed(seeds); }
+    // set lane i as if constructed with seeds[i]
+    void setSeed(const int64_t *seeds)
+    {
+        for (size_t i = 0; i < N; ++i)
+            state[i] = (seeds[i] ^ _mult) & ((1uLL << _ss) - 1);
+    }
+    // set one lane as if constructed with seed
+    void setSeed(size_t lane, int64_t seed)
+    {
+        state[lane] = (seed ^ _mult) & ((1uLL << _ss) - 1);
+    }
+    int64_t getState(size_t lane) const { return state[lane]; }
+    void setState(size_t lane, int64_t s)
+    {
+        state[lane] = s & ((1LL << _ss) - 1);
+    }
+    // advance every lane by n steps (see Random::skip)
+    void skip(int64_t n)
+    {
+        _lcg_affine f = _lcg_steps(n);
+        for (size_t i = 0; i < N; ++i)
+            state[i] = f.apply(state[i]);
+    }
+    // next 32 bit integer for every lane
+    void nextInt(int32_t *out) { _next(out,32); }
+    // random integer in [0,n) for every lane
+    void nextInt(int32_t *out, int32_t n)
+    {
+        if (unlikely(n <= 0))
+            throw "bound must be positive";
+        _next(out,31);
+        if ((n & -n) == n)
+        {
+            for (size_t i = 0; i < N; ++i)
+                out[i] = (int32_t)((n * (int64_t)out[i]) >> 31);
+            return;
+        }
+        // quotient through double is exact for 31 bit operands
+        // unlike integer division this vectorizes
+        uint32_t redo = 0;
+        const double dn = n;
+        for (size_t i = 0; i < N; ++i)
+        {
+            int32_t bits = out[i];
+            int32_t val = bits - n*(int32_t)(bits/dn);
+            // java int overflow in bits - val + (n-1) marks an incomplete range
+            redo |= (uint32_t)((uint32_t)(bits - val) + (uint32_t)(n - 1)
+                    >= 0x80000000u) << i;
+            out[i] = val;
+        }
+        while (unlikely(redo))
+        {
+            _step(redo);
+            uint32_t again = 0;
+            for (size_t i = 0; i < N; ++i)
+            {
+                if (!((redo >> i) & 1))
+                    continue;
+                int32_t bits = (int32_t)(state[i] >> (_ss - 31));
+                int32_t val = bits % n;
+                again |= (uint32_t)((uint32_t)(bits - val) + (uint32_t)(n - 1)
+                        >= 0x80000000u) << i;
+                out[i] = val;
+            }
+            redo = again;
+        }
+    }
+    // next 64 bit integer for every lane
+    void nextLong(int64_t *out)
+    {
+        alignas(64) int32_t hi[N], lo[N];
+        _next(hi,32);
+        _next(lo,32);
+        for (size_t i = 0; i < N; ++i)
+            out[i] = (int64_t)(((uint64_t)(int64_t)hi[i] << 32)
+                    + (uint64_t)(int64_t)lo[i]);
+    }
+    // next boolean for every lane
+    void nextBool(bool *out)
+    {
+        alignas(64) int32_t b[N];
+        _next(b,1);
+        for (size_t i = 0; i < N; ++i)
+            out[i] = b[i];
+    }
+    // next single precision float in [0,1) for every lane
+    void nextFloat(float *out)
+    {
+        alignas(64) int32_t b[N];
+        _next(b,24);
+        for (size_t i = 0; i < N; ++i)
+            out[i] = b[i] / (float) 0x1000000;
+    }
+    // next double precision float in [0,1) for every lane
+    void nextDouble(double *out)
+    {
+        alignas(64) int32_t hi[N], lo[N];
+        _next(hi,26);
+        _next(lo,27);
+        for (size_t i = 0; i < N; ++i)
+            out[i] = (((int64_t)hi[i] << 27) + lo[i])
+                    / (double) 0x20000000000000L;
+    }
+};
+
 }
 
 #undef likely
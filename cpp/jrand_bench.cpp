@@ -0,0 +1,316 @@
+/*
+Benchmark for mclib::Random with differential checking against Java
+
+jrand_bench [dump_dir] [min_secs]
+
+Times every Random method (single calls and bulk fills) and prints one line of
+key=value pairs per case with ns/call and calls/s. When dump_dir contains the
+files written by test/test_java.sh (out_nextInt_java.bin etc.), each case also
+regenerates the same sequence and compares it with the big endian dump:
+check=ok, check=mismatch (with the first differing call), check=missing when
+the file is absent, or check=none for cases without a dump. nextGaussian is
+compared with a small absolute tolerance since it does not use StrictMath.
+
+The first line describes the build (compiler and enabled instruction sets) so
+results from different compilers and -march levels can be told apart.
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "jrand.hpp"
+#include "utils.hpp"
+
+static std::string dump_dir;
+static double min_secs = 0.2;
+static bool failed = false;
+
+// sink so generated values are not optimized away
+static volatile uint64_t sink;
+
+static bool _read_file(const std::string &path, std::vector<char> &data)
+{
+    FILE *f = fopen(path.c_str(),"rb");
+    if (!f)
+        return false;
+    char buf[1 << 16];
+    size_t n;
+    while ((n = fread(buf,1,sizeof(buf),f)) > 0)
+        data.insert(data.end(),buf,buf+n);
+    fclose(f);
+    return true;
+}
+
+static bool _equal(int8_t a, const char *p)
+{
+    return a == mclib::_from_bytes_byte(p);
+}
+static bool _equal(bool a, const char *p)
+{
+    return a == (*p != 0);
+}
+static bool _equal(int32_t a, const char *p)
+{
+    return a == mclib::_from_bytes_int(p);
+}
+static bool _equal(int64_t a, const char *p)
+{
+    return a == mclib::_from_bytes_long(p);
+}
+static bool _equal(float a, const char *p)
+{
+    return a == mclib::_from_bytes_float(p);
+}
+static bool _equal(double a, const char *p)
+{
+    return a == mclib::_from_bytes_double(p);
+}
+
+static uint64_t _bits(int8_t v) { return (uint8_t)v; }
+static uint64_t _bits(bool v) { return v; }
+static uint64_t _bits(int32_t v) { return (uint32_t)v; }
+static uint64_t _bits(int64_t v) { return v; }
+static uint64_t _bits(float v) { return (uint64_t)(v*(1 << 24)); }
+static uint64_t _bits(double v) { return (uint64_t)(int64_t)(v*(1 << 30)); }
+
+// gen(r,out,n) makes n calls writing per*n values to out
+// dump is the file name from test_java.sh (nullptr if none), tol is the
+// absolute tolerance for floating point comparison
+template <typename T, typename F>
+static void bench(const char *name, const char *dump, int64_t seed,
+        size_t calls, size_t per, double tol, F gen)
+{
+    // timing, in batches small enough to stay in cache
+    const size_t batch = 4096;
+    // not std::vector since the bool outputs need a bool array
+    std::unique_ptr<T[]> buf(new T[batch*per]);
+    mclib::Random r(seed);
+    size_t total = 0;
+    uint64_t acc = 0;
+    size_t t0 = mclib::_nanotime();
+    double secs;
+    do
+    {
+        for (size_t i = 0; i < 64; ++i)
+        {
+            gen(r,buf.get(),batch);
+            acc += _bits(buf[i % (batch*per)]);
+        }
+        total += 64*batch;
+        secs = (mclib::_nanotime() - t0) / 1e9;
+    }
+    while (secs < min_secs);
+    sink = acc;
+    // differential check
+    std::string check = "none";
+    size_t bad_call = 0;
+    if (dump)
+    {
+        std::vector<char> data;
+        check = "missing";
+        if (!dump_dir.empty() && _read_file(dump_dir + "/" + dump,data))
+        {
+            size_t esize = std::is_same<T,bool>::value ? 1 : sizeof(T);
+            size_t count = calls*per;
+            std::unique_ptr<T[]> vals(new T[count]);
+            mclib::Random c(seed);
+            gen(c,vals.get(),calls);
+            check = "ok";
+            if (data.size() != count*esize)
+            {
+                check = "mismatch";
+                bad_call = std::min(data.size()/esize,count) / per;
+            }
+            for (size_t i = 0; i < count && check == "ok"; ++i)
+            {
+                const char *p = data.data() + i*esize;
+                bool eq;
+                if constexpr (std::is_floating_point<T>::value)
+                {
+                    double ref = sizeof(T) == 8 ? mclib::_from_bytes_double(p)
+                            : mclib::_from_bytes_float(p);
+                    eq = tol == 0 ? _equal(vals[i],p)
+                            : fabs(vals[i] - ref) <= tol;
+                }
+                else
+                    eq = _equal(vals[i],p);
+                if (!eq)
+                {
+                    check = "mismatch";
+                    bad_call = i / per;
+                }
+            }
+        }
+    }
+    if (check == "mismatch")
+        failed = true;
+    printf("case=%s calls=%zu secs=%.4f ns_per_call=%.3f calls_per_s=%.4e "
+            "check=%s",name,total,secs,secs*1e9/total,total/secs,check.c_str());
+    if (check == "mismatch")
+        printf(" first_bad_call=%zu",bad_call);
+    printf("\n");
+    fflush(stdout);
+}
+
+int main(int argc, char **argv)
+{
+    if (argc > 1)
+        dump_dir = argv[1];
+    if (argc > 2)
+        min_secs = std::stod(argv[2]);
+#if defined(__clang__)
+    const char *compiler = "clang";
+#elif defined(__GNUC__)
+    const char *compiler = "gcc";
+#else
+    const char *compiler = "unknown";
+#endif
+    printf("build compiler=%s version=\"%s\" avx2=%d avx512dq=%d\n",compiler,
+            __VERSION__,
+#if defined(__AVX2__)
+            1,
+#else
+            0,
+#endif
+#if defined(__AVX512DQ__)
+            1
+#else
+            0
+#endif
+            );
+    typedef mclib::Random R;
+    const size_t M = 1048576;
+    // single calls
+    bench<int32_t>("nextInt","out_nextInt_java.bin",
+            -3865984986348818578LL,M,1,0,
+            [](R &r, int32_t *o, size_t n)
+            {
+                for (size_t i = 0; i < n; ++i)
+                    o[i] = r.nextInt();
+            });
+    bench<int32_t>("nextInt_16",nullptr,
+            8645836755261LL,M,1,0,
+            [](R &r, int32_t *o, size_t n)
+            {
+                for (size_t i = 0; i < n; ++i)
+                    o[i] = r.nextInt(16);
+            });
+    bench<int32_t>("nextInt_10","out_nextInt_1_java.bin",
+            8645836755261LL,M,1,0,
+            [](R &r, int32_t *o, size_t n)
+            {
+                for (size_t i = 0; i < n; ++i)
+                    o[i] = r.nextInt(10);
+            });
+    bench<int32_t>("nextInt_1073741825","out_nextInt_2_java.bin",
+            -73865865LL,M,1,0,
+            [](R &r, int32_t *o, size_t n)
+            {
+                for (size_t i = 0; i < n; ++i)
+                    o[i] = r.nextInt(1073741825);
+            });
+    bench<int64_t>("nextLong","out_nextLong_java.bin",
+            7348635979463856121LL,M,1,0,
+            [](R &r, int64_t *o, size_t n)
+            {
+                for (size_t i = 0; i < n; ++i)
+                    o[i] = r.nextLong();
+            });
+    bench<bool>("nextBool","out_nextBoolean_java.bin",
+            -735785672572LL,M,1,0,
+            [](R &r, bool *o, size_t n)
+            {
+                for (size_t i = 0; i < n; ++i)
+                    o[i] = r.nextBool();
+            });
+    bench<float>("nextFloat","out_nextFloat_java.bin",
+            6248685LL,M,1,0,
+            [](R &r, float *o, size_t n)
+            {
+                for (size_t i = 0; i < n; ++i)
+                    o[i] = r.nextFloat();
+            });
+    bench<double>("nextDouble","out_nextDouble_java.bin",
+            -7158636LL,M,1,0,
+            [](R &r, double *o, size_t n)
+            {
+                for (size_t i = 0; i < n; ++i)
+                    o[i] = r.nextDouble();
+            });
+    bench<double>("nextGaussian","out_nextGaussian_java.bin",
+            186586357641LL,M,1,1e-14,
+            [](R &r, double *o, size_t n)
+            {
+                for (size_t i = 0; i < n; ++i)
+                    o[i] = r.nextGaussian();
+            });
+    bench<int8_t>("nextBytes_257","out_nextBytes_1_java.bin",
+            95876265768466LL,10000,257,0,
+            [](R &r, int8_t *o, size_t n)
+            {
+                for (size_t i = 0; i < n; ++i)
+                    r.nextBytes(o+257*i,257);
+            });
+    bench<int8_t>("nextBytes_128","out_nextBytes_2_java.bin",
+            65882587452163LL,20000,128,0,
+            [](R &r, int8_t *o, size_t n)
+            {
+                for (size_t i = 0; i < n; ++i)
+                    r.nextBytes(o+128*i,128);
+            });
+    // bulk fills
+    bench<int32_t>("nextInts","out_nextInt_java.bin",
+            -3865984986348818578LL,M,1,0,
+            [](R &r, int32_t *o, size_t n)
+            {
+                r.nextInts(o,n);
+            });
+    bench<int32_t>("nextInts_16",nullptr,
+            8645836755261LL,M,1,0,
+            [](R &r, int32_t *o, size_t n)
+            {
+                r.nextInts(o,n,16);
+            });
+    bench<int32_t>("nextInts_10","out_nextInt_1_java.bin",
+            8645836755261LL,M,1,0,
+            [](R &r, int32_t *o, size_t n)
+            {
+                r.nextInts(o,n,10);
+            });
+    bench<int32_t>("nextInts_1073741825","out_nextInt_2_java.bin",
+            -73865865LL,M,1,0,
+            [](R &r, int32_t *o, size_t n)
+            {
+                r.nextInts(o,n,1073741825);
+            });
+    bench<int64_t>("nextLongs","out_nextLong_java.bin",
+            7348635979463856121LL,M,1,0,
+            [](R &r, int64_t *o, size_t n)
+            {
+                r.nextLongs(o,n);
+            });
+    bench<bool>("nextBools","out_nextBoolean_java.bin",
+            -735785672572LL,M,1,0,
+            [](R &r, bool *o, size_t n)
+            {
+                r.nextBools(o,n);
+            });
+    bench<float>("nextFloats","out_nextFloat_java.bin",
+            6248685LL,M,1,0,
+            [](R &r, float *o, size_t n)
+            {
+                r.nextFloats(o,n);
+            });
+    bench<double>("nextDoubles","out_nextDouble_java.bin",
+            -7158636LL,M,1,0,
+            [](R &r, double *o, size_t n)
+            {
+                r.nextDoubles(o,n);
+            });
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,341 @@
+/*
+Recovering the internal state of java.util.Random from its outputs
+
+- prevState/nextState step the 48 bit lcg backward and forward
+- seedFromState gives the (lower 48 bits of the) seed passed to setSeed
+- statesFromLong/statesFromInts invert nextLong() and 2 nextInt() outputs by
+  trying the 2^16 unseen low bits
+- RandomSolver takes a sequence of observed outputs and finds every state
+  consistent with them. Outputs that fix the top bits of a state (nextInt(),
+  nextInt(2^k), nextLong, nextFloat, nextDouble, nextBool) are each an interval
+  for (A*s + C) mod 2^48 where s is the unknown state, so the states are the
+  points of a lattice inside a box. The lattice basis is LLL reduced and the
+  box is enumerated with Fincke-Pohst, usually visiting a handful of points
+  instead of 2^48. nextInt(n) for other n only constrains the state modulo n
+  and is used to filter the candidates. The interval outputs need to carry
+  at least 24 of the 48 bits (for example one nextInt(), two nextFloat() or
+  six nextInt(16)), the filters and the enumeration cover the rest.
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "jrand.hpp"
+
+namespace mclib
+{
+
+// _mult * _mult_inv = 1 mod 2^48
+const int64_t _mult_inv = 0xdfe05bcb1365LL;
+
+static_assert((((uint64_t)_mult*_mult_inv) & ((1uLL << _ss) - 1)) == 1);
+
+// state before one lcg step
+static inline int64_t prevState(int64_t s)
+{
+    return (int64_t)((((uint64_t)s - _add)*_mult_inv) & ((1uLL << _ss) - 1));
+}
+
+// state after one lcg step
+static inline int64_t nextState(int64_t s)
+{
+    return (int64_t)_lcg_step((uint64_t)s);
+}
+
+// seed for Random(seed)/setSeed(seed) that starts at this state, only the
+// lower 48 bits of a seed matter so this is one of 2^16 equivalent seeds
+static inline int64_t seedFromState(int64_t s)
+{
+    return (s ^ _mult) & ((1LL << _ss) - 1);
+}
+
+// states s such that Random.setState(s) then nextInt(), nextInt() gives a, b
+static inline std::vector<int64_t> statesFromInts(int32_t a, int32_t b)
+{
+    std::vector<int64_t> ret;
+    uint64_t hi = (uint64_t)(uint32_t)a << 16;
+    for (uint64_t low = 0; low < 0x10000; ++low)
+    {
+        uint64_t s1 = hi | low;
+        if ((int32_t)(_lcg_step(s1) >> 16) == b)
+            ret.push_back(prevState((int64_t)s1));
+    }
+    return ret;
+}
+
+// states s such that Random.setState(s) then nextLong() gives v
+static inline std::vector<int64_t> statesFromLong(int64_t v)
+{
+    // v = (hi << 32) + lo with lo sign extended
+    int32_t lo = (int32_t)v;
+    int32_t hi = (int32_t)(((uint64_t)v - (uint64_t)(int64_t)lo) >> 32);
+    return statesFromInts(hi,lo);
+}
+
+typedef __int128 _i128;
+
+// lll reduce the rows of b in place (exact integer basis, floating point
+// gram-schmidt), delta = 0.99
+static inline void _lll(std::vector<std::vector<_i128>> &b)
+{
+    typedef long double ld;
+    const size_t d = b.size(), n = b[0].size();
+    std::vector<std::vector<ld>> bs(d,std::vector<ld>(n));
+    std::vector<std::vector<ld>> mu(d,std::vector<ld>(d));
+    std::vector<ld> len2(d);
+    auto gram_schmidt = [&]()
+    {
+        for (size_t i = 0; i < d; ++i)
+        {
+            for (size_t c = 0; c < n; ++c)
+                bs[i][c] = (ld)b[i][c];
+            for (size_t j = 0; j < i; ++j)
+            {
+                ld dot = 0;
+                for (size_t c = 0; c < n; ++c)
+                    dot += (ld)b[i][c]*bs[j][c];
+                mu[i][j] = dot / len2[j];
+                for (size_t c = 0; c < n; ++c)
+                    bs[i][c] -= mu[i][j]*bs[j][c];
+            }
+            len2[i] = 0;
+            for (size_t c = 0; c < n; ++c)
+                len2[i] += bs[i][c]*bs[i][c];
+        }
+    };
+    gram_schmidt();
+    size_t k = 1;
+    for (size_t iter = 0; k < d && iter < 100000; ++iter)
+    {
+        for (size_t j = k; j-- > 0;)
+        {
+            ld q = roundl(mu[k][j]);
+            if (q == 0)
+                continue;
+            _i128 qi = (_i128)q;
+            for (size_t c = 0; c < n; ++c)
+                b[k][c] -= qi*b[j][c];
+            mu[k][j] -= q;
+            for (size_t l = 0; l < j; ++l)
+                mu[k][l] -= q*mu[j][l];
+        }
+        if (len2[k] >= (0.99L - mu[k][k-1]*mu[k][k-1])*len2[k-1])
+            ++k;
+        else
+        {
+            std::swap(b[k],b[k-1]);
+            gram_schmidt();
+            k = k > 1 ? k-1 : 1;
+        }
+    }
+}
+
+class RandomSolver
+{
+private:
+    // state after `step` lcg steps must satisfy the observation
+    struct _obs
+    {
+        int64_t step;
+        // interval for the state (inclusive), or the bound for a filter
+        uint64_t lo, hi;
+        // filter only: (state >> 17) % n == v
+        int32_t n, v;
+    };
+    std::vector<_obs> obs;
+    int64_t steps;
+    void _interval(uint64_t lo, uint64_t hi)
+    {
+        obs.push_back({++steps,lo,hi,0,0});
+    }
+    void _top(uint64_t value, size_t bits)
+    {
+        uint64_t lo = value << (_ss - bits);
+        _interval(lo,lo | ((1uLL << (_ss - bits)) - 1));
+    }
+    bool _check(int64_t s) const
+    {
+        for (const _obs &o : obs)
+        {
+            uint64_t t = _lcg_steps(o.step).apply((uint64_t)s);
+            if (o.n)
+            {
+                if ((int32_t)((t >> 17) % (uint32_t)o.n) != o.v)
+                    return false;
+            }
+            else if (t < o.lo || t > o.hi)
+                return false;
+        }
+        return true;
+    }
+public:
+    RandomSolver(): steps(0) {}
+    // record outputs in the order they were produced
+    void nextInt(int32_t v) { _top((uint32_t)v,32); }
+    // assumes the call did not reject (probability below n/2^31)
+    void nextInt(int32_t n, int32_t v)
+    {
+        if (n <= 0 || v < 0 || v >= n)
+            throw "random solver bounded int out of range";
+        if ((n & -n) == n)
+        {
+            uint64_t w = 0x80000000uLL / n;
+            _interval((v*w) << 17,(((v+1)*w - 1) << 17) | 0x1FFFF);
+        }
+        else
+            obs.push_back({++steps,0,0,n,v});
+    }
+    void nextLong(int64_t v)
+    {
+        int32_t lo = (int32_t)v;
+        nextInt((int32_t)(((uint64_t)v - (uint64_t)(int64_t)lo) >> 32));
+        nextInt(lo);
+    }
+    void nextBool(bool v) { _top(v,1); }
+    void nextFloat(float v) { _top((uint64_t)(v * (float)0x1000000),24); }
+    void nextDouble(double v)
+    {
+        uint64_t x = (uint64_t)(v * (double)0x20000000000000L);
+        _top(x >> 27,26);
+        _top(x & ((1uLL << 27) - 1),27);
+    }
+    // outputs that were not observed, in lcg steps
+    void skip(int64_t n) { steps += n; }
+    // internal states (before the first recorded output, use seedFromState
+    // for the seed) consistent with every observation, stops after limit
+    std::vector<int64_t> solve(size_t limit = 1 << 16) const
+    {
+        const uint64_t M = 1uLL << _ss;
+        std::vector<const _obs*> cons;
+        for (const _obs &o : obs)
+            if (!o.n && o.hi - o.lo + 1 < M)
+                cons.push_back(&o);
+        if (cons.empty())
+            throw "random solver needs an output that fixes top bits";
+        // most informative first, the first is the reference coordinate,
+        // keep scale factors (max width / width) and the dimension bounded
+        std::sort(cons.begin(),cons.end(),[](const _obs *a, const _obs *b)
+                { return a->hi - a->lo < b->hi - b->lo; });
+        uint64_t wmin = cons[0]->hi - cons[0]->lo + 1;
+        size_t d = 0;
+        double info = 0;
+        while (d < cons.size() && d < 20
+                && (cons[d]->hi - cons[d]->lo + 1) / wmin <= (1uLL << 24))
+        {
+            info += _ss - log2((double)(cons[d]->hi - cons[d]->lo + 1));
+            ++d;
+        }
+        cons.resize(d);
+        // the box holds about 2^(48-info) lattice points which are then
+        // filtered one by one, and the sphere enumerated around the box gets
+        // much bigger than the box in high dimension
+        if (info + 24 < _ss)
+            throw "random solver needs more outputs that fix top bits";
+        uint64_t wmax = cons[d-1]->hi - cons[d-1]->lo + 1;
+        // coordinate j is state_j = (A_j*t + C_j) mod M where t is the state
+        // of the reference, lattice rows: (s_0, A_1*s_1, ...), M*s_j*e_j
+        const _obs &ref = *cons[0];
+        std::vector<int64_t> scale(d), blo(d), bhi(d);
+        std::vector<std::vector<_i128>> basis(d,std::vector<_i128>(d,0));
+        for (size_t j = 0; j < d; ++j)
+        {
+            _lcg_affine f = _lcg_steps(cons[j]->step - ref.step);
+            scale[j] = wmax / (cons[j]->hi - cons[j]->lo + 1);
+            blo[j] = (int64_t)cons[j]->lo - (int64_t)f.add;
+            bhi[j] = (int64_t)cons[j]->hi - (int64_t)f.add;
+            basis[0][j] = (_i128)f.mult*scale[j];
+            if (j)
+                basis[j][j] = (_i128)M*scale[j];
+        }
+        _lll(basis);
+        // gram-schmidt of the reduced basis for the enumeration
+        typedef long double ld;
+        std::vector<std::vector<ld>> bs(d,std::vector<ld>(d));
+        std::vector<std::vector<ld>> mu(d,std::vector<ld>(d,0));
+        std::vector<ld> len2(d);
+        for (size_t i = 0; i < d; ++i)
+        {
+            for (size_t c = 0; c < d; ++c)
+                bs[i][c] = (ld)basis[i][c];
+            for (size_t j = 0; j < i; ++j)
+            {
+                ld dot = 0;
+                for (size_t c = 0; c < d; ++c)
+                    dot += (ld)basis[i][c]*bs[j][c];
+                mu[i][j] = dot / len2[j];
+                for (size_t c = 0; c < d; ++c)
+                    bs[i][c] -= mu[i][j]*bs[j][c];
+            }
+            len2[i] = 0;
+            for (size_t c = 0; c < d; ++c)
+                len2[i] += bs[i][c]*bs[i][c];
+        }
+        // box center in basis coordinates, sphere around the box
+        std::vector<ld> y(d);
+        for (size_t j = d; j-- > 0;)
+        {
+            ld tau = 0;
+            for (size_t c = 0; c < d; ++c)
+                tau += (ld)scale[c]*((ld)blo[c] + (ld)bhi[c])/2 * bs[j][c];
+            tau /= len2[j];
+            for (size_t i = j+1; i < d; ++i)
+                tau -= mu[i][j]*y[i];
+            y[j] = tau;
+        }
+        ld r2 = (ld)d * ((ld)wmax/2) * ((ld)wmax/2) * 1.0001L + 1;
+        std::vector<int64_t> ret;
+        std::vector<int64_t> coef(d);
+        std::vector<_i128> v(d);
+        // depth first over coefficients from the last basis vector down
+        auto visit = [&](auto &self, size_t j, ld dist) -> void
+        {
+            if (ret.size() >= limit)
+                return;
+            ld center = y[j];
+            for (size_t i = j+1; i < d; ++i)
+                center -= mu[i][j]*((ld)coef[i] - y[i]);
+            ld rad = sqrtl(std::max((ld)0,(r2 - dist) / len2[j]));
+            int64_t cmin = (int64_t)ceill(center - rad);
+            int64_t cmax = (int64_t)floorl(center + rad);
+            for (int64_t c = cmin; c <= cmax; ++c)
+            {
+                coef[j] = c;
+                ld diff = (ld)c - center;
+                ld nd = dist + diff*diff*len2[j];
+                if (nd > r2)
+                    continue;
+                if (j)
+                {
+                    self(self,j-1,nd);
+                    continue;
+                }
+                // exact check of the lattice point against the box
+                bool in = true;
+                for (size_t k = 0; k < d && in; ++k)
+                {
+                    _i128 x = 0;
+                    for (size_t i = 0; i < d; ++i)
+                        x += (_i128)coef[i]*basis[i][k];
+                    v[k] = x / scale[k];
+                    in = x % scale[k] == 0 && v[k] >= blo[k] && v[k] <= bhi[k];
+                }
+                if (!in)
+                    continue;
+                int64_t s0 = (int64_t)_lcg_steps(-ref.step).apply(
+                        (uint64_t)v[0]);
+                if (_check(s0) && ret.size() < limit)
+                    ret.push_back(s0);
+            }
+        };
+        visit(visit,d-1,0);
+        std::sort(ret.begin(),ret.end());
+        ret.erase(std::unique(ret.begin(),ret.end()),ret.end());
+        return ret;
+    }
+};
+
+}
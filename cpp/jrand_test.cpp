@@ -0,0 +1,178 @@
+#include <algorithm>
+#include <cassert>
+#include <iostream>
+
+#include "jrand.hpp"
+#include "jrand_recover.hpp"
+
+// values from java.util.Random
+static void test_known_values()
+{
+    mclib::Random r0(0);
+    assert(r0.nextInt() == -1155484576);
+    assert(r0.nextInt(10) == 8);
+    assert(r0.nextLong() == 4437113781045784766LL);
+    mclib::Random r42(42);
+    assert(r42.nextInt() == -1170105035);
+    // rejection for a bound just over 2^30
+    mclib::Random rb(-73865865);
+    const int32_t big[] = {62519644, 628968971, 1004143319, 922177648};
+    for (int32_t v : big)
+        assert(rb.nextInt(1073741825) == v);
+}
+
+static void test_skip()
+{
+    const int64_t counts[] = {0, 1, 2, 3, 7, 64, 1000, 123457};
+    for (int64_t n : counts)
+    {
+        mclib::Random a(8645836755261LL), b(8645836755261LL);
+        for (int64_t i = 0; i < n; ++i)
+            a.nextInt();
+        b.skip(n);
+        assert(a.getState() == b.getState());
+        assert(a.nextInt() == b.nextInt());
+        // stepping back returns to the starting state
+        b.skip(-n-1);
+        assert(b.getState() == mclib::Random(8645836755261LL).getState());
+    }
+    // full period is the identity
+    mclib::Random c(-73865865);
+    int64_t s = c.getState();
+    c.skip(1LL << 48);
+    assert(c.getState() == s);
+}
+
+static void test_substream()
+{
+    // blocks of a partitioned stream concatenate to the original sequence
+    const uint64_t threads = 5, len = 1000;
+    mclib::Random whole(7348635979463856121LL);
+    mclib::Random base(7348635979463856121LL);
+    for (uint64_t t = 0; t < threads; ++t)
+    {
+        mclib::Random part = base.substream(t,len);
+        for (uint64_t i = 0; i < len; ++i)
+            assert(part.nextInt() == whole.nextInt());
+    }
+    assert(base.jump(threads*len).getState() == whole.getState());
+}
+
+// every lane matches a scalar Random seeded the same way
+template <size_t N>
+static void test_lanes()
+{
+    int64_t seeds[N];
+    mclib::Random scalar[N];
+    for (size_t i = 0; i < N; ++i)
+    {
+        seeds[i] = -3865984986348818578LL + (int64_t)i*7919;
+        scalar[i].setSeed(seeds[i]);
+    }
+    mclib::RandomLanes<N> lanes(seeds);
+    const int32_t bounds[] = {1, 10, 16, 1000, 1073741825, 0x7FFFFFFF};
+    int32_t ints[N];
+    int64_t longs[N];
+    float floats[N];
+    double doubles[N];
+    for (size_t round = 0; round < 2000; ++round)
+    {
+        lanes.nextInt(ints);
+        for (size_t i = 0; i < N; ++i)
+            assert(ints[i] == scalar[i].nextInt());
+        for (int32_t n : bounds)
+        {
+            lanes.nextInt(ints,n);
+            for (size_t i = 0; i < N; ++i)
+                assert(ints[i] == scalar[i].nextInt(n));
+        }
+        lanes.nextLong(longs);
+        for (size_t i = 0; i < N; ++i)
+            assert(longs[i] == scalar[i].nextLong());
+        lanes.nextFloat(floats);
+        for (size_t i = 0; i < N; ++i)
+            assert(floats[i] == scalar[i].nextFloat());
+        lanes.nextDouble(doubles);
+        for (size_t i = 0; i < N; ++i)
+            assert(doubles[i] == scalar[i].nextDouble());
+    }
+}
+
+// bulk fills match repeated single calls
+static void test_bulk()
+{
+    const size_t len = 4096;
+    const int32_t bounds[] = {1, 10, 64, 1000, 1073741825, 0x7FFFFFFF};
+    mclib::Random a(-7158636), b(-7158636);
+    int32_t ints[len];
+    int64_t longs[len];
+    bool bools[len];
+    float floats[len];
+    double doubles[len];
+    a.nextInts(ints,len);
+    for (size_t i = 0; i < len; ++i)
+        assert(ints[i] == b.nextInt());
+    for (int32_t n : bounds)
+    {
+        a.nextInts(ints,len,n);
+        for (size_t i = 0; i < len; ++i)
+            assert(ints[i] == b.nextInt(n));
+        mclib::IntBound bound(n);
+        for (size_t i = 0; i < len; ++i)
+            assert(a.nextInt(bound) == b.nextInt(n));
+    }
+    a.nextLongs(longs,len);
+    for (size_t i = 0; i < len; ++i)
+        assert(longs[i] == b.nextLong());
+    a.nextBools(bools,len);
+    for (size_t i = 0; i < len; ++i)
+        assert(bools[i] == b.nextBool());
+    a.nextFloats(floats,len);
+    for (size_t i = 0; i < len; ++i)
+        assert(floats[i] == b.nextFloat());
+    a.nextDoubles(doubles,len);
+    for (size_t i = 0; i < len; ++i)
+        assert(doubles[i] == b.nextDouble());
+    assert(a.getState() == b.getState());
+}
+
+// recovered states reproduce the observed outputs
+static void test_recover()
+{
+    mclib::Random g(186586357641LL);
+    g.nextInt();
+    const int64_t s = g.getState();
+    assert(mclib::prevState(mclib::nextState(s)) == s);
+    assert(mclib::Random(mclib::seedFromState(s)).getState() == s);
+    mclib::Random r = g;
+    std::vector<int64_t> states = mclib::statesFromLong(r.nextLong());
+    assert(std::find(states.begin(),states.end(),s) != states.end());
+    // top bits from floats and a power of 2 bound, nextInt(10) filters
+    r = g;
+    mclib::RandomSolver solver;
+    solver.nextFloat(r.nextFloat());
+    solver.nextInt(10,r.nextInt(10));
+    r.nextDouble();
+    solver.skip(2);
+    for (size_t i = 0; i < 4; ++i)
+        solver.nextInt(64,r.nextInt(64));
+    solver.nextFloat(r.nextFloat());
+    states = solver.solve();
+    assert(states.size() == 1 && states[0] == s);
+}
+
+int main(int argc, char **argv)
+{
+    (void)argc;
+    (void)argv;
+    test_known_values();
+    test_skip();
+    test_substream();
+    test_bulk();
+    test_recover();
+    test_lanes<4>();
+    test_lanes<8>();
+    test_lanes<16>();
+    std::cout << "jrand tests passed" << std::endl;
+    return 0;
+}
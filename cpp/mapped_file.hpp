@@ -0,0 +1,77 @@
+/*
+Read only memory mapped file
+
+The whole file is mapped with mmap (private, read only) so it can be parsed in
+place without reading it into a buffer first. Empty files are not mapped and
+give data() == nullptr with size() == 0.
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace mclib
+{
+
+class MappedFile
+{
+private:
+    const char *ptr;
+    size_t len;
+public:
+    MappedFile(const std::string &path): ptr(nullptr), len(0)
+    {
+        int fd = open(path.c_str(),O_RDONLY);
+        if (fd < 0)
+            throw "mapped file cannot open file";
+        struct stat st;
+        if (fstat(fd,&st))
+        {
+            close(fd);
+            throw "mapped file cannot stat file";
+        }
+        len = st.st_size;
+        if (len)
+        {
+            void *p = mmap(nullptr,len,PROT_READ,MAP_PRIVATE,fd,0);
+            if (p == MAP_FAILED)
+            {
+                close(fd);
+                throw "mapped file cannot map file";
+            }
+            ptr = (const char*)p;
+        }
+        close(fd);
+    }
+    MappedFile(const MappedFile&) = delete;
+    MappedFile &operator=(const MappedFile&) = delete;
+    MappedFile(MappedFile &&o): ptr(o.ptr), len(o.len)
+    {
+        o.ptr = nullptr;
+        o.len = 0;
+    }
+    ~MappedFile()
+    {
+        if (ptr)
+            munmap((void*)ptr,len);
+    }
+    const char *data() const { return ptr; }
+    size_t size() const { return len; }
+    // hint that the whole file will be read soon (and in order)
+    void willNeed(bool sequential = true) const
+    {
+        if (!ptr)
+            return;
+        madvise((void*)ptr,len,MADV_WILLNEED);
+        if (sequential)
+            madvise((void*)ptr,len,MADV_SEQUENTIAL);
+    }
+};
+
+}
@@ -0,0 +1,79 @@
+/*
+Lock free multiple producer single consumer queue
+
+Producers push nodes onto an atomic stack with a compare and swap. The consumer
+takes the whole stack with one exchange and reverses it, so items come out in
+push order per producer. Taking everything at once means the consumer never
+holds a pointer into the live stack (no ABA problem).
+*/
+
+#pragma once
+
+#include <atomic>
+#include <vector>
+
+namespace mclib
+{
+
+template <typename T>
+class MpscQueue
+{
+private:
+    struct _node
+    {
+        T value;
+        _node *next;
+    };
+    std::atomic<_node*> head;
+public:
+    MpscQueue(): head(nullptr) {}
+    ~MpscQueue()
+    {
+        _node *n = head.exchange(nullptr);
+        while (n)
+        {
+            _node *next = n->next;
+            delete n;
+            n = next;
+        }
+    }
+    MpscQueue(const MpscQueue&) = delete;
+    MpscQueue &operator=(const MpscQueue&) = delete;
+    // safe from any number of threads
+    void push(const T &value)
+    {
+        _node *n = new _node{value,head.load(std::memory_order_relaxed)};
+        while (!head.compare_exchange_weak(n->next,n,
+                std::memory_order_release,std::memory_order_relaxed));
+    }
+    bool empty() const
+    {
+        return head.load(std::memory_order_acquire) == nullptr;
+    }
+    // consumer only, appends everything pushed so far to out (oldest first)
+    // returns the number of items taken
+    size_t drain(std::vector<T> &out)
+    {
+        _node *n = head.exchange(nullptr,std::memory_order_acquire);
+        _node *rev = nullptr;
+        while (n)
+        {
+            _node *next = n->next;
+            n->next = rev;
+            rev = n;
+            n = next;
+        }
+        size_t count = 0;
+        while (rev)
+        {
+            _node *next = rev->next;
+            out.push_back(std::move(rev->value));
+            delete rev;
+            rev = next;
+            ++count;
+        }
+        return count;
+    }
+};
+
+}
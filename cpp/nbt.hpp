@@ -7,33 +7,38 @@ because the NBT format is simple and precompiling this is not really saving any
 time.
 
 TODO
-- make this library work on big endian systems
 - add links to documentation used
 */
 
 #pragma once
 
+#include <algorithm>
 #include <cassert>
+#include <charconv>
+#include <cmath>
 #include <cstdint>
 #include <cstring>
+#include <memory_resource>
+#include <new>
 #include <sstream>
 #include <streambuf>
 #include <string>
+#include <string_view>
 #include <unordered_map>
-#include <unordered_set>
+#include <utility>
 #include <vector>
 
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
 // my own custom header for checking system endian
-// nbt stores data in big endian because java stores data in big endian
-// this code is most likely to be used on x86 which is little endian
+// nbt stores data in big endian because java stores data in big endian,
+// utils.hpp converts (byte swapping only on little endian systems)
 #include "endian.hpp"
+#include "nbt_names.hpp"
 #include "utils.hpp"
 
-// TODO add support for big endian systems
-// for now just make sure the system is little endian
-// and warn the user if it is not
-static_assert(TKOZ_LITTLE_ENDIAN);
-
 // keep everything inside its own namespace, the string "nbt" is short
 // people can put "using namespace nbt;" in their code if they want
 namespace mclib
@@ -59,12 +64,49 @@ class TAG_Long_Array;
 typedef std::vector<char> bytes_t;
 
 // typedefs for some nbt data types
-typedef std::vector<int8_t> byte_array_t;
-typedef std::vector<int16_t> short_array_t;
-typedef std::vector<int32_t> int_array_t;
-typedef std::vector<int64_t> long_array_t;
-typedef std::vector<TAG*> list_t;
-typedef std::unordered_map<std::string,TAG*> compound_t;
+// tag data uses polymorphic allocators so a decoded tree can be placed entirely
+// in an arena (see TAG::decode with a memory resource)
+typedef std::pmr::vector<int8_t> byte_array_t;
+typedef std::pmr::vector<int16_t> short_array_t;
+typedef std::pmr::vector<int32_t> int_array_t;
+typedef std::pmr::vector<int64_t> long_array_t;
+typedef std::pmr::vector<TAG*> list_t;
+typedef std::pmr::unordered_map<std::pmr::string,TAG*> compound_t;
+typedef std::pmr::vector<std::pmr::string> order_t;
+
+// memory resource for tag data, nullptr means the ordinary heap
+static inline std::pmr::memory_resource *_resource(
+        std::pmr::memory_resource *mr)
+{
+    return mr ? mr : std::pmr::new_delete_resource();
+}
+
+// shortest text reading back as the same float or double (std::to_chars),
+// whole numbers get ".0", nan and infinity are written like Python's json,
+// needs 32 bytes at p, returns the end
+template <typename T>
+static inline char *_float_chars(char *p, T v)
+{
+    if (std::isnan(v))
+    {
+        memcpy(p,"NaN",3);
+        return p + 3;
+    }
+    if (std::isinf(v))
+    {
+        if (v < 0)
+            *p++ = '-';
+        memcpy(p,"Infinity",8);
+        return p + 8;
+    }
+    char *end = std::to_chars(p,p+32,v).ptr;
+    if (std::find_if(p,end,[](char c) { return c == '.' || c == 'e'; }) == end)
+    {
+        *end++ = '.';
+        *end++ = '0';
+    }
+    return end;
+}
 
 // alternative name
 typedef TAG NBT;
@@ -92,23 +134,42 @@ class TAG
     // subclasses can use the protected constructor but not the functions?
     friend class TAG_List;
     friend class TAG_Compound;
+    // path queries decode only the parts they select
+    friend class NbtQuery;
+    // tapes decode subtrees and assemble containers from them
+    friend class NbtTape;
 private:
-    const std::string name;
+    // interned name (shared by all tags with the same name)
+    const NbtName *name;
     TAG(){}
     // decode NBT tag using bytes in [ptr,end)
     // move ptr to 1 byte past the end of what is decoded
-    static TAG *decodeTag(const char *&ptr, const char *end);
+    // tags are allocated in mr (heap if nullptr)
+    static TAG *decodeTag(const char *&ptr, const char *end,
+            std::pmr::memory_resource *mr);
     // decode NBT tag payload in [ptr,end)
     // move ptr to 1 byte past the end of what is decoded
     static TAG *decodePayload(const char *&ptr, const char *end, int8_t tid,
-            const std::string &name);
+            std::string_view name, std::pmr::memory_resource *mr);
 protected:
     // construct common part to all tags (the name)
     // (except TAG_End which is handled with nullptr in this library)
-    TAG(const std::string &s): name(s)
+    // (names are interned, so mr is not used for them)
+    TAG(std::string_view s, std::pmr::memory_resource *mr)
     {
-        if (s.size() >= 0x10000) 
+        (void)mr;
+        if (s.size() >= 0x10000)
             throw "nbt tag name cannot be longer than 65535 bytes";
+        name = NbtNameTable::global().intern(s);
+    }
+    // new tag object, placed in mr if it is not nullptr (never deleted then)
+    template <typename T, typename... Args>
+    static T *_new(std::pmr::memory_resource *mr, Args&&... args)
+    {
+        if (!mr)
+            return new T(std::forward<Args>(args)...);
+        return new (mr->allocate(sizeof(T),alignof(T)))
+                T(std::forward<Args>(args)...);
     }
     // string name for the tag type (used in printing)
     virtual std::string _type() const = 0;
@@ -116,7 +177,7 @@ protected:
     virtual std::string _namestr() const final
     {
         // TODO FIXME escape special characters
-        return _type() + "('" + name + "')";
+        return _type() + "('" + std::string(name->str) + "')";
     }
     // print the value part (depends on tag type)
     virtual std::string printValue(size_t depth, size_t space) const = 0;
@@ -130,33 +191,45 @@ public:
     // custom destructors not used but this is required for abstract base class
     virtual ~TAG(){}
     // the tag name
-    virtual const std::string &getName() const final { return name; }
+    virtual std::string_view getName() const final { return name->str; }
+    // interned name id (tags with equal names have equal ids)
+    virtual uint32_t getNameId() const final { return name->id; }
     // tag ID
     virtual int8_t id() const = 0;
-    // length of payload bytes
+    // length of payload bytes (lists and compounds keep it, tags do not
+    // change after construction, so this does not walk the subtree)
     virtual size_t payloadSize() const = 0;
     // length of full tag in NBT
     virtual size_t nbtSize() const final
-    { return 3 + name.size() + payloadSize(); }
+    { return 3 + name->str.size() + payloadSize(); }
     // write payload bytes (must have space for payloadSize() bytes)
-    virtual void writePayload(char *p) const = 0;
+    // returns pointer past the last byte written
+    virtual char *writePayload(char *p) const = 0;
     // write the full tag bytes (must have space for nbtSize() bytes)
-    virtual void writeNbt(char *p) const final
+    // returns pointer past the last byte written
+    virtual char *writeNbt(char *p) const final
     {
         // type byte, name length, name, payload
         _to_bytes(p,id());
-        _to_bytes(p+1,(int16_t)(name.size()));
-        memcpy(p+3,name.data(),name.size());
-        writePayload(p+3+name.size());
+        std::string_view n = name->str;
+        _to_bytes(p+1,(int16_t)(n.size()));
+        memcpy(p+3,n.data(),n.size());
+        return writePayload(p+3+n.size());
     }
     // convert to a binary bytes object (for saving as file)
     virtual bytes_t encode() const final
     {
         bytes_t ret;
-        ret.resize(nbtSize());
-        writeNbt(ret.data());
+        encode(ret);
         return ret;
     }
+    // append the binary form to out (reusing its capacity between calls)
+    virtual void encode(bytes_t &out) const final
+    {
+        size_t n = out.size();
+        out.resize(n + nbtSize());
+        writeNbt(out.data() + n);
+    }
     // create a human readable representation of the NBT data
     virtual std::string printTag(size_t space = 4) const final
     { return printTag(0,space); }
@@ -164,22 +237,29 @@ public:
     static TAG *decode(const bytes_t &data);
     // decode NBT data from C array
     static TAG *decode(const char *data, size_t len);
+    // decode with tags, strings and arrays allocated from mr (like an Arena,
+    // tag names are interned), the tree must not be deleted, it is freed all
+    // at once when the memory resource is reset or released
+    static TAG *decode(const bytes_t &data, std::pmr::memory_resource *mr);
+    static TAG *decode(const char *data, size_t len,
+            std::pmr::memory_resource *mr);
 };
 
 // tag for 1 byte integer
 class TAG_Byte: public TAG
 {
     friend class TAG;
+    friend class NbtJsonWriter;
 private:
     int8_t value;
     static TAG_Byte *decodePayload(const char *&ptr, const char *end,
-            const std::string &name)
+            std::string_view name, std::pmr::memory_resource *mr)
     {
         if (ptr+1 > end)
             throw "nbt parsing tag_byte, not enough data";
         int8_t value = _from_bytes_byte(ptr);
         ptr += 1;
-        return new TAG_Byte(name,value);
+        return _new<TAG_Byte>(mr,name,value,mr);
     }
 protected:
     virtual std::string _type() const override { return "TAG_Byte"; }
@@ -189,12 +269,15 @@ protected:
         return std::to_string(value);
     }
 public:
-    TAG_Byte(const std::string &s, int8_t v): TAG(s), value(v) {}
+    TAG_Byte(std::string_view s, int8_t v,
+            std::pmr::memory_resource *mr = nullptr):
+            TAG(s,mr), value(v) {}
     int8_t id() const override { return 1; }
     size_t payloadSize() const override { return 1; }
-    void writePayload(char *p) const override
+    char *writePayload(char *p) const override
     {
         _to_bytes(p,value);
+        return p + sizeof(value);
     }
 };
 
@@ -202,16 +285,17 @@ public:
 class TAG_Short: public TAG
 {
     friend class TAG;
+    friend class NbtJsonWriter;
 private:
     int16_t value;
     static TAG_Short *decodePayload(const char *&ptr, const char *end,
-            const std::string &name)
+            std::string_view name, std::pmr::memory_resource *mr)
     {
         if (ptr+2 > end)
             throw "nbt parsing tag_short, not enough data";
         int16_t value = _from_bytes_short(ptr);
         ptr += 2;
-        return new TAG_Short(name,value);
+        return _new<TAG_Short>(mr,name,value,mr);
     }
 protected:
     virtual std::string _type() const override { return "TAG_Short"; }
@@ -221,12 +305,15 @@ protected:
         return std::to_string(value);
     }
 public:
-    TAG_Short(const std::string &s, int16_t v): TAG(s), value(v) {}
+    TAG_Short(std::string_view s, int16_t v,
+            std::pmr::memory_resource *mr = nullptr):
+            TAG(s,mr), value(v) {}
     int8_t id() const override { return 2; }
     size_t payloadSize() const override { return 2; }
-    void writePayload(char *p) const override
+    char *writePayload(char *p) const override
     {
         _to_bytes(p,value);
+        return p + sizeof(value);
     }
 };
 
@@ -234,16 +321,17 @@ public:
 class TAG_Int: public TAG
 {
     friend class TAG;
+    friend class NbtJsonWriter;
 private:
     int32_t value;
     static TAG_Int *decodePayload(const char *&ptr, const char *end,
-            const std::string &name)
+            std::string_view name, std::pmr::memory_resource *mr)
     {
         if (ptr+4 > end)
             throw "nbt parsing tag_int, not enough data";
         int32_t value = _from_bytes_int(ptr);
         ptr += 4;
-        return new TAG_Int(name,value);
+        return _new<TAG_Int>(mr,name,value,mr);
     }
 protected:
     virtual std::string _type() const override { return "TAG_Int"; }
@@ -253,12 +341,15 @@ protected:
         return std::to_string(value);
     }
 public:
-    TAG_Int(const std::string &s, int32_t v): TAG(s), value(v) {}
+    TAG_Int(std::string_view s, int32_t v,
+            std::pmr::memory_resource *mr = nullptr):
+            TAG(s,mr), value(v) {}
     int8_t id() const override { return 3; }
     size_t payloadSize() const override { return 4; }
-    void writePayload(char *p) const override
+    char *writePayload(char *p) const override
     {
         _to_bytes(p,value);
+        return p + sizeof(value);
     }
 };
 
@@ -266,16 +357,17 @@ public:
 class TAG_Long: public TAG
 {
     friend class TAG;
+    friend class NbtJsonWriter;
 private:
     int64_t value;
     static TAG_Long *decodePayload(const char *&ptr, const char *end,
-            const std::string &name)
+            std::string_view name, std::pmr::memory_resource *mr)
     {
         if (ptr+8 > end)
             throw "nbt parsing tag_long, not enough data";
         int64_t value = _from_bytes_long(ptr);
         ptr += 8;
-        return new TAG_Long(name,value);
+        return _new<TAG_Long>(mr,name,value,mr);
     }
 protected:
     virtual std::string _type() const override { return "TAG_Long"; }
@@ -285,12 +377,15 @@ protected:
         return std::to_string(value);
     }
 public:
-    TAG_Long(const std::string &s, int64_t v): TAG(s), value(v) {}
+    TAG_Long(std::string_view s, int64_t v,
+            std::pmr::memory_resource *mr = nullptr):
+            TAG(s,mr), value(v) {}
     int8_t id() const override { return 4; }
     size_t payloadSize() const override { return 8; }
-    void writePayload(char *p) const override
+    char *writePayload(char *p) const override
     {
         _to_bytes(p,value);
+        return p + sizeof(value);
     }
 };
 
@@ -298,32 +393,36 @@ public:
 class TAG_Float: public TAG
 {
     friend class TAG;
+    friend class NbtJsonWriter;
 private:
     float value;
     static TAG_Float *decodePayload(const char *&ptr, const char *end,
-            const std::string &name)
+            std::string_view name, std::pmr::memory_resource *mr)
     {
         if (ptr+4 > end)
             throw "nbt parsing tag_float, not enough data";
         float value = _from_bytes_float(ptr);
         ptr += 4;
-        return new TAG_Float(name,value);
+        return _new<TAG_Float>(mr,name,value,mr);
     }
 protected:
     virtual std::string _type() const override { return "TAG_Float"; }
     std::string printValue(size_t depth, size_t space) const override
     {
         (void)(depth+space); // suppress unused variable warning/error
-        // TODO FIXME std::to_string uses a bad format for floating point
-        return std::to_string(value);
+        char buf[32];
+        return std::string(buf,_float_chars(buf,value));
     }
 public:
-    TAG_Float(const std::string &s, float v): TAG(s), value(v) {}
+    TAG_Float(std::string_view s, float v,
+            std::pmr::memory_resource *mr = nullptr):
+            TAG(s,mr), value(v) {}
     int8_t id() const override { return 5; }
     size_t payloadSize() const override { return 4; }
-    void writePayload(char *p) const override
+    char *writePayload(char *p) const override
     {
         _to_bytes(p,value);
+        return p + sizeof(value);
     }
 };
 
@@ -331,32 +430,36 @@ public:
 class TAG_Double: public TAG
 {
     friend class TAG;
+    friend class NbtJsonWriter;
 private:
     double value;
     static TAG_Double *decodePayload(const char *&ptr, const char *end,
-            const std::string &name)
+            std::string_view name, std::pmr::memory_resource *mr)
     {
         if (ptr+8 > end)
             throw "nbt parsing tag_double, not enough data";
         double value = _from_bytes_double(ptr);
         ptr += 8;
-        return new TAG_Double(name,value);
+        return _new<TAG_Double>(mr,name,value,mr);
     }
 protected:
     virtual std::string _type() const override { return "TAG_Double"; }
     std::string printValue(size_t depth, size_t space) const override
     {
         (void)(depth+space); // suppress unused variable warning/error
-        // TODO FIXME std::to_string uses a bad format for floating point
-        return std::to_string(value);
+        char buf[32];
+        return std::string(buf,_float_chars(buf,value));
     }
 public:
-    TAG_Double(const std::string &s, double v): TAG(s), value(v) {}
+    TAG_Double(std::string_view s, double v,
+            std::pmr::memory_resource *mr = nullptr):
+            TAG(s,mr), value(v) {}
     int8_t id() const override { return 6; }
     size_t payloadSize() const override { return 8; }
-    void writePayload(char *p) const override
+    char *writePayload(char *p) const override
     {
         _to_bytes(p,value);
+        return p + sizeof(value);
     }
 };
 
@@ -364,25 +467,24 @@ public:
 class TAG_Byte_Array: public TAG
 {
     friend class TAG;
+    friend class NbtJsonWriter;
 private:
     byte_array_t value;
     static TAG_Byte_Array *decodePayload(const char *&ptr, const char *end,
-            const std::string &name)
+            std::string_view name, std::pmr::memory_resource *mr)
     {
         if (ptr+4 > end)
             throw "nbt parsing tag_byte_array, cannot parse length";
         size_t len = (uint32_t)_from_bytes_int(ptr);
         ptr += 4;
-        if (ptr+len > end)
+        if (len > (size_t)(end-ptr))
             throw "nbt parsing tag_byte_array, not enough data";
-        byte_array_t value;
-        value.resize(len);
-        for (size_t i = 0; i < len; ++i)
-        {
-            value[i] = _from_bytes_byte(ptr);
-            ++ptr;
-        }
-        return new TAG_Byte_Array(name,value);
+        // filled in place so the array is allocated once
+        TAG_Byte_Array *ret = _new<TAG_Byte_Array>(mr,name,
+                byte_array_t(_resource(mr)),mr);
+        ret->value.assign((const int8_t*)ptr,(const int8_t*)ptr+len);
+        ptr += len;
+        return ret;
     }
 protected:
     virtual std::string _type() const override { return "TAG_Byte_Array"; }
@@ -401,20 +503,27 @@ protected:
         return ret;
     }
 public:
-    TAG_Byte_Array(const std::string &s, const byte_array_t &v):
-            TAG(s), value(v)
+    TAG_Byte_Array(std::string_view s, const byte_array_t &v,
+            std::pmr::memory_resource *mr = nullptr):
+            TAG(s,mr), value(v,_resource(mr))
     {
         if (v.size() >= 0x80000000)
             throw "nbt byte array cannot be longer than 2147483647";
     }
+    TAG_Byte_Array(std::string_view s, byte_array_t &&v,
+            std::pmr::memory_resource *mr = nullptr):
+            TAG(s,mr), value(std::move(v),_resource(mr))
+    {
+        if (value.size() >= 0x80000000)
+            throw "nbt byte array cannot be longer than 2147483647";
+    }
     int8_t id() const override { return 7; }
     size_t payloadSize() const override { return 4 + value.size(); }
-    void writePayload(char *p) const override
+    char *writePayload(char *p) const override
     {
         _to_bytes(p,(int32_t)(value.size()));
-        p += 4;
-        for (size_t i = 0; i < value.size(); ++i)
-            _to_bytes(p+i,value[i]);
+        _to_bytes_array(p+4,value.data(),value.size());
+        return p + 4 + value.size()*sizeof(value[0]);
     }
 };
 
@@ -422,10 +531,11 @@ public:
 class TAG_String: public TAG
 {
     friend class TAG;
+    friend class NbtJsonWriter;
 private:
-    std::string value;
+    std::pmr::string value;
     static TAG_String *decodePayload(const char *&ptr, const char *end,
-            const std::string &name)
+            std::string_view name, std::pmr::memory_resource *mr)
     {
         if (ptr+2 > end)
             throw "nbt parsing tag_string, cannot parse length";
@@ -433,9 +543,9 @@ private:
         ptr += 2;
         if (ptr+len > end)
             throw "nbt parsing tag_string, not enough data";
-        std::string value(ptr,len);
+        std::string_view value(ptr,len);
         ptr += len;
-        return new TAG_String(name,value);
+        return _new<TAG_String>(mr,name,value,mr);
     }
 protected:
     virtual std::string _type() const override { return "TAG_String"; }
@@ -443,20 +553,23 @@ protected:
     {
         (void)(depth+space); // suppress unused variable warning/error
         // TODO FIXME escape special characters
-        return "'" + value + "'";
+        return "'" + std::string(value) + "'";
     }
 public:
-    TAG_String(const std::string &s, const std::string &v): TAG(s), value(v)
+    TAG_String(std::string_view s, std::string_view v,
+            std::pmr::memory_resource *mr = nullptr):
+            TAG(s,mr), value(v,_resource(mr))
     {
         if (v.size() >= 0x10000)
             throw "nbt string cannot be longer than 65535 bytes";
     }
     int8_t id() const override { return 8; }
     size_t payloadSize() const override { return 2 + value.size(); }
-    void writePayload(char *p) const override
+    char *writePayload(char *p) const override
     {
         _to_bytes(p,(int16_t)(value.size()));
         memcpy(p+2,value.data(),value.size());
+        return p + 2 + value.size();
     }
 };
 
@@ -464,24 +577,43 @@ public:
 class TAG_List: public TAG
 {
     friend class TAG;
+    friend class NbtJsonWriter;
+    friend class NbtTape;
 private:
     list_t value;
     int8_t tid;
+    // payload size, known once the elements are
+    size_t psize;
     static TAG_List *decodePayload(const char *&ptr, const char *end,
-            const std::string &name)
+            std::string_view name, std::pmr::memory_resource *mr)
     {
-        if (ptr > end)
+        if (ptr >= end)
             throw "nbt parsing tag_list, cannot parse tag type id";
         int8_t tid = (int8_t)(*(ptr++));
         if (ptr+4 > end)
             throw "nbt parsing tag_list, cannot parse length";
         size_t len = (uint32_t)_from_bytes_int(ptr);
         ptr += 4;
-        list_t value;
-        value.resize(len);
-        for (size_t i = 0; i < len; ++i)
-            value[i] = TAG::decodePayload(ptr,end,tid,"");
-        return new TAG_List(name,value);
+        // every payload except TAG_End takes at least 1 byte
+        if (tid != 0 && len > (size_t)(end-ptr))
+            throw "nbt parsing tag_list, not enough data";
+        const char *start = ptr - 5;
+        TAG_List *ret = _new<TAG_List>(mr,name,list_t(_resource(mr)),tid,mr);
+        try
+        {
+            list_t &value = ret->value;
+            value.resize(len);
+            for (size_t i = 0; i < len; ++i)
+                value[i] = TAG::decodePayload(ptr,end,tid,"",mr);
+            ret->psize = ptr - start;
+        }
+        catch (...)
+        {
+            if (!mr) // arena trees are freed with the arena
+                delete ret;
+            throw;
+        }
+        return ret;
     }
 protected:
     virtual std::string _type() const override { return "TAG_List"; }
@@ -502,8 +634,9 @@ public:
         for (TAG *t : value)
             delete t;
     }
-    TAG_List(const std::string &s, const list_t &v, int8_t tid = -1):
-            TAG(s), value(v)
+    TAG_List(std::string_view s, const list_t &v, int8_t tid = -1,
+            std::pmr::memory_resource *mr = nullptr):
+            TAG(s,mr), value(v,_resource(mr))
     {
         // tid == -1 means infer type from provided vector
         if (v.size() >= 0x80000000)
@@ -511,6 +644,7 @@ public:
         if (tid == -1) // infer tag type id, use TAG_End if list is empty
             tid = v.size() ? v[0]->id() : 0;
         this->tid = tid;
+        psize = 5;
         for (size_t i = 0; i < v.size(); ++i)
         {
             if ((!v[i] && tid != 0) || (v[i] && v[i]->id() != tid))
@@ -518,57 +652,156 @@ public:
             // this check could be ignored since tag names are ignored anyway
             if (v[i] && v[i]->getName() != "")
                 throw "nbt list tags must be unnamed";
+            if (v[i])
+                psize += v[i]->payloadSize();
         }
     }
     int8_t id() const override { return 9; }
-    size_t payloadSize() const override
-    {
-        size_t ret = 5;
-        for (size_t i = 0; i < value.size(); ++i)
-            if (value[i])
-                ret += value[i]->payloadSize();
-        return ret;
-    }
-    void writePayload(char *p) const override
+    size_t payloadSize() const override { return psize; }
+    char *writePayload(char *p) const override
     {
         _to_bytes(p,tid);
         _to_bytes(p+1,(int32_t)(value.size()));
         p += 5;
         for (size_t i = 0; i < value.size(); ++i)
             if (value[i])
-            {
-                value[i]->writePayload(p);
-                p += value[i]->payloadSize();
-            }
+                p = value[i]->writePayload(p);
+        return p;
     }
 };
 
+// position of id in keys[0,n), n if it is not there
+static inline size_t _find_key(const uint32_t *keys, size_t n, uint32_t id)
+{
+    size_t i = 0;
+#if defined(__AVX2__)
+    const __m256i v8 = _mm256_set1_epi32((int32_t)id);
+    for (; i + 8 <= n; i += 8)
+    {
+        __m256i k = _mm256_loadu_si256((const __m256i*)(keys+i));
+        unsigned m = (unsigned)_mm256_movemask_ps(
+                _mm256_castsi256_ps(_mm256_cmpeq_epi32(k,v8)));
+        if (m)
+            return i + __builtin_ctz(m);
+    }
+#endif
+#if defined(__SSE2__)
+    const __m128i v4 = _mm_set1_epi32((int32_t)id);
+    for (; i + 4 <= n; i += 4)
+    {
+        __m128i k = _mm_loadu_si128((const __m128i*)(keys+i));
+        unsigned m = (unsigned)_mm_movemask_ps(
+                _mm_castsi128_ps(_mm_cmpeq_epi32(k,v4)));
+        if (m)
+            return i + __builtin_ctz(m);
+    }
+#endif
+    for (; i < n; ++i)
+        if (keys[i] == id)
+            return i;
+    return n;
+}
+
 // tag for sequence of tags (varying type)
-// TODO keep track of tag order in unordered_map
-// (will require writing a new data structure based on unordered_map and list)
+// children are kept in insertion order (the order they are written in) with
+// their interned name ids beside them, small compounds are searched by
+// scanning the ids, larger ones also get an open addressed index
 class TAG_Compound: public TAG
 {
     friend class TAG;
+    friend class NbtJsonWriter;
+    friend class NbtTape;
 private:
-    compound_t value;
-    std::vector<std::string> order;
+    list_t value;
+    std::pmr::vector<uint32_t> keys;
+    // position+1 of the child for each slot (0 is empty), size is a power of
+    // 2 and at least twice the number of children, empty for small compounds
+    std::pmr::vector<uint32_t> index;
+    // payload size, known once the children are
+    size_t psize;
+    // compounds with more children than this get an index
+    static const size_t _index_min = 16;
+    static size_t _slot(uint32_t id, size_t mask)
+    {
+        return (size_t)(id * 0x9e3779b1u) & mask;
+    }
+    // position of the child with name id, value.size() if there is none
+    size_t _find(uint32_t id) const
+    {
+        if (index.empty())
+            return _find_key(keys.data(),keys.size(),id);
+        size_t mask = index.size() - 1;
+        for (size_t i = _slot(id,mask);; i = (i+1) & mask)
+        {
+            uint32_t pos = index[i];
+            if (!pos)
+                return value.size();
+            if (keys[pos-1] == id)
+                return pos-1;
+        }
+    }
+    void _reindex(size_t slots)
+    {
+        index.assign(slots,0);
+        size_t mask = slots - 1;
+        for (size_t pos = 0; pos < keys.size(); ++pos)
+        {
+            size_t i = _slot(keys[pos],mask);
+            while (index[i])
+                i = (i+1) & mask;
+            index[i] = (uint32_t)(pos+1);
+        }
+    }
+    // add a child at the end, false if the name is already used
+    bool _insert(TAG *t)
+    {
+        uint32_t id = t->getNameId();
+        if (_find(id) != value.size())
+            return false;
+        value.push_back(t);
+        keys.push_back(id);
+        size_t n = keys.size();
+        if (n > _index_min)
+        {
+            if (2*n > index.size())
+                _reindex(index.empty() ? 64 : 2*index.size());
+            else
+            {
+                size_t mask = index.size() - 1;
+                size_t i = _slot(id,mask);
+                while (index[i])
+                    i = (i+1) & mask;
+                index[i] = (uint32_t)n;
+            }
+        }
+        return true;
+    }
     static TAG_Compound *decodePayload(const char *&ptr, const char *end,
-            const std::string &name)
+            std::string_view name, std::pmr::memory_resource *mr)
     {
-        compound_t value;
-        std::vector<std::string> order;
-        TAG *item;
-        // decode tags until finding TAG_End
-        while ((item = TAG::decodeTag(ptr,end)))
+        const char *start = ptr;
+        TAG_Compound *ret = _new<TAG_Compound>(mr,name,
+                compound_t(_resource(mr)),order_t(_resource(mr)),mr);
+        try
+        {
+            TAG *item;
+            // decode tags until finding TAG_End
+            while ((item = TAG::decodeTag(ptr,end,mr)))
+                if (!ret->_insert(item))
+                {
+                    if (!mr)
+                        delete item;
+                    throw "nbt parsing tag_compound, duplicate tag name";
+                }
+            ret->psize = ptr - start;
+        }
+        catch (...)
         {
-            const std::string &itemname = item->getName();
-            auto it = value.find(itemname);
-            if (it != value.end())
-                throw "nbt parsing tag_compound, duplicate tag name";
-            value[itemname] = item;
-            order.push_back(itemname);
+            if (!mr) // arena trees are freed with the arena
+                delete ret;
+            throw;
         }
-        return new TAG_Compound(name,value,order);
+        return ret;
     }
 protected:
     virtual std::string _type() const override { return "TAG_Compound"; }
@@ -577,67 +810,71 @@ protected:
         std::string spacestr(space*depth,' ');
         std::string ret = std::to_string(value.size()) + " entries\n";
         ret += spacestr + "{\n";
-        if (order.empty())
-            for (auto it = value.begin(); it != value.end(); ++it)
-                ret += it->second->printTag(depth+1,space) + "\n";
-        else
-            for (auto key : order)
-                ret += value.find(key)->second->printTag(depth+1,space) + "\n";
+        for (TAG *t : value)
+            ret += t->printTag(depth+1,space) + "\n";
         ret += spacestr + "}";
         return ret;
     }
 public:
     ~TAG_Compound()
     {
-        for (auto it : value)
-            delete it.second;
+        for (TAG *t : value)
+            delete t;
     }
-    TAG_Compound(const std::string &s, const compound_t &v,
-            const std::vector<std::string> &order = {}):
-            TAG(s), value(v), order(order)
+    // children from v (each key must be the name of its tag), in the order
+    // given by order or in the iteration order of v if order is empty
+    TAG_Compound(std::string_view s, const compound_t &v,
+            const order_t &order = {}, std::pmr::memory_resource *mr = nullptr):
+            TAG(s,mr), value(_resource(mr)), keys(_resource(mr)),
+            index(_resource(mr))
     {
+        psize = 1;
         for (auto it = v.begin(); it != v.end(); ++it)
+        {
             if (!it->second)
                 throw "nbt compound cannot contain tag_end";
-        if (!order.empty()) // make sure it is a valid tag order list
+            if (it->second->getName() != it->first)
+                throw "nbt compound key does not match tag name";
+            psize += it->second->nbtSize();
+        }
+        value.reserve(v.size());
+        keys.reserve(v.size());
+        if (order.empty())
+            for (auto it = v.begin(); it != v.end(); ++it)
+                _insert(it->second);
+        else // make sure it is a valid tag order list
         {
-            std::unordered_set<std::string> keys;
             if (order.size() != v.size())
                 throw "nbt compound tag order length incorrect";
             for (size_t i = 0; i < order.size(); ++i)
             {
-                if (v.find(order[i]) == v.end())
+                auto it = v.find(order[i]);
+                if (it == v.end())
                     throw "nbt compound tag order has nonexistent tag name";
-                if (keys.find(order[i]) != keys.end())
+                if (!_insert(it->second))
                     throw "nbt compound tag order has duplicate tag name";
-                keys.insert(order[i]);
             }
         }
     }
     int8_t id() const override { return 10; }
-    size_t payloadSize() const override
+    // number of children
+    size_t size() const { return value.size(); }
+    // child with the given name, nullptr if there is none
+    TAG *get(std::string_view key) const
     {
-        size_t ret = 1;
-        for (auto it = value.begin(); it != value.end(); ++it)
-            ret += it->second->nbtSize();
-        return ret;
+        const NbtName *n = NbtNameTable::global().lookup(key);
+        if (!n)
+            return nullptr;
+        size_t pos = _find(n->id);
+        return pos < value.size() ? value[pos] : nullptr;
     }
-    void writePayload(char *p) const override
+    size_t payloadSize() const override { return psize; }
+    char *writePayload(char *p) const override
     {
-        if (order.empty()) // use order from unordered_map iteration
-            for (auto it = value.begin(); it != value.end(); ++it)
-            {
-                it->second->writeNbt(p);
-                p += it->second->nbtSize();
-            }
-        else // use provided tag order
-            for (auto key : order)
-            {
-                auto it = value.find(key); // will not be value.end()
-                it->second->writeNbt(p);
-                p += it->second->nbtSize();
-            }
+        for (TAG *t : value)
+            p = t->writeNbt(p);
         *p = '\0'; // TAG_End
+        return p + 1;
     }
 };
 
@@ -645,25 +882,26 @@ public:
 class TAG_Int_Array: public TAG
 {
     friend class TAG;
+    friend class NbtJsonWriter;
 private:
     int_array_t value;
     static TAG_Int_Array *decodePayload(const char *&ptr, const char *end,
-            const std::string &name)
+            std::string_view name, std::pmr::memory_resource *mr)
     {
         if (ptr+4 > end)
             throw "nbt parsing tag_int_array, cannot parse length";
         size_t len = (uint32_t)_from_bytes_int(ptr);
         ptr += 4;
-        if (ptr + len*4 > end)
+        if (len > (size_t)(end-ptr)/4)
             throw "nbt parsing tag_int_array, not enough data";
-        int_array_t value;
+        // filled in place so the array is allocated once
+        TAG_Int_Array *ret = _new<TAG_Int_Array>(mr,name,
+                int_array_t(_resource(mr)),mr);
+        int_array_t &value = ret->value;
         value.resize(len);
-        for (size_t i = 0; i < len; ++i)
-        {
-            value[i] = _from_bytes_int(ptr);
-            ptr += 4;
-        }
-        return new TAG_Int_Array(name,value);
+        _from_bytes_array(ptr,value.data(),len);
+        ptr += len*4;
+        return ret;
     }
 protected:
     virtual std::string _type() const override { return "TAG_Int_Array"; }
@@ -682,20 +920,27 @@ protected:
         return ret;
     }
 public:
-    TAG_Int_Array(const std::string &s, const int_array_t &v):
-        TAG(s), value(v)
+    TAG_Int_Array(std::string_view s, const int_array_t &v,
+            std::pmr::memory_resource *mr = nullptr):
+            TAG(s,mr), value(v,_resource(mr))
     {
         if (v.size() >= 0x80000000)
             throw "nbt array cannot be longer than 2147483647";
     }
+    TAG_Int_Array(std::string_view s, int_array_t &&v,
+            std::pmr::memory_resource *mr = nullptr):
+            TAG(s,mr), value(std::move(v),_resource(mr))
+    {
+        if (value.size() >= 0x80000000)
+            throw "nbt array cannot be longer than 2147483647";
+    }
     int8_t id() const override { return 11; }
     size_t payloadSize() const override { return 4 + value.size()*4; }
-    void writePayload(char *p) const override
+    char *writePayload(char *p) const override
     {
         _to_bytes(p,(int32_t)(value.size()));
-        p += 4;
-        for (size_t i = 0; i < value.size(); ++i)
-            _to_bytes(p+i*4,value[i]);
+        _to_bytes_array(p+4,value.data(),value.size());
+        return p + 4 + value.size()*sizeof(value[0]);
     }
 };
 
@@ -703,25 +948,28 @@ public:
 class TAG_Long_Array: public TAG
 {
     friend class TAG;
+    friend class NbtJsonWriter;
+    // unpacks block states and heightmaps straight from the array
+    friend class PackedArray;
 private:
     long_array_t value;
     static TAG_Long_Array *decodePayload(const char *&ptr, const char *end,
-            const std::string &name)
+            std::string_view name, std::pmr::memory_resource *mr)
     {
         if (ptr+4 > end)
             throw "nbt parsing tag_long_array, cannot parse length";
         size_t len = (uint32_t)_from_bytes_int(ptr);
         ptr += 4;
-        if (ptr + len*8 > end)
+        if (len > (size_t)(end-ptr)/8)
             throw "nbt parsing tag_long_array, not enough data";
-        long_array_t value;
+        // filled in place so the array is allocated once
+        TAG_Long_Array *ret = _new<TAG_Long_Array>(mr,name,
+                long_array_t(_resource(mr)),mr);
+        long_array_t &value = ret->value;
         value.resize(len);
-        for (size_t i = 0; i < len; ++i)
-        {
-            value[i] = _from_bytes_long(ptr);
-            ptr += 8;
-        }
-        return new TAG_Long_Array(name,value);
+        _from_bytes_array(ptr,value.data(),len);
+        ptr += len*8;
+        return ret;
     }
 protected:
     virtual std::string _type() const override { return "TAG_Long_Array"; }
@@ -740,20 +988,27 @@ protected:
         return ret;
     }
 public:
-    TAG_Long_Array(const std::string &s, const long_array_t &v):
-            TAG(s), value(v)
+    TAG_Long_Array(std::string_view s, const long_array_t &v,
+            std::pmr::memory_resource *mr = nullptr):
+            TAG(s,mr), value(v,_resource(mr))
     {
         if (v.size() >= 0x80000000)
             throw "nbt array cannot be longer than 2147483647";
     }
+    TAG_Long_Array(std::string_view s, long_array_t &&v,
+            std::pmr::memory_resource *mr = nullptr):
+            TAG(s,mr), value(std::move(v),_resource(mr))
+    {
+        if (value.size() >= 0x80000000)
+            throw "nbt array cannot be longer than 2147483647";
+    }
     int8_t id() const override { return 12; }
     size_t payloadSize() const override { return 4 + value.size()*8; }
-    void writePayload(char *p) const override
+    char *writePayload(char *p) const override
     {
         _to_bytes(p,(int32_t)(value.size()));
-        p += 4;
-        for (size_t i = 0; i < value.size(); ++i)
-            _to_bytes(p+i*8,value[i]);
+        _to_bytes_array(p+4,value.data(),value.size());
+        return p + 4 + value.size()*sizeof(value[0]);
     }
 };
 
@@ -771,42 +1026,43 @@ class _icharbuf : private std::streambuf
 };
 
 TAG *TAG::decodePayload(const char *&ptr, const char *end, int8_t tid,
-        const std::string &name)
+        std::string_view name, std::pmr::memory_resource *mr)
 {
     switch (tid)
     {
     case 0: // TAG_End
         return nullptr;
     case 1: // TAG_Byte
-        return TAG_Byte::decodePayload(ptr,end,name);
+        return TAG_Byte::decodePayload(ptr,end,name,mr);
     case 2: // TAG_Short
-        return TAG_Short::decodePayload(ptr,end,name);
+        return TAG_Short::decodePayload(ptr,end,name,mr);
     case 3: // TAG_Int
-        return TAG_Int::decodePayload(ptr,end,name);
+        return TAG_Int::decodePayload(ptr,end,name,mr);
     case 4: // TAG_Long
-        return TAG_Long::decodePayload(ptr,end,name);
+        return TAG_Long::decodePayload(ptr,end,name,mr);
     case 5: // TAG_Float
-        return TAG_Float::decodePayload(ptr,end,name);
+        return TAG_Float::decodePayload(ptr,end,name,mr);
     case 6: // TAG_Double
-        return TAG_Double::decodePayload(ptr,end,name);
+        return TAG_Double::decodePayload(ptr,end,name,mr);
     case 7: // TAG_Byte_Array
-        return TAG_Byte_Array::decodePayload(ptr,end,name);
+        return TAG_Byte_Array::decodePayload(ptr,end,name,mr);
     case 8: // TAG_String
-        return TAG_String::decodePayload(ptr,end,name);
+        return TAG_String::decodePayload(ptr,end,name,mr);
     case 9: // TAG_List
-        return TAG_List::decodePayload(ptr,end,name);
+        return TAG_List::decodePayload(ptr,end,name,mr);
     case 10: // TAG_Compound
-        return TAG_Compound::decodePayload(ptr,end,name);
+        return TAG_Compound::decodePayload(ptr,end,name,mr);
     case 11: // TAG_Int_Array
-        return TAG_Int_Array::decodePayload(ptr,end,name);
+        return TAG_Int_Array::decodePayload(ptr,end,name,mr);
     case 12: // TAG_Long_Array
-        return TAG_Long_Array::decodePayload(ptr,end,name);
+        return TAG_Long_Array::decodePayload(ptr,end,name,mr);
     default:
         throw "nbt parsing payload, invalid tag type id";
     }
 }
 
-TAG *TAG::decodeTag(const char *&ptr, const char *end)
+TAG *TAG::decodeTag(const char *&ptr, const char *end,
+        std::pmr::memory_resource *mr)
 {
     if (ptr == end)
         throw "nbt parsing cannot decode tag from empty data";
@@ -819,24 +1075,35 @@ TAG *TAG::decodeTag(const char *&ptr, const char *end)
     ptr += 2;
     if (ptr+len > end)
         throw "nbt parsing cannot decode tag name string";
-    std::string name(ptr,len);
+    std::string_view name(ptr,len);
     ptr += len;
-    return decodePayload(ptr,end,id,name);
+    return decodePayload(ptr,end,id,name,mr);
 }
 
 TAG *TAG::decode(const bytes_t &data)
 {
-    return decode(data.data(),data.size());
+    return decode(data.data(),data.size(),nullptr);
 }
 
 TAG *TAG::decode(const char *data, size_t len)
+{
+    return decode(data,len,nullptr);
+}
+
+TAG *TAG::decode(const bytes_t &data, std::pmr::memory_resource *mr)
+{
+    return decode(data.data(),data.size(),mr);
+}
+
+TAG *TAG::decode(const char *data, size_t len, std::pmr::memory_resource *mr)
 {
     const char *ptr = data;
     const char *end = data+len;
-    TAG *ret = decodeTag(ptr,end);
+    TAG *ret = decodeTag(ptr,end,mr);
     if (ptr != end)
     {
-        delete ret;
+        if (!mr)
+            delete ret;
         throw "nbt parsing terminated with extra data at end";
     }
     return ret;
@@ -0,0 +1,468 @@
+/*
+Benchmark for NBT decoding, heap allocated trees vs arena allocated trees and
+the ways to read NBT without building a whole tree
+
+nbt_bench [file.nbt] [iterations] [hold]
+
+Decodes an uncompressed NBT file (or a generated chunk of about 30k tags when
+no file is given) repeatedly and prints one key=value line per mode:
+- heap: TAG::decode then delete, with decode and free time per tree, MB/s, ns
+  per tag and heap allocations per decode
+- arena: TAG::decode into an Arena that is reset before each decode, same
+  numbers as heap
+- view: time to read DataVersion and xPos through an NbtView without decoding
+  (it skips the subtrees in front of them)
+- query: an NbtQuery selecting the block states and entity ids, with bytes
+  skipped and decoded per run
+- sax: NbtParser events fed in 16 KB pieces (like output of a decompressor)
+- tape: building an NbtTape (stage 1) and materializing the tree from it on
+  one thread and on a ThreadPool of all cores
+- arrays: decoding and encoding an 8 MB TAG_Long_Array alone
+- encode: TAG::encode on the input and on a document of 500 nested compounds
+  (its time per tag shows encoding stays linear in the nesting depth)
+Peak RSS for heap and arena is measured in a child process that keeps `hold`
+decoded trees alive at once (like a region worth of chunks), against the
+baseline line.
+*/
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <vector>
+
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "arena.hpp"
+#include "jrand.hpp"
+#include "nbt.hpp"
+#include "nbt_path.hpp"
+#include "nbt_sax.hpp"
+#include "nbt_tape.hpp"
+#include "nbt_view.hpp"
+
+// count heap allocations made by the whole program, the replacement operators
+// use malloc and free which gcc flags as mismatched once they are inlined
+static std::atomic<size_t> allocs(0);
+
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+
+void *operator new(size_t n)
+{
+    ++allocs;
+    void *p = malloc(n ? n : 1);
+    if (!p)
+        throw std::bad_alloc();
+    return p;
+}
+
+void operator delete(void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+
+using namespace mclib;
+
+// synthetic chunk shaped like a 1.18 chunk: sections with block state
+// palettes, heightmaps, block entities and entities
+static TAG *make_chunk(size_t entities)
+{
+    Random r(8645836755261LL);
+    compound_t root;
+    root["DataVersion"] = new TAG_Int("DataVersion",2975);
+    root["xPos"] = new TAG_Int("xPos",-12);
+    root["zPos"] = new TAG_Int("zPos",31);
+    root["Status"] = new TAG_String("Status","full");
+    root["LastUpdate"] = new TAG_Long("LastUpdate",r.nextLong());
+    root["InhabitedTime"] = new TAG_Long("InhabitedTime",r.nextLong());
+    const char *blocks[] = {"minecraft:stone","minecraft:dirt",
+            "minecraft:grass_block","minecraft:deepslate","minecraft:water",
+            "minecraft:oak_stairs","minecraft:redstone_wire","minecraft:air"};
+    list_t sections;
+    for (int y = -4; y < 20; ++y)
+    {
+        compound_t sec;
+        sec["Y"] = new TAG_Byte("Y",(int8_t)y);
+        list_t palette;
+        for (size_t i = 0; i < 24; ++i)
+        {
+            compound_t entry;
+            entry["Name"] = new TAG_String("Name",blocks[r.nextInt(8)]);
+            compound_t props;
+            props["facing"] = new TAG_String("facing","north");
+            props["half"] = new TAG_String("half","bottom");
+            props["waterlogged"] = new TAG_String("waterlogged","false");
+            entry["Properties"] = new TAG_Compound("Properties",props);
+            palette.push_back(new TAG_Compound("",entry));
+        }
+        long_array_t data(256);
+        for (int64_t &v : data)
+            v = r.nextLong();
+        compound_t states;
+        states["palette"] = new TAG_List("palette",palette);
+        states["data"] = new TAG_Long_Array("data",data);
+        sec["block_states"] = new TAG_Compound("block_states",states);
+        byte_array_t light(2048);
+        for (int8_t &v : light)
+            v = (int8_t)r.nextInt(256);
+        sec["SkyLight"] = new TAG_Byte_Array("SkyLight",light);
+        sec["BlockLight"] = new TAG_Byte_Array("BlockLight",light);
+        sections.push_back(new TAG_Compound("",sec));
+    }
+    root["sections"] = new TAG_List("sections",sections);
+    compound_t heightmaps;
+    const char *hm[] = {"MOTION_BLOCKING","MOTION_BLOCKING_NO_LEAVES",
+            "OCEAN_FLOOR","WORLD_SURFACE"};
+    for (const char *name : hm)
+    {
+        long_array_t data(37);
+        for (int64_t &v : data)
+            v = r.nextLong();
+        heightmaps[name] = new TAG_Long_Array(name,data);
+    }
+    root["Heightmaps"] = new TAG_Compound("Heightmaps",heightmaps);
+    list_t ents;
+    for (size_t i = 0; i < entities; ++i)
+    {
+        compound_t e;
+        e["id"] = new TAG_String("id","minecraft:chest");
+        e["x"] = new TAG_Int("x",r.nextInt(16));
+        e["y"] = new TAG_Int("y",r.nextInt(256));
+        e["z"] = new TAG_Int("z",r.nextInt(16));
+        e["keepPacked"] = new TAG_Byte("keepPacked",0);
+        list_t items;
+        for (size_t j = 0; j < 9; ++j)
+        {
+            compound_t item;
+            item["Slot"] = new TAG_Byte("Slot",(int8_t)j);
+            item["id"] = new TAG_String("id","minecraft:iron_ingot");
+            item["Count"] = new TAG_Byte("Count",(int8_t)r.nextInt(64));
+            compound_t tag;
+            tag["Damage"] = new TAG_Int("Damage",r.nextInt(100));
+            tag["RepairCost"] = new TAG_Int("RepairCost",0);
+            item["tag"] = new TAG_Compound("tag",tag);
+            items.push_back(new TAG_Compound("",item));
+        }
+        e["Items"] = new TAG_List("Items",items);
+        list_t pos;
+        for (size_t j = 0; j < 3; ++j)
+            pos.push_back(new TAG_Double("",r.nextDouble()*1000));
+        e["Pos"] = new TAG_List("Pos",pos);
+        e["UUID"] = new TAG_Int_Array("UUID",int_array_t{1,2,3,4});
+        ents.push_back(new TAG_Compound("",e));
+    }
+    root["block_entities"] = new TAG_List("block_entities",ents);
+    return new TAG_Compound("",root);
+}
+
+// compounds nested depth levels deep, each with a few values and a list
+static TAG *make_deep(size_t depth)
+{
+    TAG *inner = nullptr;
+    for (size_t d = depth; d-- > 0;)
+    {
+        compound_t c;
+        c["depth"] = new TAG_Int("depth",(int32_t)d);
+        c["name"] = new TAG_String("name","level" + std::to_string(d));
+        list_t l;
+        l.push_back(new TAG_Float("",0.5f));
+        l.push_back(new TAG_Float("",1.5f));
+        c["list"] = new TAG_List("list",l);
+        if (inner)
+            c["next"] = inner;
+        inner = new TAG_Compound(d ? "next" : "",c);
+    }
+    return inner;
+}
+
+// number of tags in a payload of type tid at p (moves p past it)
+static size_t count_payload(const char *&p, int8_t tid)
+{
+    switch (tid)
+    {
+    case 1: p += 1; return 1;
+    case 2: p += 2; return 1;
+    case 3: case 5: p += 4; return 1;
+    case 4: case 6: p += 8; return 1;
+    case 7: p += 4 + (uint32_t)_from_bytes_int(p); return 1;
+    case 8: p += 2 + (uint16_t)_from_bytes_short(p); return 1;
+    case 11: p += 4 + 4*(size_t)(uint32_t)_from_bytes_int(p); return 1;
+    case 12: p += 4 + 8*(size_t)(uint32_t)_from_bytes_int(p); return 1;
+    case 9:
+    {
+        int8_t t = *p;
+        size_t len = (uint32_t)_from_bytes_int(p+1);
+        p += 5;
+        size_t n = 1;
+        for (size_t i = 0; i < len; ++i)
+            n += count_payload(p,t);
+        return n;
+    }
+    case 10:
+    {
+        size_t n = 1;
+        int8_t t;
+        while ((t = *p++))
+        {
+            p += 2 + (uint16_t)_from_bytes_short(p);
+            n += count_payload(p,t);
+        }
+        return n;
+    }
+    default:
+        return 0;
+    }
+}
+
+static size_t count_tags(const bytes_t &data)
+{
+    const char *p = data.data();
+    int8_t t = *p++;
+    p += 2 + (uint16_t)_from_bytes_short(p);
+    return count_payload(p,t);
+}
+
+static double now()
+{
+    return mclib::_nanotime() / 1e9;
+}
+
+// peak RSS (KB) of a child that decodes `hold` trees and keeps them
+template <typename F>
+static long child_rss(F f)
+{
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        f();
+        _exit(0);
+    }
+    int status;
+    struct rusage ru;
+    if (wait4(pid,&status,0,&ru) != pid || !WIFEXITED(status)
+            || WEXITSTATUS(status) != 0)
+        return -1;
+    return ru.ru_maxrss;
+}
+
+int main(int argc, char **argv)
+{
+    bytes_t data;
+    if (argc > 1 && std::string(argv[1]) != "-")
+    {
+        FILE *f = fopen(argv[1],"rb");
+        if (!f)
+        {
+            perror(argv[1]);
+            return 2;
+        }
+        char buf[1 << 16];
+        size_t n;
+        while ((n = fread(buf,1,sizeof(buf),f)) > 0)
+            data.insert(data.end(),buf,buf+n);
+        fclose(f);
+    }
+    else
+    {
+        TAG *chunk = make_chunk(450);
+        data = chunk->encode();
+        delete chunk;
+    }
+    size_t iters = argc > 2 ? std::stoul(argv[2]) : 200;
+    size_t hold = argc > 3 ? std::stoul(argv[3]) : 256;
+    size_t tags = count_tags(data);
+    printf("input bytes=%zu tags=%zu\n",data.size(),tags);
+
+    // heap mode
+    {
+        double dec = 0, del = 0;
+        size_t a0 = allocs;
+        for (size_t i = 0; i < iters; ++i)
+        {
+            double t0 = now();
+            TAG *t = TAG::decode(data);
+            double t1 = now();
+            delete t;
+            del += now() - t1;
+            dec += t1 - t0;
+        }
+        size_t a = (allocs - a0) / iters;
+        long rss = child_rss([&]
+        {
+            std::vector<TAG*> trees;
+            for (size_t i = 0; i < hold; ++i)
+                trees.push_back(TAG::decode(data));
+        });
+        printf("mode=heap decode_us=%.2f free_us=%.2f MB_per_s=%.1f "
+                "ns_per_tag=%.2f allocs_per_decode=%zu hold=%zu "
+                "peak_rss_kb=%ld\n",dec/iters*1e6,del/iters*1e6,
+                data.size()*iters/dec/1e6,dec/iters/tags*1e9,a,hold,rss);
+    }
+    // arena mode
+    {
+        Arena arena;
+        TAG::decode(data,&arena); // warm up, blocks are kept after this
+        double dec = 0, del = 0;
+        size_t a0 = allocs;
+        for (size_t i = 0; i < iters; ++i)
+        {
+            double t0 = now();
+            arena.reset();
+            double t1 = now();
+            TAG::decode(data,&arena);
+            dec += now() - t1;
+            del += t1 - t0;
+        }
+        size_t a = (allocs - a0) / iters;
+        size_t used = arena.used();
+        long rss = child_rss([&]
+        {
+            Arena held;
+            for (size_t i = 0; i < hold; ++i)
+                TAG::decode(data,&held);
+        });
+        printf("mode=arena decode_us=%.2f free_us=%.2f MB_per_s=%.1f "
+                "ns_per_tag=%.2f allocs_per_decode=%zu hold=%zu "
+                "peak_rss_kb=%ld arena_bytes=%zu\n",dec/iters*1e6,
+                del/iters*1e6,data.size()*iters/dec/1e6,dec/iters/tags*1e9,a,
+                hold,rss,used);
+    }
+    // view mode, no tree is built
+    {
+        double t0 = now();
+        int64_t sum = 0;
+        for (size_t i = 0; i < iters; ++i)
+        {
+            NbtView root = NbtView::root(data.data(),data.size());
+            NbtView v = root["DataVersion"];
+            NbtView x = root["xPos"];
+            if (!x)
+                x = root.find("Level.xPos");
+            sum += (v ? v.asInteger() : 0) + (x ? x.asInteger() : 0);
+        }
+        double dt = now() - t0;
+        size_t a0 = allocs;
+        NbtView::root(data.data(),data.size()).payloadEnd();
+        printf("mode=view lookup_us=%.3f scan_allocs=%zu check=%lld\n",
+                dt/iters*1e6,allocs-a0,(long long)sum);
+    }
+    // query mode, only the selected values are decoded
+    {
+        NbtQuery q({"sections[*].block_states","Level.Sections[*].BlockStates",
+                "block_entities[*].id","Level.Entities[*].id"});
+        Arena arena;
+        NbtQueryStats st;
+        size_t found = 0;
+        double t0 = now();
+        for (size_t i = 0; i < iters; ++i)
+        {
+            arena.reset();
+            st = q.run(data.data(),data.size(),[&](size_t, TAG*) { ++found; },
+                    &arena);
+        }
+        double dt = now() - t0;
+        printf("mode=query query_us=%.2f matches=%zu bytes=%zu skipped=%zu "
+                "decoded=%zu scanned=%zu\n",dt/iters*1e6,found/iters,st.bytes,
+                st.skipped,st.decoded,st.scanned());
+    }
+    // sax mode, events counted by a visitor
+    {
+        struct Counter: NbtVisitor
+        {
+            size_t n = 0;
+            void beginCompound(std::string_view) { ++n; }
+            void beginList(std::string_view, int8_t, size_t) { ++n; }
+            void scalar(std::string_view, const NbtScalar&) { ++n; }
+            void beginArray(std::string_view, int8_t, size_t) { ++n; }
+        } counter;
+        NbtParser<Counter> parser(counter);
+        size_t a0 = allocs;
+        double t0 = now();
+        for (size_t i = 0; i < iters; ++i)
+        {
+            parser.reset();
+            for (size_t j = 0; j < data.size(); j += 16384)
+                parser.feed(data.data()+j,
+                        std::min((size_t)16384,data.size()-j));
+            parser.finish();
+        }
+        double dt = now() - t0;
+        printf("mode=sax decode_us=%.2f MB_per_s=%.1f ns_per_tag=%.2f "
+                "allocs_per_decode=%zu tags=%zu\n",dt/iters*1e6,
+                data.size()*iters/dt/1e6,dt/iters/tags*1e9,
+                (allocs-a0)/iters,counter.n/iters);
+    }
+    // tape mode, structural index then trees from it
+    {
+        NbtTape tape;
+        size_t a0 = allocs;
+        double t0 = now();
+        for (size_t i = 0; i < iters; ++i)
+            tape.build(data.data(),data.size());
+        double scan = now() - t0;
+        size_t scan_allocs = allocs - a0;
+        t0 = now();
+        for (size_t i = 0; i < iters; ++i)
+            delete tape.materialize(0);
+        double seq = now() - t0;
+        ThreadPool pool;
+        t0 = now();
+        for (size_t i = 0; i < iters; ++i)
+            delete tape.materialize(0,pool,16384);
+        double par = now() - t0;
+        printf("mode=tape scan_us=%.2f scan_MB_per_s=%.1f scan_allocs=%zu "
+                "entries=%zu materialize_us=%.2f parallel_us=%.2f "
+                "threads=%zu\n",
+                scan/iters*1e6,data.size()*iters/scan/1e6,scan_allocs/iters,
+                tape.size(),seq/iters*1e6,par/iters*1e6,pool.size());
+    }
+    // big endian array codecs
+    {
+        long_array_t big(1 << 20);
+        for (size_t i = 0; i < big.size(); ++i)
+            big[i] = (int64_t)(i*0x9e3779b97f4a7c15ull);
+        TAG *t = new TAG_Long_Array("",std::move(big));
+        bytes_t enc = t->encode();
+        size_t reps = iters/10 ? iters/10 : 1;
+        Arena arena;
+        double dec = 0, wr = 0;
+        for (size_t i = 0; i < reps; ++i)
+        {
+            double t0 = now();
+            arena.reset();
+            TAG::decode(enc,&arena);
+            double t1 = now();
+            t->writeNbt(enc.data());
+            wr += now() - t1;
+            dec += t1 - t0;
+        }
+        delete t;
+        printf("mode=arrays bytes=%zu decode_MB_per_s=%.1f "
+                "encode_MB_per_s=%.1f\n",enc.size(),enc.size()*reps/dec/1e6,
+                enc.size()*reps/wr/1e6);
+    }
+    // encoding
+    {
+        TAG *tree = TAG::decode(data);
+        TAG *deep = make_deep(500);
+        std::pair<const char*,TAG*> inputs[] = {{"input",tree},{"deep",deep}};
+        for (auto &in : inputs)
+        {
+            bytes_t enc = in.second->encode();
+            double t0 = now();
+            for (size_t i = 0; i < iters; ++i)
+                enc = in.second->encode();
+            double dt = now() - t0;
+            printf("mode=encode doc=%s bytes=%zu encode_us=%.2f "
+                    "MB_per_s=%.1f\n",in.first,enc.size(),dt/iters*1e6,
+                    enc.size()*iters/dt/1e6);
+            delete in.second;
+        }
+    }
+    // baseline for the RSS numbers
+    long base = child_rss([]{});
+    printf("baseline peak_rss_kb=%ld\n",base);
+    return 0;
+}
@@ -0,0 +1,387 @@
+/*
+Compressed NBT input and output (gzip and zlib)
+
+level.dat and playerdata files are gzip compressed, region chunks are zlib
+(or gzip/uncompressed, the same compression ids 1, 2 and 3 as mca.py are used
+here). NbtInflater detects the format from the first bytes and inflates into a
+buffer that is kept between calls, so decoding many files or chunks with one
+inflater allocates only when a larger output than before is seen. For gzip
+the output size is known from the trailer. Uncompressed input is passed
+through without a copy. parse() instead streams the output in 64 KB pieces
+to an NbtParser so the whole uncompressed document is never held at once.
+
+NbtDeflater compresses with a selectable level, reusing its stream and output
+buffer in the same way.
+
+zlib is required (link with -lz). Building with -DMCLIB_LIBDEFLATE (and
+-ldeflate) makes whole buffer inflate and deflate use libdeflate, which is
+faster than zlib, streaming parse() always uses zlib.
+
+Inflaters and deflaters are not thread safe, use one per thread.
+*/
+
+#pragma once
+
+#include <climits>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory_resource>
+#include <string>
+#include <string_view>
+
+#include <zlib.h>
+
+#ifdef MCLIB_LIBDEFLATE
+#include <libdeflate.h>
+#endif
+
+#include "mapped_file.hpp"
+#include "nbt.hpp"
+#include "nbt_sax.hpp"
+
+namespace mclib
+{
+
+// compression ids (same as region files)
+const int NBT_GZIP = 1;
+const int NBT_ZLIB = 2;
+const int NBT_RAW = 3;
+
+// compression of data from its header bytes
+static inline int nbtCompression(const char *data, size_t len)
+{
+    if (len < 2)
+        return NBT_RAW;
+    uint8_t b0 = (uint8_t)data[0], b1 = (uint8_t)data[1];
+    if (b0 == 0x1f && b1 == 0x8b)
+        return NBT_GZIP;
+    // deflate method with a header check that is a multiple of 31
+    if ((b0 & 0x0f) == 8 && (b0 >> 4) <= 7 && (b0*256 + b1) % 31 == 0)
+        return NBT_ZLIB;
+    return NBT_RAW;
+}
+
+class NbtInflater
+{
+private:
+    z_stream zs;
+    bytes_t buf;
+    // output pieces for parse()
+    bytes_t piece;
+#ifdef MCLIB_LIBDEFLATE
+    libdeflate_decompressor *ld;
+#endif
+    // start inflating [data,data+len), gzip or zlib header detected by zlib
+    void _start(const char *data, size_t len)
+    {
+        if (len > UINT_MAX)
+            throw "nbt inflate input larger than 4 GiB";
+        if (inflateReset(&zs) != Z_OK)
+            throw "nbt inflate cannot reset stream";
+        zs.next_in = (Bytef*)data;
+        zs.avail_in = (uInt)len;
+    }
+    // inflate into [out,out+n), true at the end of the data
+    bool _step(char *out, size_t n, int compression)
+    {
+        zs.next_out = (Bytef*)out;
+        zs.avail_out = (uInt)(n > UINT_MAX ? UINT_MAX : n);
+        int r = ::inflate(&zs,Z_NO_FLUSH);
+        if (r == Z_STREAM_END)
+        {
+            // gzip files can have several members
+            if (compression == NBT_GZIP && zs.avail_in >= 2
+                    && zs.next_in[0] == 0x1f && zs.next_in[1] == 0x8b)
+            {
+                Bytef *next = zs.next_in;
+                uInt avail = zs.avail_in;
+                inflateReset(&zs);
+                zs.next_in = next;
+                zs.avail_in = avail;
+                return false;
+            }
+            if (zs.avail_in)
+                throw "nbt inflate extra data after compressed stream";
+            return true;
+        }
+        if (r == Z_BUF_ERROR && zs.avail_out)
+            throw "nbt inflate compressed data is truncated";
+        if (r != Z_OK && r != Z_BUF_ERROR)
+            throw "nbt inflate compressed data is invalid";
+        return false;
+    }
+    // output size expected for compressed input (grown if it is more)
+    static size_t _guess(const char *data, size_t len, int compression)
+    {
+        // gzip trailer has the size mod 2^32, deflate cannot expand more
+        // than about 1032 times so a corrupt trailer cannot ask for more
+        if (compression == NBT_GZIP && len >= 18)
+        {
+            size_t n = (uint32_t)((uint8_t)data[len-4]
+                    | (uint8_t)data[len-3] << 8 | (uint8_t)data[len-2] << 16
+                    | (uint32_t)(uint8_t)data[len-1] << 24);
+            return (n < 1032*len ? n : 1032*len) + 1;
+        }
+        return 4*len + 1024;
+    }
+public:
+    NbtInflater()
+    {
+        memset(&zs,0,sizeof(zs));
+        // 15 bit window, 32 detects gzip or zlib headers
+        if (inflateInit2(&zs,15+32) != Z_OK)
+            throw "nbt inflate cannot initialize zlib";
+#ifdef MCLIB_LIBDEFLATE
+        ld = libdeflate_alloc_decompressor();
+        if (!ld)
+        {
+            inflateEnd(&zs);
+            throw "nbt inflate cannot initialize libdeflate";
+        }
+#endif
+    }
+    ~NbtInflater()
+    {
+        inflateEnd(&zs);
+#ifdef MCLIB_LIBDEFLATE
+        libdeflate_free_decompressor(ld);
+#endif
+    }
+    NbtInflater(const NbtInflater&) = delete;
+    NbtInflater &operator=(const NbtInflater&) = delete;
+    // uncompressed bytes of data (compression 0 detects it), valid until the
+    // next call (or as long as data for uncompressed input)
+    std::string_view inflate(const char *data, size_t len, int compression = 0)
+    {
+        if (compression == 0)
+            compression = nbtCompression(data,len);
+        if (compression == NBT_RAW)
+            return std::string_view(data,len);
+        if (compression != NBT_GZIP && compression != NBT_ZLIB)
+            throw "nbt inflate unknown compression";
+        size_t guess = _guess(data,len,compression);
+        if (buf.size() < guess)
+            buf.resize(guess);
+#ifdef MCLIB_LIBDEFLATE
+        for (;;)
+        {
+            size_t in = 0, out = 0;
+            libdeflate_result r = compression == NBT_GZIP
+                ? libdeflate_gzip_decompress_ex(ld,data,len,buf.data(),
+                        buf.size(),&in,&out)
+                : libdeflate_zlib_decompress_ex(ld,data,len,buf.data(),
+                        buf.size(),&in,&out);
+            if (r == LIBDEFLATE_INSUFFICIENT_SPACE)
+            {
+                buf.resize(2*buf.size());
+                continue;
+            }
+            if (r != LIBDEFLATE_SUCCESS)
+                throw "nbt inflate compressed data is invalid";
+            // other gzip members go through zlib
+            if (in == len)
+                return std::string_view(buf.data(),out);
+            break;
+        }
+#endif
+        _start(data,len);
+        size_t out = 0;
+        for (;;)
+        {
+            if (out == buf.size())
+                buf.resize(2*buf.size());
+            bool end = _step(buf.data()+out,buf.size()-out,compression);
+            out = (char*)zs.next_out - buf.data();
+            if (end)
+                break;
+        }
+        return std::string_view(buf.data(),out);
+    }
+    // decode the (compressed) document in data
+    TAG *decode(const char *data, size_t len,
+            std::pmr::memory_resource *mr = nullptr)
+    {
+        std::string_view raw = inflate(data,len);
+        return TAG::decode(raw.data(),raw.size(),mr);
+    }
+    // stream the uncompressed document in data to parser in pieces
+    template <typename Visitor>
+    void parse(const char *data, size_t len, NbtParser<Visitor> &parser,
+            int compression = 0)
+    {
+        if (compression == 0)
+            compression = nbtCompression(data,len);
+        if (compression == NBT_RAW)
+        {
+            parser.parse(data,len);
+            return;
+        }
+        if (compression != NBT_GZIP && compression != NBT_ZLIB)
+            throw "nbt inflate unknown compression";
+        piece.resize(1 << 16);
+        parser.reset();
+        _start(data,len);
+        for (;;)
+        {
+            bool end = _step(piece.data(),piece.size(),compression);
+            size_t n = (char*)zs.next_out - piece.data();
+            if (n)
+                parser.feed(piece.data(),n);
+            if (end)
+                break;
+        }
+        parser.finish();
+    }
+    // memory kept for output
+    size_t capacity() const { return buf.capacity() + piece.capacity(); }
+};
+
+class NbtDeflater
+{
+private:
+    z_stream zs;
+    // format and level zs is set up for (0 when there is none)
+    int zformat, zlevel;
+    bytes_t buf;
+    // encoded tags before compression
+    bytes_t raw;
+#ifdef MCLIB_LIBDEFLATE
+    libdeflate_compressor *lc;
+    int llevel;
+#endif
+    void _setup(int compression, int level)
+    {
+        if (zformat == compression && zlevel == level)
+        {
+            deflateReset(&zs);
+            return;
+        }
+        if (zformat)
+            deflateEnd(&zs);
+        zformat = 0;
+        memset(&zs,0,sizeof(zs));
+        // 16 added to the window bits writes a gzip header
+        if (deflateInit2(&zs,level,Z_DEFLATED,
+                compression == NBT_GZIP ? 15+16 : 15,8,Z_DEFAULT_STRATEGY)
+                != Z_OK)
+            throw "nbt deflate cannot initialize zlib";
+        zformat = compression;
+        zlevel = level;
+    }
+public:
+    NbtDeflater(): zformat(0), zlevel(0)
+    {
+#ifdef MCLIB_LIBDEFLATE
+        lc = nullptr;
+        llevel = -1;
+#endif
+    }
+    ~NbtDeflater()
+    {
+        if (zformat)
+            deflateEnd(&zs);
+#ifdef MCLIB_LIBDEFLATE
+        if (lc)
+            libdeflate_free_compressor(lc);
+#endif
+    }
+    NbtDeflater(const NbtDeflater&) = delete;
+    NbtDeflater &operator=(const NbtDeflater&) = delete;
+    // data compressed with level 0 (none) to 9 (smallest) or -1 (zlib
+    // default), valid until the next call (data itself for NBT_RAW)
+    std::string_view deflate(const char *data, size_t len,
+            int compression = NBT_GZIP, int level = Z_DEFAULT_COMPRESSION)
+    {
+        if (compression == NBT_RAW)
+            return std::string_view(data,len);
+        if (compression != NBT_GZIP && compression != NBT_ZLIB)
+            throw "nbt deflate unknown compression";
+        if (level < -1 || level > 9)
+            throw "nbt deflate level must be -1 to 9";
+        if (len > UINT_MAX)
+            throw "nbt deflate input larger than 4 GiB";
+#ifdef MCLIB_LIBDEFLATE
+        int l = level < 0 ? 6 : level;
+        if (!lc || llevel != l)
+        {
+            if (lc)
+                libdeflate_free_compressor(lc);
+            lc = libdeflate_alloc_compressor(l);
+            if (!lc)
+                throw "nbt deflate cannot initialize libdeflate";
+            llevel = l;
+        }
+        size_t bound = compression == NBT_GZIP
+            ? libdeflate_gzip_compress_bound(lc,len)
+            : libdeflate_zlib_compress_bound(lc,len);
+        if (buf.size() < bound)
+            buf.resize(bound);
+        size_t n = compression == NBT_GZIP
+            ? libdeflate_gzip_compress(lc,data,len,buf.data(),buf.size())
+            : libdeflate_zlib_compress(lc,data,len,buf.data(),buf.size());
+        if (!n)
+            throw "nbt deflate failed";
+        return std::string_view(buf.data(),n);
+#else
+        _setup(compression,level);
+        // gzip header and trailer are not in the zlib bound
+        size_t bound = deflateBound(&zs,(uLong)len) + 32;
+        if (buf.size() < bound)
+            buf.resize(bound);
+        zs.next_in = (Bytef*)data;
+        zs.avail_in = (uInt)len;
+        zs.next_out = (Bytef*)buf.data();
+        zs.avail_out = (uInt)(bound > UINT_MAX ? UINT_MAX : bound);
+        if (::deflate(&zs,Z_FINISH) != Z_STREAM_END)
+            throw "nbt deflate failed";
+        return std::string_view(buf.data(),(char*)zs.next_out - buf.data());
+#endif
+    }
+    // compressed encoding of t
+    std::string_view encode(const TAG &t, int compression = NBT_GZIP,
+            int level = Z_DEFAULT_COMPRESSION)
+    {
+        raw.clear();
+        t.encode(raw);
+        return deflate(raw.data(),raw.size(),compression,level);
+    }
+};
+
+// one inflater and deflater per thread for the file functions
+static inline NbtInflater &_thread_inflater()
+{
+    static thread_local NbtInflater inflater;
+    return inflater;
+}
+
+static inline NbtDeflater &_thread_deflater()
+{
+    static thread_local NbtDeflater deflater;
+    return deflater;
+}
+
+// decode an nbt file (gzip, zlib or uncompressed), the file is memory mapped
+// and inflated into a buffer kept for the calling thread
+static inline TAG *loadNbt(const std::string &path,
+        std::pmr::memory_resource *mr = nullptr)
+{
+    MappedFile f(path);
+    f.willNeed();
+    return _thread_inflater().decode(f.data(),f.size(),mr);
+}
+
+// write t to a file, gzip compressed by default like level.dat
+static inline void saveNbt(const std::string &path, const TAG &t,
+        int compression = NBT_GZIP, int level = Z_DEFAULT_COMPRESSION)
+{
+    std::string_view data = _thread_deflater().encode(t,compression,level);
+    FILE *f = fopen(path.c_str(),"wb");
+    if (!f)
+        throw "nbt file cannot be opened for writing";
+    size_t n = fwrite(data.data(),1,data.size(),f);
+    if (fclose(f) != 0 || n != data.size())
+        throw "nbt file write failed";
+}
+
+}
@@ -0,0 +1,152 @@
+#include <cassert>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "arena.hpp"
+#include "nbt.hpp"
+#include "nbt_io.hpp"
+#include "nbt_test_docs.hpp"
+
+using namespace mclib;
+
+static bytes_t make_doc(size_t n)
+{
+    compound_t root;
+    root["DataVersion"] = new TAG_Int("DataVersion",2230);
+    list_t items;
+    for (size_t i = 0; i < n; ++i)
+    {
+        compound_t item;
+        item["id"] = new TAG_String("id","minecraft:stone");
+        item["Count"] = new TAG_Byte("Count",(int8_t)(i % 64));
+        items.push_back(new TAG_Compound("",item));
+    }
+    root["Inventory"] = new TAG_List("Inventory",items);
+    long_array_t la(n);
+    for (size_t i = 0; i < la.size(); ++i)
+        la[i] = (int64_t)(i*0x9e3779b97f4a7c15ull);
+    root["Data"] = new TAG_Long_Array("Data",la);
+    return testEncode("",root);
+}
+
+// counts scalar events
+struct Counter: NbtVisitor
+{
+    size_t scalars = 0, longs = 0;
+    using NbtVisitor::arrayChunk;
+    void scalar(std::string_view, const NbtScalar&) { ++scalars; }
+    void arrayChunk(const int64_t*, size_t n) { longs += n; }
+};
+
+int main(int argc, char **argv)
+{
+    (void)argc;
+    (void)argv;
+    NbtInflater inf;
+    NbtDeflater def;
+    // round trips for both formats and several levels, small and large
+    // documents (the output buffer grows and is reused)
+    for (size_t n : {0,10,20000,5})
+    {
+        bytes_t doc = make_doc(n);
+        assert(inf.inflate(doc.data(),doc.size()).data() == doc.data());
+        for (int c : {NBT_GZIP,NBT_ZLIB,NBT_RAW})
+            for (int level : {-1,0,1,9})
+            {
+                std::string_view z = def.deflate(doc.data(),doc.size(),c,level);
+                bytes_t comp(z.begin(),z.end());
+                assert(nbtCompression(comp.data(),comp.size()) == c);
+                std::string_view raw = inf.inflate(comp.data(),comp.size());
+                assert(bytes_t(raw.begin(),raw.end()) == doc);
+                raw = inf.inflate(comp.data(),comp.size(),c);
+                assert(bytes_t(raw.begin(),raw.end()) == doc);
+                TAG *t = inf.decode(comp.data(),comp.size());
+                assert(t->encode() == doc);
+                delete t;
+                // streamed to a parser
+                Counter counter;
+                NbtParser<Counter> parser(counter);
+                inf.parse(comp.data(),comp.size(),parser);
+                assert(counter.scalars == 1 + 2*n && counter.longs == n);
+            }
+    }
+    // gzip input with a wrong size in the trailer and several members
+    {
+        bytes_t doc = make_doc(3000);
+        std::string_view z = def.deflate(doc.data(),doc.size());
+        bytes_t comp(z.begin(),z.end());
+        size_t half = doc.size() / 2;
+        z = def.deflate(doc.data(),half);
+        bytes_t two(z.begin(),z.end());
+        z = def.deflate(doc.data()+half,doc.size()-half);
+        two.insert(two.end(),z.begin(),z.end());
+        NbtInflater fresh;
+        std::string_view raw = fresh.inflate(two.data(),two.size());
+        assert(bytes_t(raw.begin(),raw.end()) == doc);
+        comp[comp.size()-4] ^= 0x55;
+        comp[comp.size()-1] = (char)0xff;
+        bool threw = false;
+        try { NbtInflater().inflate(comp.data(),comp.size()); }
+        catch (const char*) { threw = true; }
+        assert(threw); // zlib checks the size too
+    }
+    // truncated, corrupt and trailing data is rejected
+    {
+        bytes_t doc = make_doc(500);
+        for (int c : {NBT_GZIP,NBT_ZLIB})
+        {
+            std::string_view z = def.deflate(doc.data(),doc.size(),c);
+            bytes_t comp(z.begin(),z.end());
+            for (size_t n = 2; n < comp.size(); n += 37)
+            {
+                bool threw = false;
+                try { inf.inflate(comp.data(),n,c); }
+                catch (const char*) { threw = true; }
+                assert(threw);
+            }
+            bytes_t bad = comp;
+            bad[bad.size()/2] ^= 0x10;
+            bool threw = false;
+            try { delete inf.decode(bad.data(),bad.size()); }
+            catch (const char*) { threw = true; }
+            assert(threw);
+            bad = comp;
+            bad.push_back(0);
+            threw = false;
+            try { inf.inflate(bad.data(),bad.size()); }
+            catch (const char*) { threw = true; }
+            assert(threw);
+        }
+        bool threw = false;
+        try { inf.inflate(doc.data(),doc.size(),7); }
+        catch (const char*) { threw = true; }
+        assert(threw);
+        threw = false;
+        try { def.deflate(doc.data(),doc.size(),NBT_GZIP,10); }
+        catch (const char*) { threw = true; }
+        assert(threw);
+    }
+    // files
+    {
+        bytes_t doc = make_doc(100);
+        TAG *t = TAG::decode(doc);
+        const char *path = "/tmp/nbt_io_test.dat";
+        for (int c : {NBT_GZIP,NBT_ZLIB,NBT_RAW})
+        {
+            saveNbt(path,*t,c,c == NBT_ZLIB ? 9 : -1);
+            Arena arena;
+            TAG *u = loadNbt(path,&arena);
+            assert(u->encode() == doc);
+        }
+        delete t;
+        remove(path);
+        bool threw = false;
+        try { loadNbt(path); }
+        catch (const char*) { threw = true; }
+        assert(threw);
+    }
+    std::cout << "nbt io tests passed" << std::endl;
+    return 0;
+}
@@ -0,0 +1,657 @@
+/*
+NBT to JSON
+
+NbtJsonWriter writes JSON for NBT, either from a decoded tree with write() or
+as the visitor of an NbtParser, so a document can be converted while it is
+inflated without building a tree. Compounds become objects (children in their
+order), lists and arrays become arrays. Strings are converted from the
+modified UTF-8 of NBT (Java's) to UTF-8 and escaped. Floats and doubles are
+written with std::to_chars in the shortest form reading back as the same
+value. The root is wrapped in an object with its name like nbt2json.py does,
+or written alone like the files of world2json.py. Each document ends with a
+newline.
+
+Output is compact by default or indented by a number of spaces per level.
+Indented output keeps the numbers of an array on one line (json.dumps puts
+each on its own line, which is most of the output for chunks).
+
+Text goes through JsonOutput, a buffer flushed to a FILE or appended to a
+string. Space for a whole string or a block of array elements is reserved at
+once so they are formatted without bounds checks. Strings are scanned 32
+(AVX2) or 16 (SSE2) bytes at a time for bytes needing an escape or conversion
+and copied in runs, byte arrays are written from a table of their 256 values.
+
+nbtToJson() converts a (compressed) document in memory, nbtFileToJson() a file.
+WorldJson is a WorldScanner visitor writing each chunk to c.X.Z.json and each
+player file to a .json file in a copy of the world's directories, so a world
+is converted on the decode threads of the scanner (worldToJson()).
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <set>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+#include <sys/stat.h>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#include "mapped_file.hpp"
+#include "nbt.hpp"
+#include "nbt_io.hpp"
+#include "nbt_sax.hpp"
+#include "world.hpp"
+
+namespace mclib
+{
+
+// buffered text output to a file or appended to a string
+class JsonOutput
+{
+private:
+    FILE *file;
+    std::string *str;
+    std::vector<char> buf;
+    size_t used;
+    size_t flushed;
+public:
+    JsonOutput(FILE *f, size_t size = 1 << 16): file(f), str(nullptr),
+            buf(size ? size : 1), used(0), flushed(0) {}
+    JsonOutput(std::string &s, size_t size = 1 << 16): file(nullptr), str(&s),
+            buf(size ? size : 1), used(0), flushed(0) {}
+    JsonOutput(const JsonOutput&) = delete;
+    JsonOutput &operator=(const JsonOutput&) = delete;
+    // call flush() first to see write errors
+    ~JsonOutput()
+    {
+        try { flush(); }
+        catch (const char*) {}
+    }
+    // space for n bytes at the end, commit() what is written in it
+    char *reserve(size_t n)
+    {
+        if (buf.size() - used < n)
+        {
+            flush();
+            if (buf.size() < n)
+                buf.resize(n);
+        }
+        return buf.data() + used;
+    }
+    void commit(char *end) { used = end - buf.data(); }
+    void put(char c)
+    {
+        *reserve(1) = c;
+        ++used;
+    }
+    void write(const char *p, size_t n)
+    {
+        memcpy(reserve(n),p,n);
+        used += n;
+    }
+    void flush()
+    {
+        if (!used)
+            return;
+        size_t n = used;
+        used = 0;
+        if (str)
+            str->append(buf.data(),n);
+        else if (fwrite(buf.data(),1,n,file) != n)
+            throw "json output write failed";
+        flushed += n;
+    }
+    // bytes written (flushed or not)
+    size_t size() const { return flushed + used; }
+};
+
+class NbtJsonWriter
+{
+private:
+    struct _frame
+    {
+        bool compound;
+        bool first;
+    };
+    JsonOutput &out;
+    size_t indent;
+    bool root_name;
+    std::vector<_frame> stack;
+    // newline and the spaces of the deepest level written so far
+    std::string nl;
+    // elements of the current array written
+    size_t arr_n;
+    // text of the byte values, length in the last byte
+    struct _byte_text
+    {
+        char s[256][5];
+        _byte_text()
+        {
+            for (int i = 0; i < 256; ++i)
+            {
+                char *e = std::to_chars(s[i],s[i]+4,(int)(int8_t)i).ptr;
+                s[i][4] = (char)(e - s[i]);
+            }
+        }
+    };
+    void _newline(size_t level)
+    {
+        size_t n = 1 + level*indent;
+        if (nl.size() < n)
+            nl.resize(n,' ');
+        out.write(nl.data(),n);
+    }
+    // separator, indent and key before a value
+    void _value(std::string_view name)
+    {
+        if (stack.empty())
+        {
+            if (!root_name)
+                return;
+            out.put('{');
+            stack.push_back({true,true});
+        }
+        _frame &f = stack.back();
+        if (!f.first)
+            out.put(',');
+        f.first = false;
+        if (indent)
+            _newline(stack.size());
+        if (f.compound)
+        {
+            _string(name);
+            if (indent)
+                out.write(": ",2);
+            else
+                out.put(':');
+        }
+    }
+    // a value finished, the document too if it was the root
+    void _after()
+    {
+        if (stack.size() != (root_name ? 1 : 0))
+            return;
+        if (root_name)
+            _close('}');
+        out.put('\n');
+    }
+    void _open(char c, bool compound)
+    {
+        if (stack.size() > _nbt_max_depth)
+            throw "nbt json nesting too deep";
+        out.put(c);
+        stack.push_back({compound,true});
+    }
+    void _close(char c)
+    {
+        if (stack.empty())
+            throw "nbt json end without a begin";
+        bool empty = stack.back().first;
+        stack.pop_back();
+        if (indent && !empty)
+            _newline(stack.size());
+        out.put(c);
+    }
+    // bytes from q before the first one that is not copied as it is
+    static size_t _plain(const uint8_t *q, const uint8_t *end)
+    {
+        const uint8_t *start = q;
+        // control characters and bytes of 0x80 and up (negative as signed)
+        // compare below space
+#if defined(__AVX2__)
+        const __m256i sp32 = _mm256_set1_epi8(0x20);
+        const __m256i qt32 = _mm256_set1_epi8('"');
+        const __m256i bs32 = _mm256_set1_epi8('\\');
+        for (; q + 32 <= end; q += 32)
+        {
+            __m256i x = _mm256_loadu_si256((const __m256i*)q);
+            __m256i m = _mm256_or_si256(_mm256_cmpgt_epi8(sp32,x),
+                    _mm256_or_si256(_mm256_cmpeq_epi8(x,qt32),
+                    _mm256_cmpeq_epi8(x,bs32)));
+            unsigned bits = (unsigned)_mm256_movemask_epi8(m);
+            if (bits)
+                return q - start + __builtin_ctz(bits);
+        }
+#endif
+#if defined(__SSE2__)
+        const __m128i sp16 = _mm_set1_epi8(0x20);
+        const __m128i qt16 = _mm_set1_epi8('"');
+        const __m128i bs16 = _mm_set1_epi8('\\');
+        for (; q + 16 <= end; q += 16)
+        {
+            __m128i x = _mm_loadu_si128((const __m128i*)q);
+            __m128i m = _mm_or_si128(_mm_cmplt_epi8(x,sp16),
+                    _mm_or_si128(_mm_cmpeq_epi8(x,qt16),
+                    _mm_cmpeq_epi8(x,bs16)));
+            unsigned bits = (unsigned)_mm_movemask_epi8(m);
+            if (bits)
+                return q - start + __builtin_ctz(bits);
+        }
+#endif
+        for (; q < end; ++q)
+            if (*q < 0x20 || *q >= 0x80 || *q == '"' || *q == '\\')
+                break;
+        return q - start;
+    }
+    static char *_u(char *p, unsigned c)
+    {
+        static const char hex[] = "0123456789abcdef";
+        p[0] = '\\';
+        p[1] = 'u';
+        p[2] = hex[c >> 12];
+        p[3] = hex[c >> 8 & 15];
+        p[4] = hex[c >> 4 & 15];
+        p[5] = hex[c & 15];
+        return p + 6;
+    }
+    static bool _cont(const uint8_t *q, const uint8_t *end, size_t i)
+    {
+        return (size_t)(end - q) > i && (q[i] & 0xc0) == 0x80;
+    }
+    // one character at q that _plain() stopped at, at most 6 bytes of output
+    // per byte of input: 0 is C0 80 in modified UTF-8 and characters above
+    // U+FFFF are two encoded surrogates (made into normal UTF-8 here), lone
+    // surrogates are escaped and invalid bytes replaced by U+FFFD
+    static char *_special(char *p, const uint8_t *&q, const uint8_t *end)
+    {
+        unsigned c = *q;
+        if (c < 0x80)
+        {
+            ++q;
+            const char *e = nullptr;
+            switch (c)
+            {
+            case '"': e = "\\\""; break;
+            case '\\': e = "\\\\"; break;
+            case '\n': e = "\\n"; break;
+            case '\r': e = "\\r"; break;
+            case '\t': e = "\\t"; break;
+            case '\b': e = "\\b"; break;
+            case '\f': e = "\\f"; break;
+            default: return _u(p,c);
+            }
+            memcpy(p,e,2);
+            return p + 2;
+        }
+        size_t n = 0;
+        if (c == 0xc0 && _cont(q,end,1) && q[1] == 0x80)
+        {
+            q += 2;
+            return _u(p,0);
+        }
+        if (c >= 0xc2 && c < 0xe0 && _cont(q,end,1))
+            n = 2;
+        else if (c >= 0xe0 && c < 0xf0 && _cont(q,end,1) && _cont(q,end,2))
+        {
+            unsigned u = (c & 15) << 12 | (q[1] & 63) << 6 | (q[2] & 63);
+            if (u >= 0xd800 && u < 0xe000)
+            {
+                // high surrogate followed by a low one
+                if (u < 0xdc00 && end - q >= 6 && q[3] == 0xed
+                        && _cont(q,end,4) && _cont(q,end,5) && q[4] >= 0xb0)
+                {
+                    unsigned l = 0xd000 | (q[4] & 63) << 6 | (q[5] & 63);
+                    unsigned cp = 0x10000 + ((u - 0xd800) << 10) + (l - 0xdc00);
+                    p[0] = (char)(0xf0 | cp >> 18);
+                    p[1] = (char)(0x80 | (cp >> 12 & 63));
+                    p[2] = (char)(0x80 | (cp >> 6 & 63));
+                    p[3] = (char)(0x80 | (cp & 63));
+                    q += 6;
+                    return p + 4;
+                }
+                q += 3;
+                return _u(p,u);
+            }
+            if (u >= 0x800)
+                n = 3;
+        }
+        else if (c >= 0xf0 && c < 0xf5 && _cont(q,end,1) && _cont(q,end,2)
+                && _cont(q,end,3))
+        {
+            unsigned u = (c & 7) << 18 | (q[1] & 63) << 12 | (q[2] & 63) << 6
+                    | (q[3] & 63);
+            if (u >= 0x10000 && u < 0x110000)
+                n = 4;
+        }
+        if (!n)
+        {
+            ++q;
+            memcpy(p,"\xef\xbf\xbd",3);
+            return p + 3;
+        }
+        memcpy(p,q,n);
+        q += n;
+        return p + n;
+    }
+    void _string(std::string_view s)
+    {
+        char *p = out.reserve(6*s.size() + 2);
+        const uint8_t *q = (const uint8_t*)s.data(), *end = q + s.size();
+        *p++ = '"';
+        while (q < end)
+        {
+            size_t n = _plain(q,end);
+            memcpy(p,q,n);
+            p += n;
+            q += n;
+            if (q < end)
+                p = _special(p,q,end);
+        }
+        *p++ = '"';
+        out.commit(p);
+    }
+    template <typename T>
+    void _number(T v)
+    {
+        char *p = out.reserve(32);
+        if constexpr (std::is_floating_point<T>::value)
+            out.commit(_float_chars(p,v));
+        else
+            out.commit(std::to_chars(p,p+32,v).ptr);
+    }
+    // array elements in blocks with space for the longest values
+    template <typename T>
+    void _elements(const T *v, size_t n)
+    {
+        static const _byte_text bytes;
+        const size_t block = 4096;
+        const size_t width = (sizeof(T) == 1 ? 4 : sizeof(T) == 4 ? 11 : 20)
+                + (indent ? 2 : 1);
+        for (size_t i = 0; i < n;)
+        {
+            size_t k = std::min(n - i,block);
+            char *p = out.reserve(k*width + 4);
+            for (size_t end = i + k; i < end; ++i)
+            {
+                if (arr_n++)
+                {
+                    *p++ = ',';
+                    if (indent)
+                        *p++ = ' ';
+                }
+                if constexpr (sizeof(T) == 1)
+                {
+                    const char *s = bytes.s[(uint8_t)v[i]];
+                    memcpy(p,s,4);
+                    p += s[4];
+                }
+                else
+                    p = std::to_chars(p,p+20,v[i]).ptr;
+            }
+            out.commit(p);
+        }
+    }
+    void _tag(std::string_view name, const TAG &t)
+    {
+        NbtScalar v;
+        v.id = t.id();
+        v.l = 0;
+        switch (v.id)
+        {
+        case 1: v.b = static_cast<const TAG_Byte&>(t).value; break;
+        case 2: v.s = static_cast<const TAG_Short&>(t).value; break;
+        case 3: v.i = static_cast<const TAG_Int&>(t).value; break;
+        case 4: v.l = static_cast<const TAG_Long&>(t).value; break;
+        case 5: v.f = static_cast<const TAG_Float&>(t).value; break;
+        case 6: v.d = static_cast<const TAG_Double&>(t).value; break;
+        case 8: v.str = static_cast<const TAG_String&>(t).value; break;
+        case 7:
+        {
+            const byte_array_t &a = static_cast<const TAG_Byte_Array&>(t).value;
+            beginArray(name,7,a.size());
+            arrayChunk(a.data(),a.size());
+            endArray();
+            return;
+        }
+        case 11:
+        {
+            const int_array_t &a = static_cast<const TAG_Int_Array&>(t).value;
+            beginArray(name,11,a.size());
+            arrayChunk(a.data(),a.size());
+            endArray();
+            return;
+        }
+        case 12:
+        {
+            const long_array_t &a = static_cast<const TAG_Long_Array&>(t).value;
+            beginArray(name,12,a.size());
+            arrayChunk(a.data(),a.size());
+            endArray();
+            return;
+        }
+        case 9:
+        {
+            const TAG_List &l = static_cast<const TAG_List&>(t);
+            beginList(name,l.tid,l.value.size());
+            for (TAG *c : l.value)
+                if (c)
+                    _tag("",*c);
+                else // lists of tag_end
+                {
+                    _value("");
+                    out.write("null",4);
+                    _after();
+                }
+            endList();
+            return;
+        }
+        case 10:
+            beginCompound(name);
+            for (TAG *c : static_cast<const TAG_Compound&>(t).value)
+                _tag(c->getName(),*c);
+            endCompound();
+            return;
+        default:
+            throw "nbt json unknown tag type";
+        }
+        scalar(name,v);
+    }
+public:
+    // indent spaces per level (0 for compact output), root_name wraps the
+    // root in an object with its name
+    NbtJsonWriter(JsonOutput &o, size_t indent = 0, bool root_name = true):
+            out(o), indent(indent), root_name(root_name), nl("\n"), arr_n(0)
+    {
+        stack.reserve(16);
+    }
+    // start over after a document that failed part way
+    void reset() { stack.clear(); }
+    // a decoded tree
+    void write(const TAG &t)
+    {
+        _tag(t.getName(),t);
+    }
+    // NbtParser events
+    void beginCompound(std::string_view name)
+    {
+        _value(name);
+        _open('{',true);
+    }
+    void endCompound()
+    {
+        _close('}');
+        _after();
+    }
+    void beginList(std::string_view name, int8_t, size_t)
+    {
+        _value(name);
+        _open('[',false);
+    }
+    void endList()
+    {
+        _close(']');
+        _after();
+    }
+    void scalar(std::string_view name, const NbtScalar &v)
+    {
+        _value(name);
+        switch (v.id)
+        {
+        case 1: _number(v.b); break;
+        case 2: _number(v.s); break;
+        case 3: _number(v.i); break;
+        case 4: _number(v.l); break;
+        case 5: _number(v.f); break;
+        case 6: _number(v.d); break;
+        case 8: _string(v.str); break;
+        default: throw "nbt json unknown scalar type";
+        }
+        _after();
+    }
+    void beginArray(std::string_view name, int8_t, size_t)
+    {
+        _value(name);
+        out.put('[');
+        arr_n = 0;
+    }
+    void arrayChunk(const int8_t *v, size_t n) { _elements(v,n); }
+    void arrayChunk(const int32_t *v, size_t n) { _elements(v,n); }
+    void arrayChunk(const int64_t *v, size_t n) { _elements(v,n); }
+    void endArray()
+    {
+        out.put(']');
+        _after();
+    }
+};
+
+// json of a decoded tree
+static inline std::string nbtToJson(const TAG &t, size_t indent = 0,
+        bool root_name = true)
+{
+    std::string ret;
+    JsonOutput out(ret);
+    NbtJsonWriter w(out,indent,root_name);
+    w.write(t);
+    out.flush();
+    return ret;
+}
+
+// json of the (gzip, zlib or uncompressed) document in data, streamed from
+// the inflater of the calling thread without decoding a tree
+static inline void nbtToJson(const char *data, size_t len, JsonOutput &out,
+        size_t indent = 0, bool root_name = true)
+{
+    NbtJsonWriter w(out,indent,root_name);
+    NbtParser<NbtJsonWriter> parser(w);
+    _thread_inflater().parse(data,len,parser);
+}
+
+static inline void _json_file(const std::string &path, size_t indent,
+        bool root_name, const char *data, size_t len, const TAG *t)
+{
+    FILE *f = fopen(path.c_str(),"wb");
+    if (!f)
+        throw "json file cannot be opened for writing";
+    try
+    {
+        JsonOutput out(f);
+        if (t)
+        {
+            NbtJsonWriter w(out,indent,root_name);
+            w.write(*t);
+        }
+        else
+            nbtToJson(data,len,out,indent,root_name);
+        out.flush();
+    }
+    catch (...)
+    {
+        fclose(f);
+        throw;
+    }
+    if (fclose(f) != 0)
+        throw "json file write failed";
+}
+
+// convert an nbt file (compressed or not) to a json file
+static inline void nbtFileToJson(const std::string &in, const std::string &out,
+        size_t indent = 0, bool root_name = true)
+{
+    MappedFile f(in);
+    f.willNeed();
+    _json_file(out,indent,root_name,f.data(),f.size(),nullptr);
+}
+
+// WorldScanner visitor writing json files of a world into directory out,
+// region/r.0.0.mca gives out/region/c.X.Z.json for each of its chunks and
+// playerdata/a.dat gives out/playerdata/a.json (roots without their name)
+class WorldJson: public WorldVisitor
+{
+private:
+    std::string world, out;
+    size_t indent;
+    std::atomic<size_t> written;
+    std::mutex lock;
+    std::set<std::string> dirs;
+    // output directory for a file of the world, created if needed
+    std::string _dir(const std::string &path)
+    {
+        if (path.compare(0,world.size(),world) != 0)
+            throw "world json file not in the world";
+        size_t slash = path.rfind('/');
+        std::string dir = out + path.substr(world.size(),
+                slash + 1 - world.size());
+        std::lock_guard<std::mutex> g(lock);
+        if (dirs.insert(dir).second)
+            for (size_t i = out.size(); i < dir.size(); ++i)
+                if (dir[i] == '/')
+                    mkdir(dir.substr(0,i).c_str(),0755);
+        return dir;
+    }
+public:
+    // world is given as to the scanner
+    WorldJson(const std::string &world, const std::string &out,
+            size_t indent = 0): world(world), out(out), indent(indent),
+            written(0)
+    {
+        if (this->world.empty())
+            this->world = ".";
+        if (this->world.back() != '/')
+            this->world += '/';
+        while (this->out.size() > 1 && this->out.back() == '/')
+            this->out.pop_back();
+        mkdir(this->out.c_str(),0755);
+        this->out += '/';
+    }
+    bool chunk(const WorldChunk &c)
+    {
+        _json_file(_dir(c.path) + "c." + std::to_string(c.x) + "."
+                + std::to_string(c.z) + ".json",indent,false,nullptr,0,c.tag);
+        ++written;
+        return true;
+    }
+    bool file(const WorldFile &f)
+    {
+        std::string dir = _dir(f.path);
+        std::string name = f.path.substr(f.path.rfind('/') + 1);
+        name.resize(name.size() - 4); // .dat
+        _json_file(dir + name + ".json",indent,false,nullptr,0,f.tag);
+        ++written;
+        return true;
+    }
+    // json files written
+    size_t files() const { return written; }
+};
+
+// convert a whole world into directory out with the scanner's threads
+static inline WorldScanStats worldToJson(const std::string &world,
+        const std::string &out, size_t indent = 0)
+{
+    WorldScanner s(world);
+    WorldJson v(world,out,indent);
+    return s.scan(v);
+}
+
+}
@@ -0,0 +1,158 @@
+/*
+Benchmark for NBT to JSON conversion
+
+nbt_json_bench [chunks] [min_secs] [world out]
+
+Converts generated chunk-like documents (section block states as long arrays,
+heightmaps, a biome int array, lists of small compounds with strings, floats
+and doubles) to JSON: from the decoded tree and streamed from zlib compressed
+nbt through the parser, compact and indented, with printTag() of the tree as
+the text output the library had before. Prints one key=value line per case
+with MB of JSON per second. With a world directory and an output directory it
+also converts the whole world with worldToJson() and prints its stats.
+*/
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "jrand.hpp"
+#include "nbt.hpp"
+#include "nbt_io.hpp"
+#include "nbt_json.hpp"
+
+using namespace mclib;
+
+typedef std::chrono::steady_clock clk;
+
+static TAG *make_chunk(Random &r, int x, int z)
+{
+    compound_t root;
+    root["xPos"] = new TAG_Int("xPos",x);
+    root["zPos"] = new TAG_Int("zPos",z);
+    root["Status"] = new TAG_String("Status","minecraft:full");
+    root["InhabitedTime"] = new TAG_Long("InhabitedTime",r.nextLong());
+    list_t sections;
+    for (int y = -4; y < 20; ++y)
+    {
+        compound_t s;
+        s["Y"] = new TAG_Byte("Y",(int8_t)y);
+        long_array_t data(256 + r.nextInt(200));
+        for (int64_t &v : data)
+            v = r.nextLong();
+        s["BlockStates"] = new TAG_Long_Array("BlockStates",data);
+        list_t pal;
+        for (int i = 0; i < 16; ++i)
+        {
+            compound_t p;
+            p["Name"] = new TAG_String("Name","minecraft:block_"
+                    + std::to_string(r.nextInt(800)));
+            pal.push_back(new TAG_Compound("",p));
+        }
+        s["Palette"] = new TAG_List("Palette",pal);
+        byte_array_t light(2048);
+        for (int8_t &v : light)
+            v = (int8_t)r.nextInt(256);
+        s["SkyLight"] = new TAG_Byte_Array("SkyLight",light);
+        sections.push_back(new TAG_Compound("",s));
+    }
+    root["Sections"] = new TAG_List("Sections",sections);
+    root["Heightmap"] = new TAG_Long_Array("Heightmap",long_array_t(37,
+            r.nextLong()));
+    int_array_t biomes(1024);
+    for (int32_t &v : biomes)
+        v = r.nextInt(64);
+    root["Biomes"] = new TAG_Int_Array("Biomes",biomes);
+    list_t entities;
+    for (int i = 0; i < 20; ++i)
+    {
+        compound_t e;
+        e["id"] = new TAG_String("id","minecraft:zombie");
+        list_t pos;
+        for (int j = 0; j < 3; ++j)
+            pos.push_back(new TAG_Double("",r.nextDouble()*1000));
+        e["Pos"] = new TAG_List("Pos",pos);
+        list_t rot;
+        for (int j = 0; j < 2; ++j)
+            rot.push_back(new TAG_Float("",r.nextFloat()*360));
+        e["Rotation"] = new TAG_List("Rotation",rot);
+        e["CustomName"] = new TAG_String("CustomName",
+                "{\"text\":\"Zombie \\u00e9 " + std::to_string(i) + "\"}");
+        entities.push_back(new TAG_Compound("",e));
+    }
+    root["Entities"] = new TAG_List("Entities",entities);
+    return new TAG_Compound("",root);
+}
+
+template <typename F>
+static void run(const char *mode, size_t indent, size_t count,
+        double min_secs, F f)
+{
+    size_t iters = 0, bytes = 0;
+    double secs = 0;
+    auto start = clk::now();
+    do
+    {
+        for (size_t i = 0; i < count; ++i)
+            bytes += f(i);
+        iters += count;
+        secs = std::chrono::duration<double>(clk::now() - start).count();
+    }
+    while (secs < min_secs);
+    printf("mode=%s indent=%zu chunks=%zu json_bytes_per_chunk=%zu "
+            "us_per_chunk=%.1f MB_per_s=%.1f\n",mode,indent,count,
+            bytes/iters,secs*1e6/iters,bytes/secs/1e6);
+}
+
+int main(int argc, char **argv)
+{
+    size_t count = argc > 1 ? std::stoul(argv[1]) : 32;
+    double min_secs = argc > 2 ? std::stod(argv[2]) : 0.5;
+    Random r(1);
+    std::vector<TAG*> tags;
+    std::vector<std::string> zlib;
+    for (size_t i = 0; i < count; ++i)
+    {
+        tags.push_back(make_chunk(r,(int)i,0));
+        std::string_view z = _thread_deflater().encode(*tags.back(),NBT_ZLIB);
+        zlib.emplace_back(z);
+    }
+    std::string text;
+    text.reserve(1 << 22);
+    for (size_t indent : {0,4})
+    {
+        run("tree",indent,count,min_secs,[&](size_t i)
+        {
+            text.clear();
+            JsonOutput out(text);
+            NbtJsonWriter w(out,indent,false);
+            w.write(*tags[i]);
+            out.flush();
+            return text.size();
+        });
+        run("stream_zlib",indent,count,min_secs,[&](size_t i)
+        {
+            text.clear();
+            JsonOutput out(text);
+            nbtToJson(zlib[i].data(),zlib[i].size(),out,indent,false);
+            out.flush();
+            return text.size();
+        });
+    }
+    run("printTag",4,count,min_secs,[&](size_t i)
+    {
+        return tags[i]->printTag().size();
+    });
+    for (TAG *t : tags)
+        delete t;
+    if (argc > 4)
+    {
+        WorldScanStats st = worldToJson(argv[3],argv[4]);
+        printf("mode=world regions=%zu chunks=%zu files=%zu failed=%zu "
+                "read_MB=%.1f nbt_MB=%.1f wall_s=%.2f chunks_per_s=%.0f\n",
+                st.regions,st.chunks,st.files,st.failed,st.read/1e6,
+                st.inflated/1e6,st.wall_s,st.chunks/st.wall_s);
+    }
+    return 0;
+}
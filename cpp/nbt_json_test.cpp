@@ -0,0 +1,302 @@
+#include <cassert>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+#include <sys/stat.h>
+
+#include "jrand.hpp"
+#include "nbt.hpp"
+#include "nbt_io.hpp"
+#include "nbt_json.hpp"
+#include "region_writer.hpp"
+
+using namespace mclib;
+
+// compound with children in the given order
+static TAG *compound(const std::string &name, std::initializer_list<TAG*> c)
+{
+    compound_t m;
+    order_t order;
+    for (TAG *t : c)
+    {
+        m[std::pmr::string(t->getName())] = t;
+        order.push_back(std::pmr::string(t->getName()));
+    }
+    return new TAG_Compound(name,m,order);
+}
+
+// json of the encoding of t, streamed through the parser
+static std::string streamed(const TAG &t, size_t indent, bool root_name,
+        int compression)
+{
+    std::string_view data = _thread_deflater().encode(t,compression);
+    std::string ret;
+    JsonOutput out(ret,7); // tiny buffer to flush often
+    nbtToJson(data.data(),data.size(),out,indent,root_name);
+    out.flush();
+    return ret;
+}
+
+static std::string str_json(std::string_view s)
+{
+    TAG_String t("",s);
+    std::string j = nbtToJson(t,0,false);
+    return j.substr(0,j.size()-1);
+}
+
+static std::string read_file(const std::string &path)
+{
+    std::string ret;
+    FILE *f = fopen(path.c_str(),"rb");
+    if (!f)
+        return ret;
+    char buf[4096];
+    size_t n;
+    while ((n = fread(buf,1,sizeof(buf),f)))
+        ret.append(buf,n);
+    fclose(f);
+    return ret;
+}
+
+int main(int argc, char **argv)
+{
+    (void)argc;
+    (void)argv;
+    TAG *root = compound("root",{
+        new TAG_Byte("b",-5),
+        new TAG_Short("s",300),
+        new TAG_Int("i",-2147483647-1),
+        new TAG_Long("l",INT64_MIN),
+        new TAG_Float("f",0.1f),
+        new TAG_Double("d",1.0/3),
+        new TAG_Byte_Array("ba",byte_array_t{-128,0,127}),
+        new TAG_String("str","a\"b"),
+        new TAG_List("empty",list_t(),0),
+        new TAG_List("ints",list_t{new TAG_Int("",1),new TAG_Int("",2)}),
+        new TAG_List("comps",list_t{compound("",{}),
+                compound("",{new TAG_Double("x",2)})}),
+        compound("nested",{new TAG_Int_Array("ia",int_array_t{1,-1}),
+                new TAG_Long_Array("la",long_array_t())})});
+    // compact
+    std::string compact =
+        "{\"root\":{\"b\":-5,\"s\":300,\"i\":-2147483648,"
+        "\"l\":-9223372036854775808,\"f\":0.1,\"d\":0.3333333333333333,"
+        "\"ba\":[-128,0,127],\"str\":\"a\\\"b\",\"empty\":[],\"ints\":[1,2],"
+        "\"comps\":[{},{\"x\":2.0}],\"nested\":{\"ia\":[1,-1],\"la\":[]}}}\n";
+    assert(nbtToJson(*root) == compact);
+    // indented, arrays on one line
+    std::string pretty =
+        "{\n"
+        "  \"root\": {\n"
+        "    \"b\": -5,\n"
+        "    \"s\": 300,\n"
+        "    \"i\": -2147483648,\n"
+        "    \"l\": -9223372036854775808,\n"
+        "    \"f\": 0.1,\n"
+        "    \"d\": 0.3333333333333333,\n"
+        "    \"ba\": [-128, 0, 127],\n"
+        "    \"str\": \"a\\\"b\",\n"
+        "    \"empty\": [],\n"
+        "    \"ints\": [\n"
+        "      1,\n"
+        "      2\n"
+        "    ],\n"
+        "    \"comps\": [\n"
+        "      {},\n"
+        "      {\n"
+        "        \"x\": 2.0\n"
+        "      }\n"
+        "    ],\n"
+        "    \"nested\": {\n"
+        "      \"ia\": [1, -1],\n"
+        "      \"la\": []\n"
+        "    }\n"
+        "  }\n"
+        "}\n";
+    assert(nbtToJson(*root,2) == pretty);
+    // without the root name
+    std::string bare = compact.substr(8,compact.size()-10) + "\n";
+    assert(nbtToJson(*root,0,false) == bare);
+    // streamed from every compression gives the same text
+    for (int c : {NBT_RAW,NBT_GZIP,NBT_ZLIB})
+    {
+        assert(streamed(*root,0,true,c) == compact);
+        assert(streamed(*root,2,true,c) == pretty);
+        assert(streamed(*root,0,false,c) == bare);
+    }
+    // a scalar root
+    {
+        TAG_Int t("n",7);
+        assert(nbtToJson(t) == "{\"n\":7}\n");
+        assert(nbtToJson(t,4) == "{\n    \"n\": 7\n}\n");
+        assert(nbtToJson(t,4,false) == "7\n");
+    }
+    // floats: shortest round trip text (also used by printTag now)
+    {
+        auto fj = [](float v) { return nbtToJson(TAG_Float("",v),0,false); };
+        auto dj = [](double v) { return nbtToJson(TAG_Double("",v),0,false); };
+        assert(fj(1.0f) == "1.0\n" && fj(-0.0f) == "-0.0\n");
+        assert(fj(1e20f) == "1e+20\n" && fj(1.5e-7f) == "1.5e-07\n");
+        assert(fj(NAN) == "NaN\n" && fj(-INFINITY) == "-Infinity\n");
+        assert(dj(0.1) == "0.1\n" && dj(100) == "100.0\n");
+        assert(dj(INFINITY) == "Infinity\n");
+        assert(TAG_Float("f",0.1f).printTag() == "TAG_Float('f'): 0.1");
+        assert(TAG_Double("d",2.5e-300).printTag()
+                == "TAG_Double('d'): 2.5e-300");
+        Random r(5);
+        for (int i = 0; i < 10000; ++i)
+        {
+            uint64_t bits = (uint64_t)r.nextLong();
+            double d;
+            memcpy(&d,&bits,8);
+            float f;
+            uint32_t fb = (uint32_t)bits;
+            memcpy(&f,&fb,4);
+            if (std::isfinite(d))
+                assert(strtod(dj(d).c_str(),nullptr) == d);
+            if (std::isfinite(f))
+                assert(strtof(fj(f).c_str(),nullptr) == f);
+        }
+    }
+    // strings: escapes, modified utf-8 and runs around the vector widths
+    {
+        assert(str_json("") == "\"\"");
+        assert(str_json("\\ \" / \n\r\t\b\f\x01\x1f") ==
+                "\"\\\\ \\\" / \\n\\r\\t\\b\\f\\u0001\\u001f\"");
+        assert(str_json("\xc0\x80") == "\"\\u0000\"");
+        assert(str_json("caf\xc3\xa9 \xe2\x82\xac")
+                == "\"caf\xc3\xa9 \xe2\x82\xac\"");
+        // U+1F600 as two surrogates becomes 4 byte utf-8
+        assert(str_json("\xed\xa0\xbd\xed\xb8\x80") == "\"\xf0\x9f\x98\x80\"");
+        assert(str_json("\xf0\x9f\x98\x80") == "\"\xf0\x9f\x98\x80\"");
+        // lone surrogates are escaped, invalid bytes replaced
+        assert(str_json("\xed\xa0\xbdx") == "\"\\ud83dx\"");
+        assert(str_json("\xed\xb8\x80") == "\"\\ude00\"");
+        assert(str_json("a\xff" "b\xc3")
+                == "\"a\xef\xbf\xbd" "b\xef\xbf\xbd\"");
+        assert(str_json("\xe0\x80\x80")
+                == "\"\xef\xbf\xbd\xef\xbf\xbd\xef\xbf\xbd\"");
+        for (size_t len : {15,16,17,31,32,33,64,100})
+            for (size_t at = 0; at < len; at += 7)
+            {
+                std::string s(len,'x');
+                s[at] = '"';
+                std::string want = "\"" + s.substr(0,at) + "\\\""
+                        + s.substr(at+1) + "\"";
+                assert(str_json(s) == want);
+                s[at] = '\xc3';
+                if (at + 1 < len)
+                {
+                    s[at+1] = '\xa9';
+                    assert(str_json(s) == "\"" + s + "\"");
+                }
+            }
+        // worst case growth (6 bytes for each control character)
+        std::string ctl(65535,'\x02');
+        std::string j = str_json(ctl);
+        assert(j.size() == 6*65535 + 2);
+    }
+    // every byte value and arrays longer than a block (and the parser's)
+    {
+        byte_array_t ba;
+        std::string want = "[";
+        for (int i = 0; i < 256*40; ++i)
+        {
+            ba.push_back((int8_t)i);
+            want += (i ? "," : "") + std::to_string((int8_t)i);
+        }
+        want += "]\n";
+        TAG_Byte_Array b("",ba);
+        assert(nbtToJson(b,0,false) == want);
+        assert(streamed(b,0,false,NBT_ZLIB) == want);
+        long_array_t la;
+        int_array_t ia;
+        std::string lw = "[", iw = "[";
+        Random r(2);
+        for (int i = 0; i < 5000; ++i)
+        {
+            la.push_back(i == 0 ? INT64_MIN : i == 1 ? INT64_MAX
+                    : r.nextLong());
+            ia.push_back(i == 0 ? INT32_MIN : r.nextInt());
+            lw += (i ? ", " : "") + std::to_string(la.back());
+            iw += (i ? ", " : "") + std::to_string(ia.back());
+        }
+        lw += "]\n";
+        iw += "]\n";
+        TAG_Long_Array l("",la);
+        TAG_Int_Array in("",ia);
+        assert(nbtToJson(l,1,false) == lw);
+        assert(streamed(l,1,false,NBT_GZIP) == lw);
+        assert(nbtToJson(in,1,false) == iw);
+        assert(streamed(in,1,false,NBT_RAW) == iw);
+    }
+    // broken input throws and the writer can go on after reset()
+    {
+        std::string_view data = _thread_deflater().encode(*root,NBT_RAW);
+        std::string s;
+        JsonOutput out(s);
+        bool threw = false;
+        try { nbtToJson(data.data(),data.size()-3,out); }
+        catch (const char*) { threw = true; }
+        assert(threw);
+        NbtJsonWriter w(out);
+        NbtParser<NbtJsonWriter> p(w);
+        try { p.parse(data.data(),data.size()-1); }
+        catch (const char*) {}
+        out.flush();
+        s.clear();
+        w.reset();
+        p.parse(data.data(),data.size());
+        out.flush();
+        assert(s == compact);
+    }
+    // files
+    {
+        saveNbt("/tmp/nbt_json_test.dat",*root);
+        nbtFileToJson("/tmp/nbt_json_test.dat","/tmp/nbt_json_test.json",2);
+        assert(read_file("/tmp/nbt_json_test.json") == pretty);
+        remove("/tmp/nbt_json_test.dat");
+        remove("/tmp/nbt_json_test.json");
+    }
+    // a world: chunks of two regions and a player file
+    {
+        std::string w = "/tmp/nbt_json_world", o = "/tmp/nbt_json_world_out";
+        std::string rm = "rm -rf " + w + " " + o;
+        int rc = system(rm.c_str());
+        assert(rc == 0);
+        for (const char *d : {"","/region","/DIM-1","/DIM-1/region",
+                "/playerdata"})
+            mkdir((w + d).c_str(),0755);
+        for (const char *r : {"/region/r.0.-1.mca","/DIM-1/region/r.1.0.mca"})
+        {
+            RegionWriter rw(w + r);
+            for (size_t ci : {0,33,1023})
+            {
+                TAG *c = compound("",{new TAG_Int("ci",(int)ci),
+                        new TAG_String("at",r)});
+                rw.setChunk(ci,*c,0);
+                delete c;
+            }
+            rw.flush();
+        }
+        saveNbt(w + "/playerdata/p.dat",*root);
+        WorldScanStats st = worldToJson(w,o + "/",2);
+        assert(st.chunks == 6 && st.files == 1 && st.failed == 0);
+        assert(read_file(o + "/region/c.0.-32.json") ==
+                "{\n  \"ci\": 0,\n  \"at\": \"/region/r.0.-1.mca\"\n}\n");
+        assert(read_file(o + "/region/c.31.-1.json").find("1023")
+                != std::string::npos);
+        assert(read_file(o + "/DIM-1/region/c.33.1.json").find("33")
+                != std::string::npos);
+        assert(read_file(o + "/playerdata/p.json") == nbtToJson(*root,2,false));
+        rc = system(rm.c_str());
+        assert(rc == 0);
+        (void)rc;
+    }
+    delete root;
+    std::cout << "nbt json tests passed" << std::endl;
+    return 0;
+}
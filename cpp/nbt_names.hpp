@@ -0,0 +1,152 @@
+/*
+Interned NBT tag names
+
+Every tag name is stored once for the whole program in NbtNameTable and tags
+refer to it by pointer, so the same keys repeated across a world (Name, Pos,
+id, Properties, ...) take no extra memory per tag and compare as integers
+(NbtName::id). Names are not removed until the program exits, the table only
+grows with the number of distinct names seen.
+
+The table is shared by all threads. Lookups first check a small cache per
+thread, then the table under a shared lock, new names take an exclusive lock.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <new>
+#include <shared_mutex>
+#include <string_view>
+#include <vector>
+
+namespace mclib
+{
+
+// an interned name, ids are consecutive from 0 (the empty name)
+struct NbtName
+{
+    uint32_t id;
+    size_t hash;
+    std::string_view str;
+};
+
+class NbtNameTable
+{
+private:
+    std::shared_mutex mutex;
+    // open addressing, size is a power of 2 and at most half full
+    std::vector<const NbtName*> slots;
+    size_t count;
+    static size_t _hash(std::string_view s)
+    {
+        return std::hash<std::string_view>()(s);
+    }
+    const NbtName *_find(std::string_view s, size_t h) const
+    {
+        size_t mask = slots.size() - 1;
+        for (size_t i = h & mask;; i = (i+1) & mask)
+        {
+            const NbtName *e = slots[i];
+            if (!e || (e->hash == h && e->str == s))
+                return e;
+        }
+    }
+    void _place(const NbtName *e)
+    {
+        size_t mask = slots.size() - 1;
+        size_t i = e->hash & mask;
+        while (slots[i])
+            i = (i+1) & mask;
+        slots[i] = e;
+    }
+    const NbtName *_insert(std::string_view s, size_t h)
+    {
+        std::unique_lock<std::shared_mutex> lock(mutex);
+        const NbtName *e = _find(s,h);
+        if (e)
+            return e;
+        if (2*(count+1) > slots.size())
+        {
+            std::vector<const NbtName*> old(slots.size()*2,nullptr);
+            old.swap(slots);
+            for (const NbtName *o : old)
+                if (o)
+                    _place(o);
+        }
+        // entry and name bytes in one allocation, freed at exit
+        char *mem = new char[sizeof(NbtName) + s.size()];
+        memcpy(mem + sizeof(NbtName),s.data(),s.size());
+        NbtName *n = new (mem) NbtName{(uint32_t)count,h,
+                std::string_view(mem + sizeof(NbtName),s.size())};
+        _place(n);
+        ++count;
+        return n;
+    }
+    NbtNameTable(): slots(1024,nullptr), count(0)
+    {
+        _insert("",_hash(""));
+    }
+    // per thread direct mapped cache of recent names
+    struct _cache
+    {
+        const NbtName *e[256] = {};
+    };
+    static _cache &_thread_cache()
+    {
+        static thread_local _cache cache;
+        return cache;
+    }
+public:
+    ~NbtNameTable()
+    {
+        for (const NbtName *e : slots)
+            if (e)
+                delete[] (const char*)e;
+    }
+    NbtNameTable(const NbtNameTable&) = delete;
+    NbtNameTable &operator=(const NbtNameTable&) = delete;
+    // the table used by all tags
+    static NbtNameTable &global()
+    {
+        static NbtNameTable table;
+        return table;
+    }
+    // the entry for s, added if it is new
+    const NbtName *intern(std::string_view s)
+    {
+        size_t h = _hash(s);
+        const NbtName *&c = _thread_cache().e[h & 255];
+        if (c && c->hash == h && c->str == s)
+            return c;
+        const NbtName *e;
+        {
+            std::shared_lock<std::shared_mutex> lock(mutex);
+            e = _find(s,h);
+        }
+        if (!e)
+            e = _insert(s,h);
+        c = e;
+        return e;
+    }
+    // the entry for s, nullptr if it was never interned (so no tag has it)
+    const NbtName *lookup(std::string_view s)
+    {
+        size_t h = _hash(s);
+        const NbtName *c = _thread_cache().e[h & 255];
+        if (c && c->hash == h && c->str == s)
+            return c;
+        std::shared_lock<std::shared_mutex> lock(mutex);
+        return _find(s,h);
+    }
+    // number of distinct names
+    size_t size()
+    {
+        std::shared_lock<std::shared_mutex> lock(mutex);
+        return count;
+    }
+};
+
+}
@@ -0,0 +1,298 @@
+/*
+Compiled path queries over NBT data
+
+A path selects values below the root compound:
+- Level.xPos           key xPos in compound Level
+- Level.Sections[*].Y  key Y in every element of the list Sections
+- Level.Sections[0]    first element of a list
+- Level.*              every child of a compound
+Keys cannot contain '.', '[' or ']'.
+
+NbtQuery compiles a set of paths into one tree of steps. run() walks the
+encoded bytes once: subtrees that no path goes into are skipped using their
+length prefixes (never decoded), the values at the end of a path are decoded
+into TAG objects with the same decodePayload functions as TAG::decode, and
+compounds and lists on the way are only scanned. Stats report how many bytes
+were skipped, decoded and scanned.
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "nbt.hpp"
+#include "nbt_view.hpp"
+
+namespace mclib
+{
+
+// bytes of a document visited by NbtQuery::run
+struct NbtQueryStats
+{
+    size_t bytes = 0; // whole document
+    size_t skipped = 0; // in subtrees no path enters
+    size_t decoded = 0; // payloads of selected values
+    size_t matches = 0; // values selected
+    // headers and parts of lists and compounds on the way to selected values
+    size_t scanned() const { return bytes - skipped - decoded; }
+};
+
+class NbtQuery
+{
+private:
+    struct _node
+    {
+        // children by key, by list index and for any key or index (-1 none)
+        std::vector<std::pair<std::string,int>> keys;
+        std::vector<std::pair<uint32_t,int>> indexes;
+        int any_key = -1;
+        int any_index = -1;
+        // paths that end here
+        std::vector<size_t> paths;
+    };
+    std::vector<_node> nodes;
+    std::vector<std::string> paths;
+    // child of cur for any key (or any list index), added if needed
+    int _any(int cur, bool index)
+    {
+        int next = index ? nodes[cur].any_index : nodes[cur].any_key;
+        if (next < 0)
+        {
+            next = (int)nodes.size();
+            nodes.emplace_back();
+            (index ? nodes[cur].any_index : nodes[cur].any_key) = next;
+        }
+        return next;
+    }
+    // child of cur for key k (or list index), added if needed
+    template <typename K>
+    int _step(int cur, std::vector<std::pair<K,int>> _node::*edges, const K &k)
+    {
+        for (auto &e : nodes[cur].*edges)
+            if (e.first == k)
+                return e.second;
+        int next = (int)nodes.size();
+        (nodes[cur].*edges).emplace_back(k,next);
+        nodes.emplace_back();
+        return next;
+    }
+    void _add(const std::string &path, size_t id)
+    {
+        int cur = 0;
+        size_t i = 0;
+        for (;;)
+        {
+            size_t dot = path.find('.',i);
+            std::string seg = path.substr(i,dot == std::string::npos
+                    ? std::string::npos : dot-i);
+            size_t b = seg.find('[');
+            std::string key = seg.substr(0,b);
+            if (key.find(']') != std::string::npos)
+                throw "nbt path has a misplaced ']'";
+            if (key.empty() && b == std::string::npos)
+                throw "nbt path has an empty key";
+            if (key == "*")
+                cur = _any(cur,false);
+            else if (!key.empty())
+                cur = _step(cur,&_node::keys,key);
+            while (b < seg.size())
+            {
+                size_t k = seg.find(']',b);
+                if (seg[b] != '[' || k == std::string::npos || k == b+1)
+                    throw "nbt path has an invalid list index";
+                std::string idx = seg.substr(b+1,k-b-1);
+                if (idx == "*")
+                    cur = _any(cur,true);
+                else
+                {
+                    if (idx.size() > 9
+                            || idx.find_first_not_of("0123456789")
+                            != std::string::npos)
+                        throw "nbt path has an invalid list index";
+                    cur = _step(cur,&_node::indexes,(uint32_t)std::stoul(idx));
+                }
+                b = k+1;
+            }
+            if (dot == std::string::npos)
+                break;
+            i = dot+1;
+        }
+        if (!nodes[cur].paths.empty())
+            throw "nbt path is given twice";
+        nodes[cur].paths.push_back(id);
+    }
+    // add the steps and paths below src to those below dst
+    void _merge(int dst, int src)
+    {
+        for (size_t i = 0; i < nodes[src].keys.size(); ++i)
+        {
+            std::pair<std::string,int> e = nodes[src].keys[i];
+            _merge(_step(dst,&_node::keys,e.first),e.second);
+        }
+        for (size_t i = 0; i < nodes[src].indexes.size(); ++i)
+        {
+            std::pair<uint32_t,int> e = nodes[src].indexes[i];
+            _merge(_step(dst,&_node::indexes,e.first),e.second);
+        }
+        if (nodes[src].any_key >= 0)
+        {
+            int c = nodes[src].any_key;
+            _merge(_any(dst,false),c);
+        }
+        if (nodes[src].any_index >= 0)
+        {
+            int c = nodes[src].any_index;
+            _merge(_any(dst,true),c);
+        }
+        for (size_t p : nodes[src].paths)
+        {
+            std::vector<size_t> &dp = nodes[dst].paths;
+            if (std::find(dp.begin(),dp.end(),p) == dp.end())
+                dp.push_back(p);
+        }
+    }
+    // a value with a key (or list index) that has its own step also matches
+    // the * step, copy what is below * into it so each value follows one node
+    // (nodes are created after their parents so this visits parents first)
+    void _determinize()
+    {
+        for (size_t n = 0; n < nodes.size(); ++n)
+        {
+            if (nodes[n].any_key >= 0)
+                for (size_t i = 0; i < nodes[n].keys.size(); ++i)
+                    _merge(nodes[n].keys[i].second,nodes[n].any_key);
+            if (nodes[n].any_index >= 0)
+                for (size_t i = 0; i < nodes[n].indexes.size(); ++i)
+                    _merge(nodes[n].indexes[i].second,nodes[n].any_index);
+        }
+    }
+    // state of one run
+    template <typename F>
+    struct _run
+    {
+        const NbtQuery &q;
+        const char *end;
+        std::pmr::memory_resource *mr;
+        F &cb;
+        NbtQueryStats stats;
+        const char *_skip(const char *p, int8_t tid)
+        {
+            const char *e = _nbt_skip(p,end,tid);
+            stats.skipped += e - p;
+            return e;
+        }
+        // payload at p of type tid reached by node, returns its end
+        const char *_value(const char *p, int8_t tid, std::string_view name,
+                int node)
+        {
+            const _node &nd = q.nodes[node];
+            size_t skipped = stats.skipped, decoded = stats.decoded;
+            const char *e;
+            // steps below this node
+            if (tid == 10 && (!nd.keys.empty() || nd.any_key >= 0))
+                e = _compound(p,node);
+            else if (tid == 9 && (!nd.indexes.empty() || nd.any_index >= 0))
+                e = _list(p,node);
+            else if (nd.paths.empty())
+                return _skip(p,tid);
+            if (!nd.paths.empty())
+            {
+                // all of it is decoded (counted once even if paths below
+                // selected parts of it), once for each path that ends here
+                stats.skipped = skipped;
+                stats.decoded = decoded;
+                for (size_t path : nd.paths)
+                {
+                    e = p;
+                    TAG *t = TAG::decodePayload(e,end,tid,name,mr);
+                    ++stats.matches;
+                    cb(path,t);
+                }
+                stats.decoded += e - p;
+            }
+            return e;
+        }
+        const char *_compound(const char *p, int node)
+        {
+            const _node &nd = q.nodes[node];
+            for (;;)
+            {
+                if (p >= end)
+                    throw "nbt path compound not terminated";
+                int8_t t = *p++;
+                if (t == 0)
+                    return p;
+                if (end - p < 2)
+                    throw "nbt path tag name out of bounds";
+                size_t n = (uint16_t)_from_bytes_short(p);
+                p += 2;
+                if ((size_t)(end - p) < n)
+                    throw "nbt path tag name out of bounds";
+                std::string_view name(p,n);
+                p += n;
+                int next = nd.any_key;
+                for (auto &k : nd.keys)
+                    if (k.first == name)
+                    {
+                        next = k.second;
+                        break;
+                    }
+                p = next < 0 ? _skip(p,t) : _value(p,t,name,next);
+            }
+        }
+        const char *_list(const char *p, int node)
+        {
+            const _node &nd = q.nodes[node];
+            if (end - p < 5)
+                throw "nbt path list header out of bounds";
+            int8_t et = p[0];
+            size_t len = (uint32_t)_from_bytes_int(p+1);
+            p += 5;
+            if (et == 0)
+                return p;
+            for (size_t i = 0; i < len; ++i)
+            {
+                int next = nd.any_index;
+                for (auto &x : nd.indexes)
+                    if (x.first == i)
+                    {
+                        next = x.second;
+                        break;
+                    }
+                p = next < 0 ? _skip(p,et) : _value(p,et,"",next);
+            }
+            return p;
+        }
+    };
+public:
+    // compile paths, results are reported with the index of their path
+    NbtQuery(const std::vector<std::string> &p): nodes(1), paths(p)
+    {
+        for (size_t i = 0; i < p.size(); ++i)
+            _add(p[i],i);
+        _determinize();
+    }
+    size_t size() const { return paths.size(); }
+    const std::string &path(size_t i) const { return paths[i]; }
+    // walk the document, calling cb(path index,tag) for each selected value
+    // in document order (values selected inside a selected value come before
+    // it), tags are allocated in mr (heap and owned by the caller if nullptr)
+    template <typename F>
+    NbtQueryStats run(const char *data, size_t len, F &&cb,
+            std::pmr::memory_resource *mr = nullptr) const
+    {
+        _run<F> r{*this,data+len,mr,cb,NbtQueryStats()};
+        r.stats.bytes = len;
+        NbtView root = NbtView::root(data,len);
+        const char *p = r._value(root.payload(),root.id(),"",0);
+        if (p != data+len)
+            throw "nbt path terminated with extra data at end";
+        return r.stats;
+    }
+};
+
+}
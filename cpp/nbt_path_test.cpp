@@ -0,0 +1,107 @@
+#include <cassert>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "arena.hpp"
+#include "nbt.hpp"
+#include "nbt_path.hpp"
+#include "nbt_test_docs.hpp"
+
+using namespace mclib;
+
+// chunk like document with sections and entities
+static bytes_t make_doc()
+{
+    compound_t level;
+    level["xPos"] = new TAG_Int("xPos",-12);
+    list_t sections;
+    for (int y = 0; y < 4; ++y)
+    {
+        compound_t sec;
+        sec["Y"] = new TAG_Byte("Y",(int8_t)y);
+        sec["BlockStates"] = new TAG_Long_Array("BlockStates",
+                long_array_t(256,y));
+        sec["BlockLight"] = new TAG_Byte_Array("BlockLight",
+                byte_array_t(2048,1));
+        sections.push_back(new TAG_Compound("",sec));
+    }
+    level["Sections"] = new TAG_List("Sections",sections);
+    list_t entities;
+    for (size_t i = 0; i < 3; ++i)
+        entities.push_back(new TAG_Compound("",testEntity(i)));
+    level["Entities"] = new TAG_List("Entities",entities);
+    compound_t root;
+    root["Level"] = new TAG_Compound("Level",level);
+    root["DataVersion"] = new TAG_Int("DataVersion",2230);
+    return testEncode("",root);
+}
+
+int main(int argc, char **argv)
+{
+    (void)argc;
+    (void)argv;
+    bytes_t doc = make_doc();
+    NbtQuery q({"Level.Sections[*].BlockStates","Level.Entities[*].id",
+            "DataVersion","Level.Entities[1].Pos[2]","Level.Missing"});
+    assert(q.size() == 5 && q.path(1) == "Level.Entities[*].id");
+    std::vector<std::vector<bytes_t>> found(q.size());
+    NbtQueryStats st = q.run(doc.data(),doc.size(),[&](size_t i, TAG *t)
+    {
+        found[i].push_back(t->encode());
+        delete t;
+    });
+    assert(found[0].size() == 4 && found[1].size() == 3);
+    assert(found[2].size() == 1 && found[3].size() == 1 && found[4].empty());
+    for (int y = 0; y < 4; ++y)
+        assert(found[0][y]
+                == TAG_Long_Array("BlockStates",long_array_t(256,y)).encode());
+    assert(found[1][2] == TAG_String("id","minecraft:pig2").encode());
+    assert(found[2][0] == TAG_Int("DataVersion",2230).encode());
+    assert(found[3][0] == TAG_Double("",12.0).encode());
+    // block light arrays are skipped, block states decoded
+    assert(st.bytes == doc.size() && st.matches == 9);
+    assert(st.decoded == 4*(4+256*8) + 3*(2+14) + 4 + 8);
+    assert(st.skipped >= 4*(4+2048));
+    assert(st.scanned() < 400);
+    // a selected value containing other selected values is decoded once and
+    // reported after them, into an arena
+    Arena arena;
+    NbtQuery q2({"Level.Entities[*]","Level.Entities[*].id"});
+    std::vector<size_t> order;
+    st = q2.run(doc.data(),doc.size(),[&](size_t i, TAG*)
+    {
+        order.push_back(i);
+    },&arena);
+    assert((order == std::vector<size_t>{1,0,1,0,1,0}));
+    assert(st.matches == 6
+            && st.decoded + st.skipped + st.scanned() == st.bytes);
+    // nothing selected, everything below the root skipped
+    st = NbtQuery({"Nothing"}).run(doc.data(),doc.size(),[](size_t, TAG*) {});
+    assert(st.matches == 0 && st.decoded == 0);
+    // a key with its own step also matches *
+    NbtQuery q3({"Level.*","Level.xPos","*.Entities[2].id",
+            "Level.Entities[*]"});
+    std::vector<size_t> count(q3.size());
+    q3.run(doc.data(),doc.size(),[&](size_t i, TAG *t)
+    {
+        ++count[i];
+        delete t;
+    });
+    assert((count == std::vector<size_t>{3,1,1,3}));
+    // invalid paths
+    for (const char *bad : {"","a..b","a.",".a","a[","a[]","a[x]","a]","a[1]b",
+            "a[1"})
+    {
+        bool threw = false;
+        try { NbtQuery(std::vector<std::string>{bad}); }
+        catch (const char*) { threw = true; }
+        assert(threw);
+    }
+    bool threw = false;
+    try { NbtQuery({"a.b","a.b"}); }
+    catch (const char*) { threw = true; }
+    assert(threw);
+    std::cout << "nbt path tests passed" << std::endl;
+    return 0;
+}
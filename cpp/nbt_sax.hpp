@@ -0,0 +1,417 @@
+/*
+Streaming (SAX style) NBT parser
+
+NbtParser<Visitor> turns NBT bytes into a sequence of events on a visitor
+instead of building a tree. Input can be given in pieces of any size with
+feed() (for example each block of output from a decompressor), the parser
+keeps its position in a small state machine with an explicit stack, so memory
+use does not depend on the input size and deep nesting cannot overflow the
+call stack.
+
+Events (a visitor can derive from NbtVisitor and define only the ones it needs):
+- beginCompound(name) ... endCompound()
+- beginList(name,element_type,length) ... endList()
+- scalar(name,value) for bytes, shorts, ints, longs, floats, doubles and
+  strings (NbtScalar has the type id and value)
+- beginArray(name,type,length), arrayChunk(values,count) any number of times
+  with values in host order, endArray()
+List elements have empty names. Names, strings and array chunks point into the
+input or an internal buffer and are only valid during the call.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+#include "nbt_view.hpp"
+#include "utils.hpp"
+
+namespace mclib
+{
+
+// scalar value of an event, id is the tag type (1-6 or 8 for strings)
+struct NbtScalar
+{
+    int8_t id;
+    union
+    {
+        int8_t b;
+        int16_t s;
+        int32_t i;
+        int64_t l;
+        float f;
+        double d;
+    };
+    std::string_view str;
+    // integer tags widened to 64 bits
+    int64_t asInteger() const
+    {
+        switch (id)
+        {
+        case 1: return b;
+        case 2: return s;
+        case 3: return i;
+        case 4: return l;
+        default: throw "nbt scalar not an integer";
+        }
+    }
+};
+
+// visitor that ignores everything
+struct NbtVisitor
+{
+    void beginCompound(std::string_view) {}
+    void endCompound() {}
+    void beginList(std::string_view, int8_t, size_t) {}
+    void endList() {}
+    void scalar(std::string_view, const NbtScalar&) {}
+    void beginArray(std::string_view, int8_t, size_t) {}
+    void arrayChunk(const int8_t*, size_t) {}
+    void arrayChunk(const int32_t*, size_t) {}
+    void arrayChunk(const int64_t*, size_t) {}
+    void endArray() {}
+};
+
+template <typename Visitor>
+class NbtParser
+{
+private:
+    enum _state: uint8_t
+    {
+        _S_TYPE, // tag type byte (in a compound or for the root)
+        _S_NAME_LEN,
+        _S_NAME,
+        _S_PAYLOAD, // payload of type tid
+        _S_STRING, // string bytes (need of them)
+        _S_ARRAY, // array elements (arr_left of them)
+        _S_DONE
+    };
+    struct _frame
+    {
+        int8_t tid; // 9 or 10
+        int8_t et; // list element type
+        uint32_t remaining; // list elements not finished
+    };
+    Visitor &vis;
+    _frame stack[_nbt_max_depth];
+    size_t depth;
+    _state state;
+    int8_t tid;
+    // bytes wanted by _S_NAME and _S_STRING
+    size_t need;
+    uint32_t arr_left;
+    // name of the current tag, points into the input or into name_buf
+    std::string_view name;
+    std::string name_buf;
+    // bytes of an item split between calls to feed()
+    std::string buf;
+    // array elements converted to host order
+    static const size_t _chunk = 512;
+    int32_t ibuf[_chunk];
+    int64_t lbuf[_chunk];
+    // n bytes at p (or collected in buf from this and earlier calls),
+    // nullptr if the input ran out first, buf must be cleared after use
+    const char *_take(const char *&p, const char *end, size_t n)
+    {
+        if (buf.empty() && (size_t)(end - p) >= n)
+        {
+            const char *ret = p;
+            p += n;
+            return ret;
+        }
+        size_t k = n - buf.size();
+        if ((size_t)(end - p) < k)
+            k = end - p;
+        buf.append(p,k);
+        p += k;
+        return buf.size() == n ? buf.data() : nullptr;
+    }
+    // next step needs no more input (empty name, string or array)
+    bool _ready() const
+    {
+        return ((state == _S_NAME || state == _S_STRING) && need == 0)
+                || (state == _S_ARRAY && arr_left == 0);
+    }
+    // a tag payload (or list element) finished
+    void _done()
+    {
+        for (;;)
+        {
+            if (depth == 0)
+            {
+                state = _S_DONE;
+                return;
+            }
+            _frame &top = stack[depth-1];
+            if (top.tid == 10)
+            {
+                state = _S_TYPE;
+                return;
+            }
+            if (--top.remaining)
+            {
+                state = _S_PAYLOAD;
+                tid = top.et;
+                name = std::string_view();
+                return;
+            }
+            --depth;
+            vis.endList();
+        }
+    }
+    void _push(int8_t t, int8_t et, uint32_t n)
+    {
+        if (depth >= _nbt_max_depth)
+            throw "nbt parsing nesting too deep";
+        stack[depth++] = {t,et,n};
+    }
+    // array elements from p, returns false if the input ran out
+    bool _array(const char *&p, const char *end)
+    {
+        size_t esz = tid == 7 ? 1 : tid == 11 ? 4 : 8;
+        while (arr_left)
+        {
+            // an element split between calls
+            if (!buf.empty() || (size_t)(end - p) < esz)
+            {
+                const char *e = _take(p,end,esz);
+                if (!e)
+                    return false;
+                _emit(e,1);
+                buf.clear();
+                --arr_left;
+                continue;
+            }
+            size_t n = (end - p) / esz;
+            if (n > arr_left)
+                n = arr_left;
+            if (n > _chunk && esz > 1)
+                n = _chunk;
+            _emit(p,n);
+            p += n*esz;
+            arr_left -= n;
+        }
+        vis.endArray();
+        return true;
+    }
+    void _emit(const char *p, size_t n)
+    {
+        if (tid == 7)
+            vis.arrayChunk((const int8_t*)p,n);
+        else if (tid == 11)
+        {
+            _from_bytes_array(p,ibuf,n);
+            vis.arrayChunk(ibuf,n);
+        }
+        else
+        {
+            _from_bytes_array(p,lbuf,n);
+            vis.arrayChunk(lbuf,n);
+        }
+    }
+    // start of a payload, returns false if the input ran out
+    bool _payload(const char *&p, const char *end)
+    {
+        NbtScalar v;
+        v.id = tid;
+        const char *q;
+        switch (tid)
+        {
+        case 1:
+            if (!(q = _take(p,end,1)))
+                return false;
+            v.b = _from_bytes_byte(q);
+            break;
+        case 2:
+            if (!(q = _take(p,end,2)))
+                return false;
+            v.s = _from_bytes_short(q);
+            break;
+        case 3:
+            if (!(q = _take(p,end,4)))
+                return false;
+            v.i = _from_bytes_int(q);
+            break;
+        case 4:
+            if (!(q = _take(p,end,8)))
+                return false;
+            v.l = _from_bytes_long(q);
+            break;
+        case 5:
+            if (!(q = _take(p,end,4)))
+                return false;
+            v.f = _from_bytes_float(q);
+            break;
+        case 6:
+            if (!(q = _take(p,end,8)))
+                return false;
+            v.d = _from_bytes_double(q);
+            break;
+        case 8:
+            if (!(q = _take(p,end,2)))
+                return false;
+            need = (uint16_t)_from_bytes_short(q);
+            buf.clear();
+            state = _S_STRING;
+            return true;
+        case 7: case 11: case 12:
+            if (!(q = _take(p,end,4)))
+                return false;
+            arr_left = (uint32_t)_from_bytes_int(q);
+            buf.clear();
+            vis.beginArray(name,tid,arr_left);
+            state = _S_ARRAY;
+            return true;
+        case 9:
+        {
+            if (!(q = _take(p,end,5)))
+                return false;
+            int8_t et = q[0];
+            uint32_t len = (uint32_t)_from_bytes_int(q+1);
+            buf.clear();
+            if (et < 0 || et > 12 || (et == 0 && len))
+                throw "nbt parsing invalid list element type id";
+            _push(9,et,len);
+            vis.beginList(name,et,len);
+            if (len == 0)
+            {
+                --depth;
+                vis.endList();
+                _done();
+            }
+            else
+            {
+                tid = et;
+                name = std::string_view();
+            }
+            return true;
+        }
+        case 10:
+            _push(10,0,0);
+            vis.beginCompound(name);
+            state = _S_TYPE;
+            return true;
+        default:
+            throw "nbt parsing invalid tag type id";
+        }
+        buf.clear();
+        vis.scalar(name,v);
+        _done();
+        return true;
+    }
+public:
+    NbtParser(Visitor &v): vis(v) { reset(); }
+    NbtParser(const NbtParser&) = delete;
+    NbtParser &operator=(const NbtParser&) = delete;
+    // start over for a new document
+    void reset()
+    {
+        depth = 0;
+        state = _S_TYPE;
+        tid = 0;
+        need = 0;
+        arr_left = 0;
+        name = std::string_view();
+        buf.clear();
+    }
+    // true once a whole document was parsed
+    bool done() const { return state == _S_DONE; }
+    // nesting depth of lists and compounds at the current position
+    size_t level() const { return depth; }
+    // parse the next len bytes of the document
+    void feed(const char *data, size_t len)
+    {
+        const char *p = data, *end = data + len;
+        while (p < end || _ready())
+        {
+            const char *q;
+            switch (state)
+            {
+            case _S_TYPE:
+            {
+                int8_t t = *p++;
+                if (t == 0)
+                {
+                    if (depth == 0)
+                        throw "nbt parsing root is tag_end";
+                    --depth;
+                    vis.endCompound();
+                    _done();
+                    break;
+                }
+                if (t < 0 || t > 12)
+                    throw "nbt parsing invalid tag type id";
+                tid = t;
+                state = _S_NAME_LEN;
+                break;
+            }
+            case _S_NAME_LEN:
+                if (!(q = _take(p,end,2)))
+                    break;
+                need = (uint16_t)_from_bytes_short(q);
+                buf.clear();
+                state = _S_NAME;
+                break;
+            case _S_NAME:
+                if (!(q = _take(p,end,need)))
+                    break;
+                if (q == buf.data())
+                {
+                    name_buf.assign(q,need);
+                    name = name_buf;
+                }
+                else
+                    name = std::string_view(q,need);
+                buf.clear();
+                state = _S_PAYLOAD;
+                break;
+            case _S_PAYLOAD:
+                _payload(p,end);
+                break;
+            case _S_STRING:
+            {
+                if (!(q = _take(p,end,need)))
+                    break;
+                NbtScalar v;
+                v.id = 8;
+                v.l = 0;
+                v.str = std::string_view(q,need);
+                vis.scalar(name,v);
+                buf.clear();
+                _done();
+                break;
+            }
+            case _S_ARRAY:
+                if (_array(p,end))
+                    _done();
+                break;
+            case _S_DONE:
+                throw "nbt parsing terminated with extra data at end";
+            }
+        }
+        // the name is needed by the next call, keep a copy
+        if ((state == _S_PAYLOAD || state == _S_STRING || state == _S_ARRAY)
+                && name.data() >= data && name.data() < end)
+        {
+            name_buf.assign(name);
+            name = name_buf;
+        }
+    }
+    // all input was given, throws if the document is incomplete
+    void finish()
+    {
+        if (state != _S_DONE)
+            throw "nbt parsing input ended early";
+    }
+    // parse a whole document
+    void parse(const char *data, size_t len)
+    {
+        reset();
+        feed(data,len);
+        finish();
+    }
+};
+
+}
@@ -0,0 +1,184 @@
+#include <cassert>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "nbt.hpp"
+#include "nbt_sax.hpp"
+#include "nbt_test_docs.hpp"
+
+using namespace mclib;
+
+// writes the events back out as nbt
+struct Writer: NbtVisitor
+{
+    bytes_t out;
+    // true for each open list
+    std::vector<bool> in_list;
+    void _header(int8_t tid, std::string_view name)
+    {
+        if (!in_list.empty() && in_list.back())
+            return;
+        out.push_back(tid);
+        out.push_back((char)(name.size() >> 8));
+        out.push_back((char)name.size());
+        out.insert(out.end(),name.begin(),name.end());
+    }
+    template <typename T>
+    void _put(T v)
+    {
+        char b[sizeof(T)];
+        _to_bytes(b,v);
+        out.insert(out.end(),b,b+sizeof(T));
+    }
+    void beginCompound(std::string_view name)
+    {
+        _header(10,name);
+        in_list.push_back(false);
+    }
+    void endCompound()
+    {
+        out.push_back(0);
+        in_list.pop_back();
+    }
+    void beginList(std::string_view name, int8_t et, size_t len)
+    {
+        _header(9,name);
+        out.push_back(et);
+        _put((int32_t)len);
+        in_list.push_back(true);
+    }
+    void endList() { in_list.pop_back(); }
+    void scalar(std::string_view name, const NbtScalar &v)
+    {
+        _header(v.id,name);
+        switch (v.id)
+        {
+        case 1: _put(v.b); break;
+        case 2: _put(v.s); break;
+        case 3: _put(v.i); break;
+        case 4: _put(v.l); break;
+        case 5: _put(v.f); break;
+        case 6: _put(v.d); break;
+        case 8:
+            _put((int16_t)v.str.size());
+            out.insert(out.end(),v.str.begin(),v.str.end());
+            break;
+        default: assert(0);
+        }
+    }
+    void beginArray(std::string_view name, int8_t tid, size_t len)
+    {
+        _header(tid,name);
+        _put((int32_t)len);
+    }
+    template <typename T>
+    void arrayChunk(const T *v, size_t n)
+    {
+        for (size_t i = 0; i < n; ++i)
+            _put(v[i]);
+    }
+};
+
+static bytes_t make_doc()
+{
+    compound_t root;
+    testScalars(root);
+    root["Empty"] = new TAG_String("Empty","");
+    int_array_t ia(1500);
+    for (size_t i = 0; i < ia.size(); ++i)
+        ia[i] = (int32_t)(i*2654435761u);
+    root["IA"] = new TAG_Int_Array("IA",ia);
+    long_array_t la(1100);
+    for (size_t i = 0; i < la.size(); ++i)
+        la[i] = (int64_t)(i*0x9e3779b97f4a7c15ull);
+    root["LA"] = new TAG_Long_Array("LA",la);
+    root["EA"] = new TAG_Long_Array("EA",long_array_t());
+    list_t sections;
+    for (int y = 0; y < 3; ++y)
+    {
+        compound_t sec;
+        sec["Y"] = new TAG_Byte("Y",(int8_t)y);
+        list_t pos;
+        for (int i = 0; i < y; ++i)
+            pos.push_back(new TAG_Double("",i*0.5));
+        sec["Pos"] = new TAG_List("Pos",pos,6);
+        list_t nested;
+        nested.push_back(new TAG_List("",list_t()));
+        sec["Nested"] = new TAG_List("Nested",nested);
+        sections.push_back(new TAG_Compound("",sec));
+    }
+    root["Sections"] = new TAG_List("Sections",sections);
+    return testEncode("root",root);
+}
+
+// nested lists, depth levels deep
+static bytes_t make_deep(size_t depth)
+{
+    bytes_t ret = {9,0,0};
+    for (size_t i = 1; i < depth; ++i)
+    {
+        ret.push_back(9);
+        ret.insert(ret.end(),{0,0,0,1});
+    }
+    ret.push_back(0);
+    ret.insert(ret.end(),{0,0,0,0});
+    return ret;
+}
+
+int main(int argc, char **argv)
+{
+    (void)argc;
+    (void)argv;
+    bytes_t doc = make_doc();
+    // whole document and every piece size up to 70
+    for (size_t piece = 0; piece <= 70; ++piece)
+    {
+        Writer w;
+        NbtParser<Writer> parser(w);
+        if (piece == 0)
+            parser.parse(doc.data(),doc.size());
+        else
+        {
+            for (size_t i = 0; i < doc.size(); i += piece)
+            {
+                assert(!parser.done());
+                parser.feed(doc.data()+i,std::min(piece,doc.size()-i));
+            }
+            parser.finish();
+        }
+        assert(parser.done() && parser.level() == 0);
+        assert(w.out == doc);
+    }
+    // reuse after reset, truncated and extended input
+    {
+        Writer w;
+        NbtParser<Writer> parser(w);
+        parser.feed(doc.data(),doc.size()-1);
+        bool threw = false;
+        try { parser.finish(); }
+        catch (const char*) { threw = true; }
+        assert(threw);
+        parser.reset();
+        bytes_t extra = doc;
+        extra.push_back(0);
+        threw = false;
+        try { parser.feed(extra.data(),extra.size()); }
+        catch (const char*) { threw = true; }
+        assert(threw);
+    }
+    // deep nesting within the limit and beyond it
+    {
+        NbtVisitor v;
+        NbtParser<NbtVisitor> parser(v);
+        bytes_t deep = make_deep(_nbt_max_depth);
+        parser.parse(deep.data(),deep.size());
+        deep = make_deep(100000);
+        bool threw = false;
+        try { parser.parse(deep.data(),deep.size()); }
+        catch (const char*) { threw = true; }
+        assert(threw);
+    }
+    std::cout << "nbt sax tests passed" << std::endl;
+    return 0;
+}
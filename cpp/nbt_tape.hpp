@@ -0,0 +1,416 @@
+/*
+Two stage NBT decoding with a tape (structural index)
+
+Stage 1 (NbtTape::build) is one linear scan over the encoded bytes that checks
+the structure and writes a flat tape: one fixed size entry per tag in document
+order with its type, name and payload offsets, payload end and the tape index
+just past its subtree. The tape is a single vector reused between documents, no
+allocation happens per tag. Numbers in lists (like arrays) are leaves, the tape
+has entries for the elements of lists of strings, arrays, lists and compounds.
+
+Stage 2 works on the tape:
+- next(i) skips a subtree in O(1) and count(i) gives the number of children
+  of a container (or elements of an array, bytes of a string) up front
+- child(), find() and view() answer lookups without decoding (views read the
+  values straight from the buffer like NbtView)
+- materialize() builds TAG objects for a subtree, the parallel version splits
+  large containers (like a list of many compounds) into runs of independent
+  sibling subtrees decoded as separate ThreadPool tasks
+
+The buffer must outlive the tape and is limited to 4 GiB (32 bit offsets).
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <memory_resource>
+#include <string_view>
+#include <vector>
+
+#include "nbt.hpp"
+#include "nbt_view.hpp"
+#include "thread_pool.hpp"
+
+namespace mclib
+{
+
+// one tag on the tape
+struct NbtTapeEntry
+{
+    uint32_t payload; // offset of the payload
+    uint32_t payload_end; // offset just past the payload
+    uint32_t name; // offset of the name bytes (0 for list elements)
+    uint32_t next; // tape index just past the subtree
+    // children of a compound, length of a list, array or string, 0 otherwise
+    uint32_t count;
+    uint16_t name_len;
+    int8_t id;
+    int8_t elem; // element type of a list
+};
+
+class NbtTape
+{
+private:
+    const char *data;
+    std::vector<NbtTapeEntry> tape;
+    // open container during the scan
+    struct _frame
+    {
+        uint32_t entry;
+        uint32_t remaining; // elements left for a list
+    };
+    std::vector<_frame> stack;
+    uint32_t _push(int8_t id, size_t name, size_t name_len, const char *p)
+    {
+        NbtTapeEntry e;
+        e.payload = (uint32_t)(p - data);
+        e.payload_end = e.payload;
+        e.name = (uint32_t)name;
+        e.next = 0;
+        e.count = 0;
+        e.name_len = (uint16_t)name_len;
+        e.id = id;
+        e.elem = 0;
+        tape.push_back(e);
+        return (uint32_t)(tape.size() - 1);
+    }
+    // scan the payload of tape entry i at p, containers are opened on the
+    // stack and finished by build
+    const char *_value(uint32_t i, const char *p, const char *end)
+    {
+        NbtTapeEntry &e = tape[i];
+        size_t n;
+        switch (e.id)
+        {
+        case 1: n = 1; break;
+        case 2: n = 2; break;
+        case 3: case 5: n = 4; break;
+        case 4: case 6: n = 8; break;
+        case 7: case 11: case 12:
+            if (end - p < 4)
+                throw "nbt tape array length out of bounds";
+            e.count = (uint32_t)_from_bytes_int(p);
+            n = (size_t)e.count * (e.id == 7 ? 1 : e.id == 11 ? 4 : 8);
+            if ((size_t)(end - p - 4) < n)
+                throw "nbt tape array out of bounds";
+            n += 4;
+            break;
+        case 8:
+            if (end - p < 2)
+                throw "nbt tape string length out of bounds";
+            e.count = (uint16_t)_from_bytes_short(p);
+            n = 2 + (size_t)e.count;
+            break;
+        case 9:
+        {
+            if (stack.size() >= _nbt_max_depth)
+                throw "nbt tape nesting too deep";
+            if (end - p < 5)
+                throw "nbt tape list header out of bounds";
+            e.elem = p[0];
+            e.count = (uint32_t)_from_bytes_int(p+1);
+            p += 5;
+            size_t fixed = e.elem == 1 ? 1 : e.elem == 2 ? 2
+                    : (e.elem == 3 || e.elem == 5) ? 4
+                    : (e.elem == 4 || e.elem == 6) ? 8 : 0;
+            if (fixed || e.elem == 0)
+            {
+                if (fixed && (size_t)(end - p) / fixed < e.count)
+                    throw "nbt tape list out of bounds";
+                n = e.count * fixed;
+                break;
+            }
+            if (e.elem < 0 || e.elem > 12)
+                throw "nbt tape invalid tag type id";
+            // every other element takes at least 1 byte
+            if ((size_t)(end - p) < e.count)
+                throw "nbt tape list out of bounds";
+            stack.push_back({i,e.count});
+            return p;
+        }
+        case 10:
+            if (stack.size() >= _nbt_max_depth)
+                throw "nbt tape nesting too deep";
+            stack.push_back({i,0});
+            return p;
+        default:
+            throw "nbt tape invalid tag type id";
+        }
+        if ((size_t)(end - p) < n)
+            throw "nbt tape payload out of bounds";
+        p += n;
+        e.payload_end = (uint32_t)(p - data);
+        e.next = i + 1;
+        return p;
+    }
+    void _close(const char *p)
+    {
+        NbtTapeEntry &e = tape[stack.back().entry];
+        e.payload_end = (uint32_t)(p - data);
+        e.next = (uint32_t)tape.size();
+        stack.pop_back();
+    }
+    // children kept for split containers by materialize
+    struct _part
+    {
+        std::vector<TAG*> kids;
+    };
+    // consecutive siblings decoded by one task
+    struct _job
+    {
+        size_t first, n;
+        bool named;
+        TAG **out;
+    };
+    bool _container(size_t i) const
+    {
+        return (tape[i].id == 10 && tape[i].count)
+            || (tape[i].id == 9 && tape[i].next > i+1);
+    }
+    std::string_view _child_name(size_t i, bool named) const
+    {
+        return named ? name(i) : std::string_view();
+    }
+    TAG *_decode(size_t i, std::string_view n,
+            std::pmr::memory_resource *mr) const
+    {
+        const char *p = data + tape[i].payload;
+        return TAG::decodePayload(p,data+tape[i].payload_end,tape[i].id,n,mr);
+    }
+    // split the children of container i into parts and jobs, containers of
+    // at least grain bytes are split again (in the same order as _assemble)
+    void _split(size_t i, size_t grain, std::deque<_part> &parts,
+            std::vector<_job> &jobs) const
+    {
+        bool named = tape[i].id == 10;
+        parts.emplace_back();
+        std::vector<TAG*> &kids = parts.back().kids;
+        kids.assign(tape[i].count,nullptr);
+        size_t c = i + 1, k = 0, run = 0;
+        _job job{0,0,named,nullptr};
+        for (; k < kids.size(); c = tape[c].next, ++k)
+        {
+            size_t bytes = tape[c].payload_end - tape[c].payload;
+            if (bytes >= grain && _container(c))
+            {
+                if (job.n)
+                    jobs.push_back(job);
+                job.n = 0;
+                _split(c,grain,parts,jobs);
+                continue;
+            }
+            if (job.n == 0 || run >= grain)
+            {
+                if (job.n)
+                    jobs.push_back(job);
+                job = {c,0,named,&kids[k]};
+                run = 0;
+            }
+            ++job.n;
+            run += bytes;
+        }
+        if (job.n)
+            jobs.push_back(job);
+    }
+    // build the tag for container i from its part and the parts after it
+    // (children left nullptr by the jobs are split containers)
+    TAG *_assemble(size_t i, std::string_view n, std::deque<_part> &parts,
+            size_t &next_part, std::pmr::memory_resource *mr) const
+    {
+        std::vector<TAG*> &kids = parts[next_part++].kids;
+        const NbtTapeEntry &e = tape[i];
+        TAG *ret;
+        if (e.id == 10)
+            ret = TAG::_new<TAG_Compound>(mr,n,compound_t(_resource(mr)),
+                    order_t(_resource(mr)),mr);
+        else
+            ret = TAG::_new<TAG_List>(mr,n,list_t(_resource(mr)),e.elem,mr);
+        try
+        {
+            if (e.id == 9)
+                ((TAG_List*)ret)->value.resize(kids.size());
+            size_t c = i + 1;
+            for (size_t k = 0; k < kids.size(); c = tape[c].next, ++k)
+            {
+                TAG *t = kids[k];
+                kids[k] = nullptr;
+                if (!t)
+                    t = _assemble(c,_child_name(c,e.id == 10),parts,next_part,
+                            mr);
+                if (e.id == 9)
+                    ((TAG_List*)ret)->value[k] = t;
+                else if (!((TAG_Compound*)ret)->_insert(t))
+                {
+                    if (!mr)
+                        delete t;
+                    throw "nbt parsing tag_compound, duplicate tag name";
+                }
+            }
+            if (e.id == 9)
+                ((TAG_List*)ret)->psize = e.payload_end - e.payload;
+            else
+                ((TAG_Compound*)ret)->psize = e.payload_end - e.payload;
+        }
+        catch (...)
+        {
+            if (!mr)
+                delete ret;
+            throw;
+        }
+        return ret;
+    }
+public:
+    NbtTape(): data(nullptr) {}
+    // build the tape for the document in [d,d+n) (one named tag)
+    NbtTape(const char *d, size_t n): NbtTape() { build(d,n); }
+    // stage 1, replaces the previous tape (keeping its memory)
+    void build(const char *d, size_t n)
+    {
+        data = d;
+        tape.clear();
+        stack.clear();
+        if (n >= 0xffffffffu)
+            throw "nbt tape input larger than 4 GiB";
+        // about one tag per 16 bytes in typical chunk data
+        tape.reserve(n/16 + 16);
+        const char *p = d, *end = d + n;
+        if (p >= end || *p == 0)
+            throw "nbt tape document is empty";
+        int8_t t = *p++;
+        if (end - p < 2)
+            throw "nbt tape tag name out of bounds";
+        size_t nl = (uint16_t)_from_bytes_short(p);
+        p += 2;
+        if ((size_t)(end - p) < nl)
+            throw "nbt tape tag name out of bounds";
+        p += nl;
+        p = _value(_push(t,p-nl-d,nl,p),p,end);
+        while (!stack.empty())
+        {
+            _frame &f = stack.back();
+            NbtTapeEntry &c = tape[f.entry];
+            if (c.id == 9)
+            {
+                if (f.remaining == 0)
+                {
+                    _close(p);
+                    continue;
+                }
+                --f.remaining;
+                p = _value(_push(c.elem,0,0,p),p,end);
+                continue;
+            }
+            if (p >= end)
+                throw "nbt tape compound not terminated";
+            t = *p++;
+            if (t == 0)
+            {
+                _close(p);
+                continue;
+            }
+            ++c.count;
+            if (end - p < 2)
+                throw "nbt tape tag name out of bounds";
+            nl = (uint16_t)_from_bytes_short(p);
+            p += 2;
+            if ((size_t)(end - p) < nl)
+                throw "nbt tape tag name out of bounds";
+            p += nl;
+            p = _value(_push(t,p-nl-d,nl,p),p,end);
+        }
+        if (p != end)
+            throw "nbt tape terminated with extra data at end";
+    }
+    // number of tags on the tape, index 0 is the root
+    size_t size() const { return tape.size(); }
+    const NbtTapeEntry &entry(size_t i) const { return tape[i]; }
+    int8_t id(size_t i) const { return tape[i].id; }
+    std::string_view name(size_t i) const
+    {
+        return std::string_view(data + tape[i].name,tape[i].name_len);
+    }
+    // tape index after the subtree of i (its next sibling if there is one)
+    size_t next(size_t i) const { return tape[i].next; }
+    // children of a compound, elements of a list or array, bytes of a string
+    size_t count(size_t i) const { return tape[i].count; }
+    // encoded payload bytes of i
+    size_t bytes(size_t i) const
+    {
+        return tape[i].payload_end - tape[i].payload;
+    }
+    // tape index of child k of a compound or list (of strings, arrays, lists
+    // or compounds), size() if there is none, skipping the k before it
+    size_t child(size_t i, size_t k) const
+    {
+        const NbtTapeEntry &e = tape[i];
+        if ((e.id != 9 && e.id != 10) || k >= e.count || e.next == i+1)
+            return tape.size();
+        size_t c = i + 1;
+        while (k--)
+            c = tape[c].next;
+        return c;
+    }
+    // tape index of the child of compound i named key, size() if none
+    size_t find(size_t i, std::string_view key) const
+    {
+        if (tape[i].id != 10)
+            return tape.size();
+        size_t c = i + 1;
+        for (size_t k = 0; k < tape[i].count; ++k, c = tape[c].next)
+            if (name(c) == key)
+                return c;
+        return tape.size();
+    }
+    // view of tag i for reading its value (an invalid view for size())
+    NbtView view(size_t i) const
+    {
+        if (i >= tape.size())
+            return NbtView();
+        return NbtView(data + tape[i].payload,data + tape[i].payload_end,
+                tape[i].id,name(i));
+    }
+    // TAG for the subtree of i (heap if mr is nullptr)
+    TAG *materialize(size_t i, std::pmr::memory_resource *mr = nullptr) const
+    {
+        return _decode(i,name(i),mr);
+    }
+    // TAG for the subtree of i decoded in parallel, containers with at least
+    // grain payload bytes are split into tasks of about grain bytes of
+    // sibling subtrees each, mr is shared by the tasks so it must be thread
+    // safe (heap if nullptr, not an Arena), must not be called from a worker
+    TAG *materialize(size_t i, ThreadPool &pool, size_t grain = 1 << 16,
+            std::pmr::memory_resource *mr = nullptr) const
+    {
+        if (grain == 0)
+            grain = 1;
+        if (bytes(i) < grain || !_container(i))
+            return materialize(i,mr);
+        std::deque<_part> parts;
+        std::vector<_job> jobs;
+        _split(i,grain,parts,jobs);
+        try
+        {
+            for (const _job &j : jobs)
+                pool.submit([this,j,mr]
+                {
+                    size_t c = j.first;
+                    for (size_t k = 0; k < j.n; ++k, c = tape[c].next)
+                        j.out[k] = _decode(c,_child_name(c,j.named),mr);
+                });
+            pool.wait();
+            size_t next_part = 0;
+            return _assemble(i,name(i),parts,next_part,mr);
+        }
+        catch (...)
+        {
+            if (!mr)
+                for (_part &p : parts)
+                    for (TAG *t : p.kids)
+                        delete t;
+            throw;
+        }
+    }
+};
+
+}
@@ -0,0 +1,161 @@
+#include <cassert>
+#include <iostream>
+#include <memory_resource>
+#include <string>
+#include <vector>
+
+#include "nbt.hpp"
+#include "nbt_tape.hpp"
+#include "nbt_test_docs.hpp"
+
+using namespace mclib;
+
+// document with a long list of compounds, nested lists and every tag type
+static bytes_t make_doc(size_t entities)
+{
+    compound_t root;
+    testScalars(root);
+    root["IA"] = new TAG_Int_Array("IA",int_array_t{7,8});
+    root["Empty"] = new TAG_List("Empty",list_t());
+    list_t ents;
+    for (size_t i = 0; i < entities; ++i)
+    {
+        compound_t e = testEntity(i);
+        e["Data"] = new TAG_Long_Array("Data",long_array_t(i % 50,(int64_t)i));
+        list_t tags;
+        for (size_t k = 0; k < i % 4; ++k)
+            tags.push_back(new TAG_String("","tag" + std::to_string(k)));
+        e["Tags"] = new TAG_List("Tags",tags);
+        ents.push_back(new TAG_Compound("",e));
+    }
+    root["Entities"] = new TAG_List("Entities",ents);
+    list_t nested;
+    for (int i = 0; i < 3; ++i)
+        nested.push_back(new TAG_List("",list_t()));
+    root["Nested"] = new TAG_List("Nested",nested);
+    return testEncode("root",root);
+}
+
+int main(int argc, char **argv)
+{
+    (void)argc;
+    (void)argv;
+    bytes_t doc = make_doc(500);
+    NbtTape tape(doc.data(),doc.size());
+    // root, 11 other children, per entity 5 tags and 0-3 strings, 3 lists
+    size_t strings = 0;
+    for (size_t i = 0; i < 500; ++i)
+        strings += i % 4;
+    assert(tape.size() == 1 + 12 + 500*5 + strings + 3);
+    assert(tape.id(0) == 10 && tape.name(0) == "root" && tape.count(0) == 12);
+    assert(tape.next(0) == tape.size() && tape.bytes(0) == doc.size() - 7);
+    // lookups
+    size_t dv = tape.find(0,"DataVersion");
+    assert(tape.view(dv).asInt() == 2230);
+    assert(tape.view(tape.find(0,"Name")).asString() == "minecraft:stone");
+    assert(tape.count(tape.find(0,"Name")) == 15);
+    assert(tape.count(tape.find(0,"IA")) == 2);
+    assert(tape.find(0,"Missing") == tape.size());
+    assert(!tape.view(tape.find(0,"Missing")).valid());
+    size_t ents = tape.find(0,"Entities");
+    assert(tape.id(ents) == 9 && tape.entry(ents).elem == 10);
+    assert(tape.count(ents) == 500);
+    size_t e7 = tape.child(ents,7);
+    assert(tape.count(e7) == 4);
+    assert(tape.view(tape.find(e7,"id")).asString() == "minecraft:pig7");
+    size_t pos = tape.find(e7,"Pos");
+    // numbers in lists have no entries of their own
+    assert(tape.next(pos) == pos+1 && tape.child(pos,0) == tape.size());
+    assert(tape.view(pos).at(2).asDouble() == 72.0);
+    size_t tags = tape.find(e7,"Tags");
+    assert(tape.count(tags) == 3);
+    assert(tape.view(tape.child(tags,2)).asString() == "tag2");
+    assert(tape.child(ents,500) == tape.size());
+    // skipping a subtree lands on the next sibling
+    assert(tape.next(tape.child(ents,499)) == tape.next(ents));
+    size_t c = 1, k = 0;
+    for (; c < tape.size(); c = tape.next(c), ++k)
+        assert(c == tape.child(0,k) && c == tape.find(0,tape.name(c)));
+    assert(k == 12);
+    assert(tape.count(tape.find(0,"Nested")) == 3);
+    // materialized subtrees encode back to the same bytes
+    {
+        TAG *t = tape.materialize(0);
+        assert(t->encode() == doc);
+        delete t;
+        t = tape.materialize(e7);
+        const char *p = doc.data() + tape.entry(e7).payload;
+        bytes_t enc = t->encode();
+        assert(bytes_t(p,p+tape.bytes(e7)) == bytes_t(enc.begin()+3,enc.end()));
+        delete t;
+    }
+    // parallel materialize with many grain sizes (splitting the entity list
+    // and the entities in it) on the heap and a synchronized pool
+    {
+        ThreadPool pool(3);
+        std::pmr::synchronized_pool_resource sync;
+        for (size_t grain : {0,1,40,100,1000,10000,1000000})
+        {
+            TAG *t = tape.materialize(0,pool,grain);
+            assert(t->encode() == doc);
+            delete t;
+            t = tape.materialize(0,pool,grain,&sync);
+            assert(t->encode() == doc);
+            t = tape.materialize(ents,pool,grain);
+            assert(((TAG_List*)t)->payloadSize() == tape.bytes(ents));
+            delete t;
+        }
+    }
+    // duplicate names are found when assembling split compounds too
+    {
+        bytes_t dup = {10,0,0, 1,0,1,'y',5, 12,0,1,'y',0,0,0,100};
+        dup.resize(dup.size() + 800);
+        dup.push_back(0);
+        NbtTape d(dup.data(),dup.size());
+        ThreadPool pool(2);
+        bool threw = false;
+        try { delete d.materialize(0,pool,10); }
+        catch (const char*) { threw = true; }
+        assert(threw);
+    }
+    // the tape is reused and every truncation is rejected
+    for (size_t n = 0; n < doc.size(); n += (n < 2000 ? 1 : 97))
+    {
+        bool threw = false;
+        try { tape.build(doc.data(),n); }
+        catch (const char*) { threw = true; }
+        assert(threw);
+    }
+    {
+        bytes_t extra = doc;
+        extra.push_back(0);
+        bool threw = false;
+        try { tape.build(extra.data(),extra.size()); }
+        catch (const char*) { threw = true; }
+        assert(threw);
+    }
+    // nesting limit
+    {
+        bytes_t deep = {9,0,0};
+        for (size_t i = 1; i < 1000; ++i)
+        {
+            deep.push_back(9);
+            deep.insert(deep.end(),{0,0,0,1});
+        }
+        deep.push_back(0);
+        deep.insert(deep.end(),{0,0,0,0});
+        bool threw = false;
+        try { tape.build(deep.data(),deep.size()); }
+        catch (const char*) { threw = true; }
+        assert(threw);
+        deep.resize(3 + 5*_nbt_max_depth);
+        deep[deep.size()-5] = 0;
+        deep[deep.size()-1] = 0;
+        tape.build(deep.data(),deep.size());
+        assert(tape.size() == _nbt_max_depth);
+    }
+    tape.build(doc.data(),doc.size());
+    assert(tape.view(tape.find(0,"DataVersion")).asInt() == 2230);
+    std::cout << "nbt tape tests passed" << std::endl;
+    return 0;
+}
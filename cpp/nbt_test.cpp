@@ -1,6 +1,11 @@
+#include <algorithm>
 #include <cassert>
 #include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
 
+#include "arena.hpp"
 #include "nbt.hpp"
 
 #include "jrand.hpp"
@@ -27,6 +32,130 @@ int main(int argc, char **argv)
             return 1;
         }
     }
+    // decoding into an arena gives the same tree, and reusing the arena after
+    // reset() does not allocate more blocks
+    mclib::Arena arena(1024);
+    size_t capacity = 0;
+    for (size_t round = 0; round < 3; ++round)
+    {
+        arena.reset();
+        mclib::TAG *atag = mclib::TAG::decode((char*)data,3128,&arena);
+        assert(atag->encode() == tag->encode());
+        assert(arena.used() > 0 && arena.used() <= arena.capacity());
+        if (round == 0)
+            capacity = arena.capacity();
+        assert(arena.capacity() == capacity);
+    }
+    // sizes kept by lists and compounds match what is written, for built
+    // and decoded trees, and encode(out) appends
+    {
+        mclib::list_t inner;
+        inner.push_back(new mclib::TAG_List("",mclib::list_t()));
+        mclib::compound_t c;
+        c["list"] = new mclib::TAG_List("list",inner);
+        c[""] = mclib::TAG::decode(tag->encode());
+        mclib::TAG *built = new mclib::TAG_Compound("built",c);
+        mclib::bytes_t enc = built->encode();
+        assert(enc.size() == built->nbtSize() && enc.size() == 3128 + 26);
+        mclib::TAG *again = mclib::TAG::decode(enc);
+        assert(again->nbtSize() == enc.size() && again->encode() == enc);
+        mclib::bytes_t out = {1,2};
+        again->encode(out);
+        assert(out.size() == enc.size() + 2
+                && std::equal(enc.begin(),enc.end(),out.begin()+2));
+        delete again;
+        delete built;
+    }
+    // compound lookups by name, small (scanned) and large (indexed), in
+    // insertion order, with equal names interned once
+    for (size_t n : {3,16,17,100,1000})
+    {
+        mclib::compound_t c;
+        mclib::order_t order;
+        for (size_t i = 0; i < n; ++i)
+        {
+            std::string k = "key" + std::to_string(i*7919 % n);
+            c[mclib::compound_t::key_type(k)] = new mclib::TAG_Int(k,(int32_t)i);
+            order.emplace_back(k);
+        }
+        mclib::TAG_Compound *comp = new mclib::TAG_Compound("",c,order);
+        mclib::TAG *dec = mclib::TAG::decode(comp->encode());
+        assert(comp->size() == n && dec->encode() == comp->encode());
+        for (size_t i = 0; i < n; ++i)
+        {
+            std::string k = "key" + std::to_string(i*7919 % n);
+            mclib::TAG *t = comp->get(k);
+            assert(t && t->getName() == k && t->encode()
+                    == mclib::TAG_Int(k,(int32_t)i).encode());
+            assert(((mclib::TAG_Compound*)dec)->get(k)->getNameId()
+                    == t->getNameId());
+        }
+        assert(!comp->get("missing") && !comp->get("key" + std::to_string(n)));
+        delete dec;
+        delete comp;
+    }
+    assert(mclib::TAG_Int("Name",1).getNameId()
+            == mclib::TAG_String("Name","x").getNameId());
+    // duplicate names and keys that do not match the tag name are rejected
+    {
+        const char dup[] = {10,0,0, 1,0,1,'a',5, 1,0,1,'a',6, 0};
+        bool threw = false;
+        try { mclib::TAG::decode(dup,sizeof(dup)); }
+        catch (const char*) { threw = true; }
+        assert(threw);
+        mclib::compound_t c;
+        c["a"] = new mclib::TAG_Int("b",1);
+        threw = false;
+        try { mclib::TAG_Compound("",c); }
+        catch (const char*) { threw = true; }
+        assert(threw);
+        delete c["a"];
+    }
+    // names interned from several threads at once get one id each
+    {
+        std::vector<std::thread> threads;
+        std::vector<std::vector<uint32_t>> ids(4);
+        for (size_t t = 0; t < 4; ++t)
+            threads.emplace_back([t,&ids]
+            {
+                for (size_t i = 0; i < 2000; ++i)
+                    ids[t].push_back(mclib::NbtNameTable::global().intern(
+                            "thread_name" + std::to_string(i))->id);
+            });
+        for (std::thread &th : threads)
+            th.join();
+        for (size_t t = 1; t < 4; ++t)
+            assert(ids[t] == ids[0]);
+    }
     delete tag;
+    // bulk array codecs agree with the single value ones for every length
+    // around the vector widths
+    for (size_t n = 0; n < 80; ++n)
+    {
+        std::vector<char> bytes(n*8+1);
+        for (size_t i = 0; i < bytes.size(); ++i)
+            bytes[i] = (char)(i*37+11);
+        const char *src = bytes.data()+1; // unaligned
+        std::vector<int16_t> s(n);
+        std::vector<int32_t> v(n);
+        std::vector<int64_t> l(n);
+        mclib::_from_bytes_array(src,s.data(),n);
+        mclib::_from_bytes_array(src,v.data(),n);
+        mclib::_from_bytes_array(src,l.data(),n);
+        for (size_t i = 0; i < n; ++i)
+        {
+            assert(s[i] == mclib::_from_bytes_short(src+2*i));
+            assert(v[i] == mclib::_from_bytes_int(src+4*i));
+            assert(l[i] == mclib::_from_bytes_long(src+8*i));
+        }
+        std::vector<char> out(n*8);
+        mclib::_to_bytes_array(out.data(),l.data(),n);
+        assert(std::equal(out.begin(),out.end(),src));
+        mclib::_to_bytes_array(out.data(),v.data(),n);
+        assert(std::equal(out.begin(),out.begin()+n*4,src));
+        mclib::_to_bytes_array(out.data(),s.data(),n);
+        assert(std::equal(out.begin(),out.begin()+n*2,src));
+    }
+    std::cout << "nbt tests passed" << std::endl;
     return 0;
 }
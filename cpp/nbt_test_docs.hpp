@@ -0,0 +1,51 @@
+/*
+Documents shared by the NBT tests
+
+testScalars() adds one tag of each scalar type (and a byte array) with fixed
+values to a compound, testEntity(i) is the i-th entity of a list ("id" of
+minecraft:pig<i> and a "Pos" list of i*10+0, 1, 2), testEncode() encodes a
+compound as a named root and frees the tree.
+*/
+
+#pragma once
+
+#include <string>
+
+#include "nbt.hpp"
+
+namespace mclib
+{
+
+// DataVersion 2230, Name, B, S, L, F, D and BA
+inline void testScalars(compound_t &c)
+{
+    c["DataVersion"] = new TAG_Int("DataVersion",2230);
+    c["Name"] = new TAG_String("Name","minecraft:stone");
+    c["B"] = new TAG_Byte("B",-5);
+    c["S"] = new TAG_Short("S",-1234);
+    c["L"] = new TAG_Long("L",-77777777777LL);
+    c["F"] = new TAG_Float("F",1.25f);
+    c["D"] = new TAG_Double("D",-0.1);
+    c["BA"] = new TAG_Byte_Array("BA",byte_array_t{1,-2,3});
+}
+
+inline compound_t testEntity(size_t i)
+{
+    compound_t e;
+    e["id"] = new TAG_String("id","minecraft:pig" + std::to_string(i));
+    list_t pos;
+    for (int k = 0; k < 3; ++k)
+        pos.push_back(new TAG_Double("",i*10.0+k));
+    e["Pos"] = new TAG_List("Pos",pos);
+    return e;
+}
+
+inline bytes_t testEncode(const std::string &name, const compound_t &root)
+{
+    TAG *tag = new TAG_Compound(name,root);
+    bytes_t ret = tag->encode();
+    delete tag;
+    return ret;
+}
+
+}
@@ -0,0 +1,432 @@
+/*
+Zero copy read only access to NBT data
+
+NbtView refers to one tag inside a borrowed buffer (a byte array, a decompressed
+chunk or a MappedFile) and reads values directly from the big endian bytes.
+Nothing is copied or allocated: names and strings come back as string_view,
+arrays as NbtArray views that convert elements on access. Looking up a compound
+key or a list element skips over the other tags using their length prefixes,
+so getting DataVersion or Level.xPos costs little more than a scan over the
+tag headers before it.
+
+The buffer must outlive every view into it. Lookups that find nothing return
+an invalid view (valid() is false), reading a value of the wrong type throws.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+
+#include "mapped_file.hpp"
+#include "utils.hpp"
+
+namespace mclib
+{
+
+// deepest nesting of lists and compounds accepted (same as Minecraft)
+const size_t _nbt_max_depth = 512;
+
+// pointer past the payload of type tid at p (payload must end before end)
+static inline const char *_nbt_skip(const char *p, const char *end, int8_t tid,
+        size_t depth = 0)
+{
+    size_t n;
+    switch (tid)
+    {
+    case 1: n = 1; break;
+    case 2: n = 2; break;
+    case 3: case 5: n = 4; break;
+    case 4: case 6: n = 8; break;
+    case 7: case 11: case 12:
+        if (end - p < 4)
+            throw "nbt view array length out of bounds";
+        n = 4 + (size_t)(uint32_t)_from_bytes_int(p)
+                * (tid == 7 ? 1 : tid == 11 ? 4 : 8);
+        break;
+    case 8:
+        if (end - p < 2)
+            throw "nbt view string length out of bounds";
+        n = 2 + (size_t)(uint16_t)_from_bytes_short(p);
+        break;
+    case 9:
+    {
+        if (depth >= _nbt_max_depth)
+            throw "nbt view nesting too deep";
+        if (end - p < 5)
+            throw "nbt view list header out of bounds";
+        int8_t et = p[0];
+        size_t len = (uint32_t)_from_bytes_int(p+1);
+        p += 5;
+        // fixed size elements are skipped all at once
+        size_t fixed = et == 1 ? 1 : et == 2 ? 2 : (et == 3 || et == 5) ? 4
+                : (et == 4 || et == 6) ? 8 : 0;
+        if (fixed)
+        {
+            if ((size_t)(end - p) / fixed < len)
+                throw "nbt view list out of bounds";
+            return p + len*fixed;
+        }
+        if (et == 0)
+            return p;
+        for (size_t i = 0; i < len; ++i)
+            p = _nbt_skip(p,end,et,depth+1);
+        return p;
+    }
+    case 10:
+    {
+        if (depth >= _nbt_max_depth)
+            throw "nbt view nesting too deep";
+        for (;;)
+        {
+            if (p >= end)
+                throw "nbt view compound not terminated";
+            int8_t t = *p++;
+            if (t == 0)
+                return p;
+            if (end - p < 2)
+                throw "nbt view tag name out of bounds";
+            size_t name_len = (uint16_t)_from_bytes_short(p);
+            p += 2;
+            if ((size_t)(end - p) < name_len)
+                throw "nbt view tag name out of bounds";
+            p = _nbt_skip(p + name_len,end,t,depth+1);
+        }
+    }
+    default:
+        throw "nbt view invalid tag type id";
+    }
+    if ((size_t)(end - p) < n)
+        throw "nbt view payload out of bounds";
+    return p + n;
+}
+
+// view of a big endian array of T (int8_t, int32_t or int64_t)
+template <typename T>
+class NbtArray
+{
+private:
+    const char *ptr;
+    size_t len;
+public:
+    NbtArray(): ptr(nullptr), len(0) {}
+    NbtArray(const char *p, size_t n): ptr(p), len(n) {}
+    size_t size() const { return len; }
+    bool empty() const { return len == 0; }
+    // raw big endian bytes
+    const char *data() const { return ptr; }
+    size_t bytes() const { return len*sizeof(T); }
+    T operator[](size_t i) const
+    {
+        const char *p = ptr + i*sizeof(T);
+        if constexpr (sizeof(T) == 1)
+            return _from_bytes_byte(p);
+        else if constexpr (sizeof(T) == 4)
+            return _from_bytes_int(p);
+        else
+            return _from_bytes_long(p);
+    }
+    // convert all elements to host order in out (len elements)
+    void copyTo(T *out) const
+    {
+        _from_bytes_array(ptr,out,len);
+    }
+    class iterator
+    {
+    private:
+        const NbtArray *a;
+        size_t i;
+    public:
+        iterator(const NbtArray *a, size_t i): a(a), i(i) {}
+        T operator*() const { return (*a)[i]; }
+        iterator &operator++() { ++i; return *this; }
+        bool operator!=(const iterator &o) const { return i != o.i; }
+        bool operator==(const iterator &o) const { return i == o.i; }
+    };
+    iterator begin() const { return iterator(this,0); }
+    iterator end() const { return iterator(this,len); }
+};
+
+class NbtView
+{
+private:
+    // start of the payload and end of the buffer
+    const char *ptr;
+    const char *bend;
+    std::string_view tname;
+    // tag type, -1 for an invalid view
+    int8_t tid;
+    void _expect(int8_t t, const char *msg) const
+    {
+        if (tid != t)
+            throw msg;
+    }
+    void _need(size_t n) const
+    {
+        if (ptr > bend || (size_t)(bend - ptr) < n)
+            throw "nbt view payload out of bounds";
+    }
+    template <typename T>
+    NbtArray<T> _array(int8_t t, const char *msg) const
+    {
+        _expect(t,msg);
+        _need(4);
+        size_t n = (uint32_t)_from_bytes_int(ptr);
+        if ((size_t)(bend - ptr - 4) / sizeof(T) < n)
+            throw "nbt view array out of bounds";
+        return NbtArray<T>(ptr+4,n);
+    }
+    // parse a named tag header at p, invalid view for TAG_End
+    static NbtView _named(const char *&p, const char *end)
+    {
+        if (p >= end)
+            throw "nbt view tag header out of bounds";
+        int8_t t = *p++;
+        if (t == 0)
+            return NbtView();
+        if (end - p < 2)
+            throw "nbt view tag name out of bounds";
+        size_t n = (uint16_t)_from_bytes_short(p);
+        p += 2;
+        if ((size_t)(end - p) < n)
+            throw "nbt view tag name out of bounds";
+        std::string_view name(p,n);
+        p += n;
+        return NbtView(p,end,t,name);
+    }
+public:
+    NbtView(): ptr(nullptr), bend(nullptr), tid(-1) {}
+    // payload at p of type t
+    NbtView(const char *p, const char *end, int8_t t,
+            std::string_view name = {}): ptr(p), bend(end), tname(name), tid(t)
+    {}
+    // the root tag of a document (a named tag, normally a compound)
+    static NbtView root(const char *data, size_t len)
+    {
+        const char *p = data;
+        NbtView ret = _named(p,data+len);
+        if (!ret.valid())
+            throw "nbt view document is empty (tag_end)";
+        return ret;
+    }
+    static NbtView root(const MappedFile &f)
+    {
+        return root(f.data(),f.size());
+    }
+    bool valid() const { return tid > 0; }
+    explicit operator bool() const { return valid(); }
+    int8_t id() const { return tid; }
+    std::string_view name() const { return tname; }
+    // payload bytes [payload(),payloadEnd()), payloadEnd() scans nested tags
+    const char *payload() const { return ptr; }
+    const char *payloadEnd() const { return _nbt_skip(ptr,bend,tid); }
+
+    // scalar values
+    int8_t asByte() const
+    {
+        _expect(1,"nbt view not a tag_byte");
+        _need(1);
+        return _from_bytes_byte(ptr);
+    }
+    int16_t asShort() const
+    {
+        _expect(2,"nbt view not a tag_short");
+        _need(2);
+        return _from_bytes_short(ptr);
+    }
+    int32_t asInt() const
+    {
+        _expect(3,"nbt view not a tag_int");
+        _need(4);
+        return _from_bytes_int(ptr);
+    }
+    int64_t asLong() const
+    {
+        _expect(4,"nbt view not a tag_long");
+        _need(8);
+        return _from_bytes_long(ptr);
+    }
+    float asFloat() const
+    {
+        _expect(5,"nbt view not a tag_float");
+        _need(4);
+        return _from_bytes_float(ptr);
+    }
+    double asDouble() const
+    {
+        _expect(6,"nbt view not a tag_double");
+        _need(8);
+        return _from_bytes_double(ptr);
+    }
+    // any integer tag widened to 64 bits
+    int64_t asInteger() const
+    {
+        switch (tid)
+        {
+        case 1: return asByte();
+        case 2: return asShort();
+        case 3: return asInt();
+        case 4: return asLong();
+        default: throw "nbt view not an integer tag";
+        }
+    }
+    std::string_view asString() const
+    {
+        _expect(8,"nbt view not a tag_string");
+        _need(2);
+        size_t n = (uint16_t)_from_bytes_short(ptr);
+        _need(2+n);
+        return std::string_view(ptr+2,n);
+    }
+    // arrays
+    NbtArray<int8_t> asByteArray() const
+    { return _array<int8_t>(7,"nbt view not a tag_byte_array"); }
+    NbtArray<int32_t> asIntArray() const
+    { return _array<int32_t>(11,"nbt view not a tag_int_array"); }
+    NbtArray<int64_t> asLongArray() const
+    { return _array<int64_t>(12,"nbt view not a tag_long_array"); }
+
+    // lists
+    int8_t listType() const
+    {
+        _expect(9,"nbt view not a tag_list");
+        _need(5);
+        return ptr[0];
+    }
+    // number of elements in a list, entries in a compound (scans it) or
+    // elements in an array
+    size_t size() const
+    {
+        switch (tid)
+        {
+        case 7: return asByteArray().size();
+        case 11: return asIntArray().size();
+        case 12: return asLongArray().size();
+        case 9:
+            _need(5);
+            return (uint32_t)_from_bytes_int(ptr+1);
+        case 10:
+        {
+            size_t n = 0;
+            for (auto it = begin(); it != end(); ++it)
+                ++n;
+            return n;
+        }
+        default:
+            throw "nbt view size of a tag without elements";
+        }
+    }
+    // list element i, O(1) for lists of fixed size tags, otherwise skips the
+    // elements before it
+    NbtView at(size_t i) const
+    {
+        int8_t et = listType();
+        size_t len = (uint32_t)_from_bytes_int(ptr+1);
+        if (i >= len)
+            return NbtView();
+        const char *p = ptr + 5;
+        size_t fixed = et == 1 ? 1 : et == 2 ? 2 : (et == 3 || et == 5) ? 4
+                : (et == 4 || et == 6) ? 8 : 0;
+        if (fixed)
+        {
+            // the whole list must fit, like when it is skipped
+            if ((size_t)(bend - p) / fixed < len)
+                throw "nbt view list out of bounds";
+            p += i*fixed;
+        }
+        else
+            for (size_t k = 0; k < i; ++k)
+                p = _nbt_skip(p,bend,et);
+        return NbtView(p,bend,et);
+    }
+
+    // compounds
+    // child with the given name (invalid view if there is none)
+    NbtView get(std::string_view key) const
+    {
+        _expect(10,"nbt view not a tag_compound");
+        for (NbtView v : *this)
+            if (v.name() == key)
+                return v;
+        return NbtView();
+    }
+    NbtView operator[](std::string_view key) const { return get(key); }
+    // follow a dot separated path of compound keys, like "Level.xPos"
+    NbtView find(std::string_view path) const
+    {
+        NbtView v = *this;
+        while (v.valid())
+        {
+            size_t dot = path.find('.');
+            if (v.tid != 10)
+                return NbtView();
+            v = v.get(path.substr(0,dot));
+            if (dot == std::string_view::npos)
+                break;
+            path.remove_prefix(dot+1);
+        }
+        return v;
+    }
+
+    // iteration over list elements or compound entries (in file order)
+    class iterator
+    {
+        friend class NbtView;
+    private:
+        const char *p;
+        const char *bend;
+        // list element type, 0 when iterating a compound
+        int8_t et;
+        size_t remaining;
+        // current tag (payload, type and name)
+        const char *cp;
+        int8_t ct;
+        std::string_view cname;
+        void _load()
+        {
+            if (et)
+            {
+                cp = p;
+                ct = et;
+                return;
+            }
+            const char *q = p;
+            NbtView v = _named(q,bend);
+            if (!v.valid())
+                p = nullptr; // reached TAG_End
+            cp = v.ptr;
+            ct = v.tid;
+            cname = v.tname;
+        }
+        iterator(): p(nullptr), bend(nullptr), et(0), remaining(0),
+                cp(nullptr), ct(-1) {}
+        iterator(const char *p, const char *end, int8_t et, size_t n):
+                p(p), bend(end), et(et), remaining(n) { _load(); }
+    public:
+        NbtView operator*() const { return NbtView(cp,bend,ct,cname); }
+        iterator &operator++()
+        {
+            p = _nbt_skip(cp,bend,ct);
+            if (et && --remaining == 0)
+                p = nullptr;
+            else
+                _load();
+            return *this;
+        }
+        bool operator!=(const iterator &o) const { return p != o.p; }
+        bool operator==(const iterator &o) const { return p == o.p; }
+    };
+    iterator begin() const
+    {
+        if (tid == 10)
+            return iterator(ptr,bend,0,0);
+        int8_t et = listType();
+        size_t len = (uint32_t)_from_bytes_int(ptr+1);
+        if (len == 0 || et == 0)
+            return iterator();
+        return iterator(ptr+5,bend,et,len);
+    }
+    iterator end() const { return iterator(); }
+};
+
+}
@@ -0,0 +1,154 @@
+#include <cassert>
+#include <cstdio>
+#include <iostream>
+#include <string>
+
+#include "nbt.hpp"
+#include "nbt_test_docs.hpp"
+#include "nbt_view.hpp"
+
+using namespace mclib;
+
+// a small chunk like document
+static bytes_t make_doc()
+{
+    compound_t level;
+    level["xPos"] = new TAG_Int("xPos",-12);
+    level["zPos"] = new TAG_Int("zPos",31);
+    level["Status"] = new TAG_String("Status","full");
+    level["Biomes"] = new TAG_Int_Array("Biomes",int_array_t{1,-2,300000});
+    level["Heights"] = new TAG_Long_Array("Heights",
+            long_array_t{-1,0x0102030405060708LL});
+    level["Light"] = new TAG_Byte_Array("Light",byte_array_t{1,2,-3});
+    list_t sections;
+    for (int y = 0; y < 4; ++y)
+    {
+        compound_t sec;
+        sec["Y"] = new TAG_Byte("Y",(int8_t)y);
+        list_t palette;
+        for (int i = 0; i <= y; ++i)
+        {
+            compound_t entry;
+            entry["Name"] = new TAG_String("Name",
+                    "minecraft:block" + std::to_string(i));
+            palette.push_back(new TAG_Compound("",entry));
+        }
+        sec["Palette"] = new TAG_List("Palette",palette);
+        sections.push_back(new TAG_Compound("",sec));
+    }
+    level["Sections"] = new TAG_List("Sections",sections);
+    list_t pos;
+    for (double d : {1.5,-2.25,64.0})
+        pos.push_back(new TAG_Double("",d));
+    level["Pos"] = new TAG_List("Pos",pos);
+    level["Empty"] = new TAG_List("Empty",list_t());
+    compound_t root;
+    root["Level"] = new TAG_Compound("Level",level);
+    root["DataVersion"] = new TAG_Int("DataVersion",2230);
+    root["Scale"] = new TAG_Float("Scale",0.5f);
+    root["Seed"] = new TAG_Long("Seed",-7LL);
+    root["Slot"] = new TAG_Short("Slot",-300);
+    return testEncode("",root);
+}
+
+int main(int argc, char **argv)
+{
+    (void)argc;
+    (void)argv;
+    bytes_t doc = make_doc();
+    NbtView root = NbtView::root(doc.data(),doc.size());
+    assert(root.id() == 10 && root.name() == "");
+    assert(root.payloadEnd() == doc.data() + doc.size());
+    assert(root.size() == 5);
+    // scalars and paths
+    assert(root["DataVersion"].asInt() == 2230);
+    assert(root.find("Level.xPos").asInt() == -12);
+    assert(root.find("Level.zPos").asInteger() == 31);
+    assert(root["Scale"].asFloat() == 0.5f);
+    assert(root["Seed"].asLong() == -7);
+    assert(root["Slot"].asShort() == -300);
+    assert(root.find("Level.Status").asString() == "full");
+    assert(!root["Missing"] && !root.find("Level.Missing.x"));
+    assert(!root.find("DataVersion.x"));
+    bool threw = false;
+    try { root["DataVersion"].asLong(); }
+    catch (const char*) { threw = true; }
+    assert(threw);
+    // arrays
+    NbtView level = root["Level"];
+    NbtArray<int32_t> biomes = level["Biomes"].asIntArray();
+    assert(biomes.size() == 3 && biomes[0] == 1 && biomes[1] == -2
+            && biomes[2] == 300000);
+    NbtArray<int64_t> heights = level["Heights"].asLongArray();
+    int64_t h[2];
+    heights.copyTo(h);
+    assert(h[0] == -1 && h[1] == 0x0102030405060708LL);
+    NbtArray<int8_t> light = level["Light"].asByteArray();
+    int sum = 0;
+    for (int8_t v : light)
+        sum += v;
+    assert(light.size() == 3 && sum == 0 && level["Light"].size() == 3);
+    // lists
+    NbtView sections = level["Sections"];
+    assert(sections.listType() == 10 && sections.size() == 4);
+    int y = 0;
+    for (NbtView sec : sections)
+    {
+        assert(sec["Y"].asByte() == y);
+        NbtView palette = sec["Palette"];
+        assert(palette.size() == (size_t)y+1);
+        assert(palette.at(y)["Name"].asString()
+                == "minecraft:block" + std::to_string(y));
+        ++y;
+    }
+    assert(y == 4);
+    assert(sections.at(2)["Y"].asByte() == 2 && !sections.at(4));
+    NbtView pos = level["Pos"];
+    assert(pos.at(1).asDouble() == -2.25 && pos.at(2).asDouble() == 64.0);
+    assert(level["Empty"].size() == 0
+            && level["Empty"].begin() == level["Empty"].end());
+    // every truncation of the document is rejected by a full scan
+    for (size_t n = 0; n < doc.size(); ++n)
+    {
+        threw = false;
+        try { NbtView::root(doc.data(),n).payloadEnd(); }
+        catch (const char*) { threw = true; }
+        assert(threw);
+    }
+    // a child name longer than the rest of the data is caught at the name
+    {
+        const char bad[] = {10,0,0, 1,(char)0xff,(char)0xff,'a',5, 0};
+        std::string e;
+        try { NbtView::root(bad,sizeof(bad)).payloadEnd(); }
+        catch (const char *m) { e = m; }
+        assert(e == "nbt view tag name out of bounds");
+    }
+    // a list of ints shorter than its length is caught by at()
+    {
+        bytes_t bad = {9,0,0, 3,0,0,0x03,(char)0xe8, 0,0,0,7};
+        NbtView list = NbtView::root(bad.data(),bad.size());
+        std::string e;
+        try { list.at(999).asInt(); }
+        catch (const char *m) { e = m; }
+        assert(e == "nbt view list out of bounds");
+        e.clear();
+        try { list.at(0).asInt(); }
+        catch (const char *m) { e = m; }
+        assert(e == "nbt view list out of bounds");
+    }
+    // mapped file
+    std::string path = "/tmp/nbt_view_test.nbt";
+    FILE *f = fopen(path.c_str(),"wb");
+    assert(f);
+    fwrite(doc.data(),1,doc.size(),f);
+    fclose(f);
+    {
+        MappedFile mf(path);
+        mf.willNeed();
+        assert(mf.size() == doc.size());
+        assert(NbtView::root(mf).find("Level.zPos").asInt() == 31);
+    }
+    remove(path.c_str());
+    std::cout << "nbt view tests passed" << std::endl;
+    return 0;
+}
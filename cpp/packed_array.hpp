@@ -0,0 +1,327 @@
+/*
+Packed block state and heightmap arrays
+
+Chunk sections keep one palette index per block (4096 of them) and heightmaps
+one height per column (256) packed into a long array with a fixed number of
+bits per entry, lowest bits first. Two layouts exist:
+- spanning (before 1.16, DataVersion < 2529): the entries form one bit stream
+  and an entry can continue in the next long
+- aligned (1.16 and later): each long holds floor(64/bits) entries and the
+  bits left at its top are unused
+
+PackedArray unpacks 1 to 16 bits per entry into uint16_t, optionally mapping
+each entry through a palette in the same pass (with the indexes checked
+against the palette size), from host order longs, from a TAG_Long_Array or
+from a big endian NbtArray view (converted into a buffer kept by the object,
+nothing else is copied). pack() goes the other way.
+
+With AVX2 one aligned long of 4 bits or more is split per step (its bytes
+shuffled into eight 32 bit lanes and shifted by lane, two vectors when it
+holds more than 8 entries) and the spanning layout 8 entries per step (8
+entries take exactly bits bytes). Palette lookups are gathers on the palette
+widened to 32 bits with indexes clamped to it, so a bad index never reads
+outside it. The rest (and other targets) is done a long at a time without
+SIMD.
+
+Not thread safe (the palette and view buffers are reused), use one object per
+thread.
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#include "nbt.hpp"
+#include "nbt_view.hpp"
+
+namespace mclib
+{
+
+const int PACKED_SPANNING = 0;
+const int PACKED_ALIGNED = 1;
+
+class PackedArray
+{
+private:
+    // palette widened for gathers
+    std::vector<uint32_t> pal;
+    // longs of a view in host order
+    std::vector<int64_t> host;
+    static void _check(size_t nwords, size_t n, unsigned bits, int layout)
+    {
+        if (bits < 1 || bits > 16)
+            throw "packed array bits per entry out of range";
+        if (layout != PACKED_SPANNING && layout != PACKED_ALIGNED)
+            throw "packed array layout unknown";
+        if (nwords < longs(n,bits,layout))
+            throw "packed array too short";
+    }
+    // entries [i,n) a long at a time, returns the largest index seen
+    template <bool PAL>
+    static uint32_t _scalar(const uint64_t *w, size_t i, size_t n,
+            unsigned bits, bool aligned, const uint32_t *pal, uint32_t last,
+            uint16_t *out)
+    {
+        const uint64_t mask = ((uint64_t)1 << bits) - 1;
+        uint32_t top = 0;
+        auto emit = [&](uint64_t v)
+        {
+            uint32_t e = (uint32_t)(v & mask);
+            top = std::max(top,e);
+            out[i] = PAL ? (uint16_t)pal[std::min(e,last)] : (uint16_t)e;
+        };
+        if (aligned)
+        {
+            size_t k = 64 / bits;
+            for (size_t wi = i / k; i < n; ++wi)
+            {
+                uint64_t v = w[wi] >> (i % k * bits);
+                for (size_t j = i % k; j < k && i < n; ++j, ++i, v >>= bits)
+                    emit(v);
+            }
+            return top;
+        }
+        for (size_t p = i*bits; i < n; ++i, p += bits)
+        {
+            size_t wi = p >> 6, s = p & 63;
+            uint64_t v = w[wi] >> s;
+            if (s + bits > 64)
+                v |= w[wi+1] << (64 - s);
+            emit(v);
+        }
+        return top;
+    }
+#if defined(__AVX2__)
+    // eight 32 bit entries a to out (through the palette)
+    template <bool PAL>
+    static __m256i _lookup(__m256i a, const uint32_t *pal, __m256i last,
+            __m256i &top)
+    {
+        top = _mm256_max_epu32(top,a);
+        if (!PAL)
+            return a;
+        return _mm256_i32gather_epi32((const int*)pal,
+                _mm256_min_epu32(a,last),4);
+    }
+    // entries from the start while there is room for whole vector stores,
+    // returns how many are done
+    template <bool PAL>
+    static size_t _avx2(const uint64_t *w, size_t nwords, size_t n,
+            unsigned bits, bool aligned, const uint32_t *pal, uint32_t last,
+            uint16_t *out, uint32_t &top_out)
+    {
+        alignas(32) uint8_t ctl[2][32];
+        alignas(32) uint32_t sh[2][8];
+        size_t k = aligned ? 64 / bits : 8;
+        // longs of more than 16 entries (below 4 bits) are left to _scalar
+        if (k > 16)
+        {
+            top_out = 0;
+            return 0;
+        }
+        // lane 1 of the spanning layout loads from this byte
+        size_t s1 = aligned ? 0 : 4*bits >> 3;
+        for (size_t j = 0; j < 16; ++j)
+        {
+            size_t v = j / 8, lane = j % 8 / 4, slot = j % 4;
+            size_t p = j*bits;
+            size_t base = aligned || lane == 0 ? 0 : s1;
+            for (size_t b = 0; b < 4; ++b)
+            {
+                size_t byte = (p >> 3) - base + b;
+                bool ok = aligned ? j < k && byte < 8 : j < 8;
+                ctl[v][lane*16 + slot*4 + b] = ok ? (uint8_t)byte : 0x80;
+            }
+            sh[v][j % 8] = (uint32_t)(p & 7);
+        }
+        const __m256i c0 = _mm256_load_si256((const __m256i*)ctl[0]);
+        const __m256i c1 = _mm256_load_si256((const __m256i*)ctl[1]);
+        const __m256i h0 = _mm256_load_si256((const __m256i*)sh[0]);
+        const __m256i h1 = _mm256_load_si256((const __m256i*)sh[1]);
+        const __m256i mask = _mm256_set1_epi32((1 << bits) - 1);
+        const __m256i lastv = _mm256_set1_epi32((int)last);
+        __m256i top = _mm256_setzero_si256();
+        size_t i = 0;
+        if (aligned)
+        {
+            size_t step = k > 8 ? 16 : 8;
+            for (size_t wi = 0; i + step <= n; i += k, ++wi)
+            {
+                __m256i x = _mm256_set1_epi64x((long long)w[wi]);
+                __m256i a = _mm256_and_si256(_mm256_srlv_epi32(
+                        _mm256_shuffle_epi8(x,c0),h0),mask);
+                a = _lookup<PAL>(a,pal,lastv,top);
+                if (k > 8)
+                {
+                    __m256i b = _mm256_and_si256(_mm256_srlv_epi32(
+                            _mm256_shuffle_epi8(x,c1),h1),mask);
+                    b = _lookup<PAL>(b,pal,lastv,top);
+                    __m256i p = _mm256_permute4x64_epi64(
+                            _mm256_packus_epi32(a,b),0xd8);
+                    _mm256_storeu_si256((__m256i*)(out+i),p);
+                }
+                else
+                {
+                    __m256i p = _mm256_permute4x64_epi64(
+                            _mm256_packus_epi32(a,a),0x08);
+                    _mm_storeu_si128((__m128i*)(out+i),
+                            _mm256_castsi256_si128(p));
+                }
+            }
+        }
+        else
+        {
+            const uint8_t *bytes = (const uint8_t*)w;
+            size_t nbytes = nwords*8;
+            for (size_t g = 0; i + 8 <= n && g + s1 + 16 <= nbytes;
+                    i += 8, g += bits)
+            {
+                __m256i x = _mm256_inserti128_si256(_mm256_castsi128_si256(
+                        _mm_loadu_si128((const __m128i*)(bytes+g))),
+                        _mm_loadu_si128((const __m128i*)(bytes+g+s1)),1);
+                __m256i a = _mm256_and_si256(_mm256_srlv_epi32(
+                        _mm256_shuffle_epi8(x,c0),h0),mask);
+                a = _lookup<PAL>(a,pal,lastv,top);
+                __m256i p = _mm256_permute4x64_epi64(
+                        _mm256_packus_epi32(a,a),0x08);
+                _mm_storeu_si128((__m128i*)(out+i),_mm256_castsi256_si128(p));
+            }
+        }
+        alignas(32) uint32_t t[8];
+        _mm256_store_si256((__m256i*)t,top);
+        top_out = *std::max_element(t,t+8);
+        return i;
+    }
+#endif
+    template <bool PAL>
+    uint32_t _unpack(const int64_t *words, size_t nwords, size_t n,
+            unsigned bits, bool aligned, uint16_t *out)
+    {
+        const uint64_t *w = (const uint64_t*)words;
+        const uint32_t *p = PAL ? pal.data() : nullptr;
+        uint32_t last = PAL ? (uint32_t)pal.size() - 1 : 0;
+        uint32_t top = 0;
+        size_t i = 0;
+#if defined(__AVX2__)
+        i = _avx2<PAL>(w,nwords,n,bits,aligned,p,last,out,top);
+#else
+        (void)nwords;
+#endif
+        return std::max(top,_scalar<PAL>(w,i,n,bits,aligned,p,last,out));
+    }
+public:
+    // longs holding n entries
+    static size_t longs(size_t n, unsigned bits, int layout)
+    {
+        if (layout == PACKED_ALIGNED)
+        {
+            size_t k = 64 / bits;
+            return (n + k-1) / k;
+        }
+        return (n*bits + 63) / 64;
+    }
+    // layout used by chunks of a data version (1.16 changed it)
+    static int layout(int32_t data_version)
+    {
+        return data_version >= 2529 ? PACKED_ALIGNED : PACKED_SPANNING;
+    }
+    // bits per block of a section with a palette of this size
+    static unsigned sectionBits(size_t palette_size)
+    {
+        unsigned b = 4;
+        while (((size_t)1 << b) < palette_size)
+            ++b;
+        return b;
+    }
+    // unpack n entries from host order longs into out, with a palette each
+    // entry is replaced by palette[entry] (and must be in it), a palette of
+    // 1 entry with no longs (sections of a single block) fills out with it
+    void unpack(const int64_t *words, size_t nwords, unsigned bits,
+            int layout, size_t n, uint16_t *out,
+            const uint16_t *palette = nullptr, size_t palette_size = 0)
+    {
+        if (palette && palette_size == 1 && nwords == 0)
+        {
+            std::fill(out,out+n,palette[0]);
+            return;
+        }
+        _check(nwords,n,bits,layout);
+        bool aligned = layout == PACKED_ALIGNED;
+        if (!palette)
+        {
+            _unpack<false>(words,nwords,n,bits,aligned,out);
+            return;
+        }
+        if (palette_size == 0)
+            throw "packed array palette is empty";
+        pal.assign(palette,palette+palette_size);
+        if (_unpack<true>(words,nwords,n,bits,aligned,out) >= palette_size)
+            throw "packed array index not in palette";
+    }
+    void unpack(const TAG_Long_Array &t, unsigned bits, int layout, size_t n,
+            uint16_t *out, const uint16_t *palette = nullptr,
+            size_t palette_size = 0)
+    {
+        unpack(t.value.data(),t.value.size(),bits,layout,n,out,palette,
+                palette_size);
+    }
+    void unpack(const NbtArray<int64_t> &a, unsigned bits, int layout,
+            size_t n, uint16_t *out, const uint16_t *palette = nullptr,
+            size_t palette_size = 0)
+    {
+        host.resize(a.size());
+        a.copyTo(host.data());
+        unpack(host.data(),host.size(),bits,layout,n,out,palette,
+                palette_size);
+    }
+    // pack n entries (each below 2^bits) into longs(n,bits,layout) longs
+    static void pack(const uint16_t *in, size_t n, unsigned bits, int layout,
+            int64_t *words)
+    {
+        _check((size_t)-1,n,bits,layout);
+        size_t nwords = longs(n,bits,layout);
+        uint64_t *w = (uint64_t*)words;
+        std::fill(w,w+nwords,0);
+        uint32_t top = 0;
+        if (layout == PACKED_ALIGNED)
+        {
+            size_t k = 64 / bits;
+            for (size_t wi = 0, i = 0; i < n; ++wi)
+            {
+                uint64_t v = 0;
+                for (size_t j = 0; j < k && i < n; ++j, ++i)
+                {
+                    top |= in[i];
+                    v |= (uint64_t)in[i] << (j*bits);
+                }
+                w[wi] = v;
+            }
+        }
+        else
+            for (size_t i = 0, p = 0; i < n; ++i, p += bits)
+            {
+                size_t wi = p >> 6, s = p & 63;
+                top |= in[i];
+                w[wi] |= (uint64_t)in[i] << s;
+                if (s + bits > 64)
+                    w[wi+1] |= (uint64_t)in[i] >> (64 - s);
+            }
+        if (top >> bits)
+            throw "packed array entry does not fit in its bits";
+    }
+    static void pack(const uint16_t *in, size_t n, unsigned bits, int layout,
+            long_array_t &out)
+    {
+        _check((size_t)-1,n,bits,layout);
+        out.resize(longs(n,bits,layout));
+        pack(in,n,bits,layout,out.data());
+    }
+};
+
+}
@@ -0,0 +1,121 @@
+/*
+Benchmark for unpacking block state and heightmap arrays
+
+packed_array_bench [sections] [min_secs]
+
+Unpacks random 4096 entry sections (and 256 entry heightmaps at 9 bits) in both
+layouts for the common widths, with PackedArray (with and without a palette)
+and with a plain loop reading each entry by itself for comparison. Prints one
+key=value line per case with ns/section and entries/s.
+*/
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "jrand.hpp"
+#include "packed_array.hpp"
+
+using namespace mclib;
+
+typedef std::chrono::steady_clock clk;
+
+// entry by entry with a division per entry, how chunk readers usually do it
+static void naive(const std::vector<int64_t> &w, unsigned bits, int layout,
+        size_t n, const uint16_t *pal, uint16_t *out)
+{
+    uint64_t mask = ((uint64_t)1 << bits) - 1;
+    for (size_t i = 0; i < n; ++i)
+    {
+        uint64_t v;
+        if (layout == PACKED_ALIGNED)
+        {
+            size_t k = 64 / bits;
+            v = (uint64_t)w[i / k] >> (i % k * bits);
+        }
+        else
+        {
+            size_t p = i*bits, wi = p / 64, s = p % 64;
+            v = (uint64_t)w[wi] >> s;
+            if (s + bits > 64)
+                v |= (uint64_t)w[wi+1] << (64 - s);
+        }
+        out[i] = pal ? pal[v & mask] : (uint16_t)(v & mask);
+    }
+}
+
+template <typename F>
+static void run(const char *mode, int layout, unsigned bits, size_t n,
+        size_t count, double min_secs, F f)
+{
+    size_t iters = 0;
+    double secs = 0;
+    auto start = clk::now();
+    do
+    {
+        for (size_t i = 0; i < count; ++i)
+            f(i);
+        iters += count;
+        secs = std::chrono::duration<double>(clk::now() - start).count();
+    }
+    while (secs < min_secs);
+    printf("mode=%s layout=%s bits=%u entries=%zu ns_per_array=%.1f "
+            "entries_per_s=%.3g\n",mode,
+            layout == PACKED_ALIGNED ? "aligned" : "spanning",bits,n,
+            secs*1e9/iters,iters*n/secs);
+}
+
+int main(int argc, char **argv)
+{
+    size_t count = argc > 1 ? std::stoul(argv[1]) : 256;
+    double min_secs = argc > 2 ? std::stod(argv[2]) : 0.2;
+#if defined(__AVX2__)
+    printf("build simd=avx2\n");
+#else
+    printf("build simd=none\n");
+#endif
+    Random r(1);
+    PackedArray pa;
+    std::vector<uint16_t> out(4096);
+    uint64_t sink = 0;
+    for (int layout : {PACKED_SPANNING,PACKED_ALIGNED})
+        for (unsigned bits : {4u,5u,6u,8u,9u,12u,15u})
+        {
+            size_t n = bits == 9 ? 256 : 4096;
+            std::vector<std::vector<int64_t>> data(count);
+            for (auto &w : data)
+            {
+                w.resize(PackedArray::longs(n,bits,layout));
+                for (int64_t &v : w)
+                    v = r.nextLong();
+            }
+            std::vector<uint16_t> pal((size_t)1 << bits);
+            for (size_t i = 0; i < pal.size(); ++i)
+                pal[i] = (uint16_t)(i*31);
+            run("naive",layout,bits,n,count,min_secs,[&](size_t i)
+            {
+                naive(data[i],bits,layout,n,nullptr,out.data());
+                sink += out[i % n];
+            });
+            run("unpack",layout,bits,n,count,min_secs,[&](size_t i)
+            {
+                pa.unpack(data[i].data(),data[i].size(),bits,layout,n,
+                        out.data());
+                sink += out[i % n];
+            });
+            run("naive_palette",layout,bits,n,count,min_secs,[&](size_t i)
+            {
+                naive(data[i],bits,layout,n,pal.data(),out.data());
+                sink += out[i % n];
+            });
+            run("unpack_palette",layout,bits,n,count,min_secs,[&](size_t i)
+            {
+                pa.unpack(data[i].data(),data[i].size(),bits,layout,n,
+                        out.data(),pal.data(),pal.size());
+                sink += out[i % n];
+            });
+        }
+    fprintf(stderr,"sink=%llu\n",(unsigned long long)sink);
+    return 0;
+}
@@ -0,0 +1,147 @@
+#include <cassert>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+#include "jrand.hpp"
+#include "nbt.hpp"
+#include "nbt_view.hpp"
+#include "packed_array.hpp"
+
+using namespace mclib;
+
+// entry i read bit by bit
+static uint16_t slow_get(const std::vector<int64_t> &w, size_t i,
+        unsigned bits, int layout)
+{
+    size_t p;
+    if (layout == PACKED_ALIGNED)
+    {
+        size_t k = 64 / bits;
+        p = i / k * 64 + i % k * bits;
+    }
+    else
+        p = i*bits;
+    uint16_t v = 0;
+    for (unsigned b = 0; b < bits; ++b, ++p)
+        v |= (uint16_t)(((uint64_t)w[p / 64] >> (p % 64) & 1) << b);
+    return v;
+}
+
+static bool unpack_throws(PackedArray &pa, const std::vector<int64_t> &w,
+        unsigned bits, int layout, size_t n, const uint16_t *pal, size_t np)
+{
+    std::vector<uint16_t> out(n);
+    try { pa.unpack(w.data(),w.size(),bits,layout,n,out.data(),pal,np); }
+    catch (const char*) { return true; }
+    return false;
+}
+
+int main(int argc, char **argv)
+{
+    (void)argc;
+    (void)argv;
+    Random r(2529);
+    PackedArray pa;
+    // sizes from the layouts
+    assert(PackedArray::longs(4096,4,PACKED_SPANNING) == 256);
+    assert(PackedArray::longs(4096,5,PACKED_SPANNING) == 320);
+    assert(PackedArray::longs(4096,5,PACKED_ALIGNED) == 342);
+    assert(PackedArray::longs(256,9,PACKED_ALIGNED) == 37);
+    assert(PackedArray::longs(256,9,PACKED_SPANNING) == 36);
+    assert(PackedArray::sectionBits(1) == 4);
+    assert(PackedArray::sectionBits(16) == 4);
+    assert(PackedArray::sectionBits(17) == 5);
+    assert(PackedArray::sectionBits(300) == 9);
+    assert(PackedArray::layout(2528) == PACKED_SPANNING);
+    assert(PackedArray::layout(2975) == PACKED_ALIGNED);
+    // a known long: 5 bits aligned, entries 1..12
+    {
+        uint64_t w = 0;
+        for (uint64_t j = 0; j < 12; ++j)
+            w |= (j+1) << (5*j);
+        std::vector<int64_t> words(1,(int64_t)w);
+        uint16_t out[12];
+        pa.unpack(words.data(),1,5,PACKED_ALIGNED,12,out);
+        for (size_t j = 0; j < 12; ++j)
+            assert(out[j] == j+1);
+    }
+    // every width and layout against the bit by bit reading, odd lengths for
+    // the tails, through palettes, views and tags
+    for (int layout : {PACKED_SPANNING,PACKED_ALIGNED})
+        for (unsigned bits = 1; bits <= 16; ++bits)
+            for (size_t n : {(size_t)4096,(size_t)256,(size_t)1,(size_t)37,
+                    (size_t)1000})
+            {
+                std::vector<int64_t> w(PackedArray::longs(n,bits,layout));
+                for (int64_t &v : w)
+                    v = r.nextLong();
+                std::vector<uint16_t> out(n), want(n);
+                for (size_t i = 0; i < n; ++i)
+                    want[i] = slow_get(w,i,bits,layout);
+                pa.unpack(w.data(),w.size(),bits,layout,n,out.data());
+                assert(out == want);
+                // pack gives the same entries back (unused bits are zero)
+                std::vector<int64_t> packed(w.size());
+                PackedArray::pack(out.data(),n,bits,layout,packed.data());
+                for (size_t i = 0; i < n; ++i)
+                    assert(slow_get(packed,i,bits,layout) == want[i]);
+                long_array_t la;
+                PackedArray::pack(out.data(),n,bits,layout,la);
+                assert(la.size() == packed.size());
+                assert(std::equal(la.begin(),la.end(),packed.begin()));
+                // palette covering every index
+                size_t np = (size_t)1 << bits;
+                std::vector<uint16_t> pal(np);
+                for (size_t i = 0; i < np; ++i)
+                    pal[i] = (uint16_t)(i*7919 + 3);
+                pa.unpack(w.data(),w.size(),bits,layout,n,out.data(),
+                        pal.data(),np);
+                for (size_t i = 0; i < n; ++i)
+                    assert(out[i] == pal[want[i]]);
+                // from a tag and from a view of its encoding
+                TAG_Long_Array t("data",long_array_t(w.begin(),w.end()));
+                std::fill(out.begin(),out.end(),0);
+                pa.unpack(t,bits,layout,n,out.data());
+                assert(out == want);
+                bytes_t enc = t.encode();
+                NbtView v = NbtView::root(enc.data(),enc.size());
+                std::fill(out.begin(),out.end(),0);
+                pa.unpack(v.asLongArray(),bits,layout,n,out.data(),pal.data(),
+                        np);
+                for (size_t i = 0; i < n; ++i)
+                    assert(out[i] == pal[want[i]]);
+                // a palette missing the largest index
+                uint16_t top = *std::max_element(want.begin(),want.end());
+                assert(unpack_throws(pa,w,bits,layout,n,pal.data(),top));
+            }
+    // errors
+    {
+        std::vector<int64_t> w(10,-1);
+        uint16_t pal[16] = {};
+        assert(unpack_throws(pa,w,4,PACKED_ALIGNED,161,nullptr,0));
+        assert(!unpack_throws(pa,w,4,PACKED_ALIGNED,160,nullptr,0));
+        assert(unpack_throws(pa,w,0,PACKED_ALIGNED,1,nullptr,0));
+        assert(unpack_throws(pa,w,17,PACKED_ALIGNED,1,nullptr,0));
+        assert(unpack_throws(pa,w,4,2,1,nullptr,0));
+        assert(unpack_throws(pa,w,4,PACKED_ALIGNED,16,pal,0));
+        assert(unpack_throws(pa,w,4,PACKED_ALIGNED,16,pal,15));
+        assert(!unpack_throws(pa,w,4,PACKED_ALIGNED,16,pal,16));
+        uint16_t in[3] = {1,2,16};
+        int64_t out[1];
+        bool threw = false;
+        try { PackedArray::pack(in,3,4,PACKED_ALIGNED,out); }
+        catch (const char*) { threw = true; }
+        assert(threw);
+    }
+    // single block sections have no data
+    {
+        uint16_t pal[1] = {42};
+        std::vector<uint16_t> out(4096);
+        pa.unpack(nullptr,0,4,PACKED_ALIGNED,4096,out.data(),pal,1);
+        assert(std::all_of(out.begin(),out.end(),[](uint16_t v)
+                { return v == 42; }));
+    }
+    std::cout << "packed array tests passed" << std::endl;
+    return 0;
+}
@@ -0,0 +1,266 @@
+/*
+Perlin and fractal (octave) noise on a grid of random unit gradients, same
+results as _perlin_test1/noise_test.py
+
+Each octave draws (h+1)*(w+1) gradients from a mclib::Random in row major
+order with the same nextDouble rejection as randomUnitVector, so a generator
+seeded like the Python script produces the same gradients. Only the part of
+the grid that the h*w samples reach is stored (x and y components in separate
+arrays). Samples are evaluated a row at a time, 4 columns per AVX2 vector when
+enabled, and an image is rendered in square tiles on a thread pool.
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#include "jrand.hpp"
+#include "thread_pool.hpp"
+
+// no fused multiply adds (with -mfma the compiler would contract the scalar
+// code but not the AVX2 intrinsics, and python never fuses), the includer's
+// setting is restored at the end
+#if defined(__clang__)
+#pragma float_control(push)
+#pragma clang fp contract(off)
+#elif defined(__GNUC__)
+#pragma GCC push_options
+#pragma GCC optimize("fp-contract=off")
+#endif
+
+namespace mclib
+{
+
+// 3w^2 - 2w^3, operation order as in the python version
+static inline double _smoothstep(double w)
+{
+    return 3.0*w*w - 2.0*w*w*w;
+}
+
+static inline double _lerp(double a0, double a1, double w)
+{
+    return (1.0-w)*a0 + w*a1;
+}
+
+#if defined(__AVX2__)
+// p[j[k]] for the 4 indexes, the masked form avoids gcc 12 warnings about the
+// undefined source in the plain one
+static inline __m256d _gather_pd(const double *p, __m128i j)
+{
+    return _mm256_mask_i32gather_pd(_mm256_setzero_pd(),p,j,
+            _mm256_castsi256_pd(_mm256_set1_epi64x(-1)),8);
+}
+#endif
+
+// one octave of perlin noise for an h by w image, sample (hh,ww) is at grid
+// coordinates (hh*freq,ww*freq)
+class PerlinOctave
+{
+private:
+    double freq;
+    // stored part of the grid
+    size_t rows, cols;
+    std::vector<double> gx, gy;
+    // dot product of the gradient at grid index i (row gr) with (x,y)
+    // minus the grid point
+    double _dot(size_t i, size_t gr, size_t gc, double x, double y) const
+    {
+        return (x-gr)*gx[i] + (y-gc)*gy[i];
+    }
+public:
+    // draws all (h+1)*(w+1) gradients from r, the samples must stay inside
+    // the grid ((h-1)*freq and (w-1)*freq at most h-1 and w-1)
+    PerlinOctave(Random &r, size_t h, size_t w, double freq): freq(freq)
+    {
+        if (h == 0 || w == 0 || !(freq >= 0.0))
+            throw "perlin octave size or frequency invalid";
+        if ((h-1)*freq > h-1 || (w-1)*freq > w-1)
+            throw "perlin octave frequency too high for the grid";
+        rows = std::min((size_t)((h-1)*freq) + 2,h+1);
+        cols = std::min((size_t)((w-1)*freq) + 2,w+1);
+        gx.resize(rows*cols);
+        gy.resize(rows*cols);
+        for (size_t i = 0; i <= h; ++i)
+            for (size_t j = 0; j <= w; ++j)
+            {
+                double x, y, s;
+                do
+                {
+                    x = 2.0*r.nextDouble() - 1.0;
+                    y = 2.0*r.nextDouble() - 1.0;
+                    // rounded separately so the rejections match exactly
+                    volatile double sx = x*x, sy = y*y;
+                    s = sx + sy;
+                }
+                while (s >= 1.0 || s == 0.0);
+                if (i < rows && j < cols)
+                {
+                    double m = sqrt(s);
+                    gx[i*cols+j] = x/m;
+                    gy[i*cols+j] = y/m;
+                }
+            }
+    }
+    double frequency() const { return freq; }
+    // noise value for sample (hh,ww)
+    double value(size_t hh, size_t ww) const
+    {
+        double x = hh*freq, y = ww*freq;
+        size_t x0 = (size_t)x, y0 = (size_t)y;
+        double sx = _smoothstep(x-x0), sy = _smoothstep(y-y0);
+        size_t i = x0*cols + y0;
+        double ix0 = _lerp(_dot(i,x0,y0,x,y),_dot(i+cols,x0+1,y0,x,y),sx);
+        double ix1 = _lerp(_dot(i+1,x0,y0+1,x,y),
+                _dot(i+cols+1,x0+1,y0+1,x,y),sx);
+        return _lerp(ix0,ix1,sy);
+    }
+    // out[k] += amp*value(hh,w0+k) for k in [0,count)
+    void addRow(size_t hh, size_t w0, size_t count, double amp,
+            double *out) const
+    {
+        double x = hh*freq;
+        size_t x0 = (size_t)x;
+        double dx0 = x-x0, dx1 = x-(x0+1);
+        double sx = _smoothstep(dx0);
+        const double *gx0 = gx.data() + x0*cols, *gy0 = gy.data() + x0*cols;
+        const double *gx1 = gx0 + cols, *gy1 = gy0 + cols;
+        size_t k = 0;
+#if defined(__AVX2__)
+        const __m256d vfreq = _mm256_set1_pd(freq);
+        const __m256d vdx0 = _mm256_set1_pd(dx0);
+        const __m256d vdx1 = _mm256_set1_pd(dx1);
+        const __m256d vsx = _mm256_set1_pd(sx);
+        const __m256d vsx1 = _mm256_set1_pd(1.0-sx);
+        const __m256d vamp = _mm256_set1_pd(amp);
+        const __m256d one = _mm256_set1_pd(1.0);
+        const __m256d two = _mm256_set1_pd(2.0);
+        const __m256d three = _mm256_set1_pd(3.0);
+        const __m256d step = _mm256_set_pd(3.0,2.0,1.0,0.0);
+        for (; k + 4 <= count; k += 4)
+        {
+            __m256d y = _mm256_mul_pd(_mm256_add_pd(
+                    _mm256_set1_pd((double)(w0+k)),step),vfreq);
+            __m256d fy = _mm256_round_pd(y,
+                    _MM_FROUND_TO_ZERO|_MM_FROUND_NO_EXC);
+            __m128i j = _mm256_cvttpd_epi32(fy);
+            __m256d dy0 = _mm256_sub_pd(y,fy);
+            __m256d dy1 = _mm256_sub_pd(y,_mm256_add_pd(fy,one));
+            // gradients at (x0,y0) (x1,y0) (x0,y0+1) (x1,y0+1)
+            __m256d n00 = _mm256_add_pd(
+                    _mm256_mul_pd(vdx0,_gather_pd(gx0,j)),
+                    _mm256_mul_pd(dy0,_gather_pd(gy0,j)));
+            __m256d n10 = _mm256_add_pd(
+                    _mm256_mul_pd(vdx1,_gather_pd(gx1,j)),
+                    _mm256_mul_pd(dy0,_gather_pd(gy1,j)));
+            __m256d n01 = _mm256_add_pd(
+                    _mm256_mul_pd(vdx0,_gather_pd(gx0+1,j)),
+                    _mm256_mul_pd(dy1,_gather_pd(gy0+1,j)));
+            __m256d n11 = _mm256_add_pd(
+                    _mm256_mul_pd(vdx1,_gather_pd(gx1+1,j)),
+                    _mm256_mul_pd(dy1,_gather_pd(gy1+1,j)));
+            __m256d ix0 = _mm256_add_pd(_mm256_mul_pd(vsx1,n00),
+                    _mm256_mul_pd(vsx,n10));
+            __m256d ix1 = _mm256_add_pd(_mm256_mul_pd(vsx1,n01),
+                    _mm256_mul_pd(vsx,n11));
+            __m256d sy = _mm256_sub_pd(
+                    _mm256_mul_pd(_mm256_mul_pd(three,dy0),dy0),
+                    _mm256_mul_pd(_mm256_mul_pd(
+                            _mm256_mul_pd(two,dy0),dy0),dy0));
+            __m256d v = _mm256_add_pd(
+                    _mm256_mul_pd(_mm256_sub_pd(one,sy),ix0),
+                    _mm256_mul_pd(sy,ix1));
+            __m256d o = _mm256_loadu_pd(out+k);
+            _mm256_storeu_pd(out+k,_mm256_add_pd(o,_mm256_mul_pd(vamp,v)));
+        }
+#endif
+        for (; k < count; ++k)
+        {
+            double y = (w0+k)*freq;
+            size_t y0 = (size_t)y;
+            double dy0 = y-y0, dy1 = y-(y0+1);
+            double ix0 = _lerp(dx0*gx0[y0] + dy0*gy0[y0],
+                    dx1*gx1[y0] + dy0*gy1[y0],sx);
+            double ix1 = _lerp(dx0*gx0[y0+1] + dy1*gy0[y0+1],
+                    dx1*gx1[y0+1] + dy1*gy1[y0+1],sx);
+            out[k] += amp*_lerp(ix0,ix1,_smoothstep(dy0));
+        }
+    }
+};
+
+// sum of octaves with amplitudes, like perlinFractalNoise
+class PerlinNoise
+{
+private:
+    size_t h, w;
+    std::vector<PerlinOctave> octaves;
+    std::vector<double> amps;
+public:
+    // octaves are drawn from r in order
+    PerlinNoise(Random &r, size_t h, size_t w, const std::vector<double> &freq,
+            const std::vector<double> &amp): h(h), w(w), amps(amp)
+    {
+        if (freq.size() != amp.size())
+            throw "perlin noise needs one amplitude per frequency";
+        octaves.reserve(freq.size());
+        for (double f : freq)
+            octaves.emplace_back(r,h,w,f);
+    }
+    size_t height() const { return h; }
+    size_t width() const { return w; }
+    // values of rows [r0,r0+th) and columns [c0,c0+tw) to out (row stride
+    // `stride` doubles)
+    void tile(size_t r0, size_t c0, size_t th, size_t tw, double *out,
+            size_t stride) const
+    {
+        for (size_t i = 0; i < th; ++i)
+        {
+            double *row = out + i*stride;
+            std::fill(row,row+tw,0.0);
+            for (size_t o = 0; o < octaves.size(); ++o)
+                octaves[o].addRow(r0+i,c0,tw,amps[o],row);
+        }
+    }
+    // all h*w values (row major) in tiles of tile_size squared (0 is taken
+    // as 1)
+    std::vector<double> values(ThreadPool &pool, size_t tile_size = 128) const
+    {
+        if (tile_size == 0)
+            tile_size = 1;
+        std::vector<double> ret(h*w);
+        for (size_t r0 = 0; r0 < h; r0 += tile_size)
+            for (size_t c0 = 0; c0 < w; c0 += tile_size)
+                pool.submit([this,r0,c0,tile_size,&ret]
+                {
+                    tile(r0,c0,std::min(tile_size,h-r0),
+                            std::min(tile_size,w-c0),ret.data()+r0*w+c0,w);
+                });
+        pool.wait();
+        return ret;
+    }
+    // image bytes, values scaled by the minimum and maximum to [0,256)
+    std::vector<uint8_t> render(ThreadPool &pool, size_t tile_size = 128) const
+    {
+        std::vector<double> v = values(pool,tile_size);
+        auto mm = std::minmax_element(v.begin(),v.end());
+        double lo = *mm.first, hi = *mm.second;
+        std::vector<uint8_t> ret(v.size());
+        for (size_t i = 0; i < v.size(); ++i)
+            ret[i] = (uint8_t)(int)(256.0*((v[i]-lo)/(hi-lo+0.000001)));
+        return ret;
+    }
+};
+
+}
+
+#if defined(__clang__)
+#pragma float_control(pop)
+#elif defined(__GNUC__)
+#pragma GCC pop_options
+#endif
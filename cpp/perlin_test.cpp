@@ -0,0 +1,67 @@
+#include <cassert>
+#include <iostream>
+
+#include "perlin.hpp"
+
+// row evaluation (vectorized when enabled) matches single samples
+static void test_rows()
+{
+    mclib::Random r(12345);
+    const size_t h = 37, w = 43;
+    const double freqs[] = {1.0, 0.5, 0.3, 0.0625};
+    for (double f : freqs)
+    {
+        mclib::PerlinOctave o(r,h,w,f);
+        for (size_t hh = 0; hh < h; ++hh)
+            for (size_t w0 = 0; w0 < 5; ++w0)
+            {
+                std::vector<double> row(w-w0,0.0);
+                o.addRow(hh,w0,w-w0,2.0,row.data());
+                for (size_t k = 0; k < w-w0; ++k)
+                    assert(fabs(row[k] - 2.0*o.value(hh,w0+k)) < 1e-12);
+            }
+    }
+}
+
+// every gradient is drawn even if only part of the grid is stored
+static void test_stream()
+{
+    mclib::Random a(-7), b(-7);
+    mclib::PerlinOctave o1(a,20,30,0.125);
+    mclib::PerlinOctave o2(b,20,30,1.0);
+    assert(a.nextLong() == b.nextLong());
+    bool thrown = false;
+    try
+    {
+        mclib::PerlinOctave o3(a,20,30,1.5);
+    }
+    catch (const char*)
+    {
+        thrown = true;
+    }
+    assert(thrown);
+}
+
+static void test_tiles()
+{
+    mclib::Random r(99);
+    mclib::PerlinNoise n(r,70,90,{0.25,0.125},{1.0,2.0});
+    mclib::ThreadPool pool(3);
+    std::vector<double> a = n.values(pool,16), b = n.values(pool,1000);
+    assert(a == b);
+    // tile size 0 is taken as 1 (it used to loop forever)
+    assert(n.values(pool,0) == a);
+    std::vector<uint8_t> img = n.render(pool);
+    assert(img.size() == 70*90);
+}
+
+int main(int argc, char **argv)
+{
+    (void)argc;
+    (void)argv;
+    test_rows();
+    test_stream();
+    test_tiles();
+    std::cout << "perlin tests passed" << std::endl;
+    return 0;
+}
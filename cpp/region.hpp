@@ -0,0 +1,211 @@
+/*
+Region (MCA) files
+
+A region file holds up to 32x32 chunks. The first 4 KiB sector has a 4 byte
+location per chunk (3 byte sector offset, 1 byte sector count), the second one
+a 4 byte timestamp per chunk, chunk data starts at sector 2 with a 4 byte
+length (counting the compression byte), the compression id (1 gzip, 2 zlib,
+3 uncompressed) and the compressed bytes, padded to whole sectors.
+
+RegionFile memory maps the file and only parses the 8 KiB header when it is
+opened: locations and timestamps go into a packed index in host order and the
+sectors are checked like mca.py does (all sectors after the header, inside the
+file and used by at most one chunk). Nothing else is read until a chunk is
+asked for, then only that chunk's sectors are touched to check its length and
+compression and to inflate and decode it. Chunk indexes are 32*z + x for chunk
+coordinates x and z in [0,32) within the region.
+
+One difference from mca.py: a chunk whose data fills its last sector exactly
+is accepted (mca.py rejects it, although its own writer can produce it).
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <memory_resource>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "mapped_file.hpp"
+#include "nbt.hpp"
+#include "nbt_io.hpp"
+#include "nbt_view.hpp"
+
+namespace mclib
+{
+
+const size_t REGION_SECTOR = 4096;
+const size_t REGION_CHUNKS = 1024;
+
+// compressed data of one chunk in a region file
+struct RegionChunkData
+{
+    int compression; // NBT_GZIP, NBT_ZLIB or NBT_RAW
+    const char *data;
+    size_t size;
+};
+
+// check the header at the start of a region file of len bytes and read it
+// into locations and timestamps (host order), used gets a bitmap of the used
+// sectors (header included), returns the number of chunks present
+static inline size_t _region_index(const char *header, size_t len,
+        uint32_t *locations, int32_t *timestamps, std::vector<uint64_t> &used)
+{
+    if (len & (REGION_SECTOR-1))
+        throw "region file not a multiple of 4 KiB";
+    if (len < 2*REGION_SECTOR)
+        throw "region file has an incomplete header";
+    size_t sectors = len / REGION_SECTOR;
+    used.assign((sectors + 63) / 64,0);
+    used[0] = 3;
+    size_t present = 0;
+    for (size_t ci = 0; ci < REGION_CHUNKS; ++ci)
+    {
+        uint32_t loc = (uint32_t)_from_bytes_int(header + 4*ci);
+        timestamps[ci] = _from_bytes_int(header + REGION_SECTOR + 4*ci);
+        locations[ci] = loc;
+        if (loc == 0)
+            continue;
+        size_t offset = loc >> 8, count = loc & 0xff;
+        if (offset < 2)
+            throw "region chunk sector offset is in the header";
+        if (count == 0)
+            throw "region chunk has no sectors";
+        if (offset + count > sectors)
+            throw "region chunk goes past end of file";
+        for (size_t s = offset; s < offset + count; ++s)
+        {
+            uint64_t bit = (uint64_t)1 << (s & 63);
+            if (used[s >> 6] & bit)
+                throw "region sector is shared by more than 1 chunk";
+            used[s >> 6] |= bit;
+        }
+        ++present;
+    }
+    return present;
+}
+
+// check the chunk header at p (the start of avail bytes of sectors)
+static inline RegionChunkData _region_chunk(const char *p, size_t avail)
+{
+    int32_t length = _from_bytes_int(p);
+    int c = (uint8_t)p[4];
+    if (c & 0x80)
+        throw "region chunk is stored in an external file";
+    if (c != NBT_GZIP && c != NBT_ZLIB && c != NBT_RAW)
+        throw "region chunk has an unknown compression id";
+    if (length < 1)
+        throw "region chunk length is not positive";
+    if ((size_t)length + 4 > avail)
+        throw "region chunk length exceeds its sectors";
+    return {c,p+5,(size_t)length-1};
+}
+
+class RegionFile
+{
+private:
+    std::unique_ptr<MappedFile> file;
+    const char *data;
+    size_t len;
+    // sector offset << 8 | sector count, 0 for missing chunks
+    uint32_t locations[REGION_CHUNKS];
+    int32_t timestamps[REGION_CHUNKS];
+    size_t present;
+    void _parse()
+    {
+        std::vector<uint64_t> used;
+        present = _region_index(data,len,locations,timestamps,used);
+    }
+    static size_t _index(int x, int z)
+    {
+        if (x < 0 || x >= 32 || z < 0 || z >= 32)
+            throw "region chunk coordinates out of range";
+        return 32*(size_t)z + (size_t)x;
+    }
+    static size_t _checked(size_t ci)
+    {
+        if (ci >= REGION_CHUNKS)
+            throw "region chunk index out of range";
+        return ci;
+    }
+public:
+    // map and index a region file
+    RegionFile(const std::string &path): file(new MappedFile(path)),
+            data(file->data()), len(file->size())
+    {
+        _parse();
+    }
+    // index region bytes owned by the caller (must outlive this)
+    RegionFile(const char *d, size_t n): data(d), len(n)
+    {
+        _parse();
+    }
+    RegionFile(const RegionFile&) = delete;
+    RegionFile &operator=(const RegionFile&) = delete;
+    static size_t index(int x, int z) { return _index(x,z); }
+    // bytes of the whole file
+    const char *bytes() const { return data; }
+    size_t size() const { return len; }
+    // number of chunks present
+    size_t chunks() const { return present; }
+    // ci is 32*z + x, larger ones throw like out of range coordinates
+    bool exists(size_t ci) const { return locations[_checked(ci)] != 0; }
+    bool exists(int x, int z) const { return exists(_index(x,z)); }
+    int32_t timestamp(size_t ci) const { return timestamps[_checked(ci)]; }
+    int32_t timestamp(int x, int z) const { return timestamp(_index(x,z)); }
+    // first sector and number of sectors of a chunk (0 if missing)
+    size_t sectorOffset(size_t ci) const
+    {
+        return locations[_checked(ci)] >> 8;
+    }
+    size_t sectorCount(size_t ci) const
+    {
+        return locations[_checked(ci)] & 0xff;
+    }
+    // compressed data of a chunk (data is nullptr if it is missing), reads
+    // only the chunk's own sectors
+    RegionChunkData raw(size_t ci) const
+    {
+        if (!locations[_checked(ci)])
+            return {0,nullptr,0};
+        return _region_chunk(data + sectorOffset(ci)*REGION_SECTOR,
+                sectorCount(ci)*REGION_SECTOR);
+    }
+    RegionChunkData raw(int x, int z) const { return raw(_index(x,z)); }
+    // uncompressed chunk nbt (empty if missing), valid until inf is used again
+    // (or as long as the region for uncompressed chunks)
+    std::string_view inflate(size_t ci, NbtInflater &inf) const
+    {
+        RegionChunkData d = raw(ci);
+        if (!d.data)
+            return std::string_view();
+        return inf.inflate(d.data,d.size,d.compression);
+    }
+    // view of the chunk root without decoding it (invalid if missing)
+    NbtView view(size_t ci, NbtInflater &inf) const
+    {
+        std::string_view s = inflate(ci,inf);
+        if (s.data() == nullptr)
+            return NbtView();
+        return NbtView::root(s.data(),s.size());
+    }
+    // decoded chunk, nullptr if it is missing
+    TAG *chunk(size_t ci, NbtInflater &inf,
+            std::pmr::memory_resource *mr = nullptr) const
+    {
+        std::string_view s = inflate(ci,inf);
+        if (s.data() == nullptr)
+            return nullptr;
+        return TAG::decode(s.data(),s.size(),mr);
+    }
+    // decoded chunk using an inflater kept for the calling thread
+    TAG *chunk(int x, int z, std::pmr::memory_resource *mr = nullptr) const
+    {
+        return chunk(_index(x,z),_thread_inflater(),mr);
+    }
+};
+
+}
@@ -0,0 +1,161 @@
+/*
+Benchmark for loading whole regions
+
+region_bench [file.mca|-] [threads] [rounds]
+
+Loads every chunk of a region file (or a generated region of 1024 zlib
+compressed chunks of about 100 KB nbt each when no file is given) sequentially
+and with a RegionLoader on 1, 2, 4, ... threads, printing one key=value line per
+run with chunks/s, MB/s of uncompressed nbt and the summed inflate and parse
+time of all workers (so their share of the region time shows).
+*/
+
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include "jrand.hpp"
+#include "nbt.hpp"
+#include "nbt_io.hpp"
+#include "region.hpp"
+#include "region_loader.hpp"
+
+using namespace mclib;
+
+// chunk with block states, palettes, light and a few block entities
+static bytes_t make_chunk(Random &r, int x, int z)
+{
+    compound_t root;
+    root["DataVersion"] = new TAG_Int("DataVersion",2975);
+    root["xPos"] = new TAG_Int("xPos",x);
+    root["zPos"] = new TAG_Int("zPos",z);
+    root["Status"] = new TAG_String("Status","full");
+    const char *blocks[] = {"minecraft:stone","minecraft:dirt",
+            "minecraft:grass_block","minecraft:deepslate","minecraft:water",
+            "minecraft:air"};
+    list_t sections;
+    for (int y = -4; y < 20; ++y)
+    {
+        compound_t sec;
+        sec["Y"] = new TAG_Byte("Y",(int8_t)y);
+        list_t palette;
+        for (size_t i = 0; i < 6; ++i)
+        {
+            compound_t entry;
+            entry["Name"] = new TAG_String("Name",blocks[i]);
+            palette.push_back(new TAG_Compound("",entry));
+        }
+        // 4 bits per block, mostly runs of the same block
+        long_array_t data(256);
+        int64_t run = 0;
+        for (int64_t &v : data)
+        {
+            if (r.nextInt(8) == 0)
+                run = r.nextLong() & 0x5555555555555555LL;
+            v = run;
+        }
+        compound_t states;
+        states["palette"] = new TAG_List("palette",palette);
+        states["data"] = new TAG_Long_Array("data",data);
+        sec["block_states"] = new TAG_Compound("block_states",states);
+        byte_array_t light(2048,(int8_t)0xff);
+        for (size_t i = 0; i < 64; ++i)
+            light[r.nextInt(2048)] = (int8_t)r.nextInt(256);
+        sec["SkyLight"] = new TAG_Byte_Array("SkyLight",light);
+        sections.push_back(new TAG_Compound("",sec));
+    }
+    root["sections"] = new TAG_List("sections",sections);
+    list_t ents;
+    for (int i = 0; i < 4; ++i)
+    {
+        compound_t e;
+        e["id"] = new TAG_String("id","minecraft:chest");
+        e["x"] = new TAG_Int("x",x*16 + r.nextInt(16));
+        e["y"] = new TAG_Int("y",r.nextInt(256));
+        e["z"] = new TAG_Int("z",z*16 + r.nextInt(16));
+        ents.push_back(new TAG_Compound("",e));
+    }
+    root["block_entities"] = new TAG_List("block_entities",ents);
+    TAG *tag = new TAG_Compound("",root);
+    bytes_t ret = tag->encode();
+    delete tag;
+    return ret;
+}
+
+static bytes_t make_region()
+{
+    Random r(2975);
+    NbtDeflater def;
+    bytes_t ret(2*REGION_SECTOR,0);
+    for (size_t ci = 0; ci < REGION_CHUNKS; ++ci)
+    {
+        bytes_t raw = make_chunk(r,(int)(ci % 32),(int)(ci / 32));
+        std::string_view d = def.deflate(raw.data(),raw.size(),NBT_ZLIB);
+        size_t offset = ret.size() / REGION_SECTOR;
+        size_t sectors = (d.size() + 5 + REGION_SECTOR-1) / REGION_SECTOR;
+        _to_bytes(ret.data() + 4*ci,(int32_t)(offset << 8 | sectors));
+        ret.resize(ret.size() + sectors*REGION_SECTOR,0);
+        char *p = ret.data() + offset*REGION_SECTOR;
+        _to_bytes(p,(int32_t)(d.size()+1));
+        p[4] = (char)NBT_ZLIB;
+        memcpy(p+5,d.data(),d.size());
+    }
+    return ret;
+}
+
+static void print(const char *mode, size_t threads, const RegionLoadStats &s,
+        size_t rounds)
+{
+    printf("mode=%s threads=%zu chunks=%zu failed=%zu wall_ms=%.2f "
+            "chunks_per_s=%.0f nbt_MB_per_s=%.1f inflate_ms=%.2f parse_ms=%.2f "
+            "inflate_share=%.2f\n",mode,threads,s.chunks/rounds,s.failed/rounds,
+            s.wall_s/rounds*1e3,s.chunks/s.wall_s,s.inflated/s.wall_s/1e6,
+            s.inflate_s/rounds*1e3,s.parse_s/rounds*1e3,
+            s.inflate_s/(s.inflate_s+s.parse_s));
+}
+
+int main(int argc, char **argv)
+{
+    bytes_t generated;
+    std::unique_ptr<RegionFile> region;
+    if (argc > 1 && std::string(argv[1]) != "-")
+        region.reset(new RegionFile(argv[1]));
+    else
+    {
+        generated = make_region();
+        region.reset(new RegionFile(generated.data(),generated.size()));
+    }
+    size_t max_threads = argc > 2 ? std::stoul(argv[2])
+            : std::thread::hardware_concurrency();
+    size_t rounds = argc > 3 ? std::stoul(argv[3]) : 5;
+    if (max_threads == 0)
+        max_threads = 1;
+    printf("input bytes=%zu chunks=%zu\n",region->size(),region->chunks());
+    auto ignore = [](size_t, TAG*, const char*) {};
+    {
+        ThreadPool pool(1);
+        RegionLoader loader(pool);
+        loader.loadSequential(*region,ignore);
+        RegionLoadStats total;
+        for (size_t i = 0; i < rounds; ++i)
+            total += loader.loadSequential(*region,ignore);
+        print("sequential",1,total,rounds);
+    }
+    for (size_t t = 1;; t *= 2)
+    {
+        if (t > max_threads)
+            t = max_threads;
+        ThreadPool pool(t);
+        RegionLoader loader(pool);
+        loader.load(*region,ignore);
+        RegionLoadStats total;
+        for (size_t i = 0; i < rounds; ++i)
+            total += loader.load(*region,ignore);
+        print("parallel",t,total,rounds);
+        if (t == max_threads)
+            break;
+    }
+    return 0;
+}
@@ -0,0 +1,161 @@
+/*
+Parallel decoding of all chunks in a region
+
+RegionLoader inflates and decodes every present chunk of a RegionFile as
+separate tasks on a ThreadPool. Each worker keeps its own NbtInflater (and its
+output buffer) and its own Arena, so after the first region nothing is
+allocated per chunk. Chunks are handed to the callback on the worker that
+decoded them, in completion order:
+
+    cb(size_t ci, TAG *chunk, const char *error)
+
+The callback must be thread safe. chunk is nullptr (and error is set) for a
+chunk that failed to inflate or decode, the other chunks are still loaded.
+Arena chunks are only valid during the callback (the arena is reset for the
+next chunk of that worker), with keep = true chunks are allocated on the heap
+and owned by the callback instead.
+
+Stats add up the time all workers spent inflating and parsing, next to the
+wall time of the whole region.
+*/
+
+#pragma once
+
+#include <chrono>
+#include <memory>
+#include <vector>
+
+#include "arena.hpp"
+#include "nbt.hpp"
+#include "nbt_io.hpp"
+#include "region.hpp"
+#include "thread_pool.hpp"
+
+namespace mclib
+{
+
+struct RegionLoadStats
+{
+    size_t chunks = 0; // decoded
+    size_t failed = 0;
+    size_t compressed = 0; // bytes
+    size_t inflated = 0; // bytes
+    double inflate_s = 0; // summed over workers
+    double parse_s = 0; // summed over workers (includes the callback)
+    double wall_s = 0;
+    RegionLoadStats &operator+=(const RegionLoadStats &o)
+    {
+        chunks += o.chunks;
+        failed += o.failed;
+        compressed += o.compressed;
+        inflated += o.inflated;
+        inflate_s += o.inflate_s;
+        parse_s += o.parse_s;
+        wall_s += o.wall_s;
+        return *this;
+    }
+};
+
+class RegionLoader
+{
+private:
+    ThreadPool &pool;
+    struct _worker
+    {
+        NbtInflater inf;
+        Arena arena;
+        RegionLoadStats stats;
+    };
+    // one per pool thread and one for the calling thread
+    std::vector<std::unique_ptr<_worker>> workers;
+    static double _now()
+    {
+        return std::chrono::duration<double>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+    template <typename F>
+    static void _load(_worker &w, const RegionFile &r, size_t ci, bool keep,
+            F &cb)
+    {
+        double t0 = _now();
+        std::string_view raw;
+        TAG *t = nullptr;
+        try
+        {
+            RegionChunkData d = r.raw(ci);
+            w.stats.compressed += d.size;
+            raw = w.inf.inflate(d.data,d.size,d.compression);
+            w.stats.inflated += raw.size();
+        }
+        catch (const char *e)
+        {
+            w.stats.inflate_s += _now() - t0;
+            ++w.stats.failed;
+            cb(ci,(TAG*)nullptr,e);
+            return;
+        }
+        double t1 = _now();
+        w.stats.inflate_s += t1 - t0;
+        if (!keep)
+            w.arena.reset();
+        const char *error = nullptr;
+        try
+        {
+            t = TAG::decode(raw.data(),raw.size(),keep ? nullptr : &w.arena);
+        }
+        catch (const char *e)
+        {
+            error = e;
+        }
+        if (t)
+            ++w.stats.chunks;
+        else
+            ++w.stats.failed;
+        cb(ci,t,error);
+        w.stats.parse_s += _now() - t1;
+    }
+public:
+    RegionLoader(ThreadPool &p): pool(p)
+    {
+        for (size_t i = 0; i <= pool.size(); ++i)
+            workers.emplace_back(new _worker());
+    }
+    // decode every present chunk of r, returns when all are done
+    // (must not be called from a worker of the pool)
+    template <typename F>
+    RegionLoadStats load(const RegionFile &r, F &&cb, bool keep = false)
+    {
+        double t0 = _now();
+        for (auto &w : workers)
+            w->stats = RegionLoadStats();
+        for (size_t ci = 0; ci < REGION_CHUNKS; ++ci)
+            if (r.exists(ci))
+                pool.submit([this,&r,ci,keep,&cb]
+                {
+                    _load(*workers[pool.workerIndex()],r,ci,keep,cb);
+                });
+        pool.wait();
+        RegionLoadStats ret;
+        for (auto &w : workers)
+            ret += w->stats;
+        ret.wall_s = _now() - t0;
+        return ret;
+    }
+    // the same on the calling thread only (for comparison)
+    template <typename F>
+    RegionLoadStats loadSequential(const RegionFile &r, F &&cb,
+            bool keep = false)
+    {
+        double t0 = _now();
+        _worker &w = *workers.back();
+        w.stats = RegionLoadStats();
+        for (size_t ci = 0; ci < REGION_CHUNKS; ++ci)
+            if (r.exists(ci))
+                _load(w,r,ci,keep,cb);
+        RegionLoadStats ret = w.stats;
+        ret.wall_s = _now() - t0;
+        return ret;
+    }
+};
+
+}
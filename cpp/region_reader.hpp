@@ -0,0 +1,721 @@
+/*
+Batched chunk reads across many region files
+
+RegionReader reads chunks from any number of region files with a few syscalls
+per batch instead of a header read and a data read per chunk. Regions are
+added by path, then the 8 KiB headers of all of them are read as one batch
+and every requested chunk is read with exactly its own sectors.
+
+Reads go through io_uring when the kernel has it (set up with the raw
+syscalls, there is no liburing): up to depth reads are in flight at once and
+each io_uring_enter call submits all queued reads and collects completions.
+The reads land in depth fixed size slots of one buffer registered with the
+ring (IORING_OP_READ_FIXED, chunks larger than a slot get their own buffer).
+Without io_uring (old kernels, seccomp, or uring = false) the same batches
+are read with pread. The backend is chosen when the reader is created, the
+results are the same.
+
+read() hands the compressed data of each chunk to a callback on the calling
+thread as its read completes. load() inflates and decodes the chunks on a
+ThreadPool as their reads complete, with an inflater and arena per worker like
+RegionLoader (the slot goes back to the reader once the chunk is inflated, or
+decoded if it is uncompressed):
+
+    read:  cb(size_t k, const RegionChunkData &d, const char *error)
+    load:  cb(size_t k, TAG *chunk, const char *error)
+
+k is the index of the chunk in the request list. Missing chunks give
+d.data == nullptr or chunk == nullptr without an error. A broken region gives
+its header error for each of its chunks. Empty region files (the game leaves
+them) have no chunks.
+
+Each region keeps its file open until the reader is destroyed, so the number
+of regions is bounded by the open file limit. Not thread safe.
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "arena.hpp"
+#include "nbt.hpp"
+#include "nbt_io.hpp"
+#include "region.hpp"
+#include "thread_pool.hpp"
+
+namespace mclib
+{
+
+// chunk ci of the region with the id returned by RegionReader::add
+struct RegionChunkRef
+{
+    size_t region;
+    size_t ci;
+};
+
+struct RegionReadStats
+{
+    size_t chunks = 0; // read (or decoded)
+    size_t failed = 0;
+    size_t bytes = 0; // read from files
+    size_t syscalls = 0; // io_uring_enter or pread calls
+    double wall_s = 0;
+};
+
+class RegionReader
+{
+private:
+    struct _region
+    {
+        std::string path;
+        int fd;
+        size_t size;
+        bool loaded;
+        const char *error;
+        uint32_t locations[REGION_CHUNKS];
+        int32_t timestamps[REGION_CHUNKS];
+    };
+    std::vector<std::unique_ptr<_region>> regions;
+    size_t depth, slot_size;
+    // io_uring, ring < 0 when reading with pread
+    int ring;
+    bool fixed; // slots registered with the ring
+    void *sq_map, *cq_map, *sqe_map;
+    size_t sq_len, cq_len, sqe_len;
+    unsigned *sq_tail, *sq_mask, *sq_array, *cq_head, *cq_tail, *cq_mask;
+    io_uring_sqe *sqes;
+    io_uring_cqe *cqes;
+    unsigned to_submit;
+    // depth slots of slot_size bytes
+    char *buffers;
+    std::vector<int> free_slots;
+    std::mutex slot_lock;
+    std::condition_variable slot_cv;
+    // reads in flight
+    struct _op
+    {
+        size_t k;
+        int fd;
+        uint64_t off;
+        size_t len, got;
+        int slot; // -1 for reads in heap
+        char *buf;
+        bytes_t heap;
+    };
+    std::vector<_op> ops;
+    std::vector<size_t> free_ops;
+    // completed ops (op, bytes read or -errno)
+    std::vector<std::pair<size_t,long>> done;
+    size_t syscalls;
+    struct _read
+    {
+        int fd;
+        uint64_t off;
+        size_t len;
+    };
+    struct _worker
+    {
+        NbtInflater inf;
+        Arena arena;
+    };
+    std::vector<std::unique_ptr<_worker>> workers;
+    static double _now()
+    {
+        return std::chrono::duration<double>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+    // try to set up the ring, false leaves the pread backend
+    bool _setup()
+    {
+        io_uring_params p;
+        memset(&p,0,sizeof(p));
+        long fd = syscall(__NR_io_uring_setup,(unsigned)depth,&p);
+        if (fd < 0)
+            return false;
+        ring = (int)fd;
+        // IORING_OP_READ came with 5.6, FAST_POLL with 5.7
+        if (!(p.features & IORING_FEAT_FAST_POLL))
+            return false;
+        sq_len = p.sq_off.array + p.sq_entries*sizeof(unsigned);
+        cq_len = p.cq_off.cqes + p.cq_entries*sizeof(io_uring_cqe);
+        bool single = p.features & IORING_FEAT_SINGLE_MMAP;
+        if (single)
+            sq_len = cq_len = std::max(sq_len,cq_len);
+        sq_map = mmap(nullptr,sq_len,PROT_READ | PROT_WRITE,
+                MAP_SHARED | MAP_POPULATE,ring,IORING_OFF_SQ_RING);
+        if (sq_map == MAP_FAILED)
+        {
+            sq_map = nullptr;
+            return false;
+        }
+        if (single)
+            cq_map = sq_map;
+        else
+        {
+            cq_map = mmap(nullptr,cq_len,PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE,ring,IORING_OFF_CQ_RING);
+            if (cq_map == MAP_FAILED)
+            {
+                cq_map = nullptr;
+                return false;
+            }
+        }
+        sqe_len = p.sq_entries*sizeof(io_uring_sqe);
+        sqe_map = mmap(nullptr,sqe_len,PROT_READ | PROT_WRITE,
+                MAP_SHARED | MAP_POPULATE,ring,IORING_OFF_SQES);
+        if (sqe_map == MAP_FAILED)
+        {
+            sqe_map = nullptr;
+            return false;
+        }
+        char *sq = (char*)sq_map, *cq = (char*)cq_map;
+        sq_tail = (unsigned*)(sq + p.sq_off.tail);
+        sq_mask = (unsigned*)(sq + p.sq_off.ring_mask);
+        sq_array = (unsigned*)(sq + p.sq_off.array);
+        cq_head = (unsigned*)(cq + p.cq_off.head);
+        cq_tail = (unsigned*)(cq + p.cq_off.tail);
+        cq_mask = (unsigned*)(cq + p.cq_off.ring_mask);
+        cqes = (io_uring_cqe*)(cq + p.cq_off.cqes);
+        sqes = (io_uring_sqe*)sqe_map;
+        // the slots stay unregistered if they cannot be pinned (memlock)
+        std::vector<iovec> iov(depth);
+        for (size_t i = 0; i < depth; ++i)
+            iov[i] = {buffers + i*slot_size,slot_size};
+        fixed = syscall(__NR_io_uring_register,ring,IORING_REGISTER_BUFFERS,
+                iov.data(),(unsigned)depth) == 0;
+        return true;
+    }
+    void _teardown()
+    {
+        if (sqe_map)
+            munmap(sqe_map,sqe_len);
+        if (cq_map && cq_map != sq_map)
+            munmap(cq_map,cq_len);
+        if (sq_map)
+            munmap(sq_map,sq_len);
+        if (ring >= 0)
+            close(ring);
+        sq_map = cq_map = sqe_map = nullptr;
+        ring = -1;
+        fixed = false;
+    }
+    int _take_slot()
+    {
+        std::lock_guard<std::mutex> g(slot_lock);
+        if (free_slots.empty())
+            return -1;
+        int s = free_slots.back();
+        free_slots.pop_back();
+        return s;
+    }
+    void _wait_slot()
+    {
+        std::unique_lock<std::mutex> lk(slot_lock);
+        slot_cv.wait(lk,[this]{ return !free_slots.empty(); });
+    }
+    void _release_slot(int s)
+    {
+        if (s < 0)
+            return;
+        {
+            std::lock_guard<std::mutex> g(slot_lock);
+            free_slots.push_back(s);
+        }
+        slot_cv.notify_one();
+    }
+    // gives a slot back when it goes out of scope
+    struct _slot_guard
+    {
+        RegionReader &r;
+        int slot;
+        ~_slot_guard() { r._release_slot(slot); }
+        void release()
+        {
+            r._release_slot(slot);
+            slot = -1;
+        }
+    };
+    // start reading the rest of op id
+    void _queue(size_t id)
+    {
+        _op &op = ops[id];
+        if (ring < 0)
+        {
+            long res = 0;
+            while (op.got < op.len)
+            {
+                ssize_t r = pread(op.fd,op.buf+op.got,op.len-op.got,
+                        op.off+op.got);
+                ++syscalls;
+                if (r < 0 && errno == EINTR)
+                    continue;
+                if (r <= 0)
+                {
+                    res = r < 0 ? -errno : 0;
+                    break;
+                }
+                op.got += r;
+                res = op.got;
+            }
+            done.emplace_back(id,op.got == op.len ? (long)op.len : res);
+            op.got = 0;
+            return;
+        }
+        unsigned tail = *sq_tail;
+        unsigned i = tail & *sq_mask;
+        io_uring_sqe *e = &sqes[i];
+        memset(e,0,sizeof(*e));
+        bool fix = fixed && op.slot >= 0;
+        e->opcode = fix ? IORING_OP_READ_FIXED : IORING_OP_READ;
+        e->fd = op.fd;
+        e->off = op.off + op.got;
+        e->addr = (uint64_t)(uintptr_t)(op.buf + op.got);
+        e->len = (unsigned)(op.len - op.got);
+        e->buf_index = fix ? (uint16_t)op.slot : 0;
+        e->user_data = id;
+        sq_array[i] = i;
+        __atomic_store_n(sq_tail,tail+1,__ATOMIC_RELEASE);
+        ++to_submit;
+    }
+    // submit the queued reads and wait for at least one completion
+    void _wait()
+    {
+        if (ring < 0)
+            return;
+        for (;;)
+        {
+            long r = syscall(__NR_io_uring_enter,ring,to_submit,1,
+                    IORING_ENTER_GETEVENTS,nullptr,0);
+            ++syscalls;
+            if (r < 0 && (errno == EINTR || errno == EAGAIN || errno == EBUSY))
+                continue;
+            if (r < 0)
+                throw "region reader io_uring_enter failed";
+            to_submit -= (unsigned)r;
+            if (to_submit == 0)
+                break;
+        }
+        unsigned head = *cq_head;
+        unsigned tail = __atomic_load_n(cq_tail,__ATOMIC_ACQUIRE);
+        for (; head != tail; ++head)
+        {
+            const io_uring_cqe &c = cqes[head & *cq_mask];
+            size_t id = (size_t)c.user_data;
+            _op &op = ops[id];
+            // a short read continues where it stopped
+            if (c.res > 0 && op.got + c.res < op.len)
+            {
+                op.got += c.res;
+                __atomic_store_n(cq_head,head+1,__ATOMIC_RELEASE);
+                _queue(id);
+                continue;
+            }
+            long res = c.res < 0 ? c.res : c.res == 0 ? 0 : (long)op.len;
+            op.got = 0;
+            done.emplace_back(id,res);
+        }
+        __atomic_store_n(cq_head,head,__ATOMIC_RELEASE);
+    }
+    // run the reads, complete(k, buf, len, slot, error) is called for each
+    // and must release the slot (now or later)
+    template <typename F>
+    void _drive(const std::vector<_read> &reads, F &complete,
+            RegionReadStats &stats)
+    {
+        size_t next = 0, inflight = 0;
+        try
+        {
+            while (next < reads.size() || inflight)
+            {
+                while (next < reads.size() && !free_ops.empty())
+                {
+                    const _read &r = reads[next];
+                    int slot = -1;
+                    if (r.len <= slot_size && (slot = _take_slot()) < 0)
+                        break;
+                    size_t id = free_ops.back();
+                    free_ops.pop_back();
+                    _op &op = ops[id];
+                    op.k = next++;
+                    op.fd = r.fd;
+                    op.off = r.off;
+                    op.len = r.len;
+                    op.got = 0;
+                    op.slot = slot;
+                    if (slot >= 0)
+                        op.buf = buffers + slot*slot_size;
+                    else
+                    {
+                        op.heap.resize(r.len);
+                        op.buf = op.heap.data();
+                    }
+                    ++inflight;
+                    _queue(id);
+                }
+                if (!inflight)
+                {
+                    // every slot is held by chunks being decoded
+                    _wait_slot();
+                    continue;
+                }
+                if (done.empty())
+                    _wait();
+                std::vector<std::pair<size_t,long>> batch;
+                batch.swap(done);
+                for (size_t j = 0; j < batch.size(); ++j)
+                {
+                    size_t id = batch[j].first;
+                    long res = batch[j].second;
+                    _op &op = ops[id];
+                    --inflight;
+                    free_ops.push_back(id);
+                    if (res == (long)op.len)
+                        stats.bytes += op.len;
+                    try
+                    {
+                        complete(op.k,op.buf,op.len,op.slot,res == (long)op.len
+                                ? nullptr : "region file read failed",op.heap);
+                    }
+                    catch (...)
+                    {
+                        // the rest of the batch still gives back its slots
+                        for (++j; j < batch.size(); ++j)
+                        {
+                            _release_slot(ops[batch[j].first].slot);
+                            free_ops.push_back(batch[j].first);
+                            --inflight;
+                        }
+                        throw;
+                    }
+                }
+            }
+        }
+        catch (...)
+        {
+            // let the reads in flight finish before their buffers are reused
+            while (inflight)
+            {
+                if (done.empty())
+                {
+                    try { _wait(); }
+                    catch (const char*) { break; }
+                }
+                for (auto &d : done)
+                {
+                    _release_slot(ops[d.first].slot);
+                    free_ops.push_back(d.first);
+                    --inflight;
+                }
+                done.clear();
+            }
+            throw;
+        }
+    }
+    // reads for the chunks of the request list, report(k, error) for the
+    // ones that need no read (missing or in a broken region)
+    template <typename F>
+    std::vector<_read> _plan(const std::vector<RegionChunkRef> &chunks,
+            std::vector<size_t> &which, F &&report)
+    {
+        loadHeaders();
+        std::vector<_read> reads;
+        for (size_t k = 0; k < chunks.size(); ++k)
+        {
+            const RegionChunkRef &c = chunks[k];
+            const _region &r = _chunk_region(c.region,c.ci);
+            if (r.error)
+            {
+                report(k,r.error);
+                continue;
+            }
+            uint32_t loc = r.locations[c.ci];
+            if (!loc)
+            {
+                report(k,nullptr);
+                continue;
+            }
+            reads.push_back({r.fd,(uint64_t)(loc >> 8)*REGION_SECTOR,
+                    (size_t)(loc & 0xff)*REGION_SECTOR});
+            which.push_back(k);
+        }
+        return reads;
+    }
+    const _region &_chunk_region(size_t id, size_t ci) const
+    {
+        if (id >= regions.size() || ci >= REGION_CHUNKS)
+            throw "region reader chunk out of range";
+        return *regions[id];
+    }
+public:
+    // depth reads in flight with slots of slot bytes (at least 8 KiB),
+    // uring = false always uses pread
+    RegionReader(size_t d = 64, size_t slot = 64*1024, bool uring = true):
+            depth(d ? d : 1), slot_size(std::max(slot,2*REGION_SECTOR)),
+            ring(-1), fixed(false), sq_map(nullptr), cq_map(nullptr),
+            sqe_map(nullptr), to_submit(0), syscalls(0)
+    {
+        slot_size = (slot_size + REGION_SECTOR-1) & ~(REGION_SECTOR-1);
+        void *b = mmap(nullptr,depth*slot_size,PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS,-1,0);
+        if (b == MAP_FAILED)
+            throw "region reader cannot allocate buffers";
+        buffers = (char*)b;
+        for (size_t i = depth; i--;)
+            free_slots.push_back((int)i);
+        ops.resize(depth);
+        for (size_t i = depth; i--;)
+            free_ops.push_back(i);
+        if (uring && !_setup())
+            _teardown();
+    }
+    ~RegionReader()
+    {
+        _teardown();
+        munmap(buffers,depth*slot_size);
+        for (auto &r : regions)
+            if (r->fd >= 0)
+                close(r->fd);
+    }
+    RegionReader(const RegionReader&) = delete;
+    RegionReader &operator=(const RegionReader&) = delete;
+    // true when reading through io_uring
+    bool uring() const { return ring >= 0; }
+    // true when the slots are registered with the ring
+    bool registered() const { return fixed; }
+    // open a region file, returns its id (an error is kept for the region)
+    size_t add(const std::string &path)
+    {
+        std::unique_ptr<_region> r(new _region());
+        r->path = path;
+        r->size = 0;
+        r->loaded = false;
+        r->error = nullptr;
+        r->fd = open(path.c_str(),O_RDONLY | O_CLOEXEC);
+        struct stat st;
+        if (r->fd < 0)
+            r->error = "region file cannot open file";
+        else if (fstat(r->fd,&st))
+            r->error = "region file cannot stat file";
+        else
+            r->size = st.st_size;
+        regions.push_back(std::move(r));
+        return regions.size()-1;
+    }
+    size_t size() const { return regions.size(); }
+    const std::string &path(size_t id) const { return regions.at(id)->path; }
+    // header error of a region (nullptr if fine), after loadHeaders()
+    const char *error(size_t id) const { return regions.at(id)->error; }
+    // chunk ci (32*z + x) of region id, out of range ones throw
+    bool exists(size_t id, size_t ci) const
+    {
+        return _chunk_region(id,ci).locations[ci] != 0;
+    }
+    int32_t timestamp(size_t id, size_t ci) const
+    {
+        return _chunk_region(id,ci).timestamps[ci];
+    }
+    // read the headers of the regions added since the last call in one batch
+    RegionReadStats loadHeaders()
+    {
+        double t0 = _now();
+        size_t calls = syscalls;
+        RegionReadStats stats;
+        std::vector<_read> reads;
+        std::vector<_region*> which;
+        for (auto &p : regions)
+        {
+            _region &r = *p;
+            if (r.loaded || r.error)
+                continue;
+            r.loaded = true;
+            memset(r.locations,0,sizeof(r.locations));
+            memset(r.timestamps,0,sizeof(r.timestamps));
+            if (r.size == 0)
+                continue;
+            if (r.size < 2*REGION_SECTOR)
+            {
+                r.error = "region file has an incomplete header";
+                ++stats.failed;
+                continue;
+            }
+            reads.push_back({r.fd,0,2*REGION_SECTOR});
+            which.push_back(&r);
+        }
+        std::vector<uint64_t> used;
+        auto complete = [&](size_t k, const char *buf, size_t, int slot,
+                const char *error, bytes_t&)
+        {
+            _slot_guard g{*this,slot};
+            _region &r = *which[k];
+            if (!error)
+            {
+                try
+                {
+                    _region_index(buf,r.size,r.locations,r.timestamps,used);
+                    ++stats.chunks;
+                    return;
+                }
+                catch (const char *e)
+                {
+                    error = e;
+                }
+            }
+            r.error = error;
+            memset(r.locations,0,sizeof(r.locations));
+            ++stats.failed;
+        };
+        _drive(reads,complete,stats);
+        stats.syscalls = syscalls - calls;
+        stats.wall_s = _now() - t0;
+        return stats;
+    }
+    // read the compressed data of chunks, cb(k, data, error) on this thread
+    template <typename F>
+    RegionReadStats read(const std::vector<RegionChunkRef> &chunks, F &&cb)
+    {
+        double t0 = _now();
+        size_t calls = syscalls;
+        RegionReadStats stats;
+        std::vector<size_t> which;
+        std::vector<_read> reads = _plan(chunks,which,
+                [&](size_t k, const char *e)
+        {
+            stats.failed += e != nullptr;
+            cb(k,RegionChunkData{0,nullptr,0},e);
+        });
+        auto complete = [&](size_t k, const char *buf, size_t len, int slot,
+                const char *error, bytes_t&)
+        {
+            _slot_guard g{*this,slot};
+            RegionChunkData d{0,nullptr,0};
+            if (!error)
+            {
+                try
+                {
+                    d = _region_chunk(buf,len);
+                }
+                catch (const char *e)
+                {
+                    error = e;
+                }
+            }
+            if (error)
+                ++stats.failed;
+            else
+                ++stats.chunks;
+            cb(which[k],d,error);
+        };
+        _drive(reads,complete,stats);
+        stats.syscalls = syscalls - calls;
+        stats.wall_s = _now() - t0;
+        return stats;
+    }
+    // read, inflate and decode chunks, cb(k, chunk, error) on the workers of
+    // pool with chunks in a per worker arena (valid during the call)
+    // (must not be called from a worker of the pool)
+    template <typename F>
+    RegionReadStats load(const std::vector<RegionChunkRef> &chunks,
+            ThreadPool &pool, F &&cb)
+    {
+        double t0 = _now();
+        size_t calls = syscalls;
+        RegionReadStats stats;
+        std::atomic<size_t> decoded(0), failed(0);
+        if (workers.size() != pool.size()+1)
+        {
+            workers.clear();
+            for (size_t i = 0; i <= pool.size(); ++i)
+                workers.emplace_back(new _worker());
+        }
+        std::vector<size_t> which;
+        std::vector<_read> reads = _plan(chunks,which,
+                [&](size_t k, const char *e)
+        {
+            failed += e != nullptr;
+            cb(k,(TAG*)nullptr,e);
+        });
+        auto complete = [&](size_t k, const char *buf, size_t len, int slot,
+                const char *error, bytes_t &heap)
+        {
+            if (error)
+            {
+                _release_slot(slot);
+                ++failed;
+                cb(which[k],(TAG*)nullptr,error);
+                return;
+            }
+            // chunks in heap buffers take the buffer along
+            std::shared_ptr<bytes_t> own;
+            if (slot < 0)
+            {
+                own.reset(new bytes_t());
+                own->swap(heap);
+                buf = own->data();
+            }
+            size_t ck = which[k];
+            pool.submit([this,&pool,&cb,&decoded,&failed,ck,buf,len,slot,own]
+            {
+                _slot_guard g{*this,slot};
+                _worker &w = *workers[pool.workerIndex()];
+                TAG *t = nullptr;
+                const char *decode_error = nullptr;
+                try
+                {
+                    RegionChunkData d = _region_chunk(buf,len);
+                    std::string_view nbt = w.inf.inflate(d.data,d.size,
+                            d.compression);
+                    // uncompressed chunks are decoded from the slot itself
+                    if (d.compression != NBT_RAW)
+                        g.release();
+                    w.arena.reset();
+                    t = TAG::decode(nbt.data(),nbt.size(),&w.arena);
+                }
+                catch (const char *e)
+                {
+                    decode_error = e;
+                }
+                if (t)
+                    ++decoded;
+                else
+                    ++failed;
+                cb(ck,t,decode_error);
+            });
+        };
+        try
+        {
+            _drive(reads,complete,stats);
+        }
+        catch (...)
+        {
+            try { pool.wait(); }
+            catch (...) {}
+            throw;
+        }
+        pool.wait();
+        stats.chunks = decoded;
+        stats.failed = failed;
+        stats.syscalls = syscalls - calls;
+        stats.wall_s = _now() - t0;
+        return stats;
+    }
+};
+
+}
@@ -0,0 +1,185 @@
+/*
+Benchmark for batched chunk reads, io_uring against pread
+
+region_reader_bench [world/region|-] [chunks] [depth] [threads]
+
+Picks random present chunks across all region files of a directory (or of a
+generated test world of 32 regions in /tmp when no directory is given) and
+reads them with RegionReader on both backends: headers of every region in one
+batch, then the raw chunk reads, then the same chunks decoded on a pool.
+Before each run the page cache of the files is dropped (best effort with
+posix_fadvise) and the run is repeated warm. Prints one key=value line per
+run with the time, syscalls and chunks/s.
+*/
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "jrand.hpp"
+#include "nbt.hpp"
+#include "region.hpp"
+#include "region_reader.hpp"
+#include "region_writer.hpp"
+
+using namespace mclib;
+
+static std::vector<std::string> list_regions(const std::string &dir)
+{
+    std::vector<std::string> ret;
+    DIR *d = opendir(dir.c_str());
+    if (!d)
+        return ret;
+    while (struct dirent *e = readdir(d))
+    {
+        std::string name = e->d_name;
+        if (name.size() > 4 && name.compare(name.size()-4,4,".mca") == 0)
+            ret.push_back(dir + "/" + name);
+    }
+    closedir(d);
+    std::sort(ret.begin(),ret.end());
+    return ret;
+}
+
+// regions full of chunks of about 4 KB of nbt
+static std::string make_world()
+{
+    std::string dir = "/tmp/region_reader_bench";
+    mkdir(dir.c_str(),0755);
+    Random r(2975);
+    ThreadPool pool;
+    for (int i = 0; i < 32; ++i)
+    {
+        char name[64];
+        snprintf(name,sizeof(name),"/r.%d.%d.mca",i % 8,i / 8);
+        std::string path = dir + name;
+        struct stat st;
+        if (stat(path.c_str(),&st) == 0 && st.st_size > 0)
+            continue;
+        RegionWriter w(path);
+        for (size_t ci = 0; ci < REGION_CHUNKS; ++ci)
+        {
+            compound_t root;
+            root["xPos"] = new TAG_Int("xPos",(int)(ci % 32));
+            root["zPos"] = new TAG_Int("zPos",(int)(ci / 32));
+            long_array_t data(512);
+            for (int64_t &v : data)
+                v = r.nextInt(64) == 0 ? r.nextLong() : r.nextInt(16);
+            root["Data"] = new TAG_Long_Array("Data",data);
+            TAG *t = new TAG_Compound("",root);
+            w.setChunk(ci,*t,0);
+            delete t;
+        }
+        w.flush(&pool);
+    }
+    return dir;
+}
+
+static void drop_cache(const std::vector<std::string> &files)
+{
+    for (const std::string &f : files)
+    {
+        int fd = open(f.c_str(),O_RDONLY);
+        if (fd < 0)
+            continue;
+        fdatasync(fd);
+        posix_fadvise(fd,0,0,POSIX_FADV_DONTNEED);
+        close(fd);
+    }
+}
+
+static void print(const char *mode, const char *backend, const char *cache,
+        const RegionReader &rr, const RegionReadStats &h,
+        const RegionReadStats &s)
+{
+    printf("mode=%s backend=%s registered=%d cache=%s regions=%zu "
+            "header_ms=%.2f header_syscalls=%zu chunks=%zu failed=%zu ms=%.2f "
+            "syscalls=%zu chunks_per_s=%.0f MB_per_s=%.1f\n",mode,backend,
+            (int)rr.registered(),cache,rr.size(),h.wall_s*1e3,h.syscalls,
+            s.chunks,s.failed,s.wall_s*1e3,s.syscalls,s.chunks/s.wall_s,
+            s.bytes/s.wall_s/1e6);
+}
+
+int main(int argc, char **argv)
+{
+    std::string dir = argc > 1 && std::string(argv[1]) != "-" ? argv[1]
+            : make_world();
+    size_t count = argc > 2 ? std::stoul(argv[2]) : 20000;
+    size_t depth = argc > 3 ? std::stoul(argv[3]) : 64;
+    size_t threads = argc > 4 ? std::stoul(argv[4])
+            : std::thread::hardware_concurrency();
+    std::vector<std::string> files = list_regions(dir);
+    if (files.empty())
+    {
+        fprintf(stderr,"no region files in %s\n",dir.c_str());
+        return 1;
+    }
+    // random present chunks
+    std::vector<RegionChunkRef> refs;
+    {
+        RegionReader rr(depth,64*1024,false);
+        for (const std::string &f : files)
+            rr.add(f);
+        rr.loadHeaders();
+        std::vector<RegionChunkRef> all;
+        for (size_t i = 0; i < rr.size(); ++i)
+            for (size_t ci = 0; ci < REGION_CHUNKS; ++ci)
+                if (!rr.error(i) && rr.exists(i,ci))
+                    all.push_back({i,ci});
+        if (all.empty())
+        {
+            fprintf(stderr,"no chunks in %s\n",dir.c_str());
+            return 1;
+        }
+        Random r(1);
+        for (size_t i = 0; i < count; ++i)
+            refs.push_back(all[r.nextInt((int32_t)std::min(all.size(),
+                    (size_t)0x7fffffff))]);
+    }
+    ThreadPool pool(threads ? threads : 1);
+    auto ignore_raw = [](size_t, const RegionChunkData&, const char*) {};
+    auto ignore_tag = [](size_t, TAG*, const char*) {};
+    for (bool uring : {false,true})
+    {
+        const char *backend = uring ? "io_uring" : "pread";
+        {
+            RegionReader probe(depth,64*1024,uring);
+            if (uring && !probe.uring())
+            {
+                printf("mode=read backend=io_uring unavailable=1\n");
+                continue;
+            }
+        }
+        for (const char *cache : {"cold","warm"})
+        {
+            if (strcmp(cache,"cold") == 0)
+                drop_cache(files);
+            RegionReader rr(depth,64*1024,uring);
+            for (const std::string &f : files)
+                rr.add(f);
+            RegionReadStats h = rr.loadHeaders();
+            RegionReadStats s = rr.read(refs,ignore_raw);
+            print("read",backend,cache,rr,h,s);
+        }
+        for (const char *cache : {"cold","warm"})
+        {
+            if (strcmp(cache,"cold") == 0)
+                drop_cache(files);
+            RegionReader rr(depth,64*1024,uring);
+            for (const std::string &f : files)
+                rr.add(f);
+            RegionReadStats h = rr.loadHeaders();
+            RegionReadStats s = rr.load(refs,pool,ignore_tag);
+            print("load",backend,cache,rr,h,s);
+        }
+    }
+    return 0;
+}
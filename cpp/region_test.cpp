@@ -0,0 +1,484 @@
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "arena.hpp"
+#include "nbt.hpp"
+#include "region.hpp"
+#include "region_loader.hpp"
+#include "region_reader.hpp"
+#include "region_writer.hpp"
+
+using namespace mclib;
+
+static bytes_t make_chunk(int x, int z)
+{
+    compound_t root;
+    root["DataVersion"] = new TAG_Int("DataVersion",2975);
+    root["xPos"] = new TAG_Int("xPos",x);
+    root["zPos"] = new TAG_Int("zPos",z);
+    // some chunks need more than 1 sector
+    long_array_t data((size_t)(x*z*37 % 2000));
+    for (size_t i = 0; i < data.size(); ++i)
+        data[i] = (int64_t)(i*0x9e3779b97f4a7c15ull);
+    root["Data"] = new TAG_Long_Array("Data",data);
+    TAG *tag = new TAG_Compound("",root);
+    bytes_t ret = tag->encode();
+    delete tag;
+    return ret;
+}
+
+// region with chunks where (x+z) % 3 != 0, compression cycling 1, 2, 3
+static bytes_t make_region()
+{
+    bytes_t ret(2*REGION_SECTOR,0);
+    NbtDeflater def;
+    for (int z = 0; z < 32; ++z)
+        for (int x = 0; x < 32; ++x)
+        {
+            if ((x+z) % 3 == 0)
+                continue;
+            size_t ci = RegionFile::index(x,z);
+            int c = 1 + (int)(ci % 3);
+            bytes_t raw = make_chunk(x,z);
+            std::string_view d = def.deflate(raw.data(),raw.size(),c);
+            size_t offset = ret.size() / REGION_SECTOR;
+            size_t sectors = (d.size() + 5 + REGION_SECTOR-1) / REGION_SECTOR;
+            _to_bytes(ret.data() + 4*ci,(int32_t)(offset << 8 | sectors));
+            _to_bytes(ret.data() + REGION_SECTOR + 4*ci,(int32_t)(1000+ci));
+            ret.resize(ret.size() + sectors*REGION_SECTOR,0);
+            char *p = ret.data() + offset*REGION_SECTOR;
+            _to_bytes(p,(int32_t)(d.size()+1));
+            p[4] = (char)c;
+            memcpy(p+5,d.data(),d.size());
+        }
+    return ret;
+}
+
+static bytes_t read_file(const char *path)
+{
+    FILE *f = fopen(path,"rb");
+    bytes_t ret;
+    char buf[65536];
+    size_t n;
+    while ((n = fread(buf,1,sizeof(buf),f)) > 0)
+        ret.insert(ret.end(),buf,buf+n);
+    fclose(f);
+    return ret;
+}
+
+static bool throws(const bytes_t &region)
+{
+    try { RegionFile r(region.data(),region.size()); }
+    catch (const char*) { return true; }
+    return false;
+}
+
+static bool throws_compact(RegionWriter &w)
+{
+    try { w.compact(); }
+    catch (const char*) { return true; }
+    return false;
+}
+
+static bool chunk_throws(const bytes_t &region, size_t ci)
+{
+    RegionFile r(region.data(),region.size());
+    NbtInflater inf;
+    try { delete r.chunk(ci,inf); }
+    catch (const char*) { return true; }
+    return false;
+}
+
+int main(int argc, char **argv)
+{
+    (void)argc;
+    (void)argv;
+    bytes_t region = make_region();
+    RegionFile r(region.data(),region.size());
+    size_t present = 0;
+    NbtInflater inf;
+    for (int z = 0; z < 32; ++z)
+        for (int x = 0; x < 32; ++x)
+        {
+            size_t ci = RegionFile::index(x,z);
+            bool e = (x+z) % 3 != 0;
+            assert(r.exists(x,z) == e && r.exists(ci) == e);
+            assert(r.timestamp(x,z) == (e ? 1000+(int32_t)ci : 0));
+            present += e;
+            if (!e)
+            {
+                assert(!r.raw(ci).data && !r.view(ci,inf).valid());
+                assert(!r.chunk(x,z));
+                continue;
+            }
+            RegionChunkData d = r.raw(x,z);
+            assert(d.compression == 1 + (int)(ci % 3));
+            assert(r.view(ci,inf)["zPos"].asInt() == z);
+            Arena arena;
+            TAG *t = r.chunk(x,z,&arena);
+            assert(t->encode() == make_chunk(x,z));
+        }
+    assert(r.chunks() == present);
+    // from a file
+    {
+        const char *path = "/tmp/region_test.mca";
+        FILE *f = fopen(path,"wb");
+        fwrite(region.data(),1,region.size(),f);
+        fclose(f);
+        RegionFile rf(path);
+        assert(rf.chunks() == present && rf.size() == region.size());
+        TAG *t = rf.chunk(31,30);
+        assert(t->encode() == make_chunk(31,30));
+        delete t;
+        remove(path);
+    }
+    // header checks
+    size_t ci = RegionFile::index(1,0), cj = RegionFile::index(2,0);
+    {
+        bytes_t bad = region;
+        bad.pop_back();
+        assert(throws(bad));
+        assert(throws(bytes_t(REGION_SECTOR,0)));
+        assert(!throws(bytes_t(2*REGION_SECTOR,0)));
+        bad = region;
+        memcpy(bad.data() + 4*cj,bad.data() + 4*ci,4); // same sectors
+        assert(throws(bad));
+        bad = region;
+        _to_bytes(bad.data() + 4*ci,(int32_t)(1 << 8 | 1)); // in header
+        assert(throws(bad));
+        bad = region;
+        bad[4*ci+3] = 0; // no sectors
+        assert(throws(bad));
+        bad = region;
+        _to_bytes(bad.data() + 4*ci,
+                (int32_t)((region.size()/REGION_SECTOR) << 8 | 1));
+        assert(throws(bad));
+    }
+    // chunk checks only when the chunk is read
+    {
+        size_t off = r.sectorOffset(ci)*REGION_SECTOR;
+        bytes_t bad = region;
+        bad[off+4] = 4;
+        assert(chunk_throws(bad,ci) && !chunk_throws(bad,cj));
+        bad[off+4] = (char)0x82;
+        assert(chunk_throws(bad,ci));
+        bad = region;
+        _to_bytes(bad.data() + off,(int32_t)0);
+        assert(chunk_throws(bad,ci));
+        bad = region;
+        _to_bytes(bad.data() + off,
+                (int32_t)(r.sectorCount(ci)*REGION_SECTOR - 3));
+        assert(chunk_throws(bad,ci));
+        bad = region;
+        bad[off+20] ^= 0x40;
+        assert(chunk_throws(bad,ci));
+        // indexes past the last chunk
+        assert(chunk_throws(region,REGION_CHUNKS));
+        bool threw = false;
+        try { r.exists(REGION_CHUNKS); }
+        catch (const char*) { threw = true; }
+        assert(threw);
+    }
+    // whole region on a pool, in arenas and kept, with a broken chunk
+    {
+        size_t off = r.sectorOffset(ci)*REGION_SECTOR;
+        bytes_t bad = region;
+        bad[off+20] ^= 0x40;
+        RegionFile rb(bad.data(),bad.size());
+        ThreadPool pool(3);
+        RegionLoader loader(pool);
+        for (bool keep : {false,true})
+        {
+            std::mutex lock;
+            std::vector<int> seen(REGION_CHUNKS,0);
+            RegionLoadStats st = loader.load(rb,[&](size_t i, TAG *t,
+                    const char *error)
+            {
+                std::lock_guard<std::mutex> g(lock);
+                ++seen[i];
+                if (i == ci)
+                {
+                    assert(!t && error);
+                    return;
+                }
+                assert(t && !error);
+                int x = (int)(i % 32), z = (int)(i / 32);
+                assert(t->encode() == make_chunk(x,z));
+                if (keep)
+                    delete t;
+            },keep);
+            assert(st.chunks == present-1 && st.failed == 1);
+            assert(st.compressed > 0 && st.inflated > 0);
+            assert(st.inflate_s > 0 && st.parse_s > 0 && st.wall_s > 0);
+            for (size_t i = 0; i < REGION_CHUNKS; ++i)
+                assert(seen[i] == (rb.exists(i) ? 1 : 0));
+            size_t n = 0;
+            RegionLoadStats sq = loader.loadSequential(r,[&](size_t, TAG *t,
+                    const char*)
+            {
+                ++n;
+                if (keep)
+                    delete t;
+            },keep);
+            assert(n == present && sq.chunks == present && sq.failed == 0);
+        }
+    }
+    // writing into a new file
+    {
+        const char *path = "/tmp/region_writer_test.mca";
+        remove(path);
+        ThreadPool pool(3);
+        {
+            RegionWriter w(path);
+            assert(w.size() == 2*REGION_SECTOR && w.dirty() == 0);
+            for (size_t i = 0; i < REGION_CHUNKS; i += 7)
+            {
+                bytes_t raw = make_chunk((int)(i % 32),(int)(i / 32));
+                w.setChunk(i,raw.data(),raw.size(),(int32_t)i);
+            }
+            assert(w.dirty() == (REGION_CHUNKS+6)/7);
+            size_t written = w.flush(&pool);
+            assert(written == (REGION_CHUNKS+6)/7 && w.dirty() == 0);
+            (void)written;
+            assert(w.freeSectors() == 0);
+        }
+        RegionFile rf(path);
+        for (size_t i = 0; i < REGION_CHUNKS; ++i)
+        {
+            assert(rf.exists(i) == (i % 7 == 0));
+            assert(rf.timestamp(i) == (i % 7 == 0 ? (int32_t)i : 0));
+            if (!rf.exists(i))
+                continue;
+            assert(rf.raw(i).compression == NBT_ZLIB);
+            TAG *t = rf.chunk(i,inf);
+            assert(t->encode() == make_chunk((int)(i % 32),(int)(i / 32)));
+            delete t;
+        }
+        remove(path);
+    }
+    // editing an existing region in place
+    {
+        const char *path = "/tmp/region_writer_test.mca";
+        FILE *f = fopen(path,"wb");
+        fwrite(region.data(),1,region.size(),f);
+        fclose(f);
+        size_t big = RegionFile::index(31,31), small = RegionFile::index(1,0);
+        size_t gone = RegionFile::index(2,0), added = RegionFile::index(2,1);
+        size_t touched = RegionFile::index(4,0);
+        assert(r.sectorCount(big) > 1 && r.sectorCount(small) == 1);
+        RegionWriter w(path);
+        // smaller chunk (and a timestamp) stays in its sectors
+        bytes_t tiny = make_chunk(0,0);
+        w.setChunk(big,tiny.data(),tiny.size(),7);
+        w.setTimestamp(touched,8);
+        size_t written = w.flush();
+        assert(written == 1);
+        (void)written;
+        assert(w.sectorOffset(big) == r.sectorOffset(big));
+        assert(w.sectorCount(big) == 1);
+        size_t freed = w.freeSectors();
+        assert(freed == r.sectorCount(big) - 1);
+        bytes_t now = read_file(path);
+        assert(now.size() == region.size());
+        for (size_t i = 0; i < REGION_CHUNKS; ++i)
+        {
+            if (i == big || !r.exists(i))
+                continue;
+            size_t off = r.sectorOffset(i)*REGION_SECTOR;
+            size_t n = r.sectorCount(i)*REGION_SECTOR;
+            assert(memcmp(now.data()+off,region.data()+off,n) == 0);
+        }
+        // a bigger chunk moves into the freed sectors, removal frees its own
+        bytes_t large = make_chunk(30,30);
+        w.setChunk(small,large.data(),large.size(),9);
+        w.removeChunk(gone);
+        w.setChunk(added,tiny.data(),tiny.size(),10);
+        ThreadPool pool(2);
+        w.flush(&pool,NBT_GZIP);
+        assert(w.sectorOffset(small) == w.sectorOffset(big) + 1);
+        assert(w.sectorCount(small) == freed);
+        // the removed chunk's sectors are only free after the flush
+        assert(w.size() == region.size() + REGION_SECTOR);
+        assert(w.sectorOffset(added) == region.size() / REGION_SECTOR);
+        assert(w.freeSectors() == r.sectorCount(gone) + 1);
+        assert(!w.exists(gone) && w.timestamp(gone) == 0);
+        bool threw = false;
+        try { w.sectorCount(REGION_CHUNKS); }
+        catch (const char*) { threw = true; }
+        assert(threw);
+        threw = false;
+        try { w.setChunk(REGION_CHUNKS,tiny.data(),tiny.size()); }
+        catch (const char*) { threw = true; }
+        assert(threw && w.dirty() == 0);
+        RegionFile rf(path);
+        assert(rf.chunks() == present);
+        assert(rf.timestamp(big) == 7 && rf.timestamp(touched) == 8);
+        assert(rf.timestamp(small) == 9 && rf.timestamp(added) == 10);
+        assert(!rf.exists(gone) && rf.timestamp(gone) == 0);
+        assert(rf.raw(small).compression == NBT_GZIP);
+        for (size_t i = 0; i < REGION_CHUNKS; ++i)
+        {
+            if (!rf.exists(i))
+                continue;
+            bytes_t want = i == big || i == added ? tiny : i == small ? large
+                    : make_chunk((int)(i % 32),(int)(i / 32));
+            TAG *t = rf.chunk(i,inf);
+            assert(t->encode() == want);
+            delete t;
+        }
+        // too large chunks are refused before anything is written
+        bytes_t snap = read_file(path);
+        bytes_t huge(256*REGION_SECTOR,0);
+        w.setChunk(small,huge.data(),huge.size());
+        threw = false;
+        try { w.flush(nullptr,NBT_RAW); }
+        catch (const char*) { threw = true; }
+        assert(threw && read_file(path) == snap);
+        assert(RegionFile(path).timestamp(small) == 9);
+        w.removeChunk(small);
+        assert(throws_compact(w));
+        w.flush();
+        // compaction gives the minimal layout with the same chunk data
+        bytes_t before = read_file(path);
+        RegionFile rb(before.data(),before.size());
+        size_t shrunk = w.compact();
+        bytes_t after = read_file(path);
+        assert(shrunk > 0 && after.size() + shrunk == before.size());
+        assert(w.size() == after.size() && w.freeSectors() == 0);
+        RegionFile ra(after.data(),after.size());
+        assert(ra.chunks() == rb.chunks());
+        size_t next = 2;
+        for (size_t i = 0; i < REGION_CHUNKS; ++i)
+        {
+            assert(ra.exists(i) == rb.exists(i));
+            assert(ra.timestamp(i) == rb.timestamp(i));
+            if (!ra.exists(i))
+                continue;
+            assert(ra.sectorOffset(i) == next);
+            next += ra.sectorCount(i);
+            RegionChunkData a = ra.raw(i), b = rb.raw(i);
+            assert(a.compression == b.compression && a.size == b.size);
+            assert(memcmp(a.data,b.data,a.size) == 0);
+            // padding is zeroed
+            size_t end = ra.sectorOffset(i)*REGION_SECTOR + 5 + a.size;
+            size_t pad = ra.sectorCount(i)*REGION_SECTOR - 5 - a.size;
+            assert(std::all_of(after.begin()+end,after.begin()+end+pad,
+                    [](char c) { return c == 0; }));
+        }
+        assert(next*REGION_SECTOR == after.size());
+        remove(path);
+    }
+    // batched reads from several files, io_uring (if available) and pread
+    {
+        std::string a = "/tmp/region_reader_a.mca";
+        std::string b = "/tmp/region_reader_b.mca";
+        std::string empty = "/tmp/region_reader_e.mca";
+        std::string bad = "/tmp/region_reader_bad.mca";
+        FILE *f = fopen(a.c_str(),"wb");
+        fwrite(region.data(),1,region.size(),f);
+        fclose(f);
+        bytes_t other = region;
+        size_t off = r.sectorOffset(ci)*REGION_SECTOR;
+        _to_bytes(other.data() + off,(int32_t)0); // broken chunk ci
+        f = fopen(b.c_str(),"wb");
+        fwrite(other.data(),1,other.size(),f);
+        fclose(f);
+        fclose(fopen(empty.c_str(),"wb"));
+        f = fopen(bad.c_str(),"wb");
+        fwrite(region.data(),1,REGION_SECTOR+7,f);
+        fclose(f);
+        // every chunk of both regions, interleaved
+        std::vector<RegionChunkRef> refs;
+        for (size_t i = REGION_CHUNKS; i--;)
+        {
+            refs.push_back({0,i});
+            refs.push_back({1,i});
+        }
+        refs.push_back({2,0});
+        refs.push_back({3,0});
+        refs.push_back({4,5});
+        for (bool uring : {true,false})
+            // small slots make the larger chunks use heap buffers
+            for (size_t slot : {(size_t)0,(size_t)1 << 20})
+            {
+                RegionReader rr(4,slot,uring);
+                size_t ia = rr.add(a), ib = rr.add(b), ie = rr.add(empty);
+                size_t ibad = rr.add(bad);
+                size_t imiss = rr.add("/tmp/region_reader_missing.mca");
+                assert(ia == 0 && ib == 1 && ie == 2);
+                assert(ibad == 3 && imiss == 4);
+                (void)ia; (void)ib; (void)ie; (void)ibad; (void)imiss;
+                RegionReadStats hs = rr.loadHeaders();
+                assert(hs.chunks == 2 && hs.failed == 1);
+                assert(!rr.error(0) && !rr.error(1) && !rr.error(2));
+                assert(rr.error(3) && rr.error(4));
+                assert(rr.timestamp(1,cj) == r.timestamp(cj));
+                bool threw = false;
+                try { rr.exists(0,REGION_CHUNKS); }
+                catch (const char*) { threw = true; }
+                assert(threw);
+                std::vector<int> seen(refs.size(),0);
+                RegionReadStats st = rr.read(refs,[&](size_t k,
+                        const RegionChunkData &d, const char *error)
+                {
+                    ++seen[k];
+                    const RegionChunkRef &c = refs[k];
+                    if (c.region >= 2)
+                    {
+                        assert(!d.data && (error != nullptr) == (c.region > 2));
+                        return;
+                    }
+                    if (c.region == 1 && c.ci == ci)
+                    {
+                        assert(error && !d.data);
+                        return;
+                    }
+                    RegionChunkData want = r.raw(c.ci);
+                    assert(!error && d.size == want.size);
+                    assert(d.compression == want.compression);
+                    assert(!d.data || memcmp(d.data,want.data,d.size) == 0);
+                });
+                for (int n : seen)
+                    assert(n == 1);
+                assert(st.chunks == 2*present-1 && st.failed == 3);
+                assert(st.bytes > 0 && st.syscalls > 0);
+                if (!rr.uring())
+                    assert(st.syscalls >= st.chunks);
+                // decoded on a pool
+                ThreadPool pool(3);
+                std::mutex lock;
+                std::fill(seen.begin(),seen.end(),0);
+                RegionReadStats ls = rr.load(refs,pool,[&](size_t k, TAG *t,
+                        const char *error)
+                {
+                    const RegionChunkRef &c = refs[k];
+                    bool ok = c.region < 2 && r.exists(c.ci)
+                            && !(c.region == 1 && c.ci == ci);
+                    assert((t != nullptr) == ok);
+                    assert((error != nullptr) == (!ok && (c.region > 2
+                            || c.ci == ci)));
+                    if (t)
+                    {
+                        int x = (int)(c.ci % 32), z = (int)(c.ci / 32);
+                        assert(t->encode() == make_chunk(x,z));
+                    }
+                    std::lock_guard<std::mutex> g(lock);
+                    ++seen[k];
+                });
+                for (int n : seen)
+                    assert(n == 1);
+                assert(ls.chunks == 2*present-1 && ls.failed == 3);
+            }
+        remove(a.c_str());
+        remove(b.c_str());
+        remove(empty.c_str());
+        remove(bad.c_str());
+    }
+    std::cout << "region tests passed" << std::endl;
+    return 0;
+}
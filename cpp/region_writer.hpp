@@ -0,0 +1,462 @@
+/*
+Incremental region (MCA) file writing
+
+RegionWriter opens (or creates) a region file and keeps its header and a
+bitmap of the used sectors in memory. Changed chunks are only recorded until
+flush(), which compresses them (in parallel on a ThreadPool if one is given,
+with a deflater per worker) and then writes only those chunks:
+- a chunk that still fits in its old sectors is written over them (extra
+  sectors at its end become free)
+- otherwise it goes to the first run of free sectors that is long enough, or
+  to the end of the file
+- sectors freed by the flush are only reused by later flushes, so the old
+  data of a chunk is never overwritten by another chunk before the header
+  pointing at its new place is written
+Chunk data is written with pwritev (runs of adjacent chunks in one call, the
+padding comes from a shared zero sector), then the changed 4 byte location and
+timestamp entries are written in place. Nothing else in the file is touched.
+
+Freed sectors stay in the file. compact() does the minimal repack that
+mca.py encodeMCA does: chunks in index order with zeroed padding, written to a
+temporary file that replaces the region, chunk data is copied as it is
+(not recompressed).
+
+A RegionFile mapped from the same file sees the writes but keeps its own
+(old) header. Not thread safe, changes are lost if flush() is not called.
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstdint>
+#include <cstdio>
+#include <ctime>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "nbt.hpp"
+#include "nbt_io.hpp"
+#include "region.hpp"
+#include "thread_pool.hpp"
+
+namespace mclib
+{
+
+class RegionWriter
+{
+private:
+    std::string path;
+    int fd;
+    uint32_t locations[REGION_CHUNKS];
+    int32_t timestamps[REGION_CHUNKS];
+    // used sectors (header included) of the sectors in the file
+    std::vector<uint64_t> used;
+    size_t sectors;
+    // changes not flushed yet
+    enum { _CLEAN, _SET, _REMOVE };
+    struct _change
+    {
+        int state = _CLEAN;
+        bool timestamp = false;
+        int32_t ts = 0;
+        bytes_t nbt;
+    };
+    std::vector<_change> changes;
+    // one per pool thread and one for the calling thread
+    std::vector<std::unique_ptr<NbtDeflater>> deflaters;
+    static const char *_zeros()
+    {
+        static const char zeros[REGION_SECTOR] = {};
+        return zeros;
+    }
+    static void _pwrite_all(int fd, const char *p, size_t n, off_t off)
+    {
+        while (n)
+        {
+            ssize_t w = pwrite(fd,p,n,off);
+            if (w < 0 && errno == EINTR)
+                continue;
+            if (w <= 0)
+                throw "region file write failed";
+            p += w;
+            n -= w;
+            off += w;
+        }
+    }
+    // write the buffers in iov one after another starting at off
+    static void _pwritev_all(int fd, std::vector<iovec> &iov, off_t off)
+    {
+        size_t i = 0;
+        while (i < iov.size())
+        {
+            int n = (int)std::min(iov.size() - i,(size_t)IOV_MAX);
+            ssize_t w = pwritev(fd,iov.data()+i,n,off);
+            if (w < 0 && errno == EINTR)
+                continue;
+            if (w <= 0)
+                throw "region file write failed";
+            off += w;
+            // skip what was written (partial writes continue mid buffer)
+            size_t left = w;
+            while (i < iov.size() && left >= iov[i].iov_len)
+                left -= iov[i++].iov_len;
+            if (left)
+            {
+                iov[i].iov_base = (char*)iov[i].iov_base + left;
+                iov[i].iov_len -= left;
+            }
+        }
+    }
+    void _load()
+    {
+        struct stat st;
+        if (fstat(fd,&st))
+            throw "region file cannot stat file";
+        if (st.st_size == 0)
+        {
+            _pwrite_all(fd,_zeros(),REGION_SECTOR,0);
+            _pwrite_all(fd,_zeros(),REGION_SECTOR,REGION_SECTOR);
+            st.st_size = 2*REGION_SECTOR;
+        }
+        bytes_t header(2*REGION_SECTOR);
+        if (st.st_size >= (off_t)header.size()
+                && pread(fd,header.data(),header.size(),0)
+                != (ssize_t)header.size())
+            throw "region file cannot read header";
+        _region_index(header.data(),st.st_size,locations,timestamps,used);
+        sectors = st.st_size / REGION_SECTOR;
+    }
+    bool _used(size_t s) const
+    {
+        return s < sectors && (used[s >> 6] >> (s & 63) & 1);
+    }
+    void _mark(size_t s, size_t n, bool u)
+    {
+        for (; n--; ++s)
+        {
+            uint64_t bit = (uint64_t)1 << (s & 63);
+            used[s >> 6] = u ? used[s >> 6] | bit : used[s >> 6] & ~bit;
+        }
+    }
+    // first run of n free sectors (marked used), at the end if there is none
+    size_t _alloc(size_t n)
+    {
+        size_t run = 0;
+        for (size_t s = 2; s < sectors; ++s)
+        {
+            if ((s & 63) == 0 && used[s >> 6] == ~(uint64_t)0)
+            {
+                run = 0;
+                s += 63;
+                continue;
+            }
+            run = _used(s) ? 0 : run+1;
+            if (run == n)
+            {
+                _mark(s+1-n,n,true);
+                return s+1-n;
+            }
+        }
+        // continue a free run at the end of the file
+        size_t start = sectors - run;
+        sectors = start + n;
+        used.resize((sectors + 63) / 64,0);
+        _mark(start,n,true);
+        return start;
+    }
+    void _compress(_change &c, bytes_t &out, NbtDeflater &d, int compression,
+            int level)
+    {
+        std::string_view z = d.deflate(c.nbt.data(),c.nbt.size(),compression,
+                level);
+        out.resize(5 + z.size());
+        _to_bytes(out.data(),(int32_t)(z.size()+1));
+        out[4] = (char)compression;
+        memcpy(out.data()+5,z.data(),z.size());
+    }
+    // write header entries [a,b) of locations or timestamps
+    void _write_entries(size_t a, size_t b, bool ts)
+    {
+        char buf[4*REGION_CHUNKS];
+        for (size_t ci = a; ci < b; ++ci)
+            _to_bytes(buf + 4*(ci-a),ts ? timestamps[ci]
+                    : (int32_t)locations[ci]);
+        _pwrite_all(fd,buf,4*(b-a),(ts ? REGION_SECTOR : 0) + 4*a);
+    }
+    static size_t _checked(size_t ci)
+    {
+        if (ci >= REGION_CHUNKS)
+            throw "region chunk index out of range";
+        return ci;
+    }
+public:
+    // open the region file at p, an empty or missing file becomes an empty
+    // region
+    RegionWriter(const std::string &p): path(p), changes(REGION_CHUNKS)
+    {
+        fd = open(path.c_str(),O_RDWR | O_CREAT,0644);
+        if (fd < 0)
+            throw "region file cannot open file";
+        try
+        {
+            _load();
+        }
+        catch (...)
+        {
+            close(fd);
+            throw;
+        }
+    }
+    ~RegionWriter()
+    {
+        close(fd);
+    }
+    RegionWriter(const RegionWriter&) = delete;
+    RegionWriter &operator=(const RegionWriter&) = delete;
+    // bytes in the file
+    size_t size() const { return sectors*REGION_SECTOR; }
+    // state after the last flush, larger indexes than the last chunk throw
+    bool exists(size_t ci) const { return locations[_checked(ci)] != 0; }
+    int32_t timestamp(size_t ci) const { return timestamps[_checked(ci)]; }
+    size_t sectorOffset(size_t ci) const
+    {
+        return locations[_checked(ci)] >> 8;
+    }
+    size_t sectorCount(size_t ci) const
+    {
+        return locations[_checked(ci)] & 0xff;
+    }
+    // sectors not used by any chunk
+    size_t freeSectors() const
+    {
+        size_t n = 0;
+        for (size_t s = 2; s < sectors; ++s)
+            n += !_used(s);
+        return n;
+    }
+    // replace chunk ci with the encoded nbt of t
+    void setChunk(size_t ci, const TAG &t, int32_t ts = (int32_t)time(nullptr))
+    {
+        _change &c = changes[_checked(ci)];
+        c.nbt.clear();
+        t.encode(c.nbt);
+        c.state = _SET;
+        c.timestamp = true;
+        c.ts = ts;
+    }
+    // replace chunk ci with uncompressed nbt bytes
+    void setChunk(size_t ci, const char *nbt, size_t len,
+            int32_t ts = (int32_t)time(nullptr))
+    {
+        _change &c = changes[_checked(ci)];
+        c.nbt.assign(nbt,nbt+len);
+        c.state = _SET;
+        c.timestamp = true;
+        c.ts = ts;
+    }
+    void removeChunk(size_t ci)
+    {
+        _change &c = changes[_checked(ci)];
+        c.nbt = bytes_t();
+        c.state = _REMOVE;
+        c.timestamp = true;
+        c.ts = 0;
+    }
+    void setTimestamp(size_t ci, int32_t ts)
+    {
+        _change &c = changes[_checked(ci)];
+        c.timestamp = true;
+        c.ts = ts;
+    }
+    // number of chunks with changes not flushed yet
+    size_t dirty() const
+    {
+        size_t n = 0;
+        for (const _change &c : changes)
+            n += c.state != _CLEAN || c.timestamp;
+        return n;
+    }
+    // compress and write the changed chunks, returns the number written
+    // (must not be called from a worker of pool)
+    size_t flush(ThreadPool *pool = nullptr, int compression = NBT_ZLIB,
+            int level = Z_DEFAULT_COMPRESSION)
+    {
+        std::vector<size_t> todo;
+        for (size_t ci = 0; ci < REGION_CHUNKS; ++ci)
+            if (changes[ci].state == _SET)
+                todo.push_back(ci);
+        size_t workers = (pool ? pool->size() : 0) + 1;
+        while (deflaters.size() < workers)
+            deflaters.emplace_back(new NbtDeflater());
+        // sector data with the 5 byte chunk header
+        std::vector<bytes_t> packed(todo.size());
+        if (pool && todo.size() > 1)
+        {
+            for (size_t i = 0; i < todo.size(); ++i)
+                pool->submit([this,pool,i,&todo,&packed,compression,level]
+                {
+                    _compress(changes[todo[i]],packed[i],
+                            *deflaters[pool->workerIndex()],compression,level);
+                });
+            pool->wait();
+        }
+        else
+            for (size_t i = 0; i < todo.size(); ++i)
+                _compress(changes[todo[i]],packed[i],*deflaters.back(),
+                        compression,level);
+        for (const bytes_t &b : packed)
+            if ((b.size() + REGION_SECTOR-1) / REGION_SECTOR > 255)
+                throw "region chunk too large (more than 255 sectors)";
+        // place chunks, frees wait until the end of the flush
+        struct _write
+        {
+            size_t sector, count, i;
+            bool operator<(const _write &o) const { return sector < o.sector; }
+        };
+        std::vector<_write> writes;
+        std::vector<std::pair<size_t,size_t>> frees;
+        for (size_t i = 0; i < todo.size(); ++i)
+        {
+            size_t ci = todo[i];
+            size_t n = (packed[i].size() + REGION_SECTOR-1) / REGION_SECTOR;
+            size_t off = sectorOffset(ci), old = sectorCount(ci);
+            if (old >= n)
+                frees.emplace_back(off+n,old-n);
+            else
+            {
+                if (old)
+                    frees.emplace_back(off,old);
+                off = _alloc(n);
+            }
+            writes.push_back({off,n,i});
+        }
+        std::sort(writes.begin(),writes.end());
+        std::vector<iovec> iov;
+        for (size_t k = 0; k < writes.size();)
+        {
+            // run of adjacent chunks
+            size_t start = writes[k].sector, end = start;
+            iov.clear();
+            for (; k < writes.size() && writes[k].sector == end; ++k)
+            {
+                bytes_t &b = packed[writes[k].i];
+                iov.push_back({b.data(),b.size()});
+                size_t pad = writes[k].count*REGION_SECTOR - b.size();
+                if (pad)
+                    iov.push_back({(void*)_zeros(),pad});
+                end += writes[k].count;
+            }
+            _pwritev_all(fd,iov,(off_t)(start*REGION_SECTOR));
+        }
+        // header entries of changed chunks, in runs of adjacent entries
+        for (const _write &w : writes)
+            locations[todo[w.i]] = (uint32_t)(w.sector << 8 | w.count);
+        for (size_t ci = 0; ci < REGION_CHUNKS; ++ci)
+        {
+            _change &c = changes[ci];
+            if (c.state == _REMOVE && locations[ci])
+            {
+                frees.emplace_back(sectorOffset(ci),sectorCount(ci));
+                locations[ci] = 0;
+            }
+            if (c.timestamp)
+                timestamps[ci] = c.ts;
+        }
+        for (int ts = 0; ts < 2; ++ts)
+            for (size_t a = 0; a < REGION_CHUNKS;)
+            {
+                const _change &c = changes[a];
+                if (ts ? !c.timestamp : c.state == _CLEAN)
+                {
+                    ++a;
+                    continue;
+                }
+                size_t b = a+1;
+                while (b < REGION_CHUNKS && (ts ? changes[b].timestamp
+                        : changes[b].state != _CLEAN))
+                    ++b;
+                _write_entries(a,b,ts);
+                a = b;
+            }
+        for (auto &f : frees)
+            _mark(f.first,f.second,false);
+        for (_change &c : changes)
+            c = _change();
+        return todo.size();
+    }
+    // write file data to disk
+    void sync()
+    {
+        if (fdatasync(fd))
+            throw "region file sync failed";
+    }
+    // repack the flushed chunks into the fewest sectors, returns the bytes
+    // the file shrank by
+    size_t compact()
+    {
+        if (dirty())
+            throw "region compact with changes not flushed";
+        size_t before = size();
+        bytes_t out(2*REGION_SECTOR,0);
+        bytes_t buf;
+        for (size_t ci = 0; ci < REGION_CHUNKS; ++ci)
+        {
+            if (!locations[ci])
+                continue;
+            size_t avail = sectorCount(ci)*REGION_SECTOR;
+            buf.resize(avail);
+            if (pread(fd,buf.data(),avail,sectorOffset(ci)*REGION_SECTOR)
+                    != (ssize_t)avail)
+                throw "region file cannot read chunk";
+            RegionChunkData d = _region_chunk(buf.data(),avail);
+            size_t bytes = 5 + d.size;
+            size_t n = (bytes + REGION_SECTOR-1) / REGION_SECTOR;
+            size_t off = out.size() / REGION_SECTOR;
+            if (off >= (1 << 24))
+                throw "region chunk offset too large";
+            _to_bytes(out.data() + 4*ci,(int32_t)(off << 8 | n));
+            _to_bytes(out.data() + REGION_SECTOR + 4*ci,timestamps[ci]);
+            out.insert(out.end(),buf.data(),buf.data()+bytes);
+            out.resize((off+n)*REGION_SECTOR,0);
+        }
+        std::string tmp = path + ".tmp";
+        int t = open(tmp.c_str(),O_WRONLY | O_CREAT | O_TRUNC,0644);
+        if (t < 0)
+            throw "region file cannot open temporary file";
+        try
+        {
+            _pwrite_all(t,out.data(),out.size(),0);
+            if (fsync(t))
+                throw "region file sync failed";
+        }
+        catch (...)
+        {
+            close(t);
+            unlink(tmp.c_str());
+            throw;
+        }
+        close(t);
+        if (rename(tmp.c_str(),path.c_str()))
+        {
+            unlink(tmp.c_str());
+            throw "region file cannot replace file";
+        }
+        int nfd = open(path.c_str(),O_RDWR);
+        if (nfd < 0)
+            throw "region file cannot open file";
+        close(fd);
+        fd = nfd;
+        _load();
+        return before - size();
+    }
+};
+
+}
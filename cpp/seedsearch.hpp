@@ -0,0 +1,281 @@
+/*
+Parallel brute force search over a range of seeds
+
+SeedSearch tests every seed in [first,last] (inclusive so the full 2^64 space
+can be expressed) with a predicate bool(uint64_t seed). Each worker thread gets
+its own copy of the predicate so it can keep scratch state. The range is split
+recursively on a work stealing pool down to units of unitSize() seeds, hits go
+through a lock free queue and are reported on the thread that called run().
+
+With a checkpoint file set, the completed ranges are saved periodically (write
+to a temporary file then rename) and a later run with the same range resumes
+from them. A checkpoint of a different range or one that cannot be parsed
+makes run() throw instead of being overwritten. Hits are handed to the
+callback before the checkpoint covering them is written, so after a restart a
+hit may be reported again but never lost.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include "mpsc_queue.hpp"
+#include "thread_pool.hpp"
+
+namespace mclib
+{
+
+template <typename Pred>
+class SeedSearch
+{
+public:
+    // called with (seeds done, seeds total, seconds) while running, the total
+    // is 0 for the full 2^64 space
+    typedef std::function<void(uint64_t,uint64_t,double)> progress_t;
+private:
+    uint64_t first, last;
+    uint64_t unit;
+    std::vector<Pred> preds;
+    MpscQueue<uint64_t> hits;
+    // completed ranges first -> last, merged when adjacent
+    std::map<uint64_t,uint64_t> done;
+    uint64_t done_count;
+    std::mutex done_lock;
+    std::atomic<bool> stopped;
+    std::atomic<uint64_t> seeds_run;
+    std::string ckpt_path;
+    double ckpt_secs;
+    double poll_secs;
+    progress_t progress;
+    // last member so it is destroyed (joined) first
+    ThreadPool pool;
+    // record [a,b] as completed
+    void _done(uint64_t a, uint64_t b)
+    {
+        std::lock_guard<std::mutex> g(done_lock);
+        done_count += b - a + 1;
+        auto next = done.lower_bound(a);
+        if (next != done.end() && b != UINT64_MAX && next->first == b+1)
+        {
+            b = next->second;
+            next = done.erase(next);
+        }
+        if (next != done.begin())
+        {
+            auto prev = std::prev(next);
+            if (prev->second != UINT64_MAX && prev->second+1 == a)
+            {
+                prev->second = b;
+                return;
+            }
+        }
+        done[a] = b;
+    }
+    // test [a,b], splitting off the upper half as a new task while it is
+    // larger than one unit so idle workers can steal it
+    void _task(uint64_t a, uint64_t b)
+    {
+        while (b - a >= unit && !stopped)
+        {
+            uint64_t mid = a + (b - a) / 2;
+            pool.submit([this,mid,b]{ _task(mid+1,b); });
+            b = mid;
+        }
+        if (stopped)
+            return;
+        Pred &pred = preds[pool.workerIndex()];
+        uint64_t s = a;
+        for (;;)
+        {
+            if (pred(s))
+                hits.push(s);
+            if (s == b)
+                break;
+            ++s;
+        }
+        seeds_run += b - a + 1;
+        _done(a,b);
+    }
+    // whether [a,b] shares a seed with a range already done
+    bool _overlaps(uint64_t a, uint64_t b)
+    {
+        std::lock_guard<std::mutex> g(done_lock);
+        auto next = done.upper_bound(b);
+        return next != done.begin() && std::prev(next)->second >= a;
+    }
+    // resume from the checkpoint if there is one, a checkpoint of another
+    // range or one that cannot be read throws (instead of being overwritten)
+    bool _load()
+    {
+        FILE *f = fopen(ckpt_path.c_str(),"r");
+        if (!f)
+            return false;
+        char line[128];
+        unsigned long long a, b;
+        int n = 0;
+        const char *error = nullptr;
+        if (!fgets(line,sizeof(line),f)
+                || sscanf(line,"seedsearch range %llu %llu\n%n",&a,&b,&n) != 2
+                || line[n] != '\0')
+            error = "seedsearch checkpoint is broken";
+        else if (a != first || b != last)
+            error = "seedsearch checkpoint is for another range";
+        while (!error && fgets(line,sizeof(line),f))
+        {
+            n = 0;
+            if (sscanf(line,"done %llu %llu\n%n",&a,&b,&n) != 2
+                    || line[n] != '\0' || a > b || a < first || b > last
+                    || _overlaps(a,b))
+                error = "seedsearch checkpoint is broken";
+            else
+                _done(a,b);
+        }
+        fclose(f);
+        if (error)
+            throw error;
+        return true;
+    }
+    std::map<uint64_t,uint64_t> _snapshot()
+    {
+        std::lock_guard<std::mutex> g(done_lock);
+        return done;
+    }
+    void _save(const std::map<uint64_t,uint64_t> &snap)
+    {
+        std::string tmp = ckpt_path + ".tmp";
+        FILE *f = fopen(tmp.c_str(),"w");
+        if (!f)
+            throw "seedsearch cannot write checkpoint";
+        fprintf(f,"seedsearch range %llu %llu\n",(unsigned long long)first,
+                (unsigned long long)last);
+        for (auto &r : snap)
+            fprintf(f,"done %llu %llu\n",(unsigned long long)r.first,
+                    (unsigned long long)r.second);
+        fflush(f);
+        fsync(fileno(f));
+        fclose(f);
+        if (rename(tmp.c_str(),ckpt_path.c_str()))
+            throw "seedsearch cannot replace checkpoint";
+    }
+public:
+    // threads = 0 uses the hardware concurrency
+    SeedSearch(uint64_t first, uint64_t last, const Pred &pred,
+            size_t threads = 0):
+            first(first), last(last), unit(1 << 16), done_count(0),
+            stopped(false), seeds_run(0), ckpt_secs(60), poll_secs(0.1),
+            pool(threads)
+    {
+        if (last < first)
+            throw "seedsearch range is empty";
+        preds.assign(pool.size(),pred);
+    }
+    // seeds tested in one piece (default 2^16)
+    uint64_t unitSize() const { return unit; }
+    void setUnitSize(uint64_t u) { unit = u ? u : 1; }
+    // save progress to path every secs seconds (and when run() returns)
+    void setCheckpoint(const std::string &path, double secs = 60)
+    {
+        ckpt_path = path;
+        ckpt_secs = secs;
+    }
+    void setProgress(progress_t p, double secs = 1)
+    {
+        progress = p;
+        poll_secs = secs;
+    }
+    size_t threads() const { return pool.size(); }
+    // seeds tested by this process (excludes resumed ranges)
+    uint64_t seedsRun() const { return seeds_run; }
+    // seeds done including resumed ranges (wraps to 0 for all 2^64 seeds)
+    uint64_t seedsDone()
+    {
+        std::lock_guard<std::mutex> g(done_lock);
+        return done_count;
+    }
+    // ask the workers to stop after their current unit, safe from callbacks
+    void stop() { stopped = true; }
+    // search the range (or what is left of it), calling on_hit(seed) on this
+    // thread for every seed that satisfies the predicate
+    template <typename F>
+    void run(F on_hit)
+    {
+        if (!ckpt_path.empty())
+            _load();
+        // schedule the gaps between completed ranges
+        {
+            std::lock_guard<std::mutex> g(done_lock);
+            uint64_t a = first;
+            bool more = true;
+            for (auto &r : done)
+            {
+                if (r.first > a)
+                {
+                    uint64_t b = r.first - 1;
+                    pool.submit([this,a,b]{ _task(a,b); });
+                }
+                if (r.second == last)
+                {
+                    more = false;
+                    break;
+                }
+                a = r.second + 1;
+            }
+            if (more)
+                pool.submit([this,a]{ _task(a,last); });
+        }
+        auto start = std::chrono::steady_clock::now();
+        auto last_save = start;
+        std::vector<uint64_t> found;
+        bool idle = false;
+        try
+        {
+            while (!idle)
+            {
+                idle = pool.waitFor(std::chrono::duration<double>(poll_secs));
+                auto now = std::chrono::steady_clock::now();
+                bool save = !ckpt_path.empty() && (idle ||
+                        std::chrono::duration<double>(now - last_save).count()
+                        >= ckpt_secs);
+                // units push their hits before they are marked done, so
+                // draining after the snapshot delivers every hit it covers
+                std::map<uint64_t,uint64_t> snap;
+                if (save)
+                    snap = _snapshot();
+                found.clear();
+                hits.drain(found);
+                for (uint64_t s : found)
+                    on_hit(s);
+                double secs = std::chrono::duration<double>(now-start).count();
+                if (progress)
+                    progress(seedsDone(),last-first+1,secs);
+                if (save)
+                {
+                    _save(snap);
+                    last_save = now;
+                }
+            }
+        }
+        catch (...)
+        {
+            stop();
+            try
+            {
+                pool.wait();
+            }
+            catch (...) {}
+            throw;
+        }
+    }
+};
+
+}
@@ -0,0 +1,52 @@
+/*
+Benchmark for SeedSearch
+
+seedsearch_bench [seeds] [max_threads]
+
+Runs a typical java.util.Random predicate (a few bounded draws per seed) over
+the given number of seeds with 1, 2, 4, ... max_threads threads and prints one
+line per run with seeds/s and seeds/s per core.
+*/
+
+#include <cstdio>
+#include <string>
+#include <thread>
+
+#include "jrand.hpp"
+#include "seedsearch.hpp"
+
+// roughly the work of checking one structure or feature condition
+struct BenchPred
+{
+    mclib::Random r;
+    bool operator()(uint64_t seed)
+    {
+        r.setSeed((int64_t)seed);
+        return r.nextInt(24) == 0 && r.nextInt(24) == 0 && r.nextInt(10) == 0;
+    }
+};
+
+int main(int argc, char **argv)
+{
+    uint64_t seeds = argc > 1 ? std::stoull(argv[1]) : (1uLL << 28);
+    size_t max_threads = argc > 2 ? std::stoul(argv[2])
+            : std::thread::hardware_concurrency();
+    if (max_threads == 0)
+        max_threads = 1;
+    for (size_t t = 1;; t *= 2)
+    {
+        if (t > max_threads)
+            t = max_threads;
+        mclib::SeedSearch<BenchPred> search(0,seeds-1,BenchPred(),t);
+        uint64_t hits = 0;
+        size_t t0 = mclib::_nanotime();
+        search.run([&](uint64_t){ ++hits; });
+        double secs = (mclib::_nanotime() - t0) / 1e9;
+        printf("threads=%zu seeds=%llu hits=%llu secs=%.3f seeds_per_s=%.4e "
+                "seeds_per_s_per_core=%.4e\n",t,(unsigned long long)seeds,
+                (unsigned long long)hits,secs,seeds/secs,seeds/secs/t);
+        if (t == max_threads)
+            break;
+    }
+    return 0;
+}
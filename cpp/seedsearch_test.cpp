@@ -0,0 +1,200 @@
+#include <atomic>
+#include <cassert>
+#include <cstdio>
+#include <iostream>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "seedsearch.hpp"
+#include "thread_pool.hpp"
+
+using namespace mclib;
+
+static const char *CKPT = "/tmp/seedsearch_test.ckpt";
+
+// hits every 1000th seed (counted from first) and marks the seeds it tests,
+// with search set it stops *search once limit seeds were tested
+struct Pred
+{
+    uint64_t first;
+    std::vector<std::atomic<uint8_t>> *tested;
+    SeedSearch<Pred> **search = nullptr;
+    std::atomic<uint64_t> *count = nullptr;
+    uint64_t limit = 0;
+    bool operator()(uint64_t seed)
+    {
+        (*tested)[seed - first] = 1;
+        if (search && ++*count == limit)
+            (*search)->stop();
+        return (seed - first) % 1000 == 7;
+    }
+};
+
+static std::string read_file(const char *path)
+{
+    std::string ret;
+    FILE *f = fopen(path,"r");
+    if (!f)
+        return ret;
+    char buf[4096];
+    size_t n;
+    while ((n = fread(buf,1,sizeof(buf),f)))
+        ret.append(buf,n);
+    fclose(f);
+    return ret;
+}
+
+static void write_file(const char *path, const std::string &s)
+{
+    FILE *f = fopen(path,"w");
+    fwrite(s.data(),1,s.size(),f);
+    fclose(f);
+}
+
+static std::string header(uint64_t a, uint64_t b)
+{
+    return "seedsearch range " + std::to_string(a) + " " + std::to_string(b)
+            + "\n";
+}
+
+static std::string done_line(uint64_t a, uint64_t b)
+{
+    return "done " + std::to_string(a) + " " + std::to_string(b) + "\n";
+}
+
+// run() of a search with the checkpoint, the error thrown or nullptr
+static const char *run_error(uint64_t first, uint64_t last)
+{
+    std::vector<std::atomic<uint8_t>> tested(last - first + 1);
+    SeedSearch<Pred> s(first,last,Pred{first,&tested},2);
+    s.setCheckpoint(CKPT,0);
+    try { s.run([](uint64_t) {}); }
+    catch (const char *e) { return e; }
+    return nullptr;
+}
+
+int main(int argc, char **argv)
+{
+    (void)argc;
+    (void)argv;
+    remove(CKPT);
+    // stop part way then resume from the checkpoint
+    {
+        const uint64_t first = 5000, last = first + (1 << 20) - 1;
+        const uint64_t n = last - first + 1;
+        std::vector<std::atomic<uint8_t>> tested(n);
+        std::set<uint64_t> hits;
+        uint64_t run1;
+        {
+            // stopped by the predicate, so it does not depend on how soon
+            // the hits reach this thread
+            SeedSearch<Pred> *search = nullptr;
+            std::atomic<uint64_t> count(0);
+            SeedSearch<Pred> s(first,last,
+                    Pred{first,&tested,&search,&count,n/4},3);
+            search = &s;
+            s.setUnitSize(1024);
+            s.setCheckpoint(CKPT,0);
+            s.run([&](uint64_t seed) { hits.insert(seed); });
+            run1 = s.seedsRun();
+            assert(run1 >= n/4 && run1 <= n/4 + 3*1024);
+            assert(s.seedsDone() == run1);
+        }
+        std::string ckpt = read_file(CKPT);
+        std::string h = header(first,last);
+        assert(ckpt.compare(0,h.size(),h) == 0);
+        assert(ckpt.find("\ndone ") != std::string::npos);
+        {
+            SeedSearch<Pred> s(first,last,Pred{first,&tested},3);
+            s.setUnitSize(1024);
+            s.setCheckpoint(CKPT,0);
+            s.run([&](uint64_t seed) { hits.insert(seed); });
+            assert(s.seedsDone() == n);
+            // only what the first run did not finish is tested again
+            assert(s.seedsRun() <= n - run1 + 3*1024 && s.seedsRun() < n);
+        }
+        for (uint64_t i = 0; i < n; ++i)
+            assert(tested[i]);
+        assert(hits.size() == (n + 992) / 1000);
+        for (uint64_t h : hits)
+            assert(h >= first && h <= last && (h - first) % 1000 == 7);
+        // everything merged into one range
+        assert(read_file(CKPT) == header(first,last) + done_line(first,last));
+        // a finished search resumes to nothing
+        std::vector<std::atomic<uint8_t>> again(n);
+        SeedSearch<Pred> s(first,last,Pred{first,&again},2);
+        s.setCheckpoint(CKPT,0);
+        s.run([](uint64_t) { assert(0); });
+        assert(s.seedsRun() == 0 && s.seedsDone() == n);
+        remove(CKPT);
+    }
+    // ranges ending at UINT64_MAX merge, also with the resumed ones
+    {
+        const uint64_t first = UINT64_MAX - 99999, last = UINT64_MAX;
+        write_file(CKPT,header(first,last) + done_line(last-999,last)
+                + done_line(first,first+999) + done_line(first+2000,
+                first+2999));
+        std::vector<std::atomic<uint8_t>> tested(100000);
+        SeedSearch<Pred> s(first,last,Pred{first,&tested},2);
+        s.setUnitSize(1000);
+        s.setCheckpoint(CKPT,0);
+        size_t hits = 0;
+        s.run([&](uint64_t) { ++hits; });
+        assert(s.seedsDone() == 100000 && s.seedsRun() == 100000 - 3000);
+        assert(hits == 97 && !tested[0] && tested[1000] && !tested[99999]);
+        assert(read_file(CKPT) == header(first,last) + done_line(first,last));
+        remove(CKPT);
+    }
+    // the full 2^64 range is expressible (done count wraps to 0)
+    {
+        SeedSearch<Pred> s(0,UINT64_MAX,Pred{0,nullptr},1);
+        assert(s.seedsDone() == 0 && s.seedsRun() == 0);
+    }
+    // checkpoints of another range or broken ones are not overwritten
+    {
+        std::string other = header(0,999) + done_line(0,99);
+        write_file(CKPT,other);
+        assert(std::string(run_error(0,1999)) ==
+                "seedsearch checkpoint is for another range");
+        assert(read_file(CKPT) == other);
+        for (std::string bad : {header(0,999) + "done 5\n",
+                header(0,999) + "done 0 99 x\n",
+                header(0,999) + "done 10 5\n",
+                header(0,999) + "done 0 1000\n",
+                header(0,999) + done_line(0,99) + done_line(0,49),
+                header(0,999) + done_line(50,99) + done_line(0,50),
+                std::string("seedsearch 0 999\n"),
+                std::string()})
+        {
+            write_file(CKPT,bad);
+            assert(std::string(run_error(0,999)) ==
+                    "seedsearch checkpoint is broken");
+            assert(read_file(CKPT) == bad);
+        }
+        remove(CKPT);
+        assert(run_error(0,999) == nullptr);
+        remove(CKPT);
+    }
+    // the pool rethrows the first task exception once from wait()
+    {
+        ThreadPool pool(3);
+        std::atomic<int> ran(0);
+        for (int i = 0; i < 100; ++i)
+            pool.submit([&ran,i]
+            {
+                ++ran;
+                if (i == 50)
+                    throw "task failed";
+            });
+        bool threw = false;
+        try { pool.wait(); }
+        catch (const char *e) { threw = std::string(e) == "task failed"; }
+        assert(threw && ran == 100);
+        pool.submit([&ran] { ++ran; });
+        pool.wait();
+        assert(ran == 101);
+    }
+    std::cout << "seedsearch tests passed" << std::endl;
+    return 0;
+}
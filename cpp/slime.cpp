@@ -0,0 +1,173 @@
+/*
+Slime chunk tool
+
+slime render <seed> <x0> <z0> <width> <height> <output> [threads]
+    writes the slime chunks of [x0,x0+width) x [z0,z0+height) to output, as a
+    PGM image (255 = slime) if the name ends with .pgm, otherwise as a packed
+    bitset (rows of ceil(width/8) bytes, bit i of a byte is column 8k+i)
+
+slime search <seed_lo> <seed_hi> <n> <m> <x0> <z0> <width> <height> [threads]
+    prints "seed x z" for each seed in [seed_lo,seed_hi) that has an n by m
+    block of slime chunks (corner at chunk x,z) inside the area
+
+threads defaults to (and 0 means) the hardware concurrency. Throughput
+(chunks/s, seeds/s) is printed to stderr.
+*/
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "slime.hpp"
+
+// threads argument, missing or 0 uses the hardware concurrency
+static size_t threads_arg(int argc, char **argv, int i)
+{
+    size_t n = argc > i ? std::stoul(argv[i]) : 0;
+    if (n == 0)
+        n = std::thread::hardware_concurrency();
+    return n ? n : 1;
+}
+
+static int render(int argc, char **argv)
+{
+    if (argc < 8)
+        return 1;
+    int64_t seed = std::stoll(argv[2]);
+    int32_t x0 = std::stoi(argv[3]);
+    int32_t z0 = std::stoi(argv[4]);
+    size_t w = std::stoul(argv[5]);
+    size_t h = std::stoul(argv[6]);
+    std::string outf = argv[7];
+    size_t threads = threads_arg(argc,argv,8);
+    bool pgm = outf.size() >= 4 && outf.substr(outf.size()-4) == ".pgm";
+    size_t stride = pgm ? w : (w+7)/8;
+    std::vector<uint8_t> image(stride*h);
+    std::vector<int64_t> xoff(w);
+    for (size_t i = 0; i < w; ++i)
+        xoff[i] = mclib::_slime_x(x0+(int32_t)i);
+    size_t t0 = mclib::_nanotime();
+    // rows are handed out dynamically in small groups
+    std::atomic<size_t> next_row(0);
+    auto work = [&]()
+    {
+        std::vector<uint8_t> row(w);
+        const size_t group = 16;
+        size_t r;
+        while ((r = next_row.fetch_add(group)) < h)
+            for (size_t z = r; z < r+group && z < h; ++z)
+            {
+                mclib::slimeRow(seed,xoff.data(),z0+(int32_t)z,w,row.data());
+                uint8_t *out = image.data() + z*stride;
+                if (pgm)
+                    for (size_t i = 0; i < w; ++i)
+                        out[i] = row[i] ? 255 : 0;
+                else
+                    for (size_t i = 0; i < w; ++i)
+                        out[i/8] |= row[i] << (i%8);
+            }
+    };
+    std::vector<std::thread> pool;
+    for (size_t i = 0; i < threads; ++i)
+        pool.emplace_back(work);
+    for (auto &t : pool)
+        t.join();
+    double secs = (mclib::_nanotime() - t0) / 1e9;
+    FILE *f = fopen(outf.c_str(),"wb");
+    if (!f)
+    {
+        perror(outf.c_str());
+        return 2;
+    }
+    if (pgm)
+        fprintf(f,"P5\n%zu %zu\n255\n",w,h);
+    fwrite(image.data(),1,image.size(),f);
+    fclose(f);
+    fprintf(stderr,"%zu chunks in %.3f s, %.3e chunks/s, %zu threads\n",
+            w*h,secs,w*h/secs,threads);
+    return 0;
+}
+
+static int search(int argc, char **argv)
+{
+    if (argc < 10)
+        return 1;
+    int64_t lo = std::stoll(argv[2]);
+    int64_t hi = std::stoll(argv[3]);
+    int32_t n = std::stoi(argv[4]);
+    int32_t m = std::stoi(argv[5]);
+    int32_t x0 = std::stoi(argv[6]);
+    int32_t z0 = std::stoi(argv[7]);
+    int32_t w = std::stoi(argv[8]);
+    int32_t h = std::stoi(argv[9]);
+    size_t threads = threads_arg(argc,argv,10);
+    if (hi <= lo)
+        return 1;
+    const uint64_t block = 1024;
+    uint64_t total = (uint64_t)hi - (uint64_t)lo;
+    std::atomic<uint64_t> next(0), seeds(0), chunks(0);
+    std::mutex out_lock;
+    size_t t0 = mclib::_nanotime();
+    auto work = [&]()
+    {
+        mclib::SlimeBlockSearch s(x0,z0,w,h,n,m);
+        mclib::SlimeHit hit;
+        uint64_t b;
+        while ((b = next.fetch_add(block)) < total)
+        {
+            uint64_t e = b+block < total ? b+block : total;
+            for (uint64_t i = b; i < e; ++i)
+                if (s.test((int64_t)((uint64_t)lo + i),hit))
+                {
+                    std::lock_guard<std::mutex> g(out_lock);
+                    printf("%lld %d %d\n",(long long)hit.seed,hit.x,hit.z);
+                    fflush(stdout);
+                }
+            seeds += e-b;
+        }
+        chunks += s.chunks();
+    };
+    std::vector<std::thread> pool;
+    for (size_t i = 0; i < threads; ++i)
+        pool.emplace_back(work);
+    for (auto &t : pool)
+        t.join();
+    double secs = (mclib::_nanotime() - t0) / 1e9;
+    fprintf(stderr,"%llu seeds, %llu chunks in %.3f s, %.3e seeds/s, "
+            "%.3e chunks/s, %zu threads\n",(unsigned long long)seeds.load(),
+            (unsigned long long)chunks.load(),secs,seeds/secs,chunks/secs,
+            threads);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    int ret = 1;
+    try
+    {
+        if (argc > 1 && !strcmp(argv[1],"render"))
+            ret = render(argc,argv);
+        else if (argc > 1 && !strcmp(argv[1],"search"))
+            ret = search(argc,argv);
+    }
+    // bad numbers from the argument parsing show the usage
+    catch (const std::invalid_argument&) {}
+    catch (const std::out_of_range&) {}
+    catch (const char *e)
+    {
+        std::cerr << "error: " << e << std::endl;
+        return 2;
+    }
+    if (ret == 1)
+        std::cerr << "usage: slime render <seed> <x0> <z0> <width> <height> "
+                "<output> [threads]\n       slime search <seed_lo> <seed_hi> "
+                "<n> <m> <x0> <z0> <width> <height> [threads]" << std::endl;
+    return ret;
+}
@@ -0,0 +1,182 @@
+/*
+Slime chunk predicate as in Minecraft (java edition). A chunk is a slime chunk
+when a java.util.Random seeded with a mix of the world seed and the chunk
+coordinates returns 0 from nextInt(10). Only the lower 48 bits of the world seed
+matter since Random drops the rest.
+
+The batch functions evaluate 16 chunks at a time with RandomLanes.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "jrand.hpp"
+
+namespace mclib
+{
+
+const int64_t _slime_xor = 0x3ad8025fLL;
+
+// seed offset from chunk x coordinate, java int arithmetic wraps
+static inline int64_t _slime_x(int32_t x)
+{
+    int32_t a = (int32_t)((uint32_t)x*(uint32_t)x*0x4c1906u);
+    int32_t b = (int32_t)((uint32_t)x*0x5ac0dbu);
+    return (int64_t)((uint64_t)(int64_t)a + (uint64_t)(int64_t)b);
+}
+
+// seed offset from chunk z coordinate, z*z is an int but the constant is long
+static inline int64_t _slime_z(int32_t z)
+{
+    int32_t a = (int32_t)((uint32_t)z*(uint32_t)z);
+    int32_t b = (int32_t)((uint32_t)z*0x5f24fu);
+    return (int64_t)((uint64_t)(int64_t)a*0x4307a7uLL + (uint64_t)(int64_t)b);
+}
+
+// java.util.Random seed used for the slime chunk check
+static inline int64_t slimeSeed(int64_t seed, int32_t x, int32_t z)
+{
+    return (int64_t)((uint64_t)seed + (uint64_t)_slime_x(x)
+            + (uint64_t)_slime_z(z)) ^ _slime_xor;
+}
+
+static inline bool isSlimeChunk(int64_t seed, int32_t x, int32_t z)
+{
+    Random r(slimeSeed(seed,x,z));
+    return r.nextInt(10) == 0;
+}
+
+// out[i] = 1 if the chunk with seed offset off[i] + add (sums of _slime_x and
+// _slime_z) is a slime chunk, 0 otherwise
+static inline void _slimeBatch(int64_t seed, const int64_t *off, int64_t add,
+        size_t count, uint8_t *out)
+{
+    const size_t N = 16;
+    int64_t seeds[N];
+    int32_t vals[N];
+    uint64_t base = (uint64_t)seed + (uint64_t)add;
+    for (size_t i = 0; i < count; i += N)
+    {
+        size_t n = count - i < N ? count - i : N;
+        for (size_t j = 0; j < N; ++j)
+            seeds[j] = (int64_t)(base + (uint64_t)off[i + (j < n ? j : 0)])
+                    ^ _slime_xor;
+        RandomLanes<N> lanes(seeds);
+        lanes.nextInt(vals,10);
+        for (size_t j = 0; j < n; ++j)
+            out[i+j] = vals[j] == 0;
+    }
+}
+
+// slime chunks in row z starting at column x0, xoff[i] = _slime_x(x0+i)
+static inline void slimeRow(int64_t seed, const int64_t *xoff, int32_t z,
+        size_t count, uint8_t *out)
+{
+    _slimeBatch(seed,xoff,_slime_z(z),count,out);
+}
+
+// block of n (along x) by m (along z) slime chunks with corner (x,z)
+struct SlimeHit
+{
+    int64_t seed;
+    int32_t x, z;
+};
+
+// searches world seeds for an n by m block of slime chunks inside the area
+// [x0,x0+w) x [z0,z0+h), one object per thread since it caches evaluations
+//
+// early rejection: any n wide window of columns contains exactly one column
+// x0+n-1+k*n (likewise for rows), so only that sparse lattice is evaluated up
+// front and windows are expanded only around lattice points that are slime
+class SlimeBlockSearch
+{
+private:
+    int32_t x0, z0, w, h, n, m;
+    std::vector<int64_t> lat_off;
+    std::vector<int32_t> lat_x, lat_z;
+    std::vector<uint8_t> lat_val;
+    // per chunk cache of the current seed, valid when stamp matches
+    std::vector<uint32_t> stamp;
+    std::vector<uint8_t> val;
+    uint32_t cur;
+    uint64_t evals;
+    bool _slime(int64_t seed, int32_t x, int32_t z)
+    {
+        size_t i = (size_t)(z-z0)*w + (x-x0);
+        if (stamp[i] != cur)
+        {
+            stamp[i] = cur;
+            val[i] = isSlimeChunk(seed,x,z);
+            ++evals;
+        }
+        return val[i];
+    }
+    bool _block(int64_t seed, int32_t x, int32_t z)
+    {
+        for (int32_t dz = 0; dz < m; ++dz)
+            for (int32_t dx = 0; dx < n; ++dx)
+                if (!_slime(seed,x+dx,z+dz))
+                    return false;
+        return true;
+    }
+public:
+    SlimeBlockSearch(int32_t x0, int32_t z0, int32_t w, int32_t h,
+            int32_t n, int32_t m):
+            x0(x0), z0(z0), w(w), h(h), n(n), m(m), cur(0), evals(0)
+    {
+        if (n <= 0 || m <= 0 || n > w || m > h)
+            throw "slime block must be nonempty and fit in the area";
+        for (int32_t z = z0+m-1; z < z0+h; z += m)
+            for (int32_t x = x0+n-1; x < x0+w; x += n)
+            {
+                lat_x.push_back(x);
+                lat_z.push_back(z);
+                lat_off.push_back((int64_t)((uint64_t)_slime_x(x)
+                        + (uint64_t)_slime_z(z)));
+            }
+        lat_val.resize(lat_off.size());
+        stamp.assign((size_t)w*h,0);
+        val.resize((size_t)w*h);
+    }
+    // chunk evaluations done so far
+    uint64_t chunks() const { return evals; }
+    // find a block for this seed, returns false if there is none
+    bool test(int64_t seed, SlimeHit &hit)
+    {
+        if (++cur == 0) // stamp wrapped around, invalidate everything
+        {
+            stamp.assign(stamp.size(),0);
+            cur = 1;
+        }
+        _slimeBatch(seed,lat_off.data(),0,lat_off.size(),lat_val.data());
+        evals += lat_off.size();
+        for (size_t i = 0; i < lat_val.size(); ++i)
+        {
+            size_t c = (size_t)(lat_z[i]-z0)*w + (lat_x[i]-x0);
+            stamp[c] = cur;
+            val[c] = lat_val[i];
+        }
+        for (size_t i = 0; i < lat_val.size(); ++i)
+        {
+            if (!lat_val[i])
+                continue;
+            int32_t lx = lat_x[i], lz = lat_z[i];
+            int32_t xlo = lx-n+1 > x0 ? lx-n+1 : x0;
+            int32_t xhi = lx < x0+w-n ? lx : x0+w-n;
+            int32_t zlo = lz-m+1 > z0 ? lz-m+1 : z0;
+            int32_t zhi = lz < z0+h-m ? lz : z0+h-m;
+            for (int32_t z = zlo; z <= zhi; ++z)
+                for (int32_t x = xlo; x <= xhi; ++x)
+                    if (_block(seed,x,z))
+                    {
+                        hit = { seed, x, z };
+                        return true;
+                    }
+        }
+        return false;
+    }
+};
+
+}
@@ -0,0 +1,129 @@
+#include <cassert>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "slime.hpp"
+
+// first rows (z = 0, 1, ...) of x in [0,32) from
+// python3 _slime_test1/slime_test.py <seed>
+static const char *PY_12345[] = {
+    "00010000110000000100100000000000",
+    "00001000000010000100001000000000",
+    "00000000001000010001000010000000",
+    "00000000000000000000001001000010"
+};
+static const char *PY_NEG[] = {
+    "01010000001000000000000000010100",
+    "01000000000000001010110010000000"
+};
+
+static void test_known()
+{
+    for (int32_t z = 0; z < 4; ++z)
+        for (int32_t x = 0; x < 32; ++x)
+            assert(mclib::isSlimeChunk(12345,x,z) == (PY_12345[z][x] == '1'));
+    for (int32_t z = 0; z < 2; ++z)
+        for (int32_t x = 0; x < 32; ++x)
+            assert(mclib::isSlimeChunk(-4172144997902289642LL,x,z)
+                    == (PY_NEG[z][x] == '1'));
+    // negative and wrapping coordinates, same formula in python
+    const int32_t xs[] = {-1,-2,-100,-1875000,INT32_MAX,INT32_MIN,46341,-46341};
+    const int32_t zs[] = {-1,-77,-1875000,INT32_MAX,INT32_MIN,46341};
+    const char *want = "000000001000000000000000000000001000000000000000";
+    size_t k = 0;
+    for (int32_t x : xs)
+        for (int32_t z : zs)
+            assert(mclib::isSlimeChunk(12345,x,z) == (want[k++] == '1'));
+}
+
+static void test_rows()
+{
+    mclib::Random r(4);
+    for (int64_t seed : {(int64_t)0,(int64_t)12345,(int64_t)-1,r.nextLong(),
+            r.nextLong()})
+        for (int32_t x0 : {-40,0,INT32_MAX-20,INT32_MIN,-1875000})
+        {
+            // odd lengths for partial batches
+            const size_t w = 53;
+            std::vector<int64_t> xoff(w);
+            for (size_t i = 0; i < w; ++i)
+                xoff[i] = mclib::_slime_x((int32_t)((uint32_t)x0 + i));
+            std::vector<uint8_t> row(w);
+            for (int32_t z : {-3,0,7,INT32_MAX,INT32_MIN,46341})
+            {
+                mclib::slimeRow(seed,xoff.data(),z,w,row.data());
+                for (size_t i = 0; i < w; ++i)
+                    assert(row[i] == mclib::isSlimeChunk(seed,
+                            (int32_t)((uint32_t)x0 + i),z));
+            }
+            for (size_t n : {(size_t)1,(size_t)15,(size_t)16,(size_t)17})
+            {
+                mclib::_slimeBatch(seed,xoff.data(),mclib::_slime_z(-9),n,
+                        row.data());
+                for (size_t i = 0; i < n; ++i)
+                    assert(row[i] == mclib::isSlimeChunk(seed,
+                            (int32_t)((uint32_t)x0 + i),-9));
+            }
+        }
+}
+
+// n by m block of slime chunks with corner (x,z)
+static bool is_block(int64_t seed, int32_t x, int32_t z, int32_t n, int32_t m)
+{
+    for (int32_t dz = 0; dz < m; ++dz)
+        for (int32_t dx = 0; dx < n; ++dx)
+            if (!mclib::isSlimeChunk(seed,x+dx,z+dz))
+                return false;
+    return true;
+}
+
+static void test_block_search()
+{
+    const int32_t x0 = -10, z0 = -7, w = 20, h = 16;
+    struct { int32_t n, m; } sizes[] = {{2,2},{3,1},{1,3},{1,1}};
+    for (auto sz : sizes)
+    {
+        mclib::SlimeBlockSearch s(x0,z0,w,h,sz.n,sz.m);
+        size_t found = 0;
+        for (int64_t seed = 0; seed < 1500; ++seed)
+        {
+            // brute force over every corner
+            bool any = false;
+            for (int32_t z = z0; z + sz.m <= z0 + h && !any; ++z)
+                for (int32_t x = x0; x + sz.n <= x0 + w && !any; ++x)
+                    any = is_block(seed,x,z,sz.n,sz.m);
+            mclib::SlimeHit hit;
+            bool got = s.test(seed,hit);
+            assert(got == any);
+            if (got)
+            {
+                ++found;
+                assert(hit.seed == seed);
+                assert(hit.x >= x0 && hit.x + sz.n <= x0 + w);
+                assert(hit.z >= z0 && hit.z + sz.m <= z0 + h);
+                assert(is_block(seed,hit.x,hit.z,sz.n,sz.m));
+            }
+        }
+        assert(found > 0);
+        // the lattice skips most chunks for blocks larger than one chunk
+        if (sz.n*sz.m > 1)
+            assert(s.chunks() < (uint64_t)1500*w*h / 2);
+    }
+    bool threw = false;
+    try { mclib::SlimeBlockSearch(0,0,4,4,5,1); }
+    catch (const char*) { threw = true; }
+    assert(threw);
+}
+
+int main(int argc, char **argv)
+{
+    (void)argc;
+    (void)argv;
+    test_known();
+    test_rows();
+    test_block_search();
+    std::cout << "slime tests passed" << std::endl;
+    return 0;
+}
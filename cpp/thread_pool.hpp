@@ -0,0 +1,202 @@
+/*
+Work stealing thread pool
+
+Each worker has its own deque. Tasks submitted from a worker go to the back of
+its own deque and are popped from the back (newest first, good locality for
+recursively split work), idle workers steal from the front of other deques
+(oldest first, which for split work are the largest pieces). Tasks submitted
+from outside the pool are spread round robin.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace mclib
+{
+
+class ThreadPool
+{
+public:
+    typedef std::function<void()> task_t;
+private:
+    struct _queue
+    {
+        std::mutex lock;
+        std::deque<task_t> tasks;
+    };
+    std::vector<std::unique_ptr<_queue>> queues;
+    std::vector<std::thread> threads;
+    // tasks in deques, changed under idle_lock so sleepers cannot miss work
+    std::atomic<size_t> queued;
+    // tasks submitted and not finished yet
+    std::atomic<size_t> pending;
+    std::atomic<size_t> next_queue;
+    std::mutex idle_lock;
+    std::condition_variable idle_cv;
+    std::mutex done_lock;
+    std::condition_variable done_cv;
+    std::exception_ptr error;
+    bool stopping;
+    static ThreadPool *&_tls_pool()
+    {
+        static thread_local ThreadPool *pool = nullptr;
+        return pool;
+    }
+    static size_t &_tls_index()
+    {
+        static thread_local size_t index = 0;
+        return index;
+    }
+    bool _pop(size_t i, task_t &t)
+    {
+        std::lock_guard<std::mutex> g(queues[i]->lock);
+        if (queues[i]->tasks.empty())
+            return false;
+        t = std::move(queues[i]->tasks.back());
+        queues[i]->tasks.pop_back();
+        return true;
+    }
+    bool _steal(size_t i, task_t &t)
+    {
+        std::lock_guard<std::mutex> g(queues[i]->lock);
+        if (queues[i]->tasks.empty())
+            return false;
+        t = std::move(queues[i]->tasks.front());
+        queues[i]->tasks.pop_front();
+        return true;
+    }
+    bool _get(size_t self, task_t &t)
+    {
+        if (_pop(self,t))
+            return true;
+        for (size_t k = 1; k < queues.size(); ++k)
+            if (_steal((self+k) % queues.size(),t))
+                return true;
+        return false;
+    }
+    void _run(size_t self)
+    {
+        _tls_pool() = this;
+        _tls_index() = self;
+        task_t t;
+        for (;;)
+        {
+            if (_get(self,t))
+            {
+                --queued;
+                try
+                {
+                    t();
+                }
+                catch (...)
+                {
+                    std::lock_guard<std::mutex> g(done_lock);
+                    if (!error)
+                        error = std::current_exception();
+                }
+                t = nullptr;
+                if (--pending == 0)
+                {
+                    std::lock_guard<std::mutex> g(done_lock);
+                    done_cv.notify_all();
+                }
+                continue;
+            }
+            std::unique_lock<std::mutex> lk(idle_lock);
+            idle_cv.wait(lk,[this]{ return stopping || queued > 0; });
+            if (stopping && queued == 0)
+                return;
+        }
+    }
+public:
+    // threads = 0 uses the hardware concurrency
+    ThreadPool(size_t n = 0): queued(0), pending(0), next_queue(0),
+            stopping(false)
+    {
+        if (n == 0)
+            n = std::thread::hardware_concurrency();
+        if (n == 0)
+            n = 1;
+        for (size_t i = 0; i < n; ++i)
+            queues.emplace_back(new _queue());
+        for (size_t i = 0; i < n; ++i)
+            threads.emplace_back(&ThreadPool::_run,this,i);
+    }
+    // finishes queued tasks then joins the workers
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> g(idle_lock);
+            stopping = true;
+        }
+        idle_cv.notify_all();
+        for (auto &t : threads)
+            t.join();
+    }
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool &operator=(const ThreadPool&) = delete;
+    size_t size() const { return threads.size(); }
+    // index of the calling worker in [0,size()), or size() if the caller is
+    // not a worker of this pool
+    size_t workerIndex() const
+    {
+        return _tls_pool() == this ? _tls_index() : threads.size();
+    }
+    void submit(task_t t)
+    {
+        size_t i = workerIndex();
+        if (i == threads.size())
+            i = next_queue++ % queues.size();
+        ++pending;
+        {
+            std::lock_guard<std::mutex> g(queues[i]->lock);
+            queues[i]->tasks.push_back(std::move(t));
+        }
+        {
+            std::lock_guard<std::mutex> g(idle_lock);
+            ++queued;
+        }
+        idle_cv.notify_one();
+    }
+    // blocks until every submitted task (including ones submitted by tasks)
+    // has finished, rethrows the first exception thrown by a task
+    // must not be called from a worker
+    void wait()
+    {
+        std::unique_lock<std::mutex> lk(done_lock);
+        done_cv.wait(lk,[this]{ return pending == 0; });
+        if (error)
+        {
+            std::exception_ptr e = error;
+            error = nullptr;
+            std::rethrow_exception(e);
+        }
+    }
+    // like wait() but gives up after the timeout, returns true if idle
+    template <typename Rep, typename Period>
+    bool waitFor(const std::chrono::duration<Rep,Period> &timeout)
+    {
+        std::unique_lock<std::mutex> lk(done_lock);
+        if (!done_cv.wait_for(lk,timeout,[this]{ return pending == 0; }))
+            return false;
+        if (error)
+        {
+            std::exception_ptr e = error;
+            error = nullptr;
+            std::rethrow_exception(e);
+        }
+        return true;
+    }
+};
+
+}
@@ -1,16 +1,59 @@
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
+#include <cstring>
 
-#include "endian.hpp"
+#if defined(__SSSE3__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
 
-static_assert(TKOZ_LITTLE_ENDIAN);
+#include "endian.hpp"
 
 namespace mclib
 {
 
 // helper functions to read/write big endian data
-// TODO support big endian, currently only supports little endian systems
+// values go through memcpy (no type punning) and are byte swapped only on
+// little endian systems, the array functions convert many values at once with
+// SSSE3/AVX2 shuffles when enabled
+
+static inline uint16_t _bswap(uint16_t n) { return __builtin_bswap16(n); }
+static inline uint32_t _bswap(uint32_t n) { return __builtin_bswap32(n); }
+static inline uint64_t _bswap(uint64_t n) { return __builtin_bswap64(n); }
+
+// unsigned integer U between host order and big endian
+template <typename U>
+static inline U _big_endian(U n)
+{
+#if TKOZ_LITTLE_ENDIAN
+    return _bswap(n);
+#else
+    return n;
+#endif
+}
+
+// read a big endian value of type T (same size as U)
+template <typename T, typename U>
+static inline T _load_be(const char *p)
+{
+    U u;
+    memcpy(&u,p,sizeof(U));
+    u = _big_endian(u);
+    T ret;
+    memcpy(&ret,&u,sizeof(T));
+    return ret;
+}
+
+// write a value of type T (same size as U) as big endian
+template <typename T, typename U>
+static inline void _store_be(char *p, T n)
+{
+    U u;
+    memcpy(&u,&n,sizeof(U));
+    u = _big_endian(u);
+    memcpy(p,&u,sizeof(U));
+}
 
 // write 1 byte integer
 static inline void _to_bytes(char *p, int8_t n)
@@ -21,54 +64,31 @@ static inline void _to_bytes(char *p, int8_t n)
 // write 2 byte integer
 static inline void _to_bytes(char *p, int16_t n)
 {
-    p[0] = (char)(n >> 8);
-    p[1] = (char)(n >> 0);
+    _store_be<int16_t,uint16_t>(p,n);
 }
 
 // write 4 byte integer
 static inline void _to_bytes(char *p, int32_t n)
 {
-    p[0] = (char)(n >> 24);
-    p[1] = (char)(n >> 16);
-    p[2] = (char)(n >> 8);
-    p[3] = (char)(n >> 0);
+    _store_be<int32_t,uint32_t>(p,n);
 }
 
 // write 8 byte integer
 static inline void _to_bytes(char *p, int64_t n)
 {
-    p[0] = (char)(n >> 56);
-    p[1] = (char)(n >> 48);
-    p[2] = (char)(n >> 40);
-    p[3] = (char)(n >> 32);
-    p[4] = (char)(n >> 24);
-    p[5] = (char)(n >> 16);
-    p[6] = (char)(n >> 8);
-    p[7] = (char)(n >> 0);
+    _store_be<int64_t,uint64_t>(p,n);
 }
 
 // write single precision float
 static inline void _to_bytes(char *p, float n)
 {
-    char *q = (char*)(&n);
-    p[0] = q[3];
-    p[1] = q[2];
-    p[2] = q[1];
-    p[3] = q[0];
+    _store_be<float,uint32_t>(p,n);
 }
 
 // write double precision float
 static inline void _to_bytes(char *p, double n)
 {
-    char *q = (char*)(&n);
-    p[0] = q[7];
-    p[1] = q[6];
-    p[2] = q[5];
-    p[3] = q[4];
-    p[4] = q[3];
-    p[5] = q[2];
-    p[6] = q[1];
-    p[7] = q[0];
+    _store_be<double,uint64_t>(p,n);
 }
 
 // read 1 byte integer
@@ -80,62 +100,138 @@ static inline int8_t _from_bytes_byte(const char *p)
 // read 2 byte integer
 static inline int16_t _from_bytes_short(const char *p)
 {
-    char q[2];
-    q[0] = p[1];
-    q[1] = p[0];
-    return *((int16_t*)q);
+    return _load_be<int16_t,uint16_t>(p);
 }
 
 // read 4 byte integer
 static inline int32_t _from_bytes_int(const char *p)
 {
-    char q[4];
-    q[0] = p[3];
-    q[1] = p[2];
-    q[2] = p[1];
-    q[3] = p[0];
-    return *((int32_t*)q);
+    return _load_be<int32_t,uint32_t>(p);
 }
 
 // read 8 byte integer
 static inline int64_t _from_bytes_long(const char *p)
 {
-    char q[8];
-    q[0] = p[7];
-    q[1] = p[6];
-    q[2] = p[5];
-    q[3] = p[4];
-    q[4] = p[3];
-    q[5] = p[2];
-    q[6] = p[1];
-    q[7] = p[0];
-    return *((int64_t*)q);
+    return _load_be<int64_t,uint64_t>(p);
 }
 
 // read single precision float
 static inline float _from_bytes_float(const char *p)
 {
-    char q[4];
-    q[0] = p[3];
-    q[1] = p[2];
-    q[2] = p[1];
-    q[3] = p[0];
-    return *((float*)q);
+    return _load_be<float,uint32_t>(p);
 }
 
 // read double precision float
 static inline double _from_bytes_double(const char *p)
 {
-    char q[8];
-    q[0] = p[7];
-    q[1] = p[6];
-    q[2] = p[5];
-    q[3] = p[4];
-    q[4] = p[3];
-    q[5] = p[2];
-    q[6] = p[1];
-    q[7] = p[0];
-    return *((double*)q);
+    return _load_be<double,uint64_t>(p);
 }
 
-}
\ No newline at end of file
+// gcc 12 warns about the vector stores when inlined with a small fixed size
+// destination (those loops do not run for it)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Warray-bounds"
+
+// copy n big endian values of size W (2, 4 or 8) from src to dst reversing the
+// bytes of each one, src and dst may be the same but must not overlap otherwise
+template <size_t W>
+static inline void _bswap_copy(char *dst, const char *src, size_t n)
+{
+    size_t i = 0, bytes = n*W;
+#if defined(__AVX2__) || defined(__SSSE3__)
+    // byte order within each 16 byte lane
+    const __m128i rev = W == 2
+        ? _mm_setr_epi8(1,0,3,2,5,4,7,6,9,8,11,10,13,12,15,14)
+        : W == 4
+        ? _mm_setr_epi8(3,2,1,0,7,6,5,4,11,10,9,8,15,14,13,12)
+        : _mm_setr_epi8(7,6,5,4,3,2,1,0,15,14,13,12,11,10,9,8);
+#if defined(__AVX2__)
+    const __m256i rev2 = _mm256_broadcastsi128_si256(rev);
+    for (; i + 128 <= bytes; i += 128)
+    {
+        __m256i a = _mm256_loadu_si256((const __m256i*)(src+i));
+        __m256i b = _mm256_loadu_si256((const __m256i*)(src+i+32));
+        __m256i c = _mm256_loadu_si256((const __m256i*)(src+i+64));
+        __m256i d = _mm256_loadu_si256((const __m256i*)(src+i+96));
+        _mm256_storeu_si256((__m256i*)(dst+i),_mm256_shuffle_epi8(a,rev2));
+        _mm256_storeu_si256((__m256i*)(dst+i+32),_mm256_shuffle_epi8(b,rev2));
+        _mm256_storeu_si256((__m256i*)(dst+i+64),_mm256_shuffle_epi8(c,rev2));
+        _mm256_storeu_si256((__m256i*)(dst+i+96),_mm256_shuffle_epi8(d,rev2));
+    }
+    for (; i + 32 <= bytes; i += 32)
+    {
+        __m256i a = _mm256_loadu_si256((const __m256i*)(src+i));
+        _mm256_storeu_si256((__m256i*)(dst+i),_mm256_shuffle_epi8(a,rev2));
+    }
+#endif
+    for (; i + 16 <= bytes; i += 16)
+    {
+        __m128i a = _mm_loadu_si128((const __m128i*)(src+i));
+        _mm_storeu_si128((__m128i*)(dst+i),_mm_shuffle_epi8(a,rev));
+    }
+#endif
+    for (; i < bytes; i += W)
+    {
+        if constexpr (W == 2)
+        {
+            uint16_t u;
+            memcpy(&u,src+i,2);
+            u = _bswap(u);
+            memcpy(dst+i,&u,2);
+        }
+        else if constexpr (W == 4)
+        {
+            uint32_t u;
+            memcpy(&u,src+i,4);
+            u = _bswap(u);
+            memcpy(dst+i,&u,4);
+        }
+        else
+        {
+            uint64_t u;
+            memcpy(&u,src+i,8);
+            u = _bswap(u);
+            memcpy(dst+i,&u,8);
+        }
+    }
+}
+
+#pragma GCC diagnostic pop
+
+// read n big endian values from p into out
+template <typename T>
+static inline void _from_bytes_array(const char *p, T *out, size_t n)
+{
+    static_assert(sizeof(T) == 1 || sizeof(T) == 2 || sizeof(T) == 4
+            || sizeof(T) == 8);
+    if (n == 0)
+        return;
+#if TKOZ_LITTLE_ENDIAN
+    if constexpr (sizeof(T) > 1)
+    {
+        _bswap_copy<sizeof(T)>((char*)out,p,n);
+        return;
+    }
+#endif
+    memcpy(out,p,n*sizeof(T));
+}
+
+// write n values from v to p as big endian
+template <typename T>
+static inline void _to_bytes_array(char *p, const T *v, size_t n)
+{
+    static_assert(sizeof(T) == 1 || sizeof(T) == 2 || sizeof(T) == 4
+            || sizeof(T) == 8);
+    if (n == 0)
+        return;
+#if TKOZ_LITTLE_ENDIAN
+    if constexpr (sizeof(T) > 1)
+    {
+        _bswap_copy<sizeof(T)>(p,(const char*)v,n);
+        return;
+    }
+#endif
+    memcpy(p,v,n*sizeof(T));
+}
+
+}
@@ -0,0 +1,592 @@
+/*
+Pipelined scan of a whole world
+
+WorldScanner finds the region files of the overworld (region/), the nether
+(DIM-1/region/) and the end (DIM1/region/) and the .dat player files in
+playerdata/ of a world directory, then runs them through three groups
+of threads connected by bounded queues:
+- I/O threads read one whole file at a time and check region headers
+- inflate threads decompress single chunks (and player files)
+- decode threads decode the nbt (in an arena per thread) and hand it to the
+  visitor
+A full queue blocks the stage feeding it. Bytes of files read and of inflated
+nbt are counted until the decode stage is done with them, and the I/O threads
+only read the next file while that count is under the memory limit (one file
+is always allowed so a region larger than the limit still gets read).
+Inflated data of chunks already in flight is not held back, so the count can
+go over the limit by about that much.
+
+The visitor derives from WorldVisitor and defines what it needs:
+
+    bool region(int dimension, int x, int z)   false skips the region
+    bool chunk(const WorldChunk &c)            false stops the scan
+    bool file(const WorldFile &f)              false stops the scan
+    void error(const std::string &path, int ci, const char *error)
+
+region() is called on the thread calling scan() before anything is read,
+the others on the worker threads at the same time (they must be thread safe).
+ci is -1 for errors about a whole file. Chunks come in no particular order and
+their nbt is only valid during the call. Broken regions or chunks are
+reported and skipped. A visitor exception stops the scan and is rethrown by
+scan().
+
+Progress (with throughput counters and the memory in use) is reported on the
+thread calling scan().
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "arena.hpp"
+#include "bounded_queue.hpp"
+#include "nbt.hpp"
+#include "nbt_io.hpp"
+#include "region.hpp"
+
+namespace mclib
+{
+
+struct WorldChunk
+{
+    int dimension; // 0 overworld, -1 nether, 1 end
+    int x, z; // chunk coordinates in the world
+    size_t ci; // index in its region
+    int32_t timestamp;
+    const std::string &path; // region file
+    TAG *tag;
+};
+
+struct WorldFile
+{
+    const std::string &path;
+    TAG *tag;
+};
+
+// visitor that takes everything and ignores it
+struct WorldVisitor
+{
+    bool region(int, int, int) { return true; }
+    bool chunk(const WorldChunk&) { return true; }
+    bool file(const WorldFile&) { return true; }
+    void error(const std::string&, int, const char*) {}
+};
+
+struct WorldScanStats
+{
+    size_t regions = 0; // region files to read
+    size_t regions_done = 0; // read and queued
+    size_t skipped = 0; // regions the visitor skipped
+    size_t files = 0; // other nbt files visited
+    size_t chunks = 0; // chunks visited
+    size_t failed = 0; // broken regions, chunks and files
+    size_t read = 0; // bytes read
+    size_t inflated = 0; // bytes of nbt
+    size_t memory = 0; // bytes held by the pipeline
+    size_t peak_memory = 0;
+    double inflate_s = 0; // summed over threads
+    double decode_s = 0; // summed over threads (includes the visitor)
+    double wall_s = 0;
+};
+
+class WorldScanner
+{
+public:
+    typedef std::function<void(const WorldScanStats&)> progress_t;
+private:
+    std::string root;
+    size_t io_threads, inflate_threads, decode_threads;
+    size_t queue_size;
+    size_t memory_limit;
+    progress_t progress;
+    double poll_secs;
+    std::atomic<bool> stopped;
+    // files to read
+    struct _source
+    {
+        std::string path;
+        bool region;
+        int dimension, x, z;
+    };
+    std::vector<_source> sources;
+    std::atomic<size_t> next_source;
+    // bytes held, the I/O stage waits on memory_cv
+    std::mutex memory_lock;
+    std::condition_variable memory_cv;
+    size_t memory, peak_memory;
+    // counters
+    std::atomic<size_t> regions_done, files, chunks, failed, bytes_read,
+            bytes_inflated;
+    std::atomic<uint64_t> inflate_ns, decode_ns;
+    std::chrono::steady_clock::time_point start;
+    size_t region_count, skipped;
+    std::exception_ptr error;
+    std::mutex error_lock;
+    // buffer counted in memory until it is destroyed
+    struct _buffer
+    {
+        WorldScanner &owner;
+        bytes_t data;
+        size_t charged;
+        _buffer(WorldScanner &o, size_t n): owner(o), charged(n) {}
+        ~_buffer() { owner._release(charged); }
+    };
+    struct _file
+    {
+        const _source &src;
+        _buffer buf;
+        std::unique_ptr<RegionFile> region;
+        _file(const _source &s, WorldScanner &o, size_t n): src(s), buf(o,n) {}
+    };
+    // a chunk of a region (ci < REGION_CHUNKS) or a whole nbt file
+    struct _compressed
+    {
+        std::shared_ptr<_file> file;
+        size_t ci;
+    };
+    struct _inflated
+    {
+        std::shared_ptr<_file> file;
+        size_t ci;
+        std::unique_ptr<_buffer> nbt;
+    };
+    std::unique_ptr<BoundedQueue<_compressed>> inflate_q;
+    std::unique_ptr<BoundedQueue<_inflated>> decode_q;
+    std::atomic<size_t> io_live, inflate_live, decode_live;
+    std::mutex done_lock;
+    std::condition_variable done_cv;
+    static uint64_t _ns()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+    // sorted names in dir (none if it does not exist)
+    static std::vector<std::string> _list(const std::string &dir)
+    {
+        std::vector<std::string> ret;
+        DIR *d = opendir(dir.c_str());
+        if (!d)
+            return ret;
+        while (struct dirent *e = readdir(d))
+            ret.push_back(e->d_name);
+        closedir(d);
+        std::sort(ret.begin(),ret.end());
+        return ret;
+    }
+    static bool _ends_with(const std::string &s, const char *end)
+    {
+        size_t n = strlen(end);
+        return s.size() >= n && s.compare(s.size()-n,n,end) == 0;
+    }
+    // wait until n more bytes fit under the limit (or nothing is held)
+    void _acquire(size_t n)
+    {
+        std::unique_lock<std::mutex> lk(memory_lock);
+        memory_cv.wait(lk,[this,n]{ return stopped || memory == 0
+                || memory + n <= memory_limit; });
+        memory += n;
+        peak_memory = std::max(peak_memory,memory);
+    }
+    // count n more bytes without waiting
+    void _charge(size_t n)
+    {
+        std::lock_guard<std::mutex> g(memory_lock);
+        memory += n;
+        peak_memory = std::max(peak_memory,memory);
+    }
+    void _release(size_t n)
+    {
+        {
+            std::lock_guard<std::mutex> g(memory_lock);
+            memory -= n;
+        }
+        memory_cv.notify_all();
+    }
+    // stop and let blocked producers fail their pushes
+    void _stop()
+    {
+        stop();
+        inflate_q->close();
+        decode_q->close();
+    }
+    void _fail(std::exception_ptr e)
+    {
+        {
+            std::lock_guard<std::mutex> g(error_lock);
+            if (!error)
+                error = e;
+        }
+        _stop();
+    }
+    template <typename V>
+    void _broken(V &vis, const std::string &path, int ci, const char *e)
+    {
+        ++failed;
+        vis.error(path,ci,e);
+    }
+    // fill out from fd (false if the file is shorter or cannot be read)
+    static bool _read(int fd, bytes_t &out)
+    {
+        size_t got = 0;
+        while (got < out.size())
+        {
+            ssize_t r = read(fd,out.data()+got,out.size()-got);
+            if (r < 0 && errno == EINTR)
+                continue;
+            if (r <= 0)
+                return false;
+            got += r;
+        }
+        return true;
+    }
+    template <typename V>
+    void _io(V &vis)
+    {
+        for (;;)
+        {
+            size_t i = next_source++;
+            if (stopped || i >= sources.size())
+                break;
+            const _source &s = sources[i];
+            int fd = open(s.path.c_str(),O_RDONLY);
+            struct stat st;
+            if (fd < 0 || fstat(fd,&st))
+            {
+                if (fd >= 0)
+                    close(fd);
+                _broken(vis,s.path,-1,"world file cannot be opened");
+                continue;
+            }
+            posix_fadvise(fd,0,0,POSIX_FADV_SEQUENTIAL);
+            size_t n = st.st_size;
+            _acquire(n);
+            std::shared_ptr<_file> f(new _file(s,*this,n));
+            f->buf.data.resize(n);
+            bool ok = _read(fd,f->buf.data);
+            close(fd);
+            if (!ok)
+            {
+                _broken(vis,s.path,-1,"world file cannot be read");
+                continue;
+            }
+            bytes_read += n;
+            if (!s.region)
+            {
+                inflate_q->push({f,REGION_CHUNKS});
+                continue;
+            }
+            // the game leaves empty region files around
+            if (n == 0)
+            {
+                ++regions_done;
+                continue;
+            }
+            try
+            {
+                f->region.reset(new RegionFile(f->buf.data.data(),n));
+            }
+            catch (const char *e)
+            {
+                _broken(vis,s.path,-1,e);
+                continue;
+            }
+            for (size_t ci = 0; ci < REGION_CHUNKS; ++ci)
+                if (f->region->exists(ci) && !inflate_q->push({f,ci}))
+                    break;
+            ++regions_done;
+        }
+    }
+    template <typename V>
+    void _inflate(V &vis)
+    {
+        NbtInflater inf;
+        _compressed c;
+        while (inflate_q->pop(c))
+        {
+            std::shared_ptr<_file> f = std::move(c.file);
+            if (stopped)
+                continue;
+            uint64_t t0 = _ns();
+            std::string_view nbt;
+            try
+            {
+                if (c.ci == REGION_CHUNKS)
+                    nbt = inf.inflate(f->buf.data.data(),f->buf.data.size());
+                else
+                {
+                    RegionChunkData d = f->region->raw(c.ci);
+                    nbt = inf.inflate(d.data,d.size,d.compression);
+                }
+            }
+            catch (const char *e)
+            {
+                inflate_ns += _ns() - t0;
+                _broken(vis,f->src.path,c.ci == REGION_CHUNKS ? -1 : (int)c.ci,
+                        e);
+                continue;
+            }
+            _charge(nbt.size());
+            std::unique_ptr<_buffer> b(new _buffer(*this,nbt.size()));
+            b->data.assign(nbt.begin(),nbt.end());
+            bytes_inflated += nbt.size();
+            inflate_ns += _ns() - t0;
+            size_t ci = c.ci;
+            if (!decode_q->push({std::move(f),ci,std::move(b)}))
+                break;
+        }
+    }
+    template <typename V>
+    void _decode(V &vis)
+    {
+        Arena arena;
+        _inflated item;
+        while (decode_q->pop(item))
+        {
+            _inflated it = std::move(item);
+            if (stopped)
+                continue;
+            uint64_t t0 = _ns();
+            arena.reset();
+            const _source &s = it.file->src;
+            TAG *t = nullptr;
+            try
+            {
+                t = TAG::decode(it.nbt->data.data(),it.nbt->data.size(),
+                        &arena);
+            }
+            catch (const char *e)
+            {
+                decode_ns += _ns() - t0;
+                _broken(vis,s.path,it.ci == REGION_CHUNKS ? -1 : (int)it.ci,
+                        e);
+                continue;
+            }
+            bool go;
+            if (it.ci == REGION_CHUNKS)
+            {
+                ++files;
+                go = vis.file(WorldFile{s.path,t});
+            }
+            else
+            {
+                ++chunks;
+                go = vis.chunk(WorldChunk{s.dimension,
+                        s.x*32 + (int)(it.ci % 32),s.z*32 + (int)(it.ci / 32),
+                        it.ci,it.file->region->timestamp(it.ci),s.path,t});
+            }
+            decode_ns += _ns() - t0;
+            if (!go)
+                _stop();
+        }
+    }
+    // run a stage, the last thread of a stage closes the queue after it
+    template <typename F>
+    void _stage(F body, std::atomic<size_t> &live,
+            BoundedQueue<_compressed> *close_in,
+            BoundedQueue<_inflated> *close_out)
+    {
+        try
+        {
+            body();
+        }
+        catch (...)
+        {
+            _fail(std::current_exception());
+        }
+        if (--live == 0)
+        {
+            if (close_in)
+                close_in->close();
+            if (close_out)
+                close_out->close();
+            std::lock_guard<std::mutex> g(done_lock);
+            done_cv.notify_all();
+        }
+    }
+    template <typename V>
+    void _enumerate(V &vis)
+    {
+        sources.clear();
+        region_count = skipped = 0;
+        const std::pair<const char*,int> dims[] = {{"",0},{"DIM-1/",-1},
+                {"DIM1/",1}};
+        for (auto &d : dims)
+        {
+            std::string dir = root + d.first + "region/";
+            for (const std::string &name : _list(dir))
+            {
+                int x, z;
+                char check[64];
+                if (name.size() >= 40 || sscanf(name.c_str(),"r.%d.%d.mca",
+                        &x,&z) != 2)
+                    continue;
+                snprintf(check,sizeof(check),"r.%d.%d.mca",x,z);
+                if (name != check)
+                    continue;
+                if (!vis.region(d.second,x,z))
+                {
+                    ++skipped;
+                    continue;
+                }
+                sources.push_back({dir + name,true,d.second,x,z});
+                ++region_count;
+            }
+        }
+        std::string dir = root + "playerdata/";
+        for (const std::string &name : _list(dir))
+            if (_ends_with(name,".dat"))
+                sources.push_back({dir + name,false,0,0,0});
+    }
+public:
+    WorldScanner(const std::string &world): root(world), io_threads(2),
+            inflate_threads(0), decode_threads(0), queue_size(4096),
+            memory_limit((size_t)1 << 30), poll_secs(1), stopped(false)
+    {
+        if (root.empty())
+            root = ".";
+        if (root.back() != '/')
+            root += '/';
+    }
+    WorldScanner(const WorldScanner&) = delete;
+    WorldScanner &operator=(const WorldScanner&) = delete;
+    // threads of each stage, 0 uses the hardware concurrency
+    void setThreads(size_t io, size_t inflate, size_t decode)
+    {
+        io_threads = io;
+        inflate_threads = inflate;
+        decode_threads = decode;
+    }
+    // items each queue holds before its producers wait
+    void setQueueSize(size_t n) { queue_size = n ? n : 1; }
+    // bytes of file data and nbt held before the I/O threads wait
+    void setMemoryLimit(size_t bytes) { memory_limit = bytes; }
+    // called every secs seconds during scan() and once at the end
+    void setProgress(progress_t p, double secs = 1)
+    {
+        progress = p;
+        poll_secs = secs;
+    }
+    // stop after the chunks being visited, safe from any thread
+    void stop()
+    {
+        std::lock_guard<std::mutex> g(memory_lock);
+        stopped = true;
+        memory_cv.notify_all();
+    }
+    bool isStopped() const { return stopped; }
+    WorldScanStats stats()
+    {
+        WorldScanStats s;
+        s.regions = region_count;
+        s.regions_done = regions_done;
+        s.skipped = skipped;
+        s.files = files;
+        s.chunks = chunks;
+        s.failed = failed;
+        s.read = bytes_read;
+        s.inflated = bytes_inflated;
+        {
+            std::lock_guard<std::mutex> g(memory_lock);
+            s.memory = memory;
+            s.peak_memory = peak_memory;
+        }
+        s.inflate_s = inflate_ns * 1e-9;
+        s.decode_s = decode_ns * 1e-9;
+        s.wall_s = std::chrono::duration<double>(
+                std::chrono::steady_clock::now() - start).count();
+        return s;
+    }
+    // scan the world with vis, returns when everything is visited or the
+    // scan was stopped
+    template <typename V>
+    WorldScanStats scan(V &vis)
+    {
+        start = std::chrono::steady_clock::now();
+        stopped = false;
+        error = nullptr;
+        memory = peak_memory = 0;
+        regions_done = files = chunks = failed = 0;
+        bytes_read = bytes_inflated = 0;
+        inflate_ns = decode_ns = 0;
+        next_source = 0;
+        _enumerate(vis);
+        size_t hw = std::max(1u,std::thread::hardware_concurrency());
+        size_t n_io = io_threads ? io_threads : hw;
+        size_t n_inflate = inflate_threads ? inflate_threads : hw;
+        size_t n_decode = decode_threads ? decode_threads : hw;
+        inflate_q.reset(new BoundedQueue<_compressed>(queue_size));
+        decode_q.reset(new BoundedQueue<_inflated>(queue_size));
+        io_live = n_io;
+        inflate_live = n_inflate;
+        decode_live = n_decode;
+        std::vector<std::thread> threads;
+        for (size_t i = 0; i < n_io; ++i)
+            threads.emplace_back([this,&vis]
+            {
+                _stage([this,&vis]{ _io(vis); },io_live,inflate_q.get(),
+                        nullptr);
+            });
+        for (size_t i = 0; i < n_inflate; ++i)
+            threads.emplace_back([this,&vis]
+            {
+                _stage([this,&vis]{ _inflate(vis); },inflate_live,nullptr,
+                        decode_q.get());
+            });
+        for (size_t i = 0; i < n_decode; ++i)
+            threads.emplace_back([this,&vis]
+            {
+                _stage([this,&vis]{ _decode(vis); },decode_live,nullptr,
+                        nullptr);
+            });
+        {
+            std::unique_lock<std::mutex> lk(done_lock);
+            while (!done_cv.wait_for(lk,std::chrono::duration<double>(
+                    poll_secs),[this]{ return decode_live == 0; }))
+            {
+                if (!progress)
+                    continue;
+                lk.unlock();
+                try
+                {
+                    progress(stats());
+                }
+                catch (...)
+                {
+                    _fail(std::current_exception());
+                }
+                lk.lock();
+            }
+        }
+        for (auto &t : threads)
+            t.join();
+        // items left in the queues after a stop
+        inflate_q.reset();
+        decode_q.reset();
+        WorldScanStats ret = stats();
+        if (progress && !error)
+            progress(ret);
+        if (error)
+            std::rethrow_exception(error);
+        return ret;
+    }
+};
+
+}
@@ -0,0 +1,220 @@
+#include <atomic>
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <mutex>
+#include <set>
+#include <string>
+#include <tuple>
+
+#include <sys/stat.h>
+
+#include "nbt.hpp"
+#include "nbt_io.hpp"
+#include "region_writer.hpp"
+#include "world.hpp"
+
+using namespace mclib;
+
+static const char *WORLD = "/tmp/world_test";
+
+static TAG *make_chunk(int dim, int x, int z)
+{
+    compound_t root;
+    root["dim"] = new TAG_Int("dim",dim);
+    root["xPos"] = new TAG_Int("xPos",x);
+    root["zPos"] = new TAG_Int("zPos",z);
+    root["Data"] = new TAG_Long_Array("Data",long_array_t(64,x*31+z));
+    return new TAG_Compound("",root);
+}
+
+// region rx,rz of dim with chunks at ci % 5 == 0
+static size_t make_region(const std::string &path, int dim, int rx, int rz)
+{
+    remove(path.c_str());
+    RegionWriter w(path);
+    size_t n = 0;
+    for (size_t ci = 0; ci < REGION_CHUNKS; ci += 5, ++n)
+    {
+        TAG *t = make_chunk(dim,rx*32 + (int)(ci % 32),rz*32 + (int)(ci / 32));
+        w.setChunk(ci,*t,(int32_t)ci);
+        delete t;
+    }
+    w.flush();
+    return n;
+}
+
+// child k of compound t is TAG_Int v
+static bool has_int(TAG *t, const char *k, int v)
+{
+    TAG *c = ((TAG_Compound*)t)->get(k);
+    return c && c->encode() == TAG_Int(k,v).encode();
+}
+
+static void write_file(const std::string &path, const bytes_t &data)
+{
+    FILE *f = fopen(path.c_str(),"wb");
+    if (!data.empty())
+        fwrite(data.data(),1,data.size(),f);
+    fclose(f);
+}
+
+struct Collect: WorldVisitor
+{
+    std::mutex lock;
+    std::set<std::tuple<int,int,int>> chunks;
+    std::set<std::string> files, errors;
+    size_t stop_after = 0;
+    std::atomic<size_t> seen{0};
+    std::set<std::tuple<int,int,int>> skip;
+    bool region(int dim, int x, int z)
+    {
+        return !skip.count({dim,x,z});
+    }
+    bool chunk(const WorldChunk &c)
+    {
+        assert(has_int(c.tag,"dim",c.dimension));
+        assert(has_int(c.tag,"xPos",c.x) && has_int(c.tag,"zPos",c.z));
+        assert(c.timestamp == (int32_t)c.ci);
+        std::lock_guard<std::mutex> g(lock);
+        bool fresh = chunks.insert({c.dimension,c.x,c.z}).second;
+        assert(fresh);
+        (void)fresh;
+        return stop_after == 0 || ++seen < stop_after;
+    }
+    bool file(const WorldFile &f)
+    {
+        TAG *name = ((TAG_Compound*)f.tag)->get("Name");
+        assert(name && name->encode() == TAG_String("Name","player").encode());
+        std::lock_guard<std::mutex> g(lock);
+        files.insert(f.path);
+        return true;
+    }
+    void error(const std::string &path, int ci, const char *e)
+    {
+        assert(e);
+        std::lock_guard<std::mutex> g(lock);
+        errors.insert(path + ":" + std::to_string(ci));
+    }
+};
+
+struct Thrower: WorldVisitor
+{
+    bool chunk(const WorldChunk&)
+    {
+        throw "visitor failed";
+    }
+};
+
+int main(int argc, char **argv)
+{
+    (void)argc;
+    (void)argv;
+    std::string w = WORLD;
+    for (const char *d : {"","/region","/DIM-1","/DIM-1/region","/DIM1",
+            "/DIM1/region","/playerdata"})
+        mkdir((w + d).c_str(),0755);
+    size_t total = 0;
+    total += make_region(w + "/region/r.0.0.mca",0,0,0);
+    total += make_region(w + "/region/r.-1.2.mca",0,-1,2);
+    total += make_region(w + "/DIM-1/region/r.0.-1.mca",-1,0,-1);
+    total += make_region(w + "/DIM1/region/r.3.3.mca",1,3,3);
+    // empty region (the game leaves these), ignored names, a broken header
+    write_file(w + "/region/r.5.5.mca",bytes_t());
+    write_file(w + "/region/r.1.1.mca.bak",bytes_t(10,1));
+    write_file(w + "/region/r.01.1.mca",bytes_t(10,1));
+    write_file(w + "/DIM1/region/r.9.9.mca",bytes_t(3*REGION_SECTOR-1,0));
+    // a chunk with a broken length
+    std::string broken = w + "/DIM1/region/r.4.4.mca";
+    total += make_region(broken,1,4,4) - 1;
+    {
+        RegionFile r(broken);
+        bytes_t data(r.bytes(),r.bytes() + r.size());
+        _to_bytes(data.data() + r.sectorOffset(5)*REGION_SECTOR,(int32_t)0);
+        write_file(broken,data);
+    }
+    compound_t player;
+    player["Name"] = new TAG_String("Name","player");
+    TAG *p = new TAG_Compound("",player);
+    saveNbt(w + "/playerdata/a.dat",*p);
+    saveNbt(w + "/playerdata/b.dat",*p,NBT_ZLIB);
+    delete p;
+    write_file(w + "/playerdata/c.dat",bytes_t(5,'x'));
+    write_file(w + "/playerdata/d.dat_old",bytes_t(5,'x'));
+    // everything, with a memory limit of one region and short queues
+    {
+        WorldScanner s(w);
+        s.setThreads(2,2,3);
+        s.setQueueSize(8);
+        s.setMemoryLimit(1);
+        size_t reports = 0;
+        s.setProgress([&](const WorldScanStats &st)
+        {
+            ++reports;
+            assert(st.regions == 7 && st.regions_done <= st.regions);
+        },0.001);
+        Collect c;
+        WorldScanStats st = s.scan(c);
+        assert(c.chunks.size() == total && st.chunks == total);
+        assert(c.chunks.count({0,-32,64}) && c.chunks.count({-1,5,-32}));
+        assert(c.chunks.count({1,3*32+10,3*32}));
+        assert(c.files.size() == 2 && st.files == 2);
+        assert(c.errors.size() == 3 && st.failed == 3);
+        assert(c.errors.count(w + "/DIM1/region/r.9.9.mca:-1"));
+        assert(c.errors.count(broken + ":5"));
+        assert(c.errors.count(w + "/playerdata/c.dat:-1"));
+        assert(st.regions == 7 && st.regions_done == 6 && st.skipped == 0);
+        assert(st.read > 0 && st.inflated > st.chunks*64*8);
+        assert(st.memory == 0 && st.peak_memory > 0);
+        assert(st.inflate_s > 0 && st.decode_s > 0 && st.wall_s > 0);
+        assert(reports >= 1);
+        // the limit holds one file read at a time plus inflated data
+        assert(st.peak_memory < 2*st.read / 6 + st.inflated);
+    }
+    // skipped regions
+    {
+        WorldScanner s(w + "/");
+        Collect c;
+        c.skip = {{0,0,0},{1,4,4},{1,9,9}};
+        WorldScanStats st = s.scan(c);
+        assert(st.skipped == 3 && st.regions == 4);
+        assert(c.chunks.size() == 3*((REGION_CHUNKS+4)/5));
+        assert(!c.chunks.count({0,0,0}) && c.errors.size() == 1);
+    }
+    // early stop
+    {
+        WorldScanner s(w);
+        s.setThreads(1,1,1);
+        s.setQueueSize(4);
+        Collect c;
+        c.stop_after = 10;
+        WorldScanStats st = s.scan(c);
+        assert(c.chunks.size() == 10 && st.chunks == 10 && s.isStopped());
+        assert(st.memory == 0);
+    }
+    // visitor exceptions stop the scan and come out of scan()
+    {
+        WorldScanner s(w);
+        s.setThreads(2,2,2);
+        Thrower t;
+        bool threw = false;
+        try { s.scan(t); }
+        catch (const char *e) { threw = std::string(e) == "visitor failed"; }
+        assert(threw);
+        assert(s.stats().memory == 0);
+    }
+    // a missing world has nothing in it
+    {
+        WorldScanner s("/tmp/world_test_missing");
+        WorldVisitor v;
+        WorldScanStats st = s.scan(v);
+        assert(st.regions == 0 && st.chunks == 0 && st.files == 0);
+    }
+    std::string cmd = std::string("rm -rf ") + WORLD;
+    int rc = system(cmd.c_str());
+    assert(rc == 0);
+    (void)rc;
+    std::cout << "world tests passed" << std::endl;
+    return 0;
+}
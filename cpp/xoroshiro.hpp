@@ -0,0 +1,443 @@
+/*
+C++ implementation of the Xoroshiro128++ random source used by newer Minecraft
+world generation (XoroshiroRandomSource), with the same method surface as
+mclib::Random
+
+A 64 bit seed is expanded to 128 bits like RandomSupport.upgradeSeedTo128bit
+(xor/add with the silver and golden ratio constants, then mixStafford13 on both
+halves). Integer outputs match exactly. nextGaussian uses the same Marsaglia
+polar method but not java.lang.StrictMath so it may differ in the last bits.
+*/
+
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#if defined(__AVX2__) || defined(__AVX512F__)
+#include <immintrin.h>
+#endif
+
+// macros for optimization
+#define likely(x)   __builtin_expect(!!(x),1)
+#define unlikely(x) __builtin_expect(!!(x),0)
+
+namespace mclib
+{
+
+// constants
+const uint64_t _golden_ratio_64 = 0x9e3779b97f4a7c15uLL;
+const uint64_t _silver_ratio_64 = 0x6a09e667f3bcc909uLL;
+
+static inline uint64_t _rotl64(uint64_t x, int k)
+{
+    return (x << k) | (x >> (64 - k));
+}
+
+// RandomSupport.mixStafford13
+static inline uint64_t _mix_stafford13(uint64_t z)
+{
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9uLL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebuLL;
+    return z ^ (z >> 31);
+}
+
+// Mth.getSeed, position hash used by positional random factories
+static inline int64_t _position_seed(int32_t x, int32_t y, int32_t z)
+{
+    uint64_t l = (uint64_t)(int64_t)(int32_t)((uint32_t)x*3129871u)
+            ^ (uint64_t)(int64_t)z*116129781uLL ^ (uint64_t)(int64_t)y;
+    l = l*l*42317861uLL + l*11uLL;
+    return (int64_t)l >> 16;
+}
+
+// md5 digest, needed for Java's Hashing.md5() in fromHashOf
+static inline void _md5(const uint8_t *msg, size_t len, uint8_t out[16])
+{
+    static const uint32_t k[64] = {
+        0xd76aa478,0xe8c7b756,0x242070db,0xc1bdceee,0xf57c0faf,0x4787c62a,
+        0xa8304613,0xfd469501,0x698098d8,0x8b44f7af,0xffff5bb1,0x895cd7be,
+        0x6b901122,0xfd987193,0xa679438e,0x49b40821,0xf61e2562,0xc040b340,
+        0x265e5a51,0xe9b6c7aa,0xd62f105d,0x02441453,0xd8a1e681,0xe7d3fbc8,
+        0x21e1cde6,0xc33707d6,0xf4d50d87,0x455a14ed,0xa9e3e905,0xfcefa3f8,
+        0x676f02d9,0x8d2a4c8a,0xfffa3942,0x8771f681,0x6d9d6122,0xfde5380c,
+        0xa4beea44,0x4bdecfa9,0xf6bb4b60,0xbebfbc70,0x289b7ec6,0xeaa127fa,
+        0xd4ef3085,0x04881d05,0xd9d4d039,0xe6db99e5,0x1fa27cf8,0xc4ac5665,
+        0xf4292244,0x432aff97,0xab9423a7,0xfc93a039,0x655b59c3,0x8f0ccc92,
+        0xffeff47d,0x85845dd1,0x6fa87e4f,0xfe2ce6e0,0xa3014314,0x4e0811a1,
+        0xf7537e82,0xbd3af235,0x2ad7d2bb,0xeb86d391 };
+    static const int r[64] = {
+        7,12,17,22,7,12,17,22,7,12,17,22,7,12,17,22,
+        5,9,14,20,5,9,14,20,5,9,14,20,5,9,14,20,
+        4,11,16,23,4,11,16,23,4,11,16,23,4,11,16,23,
+        6,10,15,21,6,10,15,21,6,10,15,21,6,10,15,21 };
+    uint32_t h[4] = { 0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476 };
+    size_t padded = ((len + 8) / 64 + 1) * 64;
+    std::string buf((const char*)msg,len);
+    buf.resize(padded,'\0');
+    buf[len] = (char)0x80;
+    uint64_t bits = (uint64_t)len * 8;
+    for (size_t i = 0; i < 8; ++i)
+        buf[padded-8+i] = (char)(bits >> (8*i));
+    for (size_t off = 0; off < padded; off += 64)
+    {
+        uint32_t w[16];
+        for (size_t i = 0; i < 16; ++i)
+        {
+            const uint8_t *p = (const uint8_t*)buf.data() + off + 4*i;
+            w[i] = p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+        }
+        uint32_t a = h[0], b = h[1], c = h[2], d = h[3];
+        for (size_t i = 0; i < 64; ++i)
+        {
+            uint32_t f;
+            size_t g;
+            if (i < 16)      { f = (b & c) | (~b & d); g = i; }
+            else if (i < 32) { f = (d & b) | (~d & c); g = (5*i + 1) % 16; }
+            else if (i < 48) { f = b ^ c ^ d;          g = (3*i + 5) % 16; }
+            else             { f = c ^ (b | ~d);       g = (7*i) % 16; }
+            f += a + k[i] + w[g];
+            a = d;
+            d = c;
+            c = b;
+            b += (f << r[i]) | (f >> (32 - r[i]));
+        }
+        h[0] += a;
+        h[1] += b;
+        h[2] += c;
+        h[3] += d;
+    }
+    for (size_t i = 0; i < 16; ++i)
+        out[i] = (uint8_t)(h[i/4] >> (8*(i%4)));
+}
+
+class XoroshiroPositional;
+
+class Xoroshiro
+{
+private:
+    uint64_t lo, hi;
+    bool has_g;
+    double next_g;
+    void _init(uint64_t l, uint64_t h)
+    {
+        if ((l | h) == 0) // all zero state is invalid
+        {
+            l = _golden_ratio_64;
+            h = _silver_ratio_64;
+        }
+        lo = l;
+        hi = h;
+        has_g = false;
+    }
+public:
+    // initialize with a 64 bit seed (expanded to 128 bits)
+    Xoroshiro(int64_t seed) { setSeed(seed); }
+    // initialize with a 128 bit state directly
+    Xoroshiro(int64_t seed_lo, int64_t seed_hi) { _init(seed_lo,seed_hi); }
+    void setSeed(int64_t seed)
+    {
+        uint64_t l = (uint64_t)seed ^ _silver_ratio_64;
+        uint64_t h = l + _golden_ratio_64;
+        _init(_mix_stafford13(l),_mix_stafford13(h));
+    }
+    int64_t getLo() const { return lo; }
+    int64_t getHi() const { return hi; }
+    // next 64 bit integer
+    int64_t nextLong()
+    {
+        uint64_t l = lo, h = hi;
+        uint64_t n = _rotl64(l + h,17) + l;
+        h ^= l;
+        lo = _rotl64(l,49) ^ h ^ (h << 21);
+        hi = _rotl64(h,28);
+        return n;
+    }
+    // consumeCount, skips n nextLong() outputs
+    void skip(size_t n)
+    {
+        for (size_t i = 0; i < n; ++i)
+            nextLong();
+    }
+    // top bits of the next long
+    int32_t _nextBits(size_t bits)
+    {
+        return (uint64_t)nextLong() >> (64 - bits);
+    }
+    // next 32 bit integer (low half of nextLong)
+    int32_t nextInt() { return (int32_t)nextLong(); }
+    // random integer in [0,n), Lemire's multiply and reject method
+    int32_t nextInt(int32_t n)
+    {
+        if (unlikely(n <= 0))
+            throw "bound must be positive";
+        uint64_t m = (uint64_t)(uint32_t)nextInt() * (uint32_t)n;
+        if (unlikely((uint32_t)m < (uint32_t)n))
+        {
+            uint32_t t = (uint32_t)(-(uint32_t)n) % (uint32_t)n;
+            while ((uint32_t)m < t)
+                m = (uint64_t)(uint32_t)nextInt() * (uint32_t)n;
+        }
+        return (int32_t)(m >> 32);
+    }
+    // next boolean (lowest bit)
+    bool nextBool() { return nextLong() & 1; }
+    // next single precision float in [0,1)
+    float nextFloat() { return _nextBits(24) * 5.9604645E-8f; }
+    // next double precision float in [0,1)
+    double nextDouble()
+    {
+        return (double)((uint64_t)nextLong() >> 11) * 1.1102230246251565E-16;
+    }
+    // next gaussian double precision (mean 0, stdev 1)
+    double nextGaussian()
+    {
+        if (has_g)
+        {
+            has_g = false;
+            return next_g;
+        }
+        double v1, v2, s;
+        do
+        {
+            v1 = 2.0*nextDouble() - 1.0;
+            v2 = 2.0*nextDouble() - 1.0;
+            // round the squares separately like java, otherwise the compiler
+            // may fuse this into a multiply add (-march with FMA)
+            volatile double sq1 = v1*v1, sq2 = v2*v2;
+            s = sq1 + sq2;
+        }
+        while (s >= 1.0 || s == 0.0);
+        double norm = sqrt(-2.0*log(s)/s);
+        next_g = v2*norm;
+        has_g = true;
+        return v1*norm;
+    }
+    // independent generator seeded from the next two outputs
+    Xoroshiro fork()
+    {
+        int64_t l = nextLong();
+        int64_t h = nextLong();
+        return Xoroshiro(l,h);
+    }
+    // factory for generators tied to positions or names
+    XoroshiroPositional forkPositional();
+};
+
+// XoroshiroPositionalRandomFactory
+class XoroshiroPositional
+{
+private:
+    uint64_t lo, hi;
+public:
+    XoroshiroPositional(int64_t seed_lo, int64_t seed_hi): lo(seed_lo),
+            hi(seed_hi) {}
+    // generator for a block position
+    Xoroshiro at(int32_t x, int32_t y, int32_t z) const
+    {
+        return Xoroshiro((int64_t)((uint64_t)_position_seed(x,y,z) ^ lo),hi);
+    }
+    // generator for a name (md5 of the utf-8 string)
+    Xoroshiro fromHashOf(const std::string &s) const
+    {
+        uint8_t d[16];
+        _md5((const uint8_t*)s.data(),s.size(),d);
+        uint64_t l = 0, h = 0;
+        for (size_t i = 0; i < 8; ++i)
+        {
+            l = (l << 8) | d[i];
+            h = (h << 8) | d[i+8];
+        }
+        return Xoroshiro((int64_t)(l ^ lo),(int64_t)(h ^ hi));
+    }
+};
+
+inline XoroshiroPositional Xoroshiro::forkPositional()
+{
+    int64_t l = nextLong();
+    int64_t h = nextLong();
+    return XoroshiroPositional(l,h);
+}
+
+// N independent Xoroshiro generators stepped together, lane i of every output
+// matches a Xoroshiro with the same seed making the same calls
+// uses AVX-512 (N multiple of 8) or AVX2 when enabled at compile time
+template <size_t N>
+class XoroshiroLanes
+{
+    static_assert(N == 4 || N == 8 || N == 16);
+private:
+    alignas(64) uint64_t lo[N];
+    alignas(64) uint64_t hi[N];
+    // out[i] = nextLong() of every lane
+    void _next(uint64_t *out)
+    {
+#if defined(__AVX512F__)
+        if constexpr (N % 8 == 0)
+        {
+            // zero masked forms with a full mask, the plain ones trip gcc 12
+            // maybe-uninitialized warnings inside the intrinsic headers
+            const __mmask8 all = 0xff;
+            for (size_t i = 0; i < N; i += 8)
+            {
+                __m512i l = _mm512_load_si512((const void*)(lo+i));
+                __m512i h = _mm512_load_si512((const void*)(hi+i));
+                __m512i n = _mm512_add_epi64(
+                        _mm512_maskz_rol_epi64(all,_mm512_add_epi64(l,h),17),l);
+                h = _mm512_xor_si512(h,l);
+                l = _mm512_xor_si512(_mm512_xor_si512(
+                        _mm512_maskz_rol_epi64(all,l,49),h),
+                        _mm512_maskz_slli_epi64(all,h,21));
+                _mm512_store_si512((void*)(lo+i),l);
+                _mm512_store_si512((void*)(hi+i),
+                        _mm512_maskz_rol_epi64(all,h,28));
+                _mm512_storeu_si512((void*)(out+i),n);
+            }
+            return;
+        }
+#endif
+#if defined(__AVX2__)
+        // no 64 bit rotate before AVX-512, use two shifts
+#define _ROTL256(x,k) _mm256_or_si256(_mm256_slli_epi64(x,k), \
+        _mm256_srli_epi64(x,64-(k)))
+        for (size_t i = 0; i < N; i += 4)
+        {
+            __m256i l = _mm256_load_si256((const __m256i*)(lo+i));
+            __m256i h = _mm256_load_si256((const __m256i*)(hi+i));
+            __m256i n = _mm256_add_epi64(_ROTL256(_mm256_add_epi64(l,h),17),l);
+            h = _mm256_xor_si256(h,l);
+            l = _mm256_xor_si256(_mm256_xor_si256(_ROTL256(l,49),h),
+                    _mm256_slli_epi64(h,21));
+            _mm256_store_si256((__m256i*)(lo+i),l);
+            _mm256_store_si256((__m256i*)(hi+i),_ROTL256(h,28));
+            _mm256_storeu_si256((__m256i*)(out+i),n);
+        }
+#undef _ROTL256
+#else
+        for (size_t i = 0; i < N; ++i)
+        {
+            uint64_t l = lo[i], h = hi[i];
+            out[i] = _rotl64(l + h,17) + l;
+            h ^= l;
+            lo[i] = _rotl64(l,49) ^ h ^ (h << 21);
+            hi[i] = _rotl64(h,28);
+        }
+#endif
+    }
+    // advance only the lanes with their bit set in mask
+    void _next(uint64_t *out, uint32_t mask)
+    {
+        for (size_t i = 0; i < N; ++i)
+        {
+            if (!((mask >> i) & 1))
+                continue;
+            uint64_t l = lo[i], h = hi[i];
+            out[i] = _rotl64(l + h,17) + l;
+            h ^= l;
+            lo[i] = _rotl64(l,49) ^ h ^ (h << 21);
+            hi[i] = _rotl64(h,28);
+        }
+    }
+public:
+    static const size_t lanes = N;
+    // initialize lane i with seeds[i]
+    XoroshiroLanes(const int64_t *seeds) { setSeed(seeds); }
+    // set lane i as if constructed with seeds[i]
+    void setSeed(const int64_t *seeds)
+    {
+        for (size_t i = 0; i < N; ++i)
+            setSeed(i,seeds[i]);
+    }
+    void setSeed(size_t lane, int64_t seed)
+    {
+        Xoroshiro x(seed);
+        lo[lane] = x.getLo();
+        hi[lane] = x.getHi();
+    }
+    // set one lane to a 128 bit state (like Xoroshiro(seed_lo,seed_hi))
+    void setState(size_t lane, int64_t seed_lo, int64_t seed_hi)
+    {
+        Xoroshiro x(seed_lo,seed_hi);
+        lo[lane] = x.getLo();
+        hi[lane] = x.getHi();
+    }
+    // next 64 bit integer for every lane
+    void nextLong(int64_t *out) { _next((uint64_t*)out); }
+    // next 32 bit integer for every lane
+    void nextInt(int32_t *out)
+    {
+        alignas(64) uint64_t v[N];
+        _next(v);
+        for (size_t i = 0; i < N; ++i)
+            out[i] = (int32_t)v[i];
+    }
+    // random integer in [0,n) for every lane
+    void nextInt(int32_t *out, int32_t n)
+    {
+        if (unlikely(n <= 0))
+            throw "bound must be positive";
+        alignas(64) uint64_t v[N], m[N];
+        _next(v);
+        uint32_t redo = 0;
+        for (size_t i = 0; i < N; ++i)
+        {
+            m[i] = (uint64_t)(uint32_t)v[i] * (uint32_t)n;
+            redo |= (uint32_t)((uint32_t)m[i] < (uint32_t)n) << i;
+        }
+        if (unlikely(redo))
+        {
+            // the low product was small, reject below the exact threshold
+            uint32_t t = (uint32_t)(-(uint32_t)n) % (uint32_t)n;
+            uint32_t again = 0;
+            for (size_t i = 0; i < N; ++i)
+                again |= (uint32_t)(((redo >> i) & 1)
+                        && (uint32_t)m[i] < t) << i;
+            while (again)
+            {
+                _next(v,again);
+                uint32_t next = 0;
+                for (size_t i = 0; i < N; ++i)
+                {
+                    if (!((again >> i) & 1))
+                        continue;
+                    m[i] = (uint64_t)(uint32_t)v[i] * (uint32_t)n;
+                    next |= (uint32_t)((uint32_t)m[i] < t) << i;
+                }
+                again = next;
+            }
+        }
+        for (size_t i = 0; i < N; ++i)
+            out[i] = (int32_t)(m[i] >> 32);
+    }
+    // next boolean for every lane
+    void nextBool(bool *out)
+    {
+        alignas(64) uint64_t v[N];
+        _next(v);
+        for (size_t i = 0; i < N; ++i)
+            out[i] = v[i] & 1;
+    }
+    // next single precision float in [0,1) for every lane
+    void nextFloat(float *out)
+    {
+        alignas(64) uint64_t v[N];
+        _next(v);
+        for (size_t i = 0; i < N; ++i)
+            out[i] = (int32_t)(v[i] >> 40) * 5.9604645E-8f;
+    }
+    // next double precision float in [0,1) for every lane
+    void nextDouble(double *out)
+    {
+        alignas(64) uint64_t v[N];
+        _next(v);
+        for (size_t i = 0; i < N; ++i)
+            out[i] = (double)(v[i] >> 11) * 1.1102230246251565E-16;
+    }
+};
+
+}
+
+#undef likely
+#undef unlikely
@@ -0,0 +1,103 @@
+#include <cassert>
+#include <cstring>
+#include <iostream>
+
+#include "xoroshiro.hpp"
+
+// values from XoroshiroRandomSource
+static void test_known_values()
+{
+    mclib::Xoroshiro r0(0);
+    assert(r0.nextLong() == 3038984756725240190LL);
+    assert(r0.nextLong() == -3694039286755638414LL);
+    assert(r0.nextLong() == 4633751808701151732LL);
+    mclib::Xoroshiro r1(12345);
+    const int32_t ints[] = {0, 8, 8, 0, 5};
+    for (int32_t v : ints)
+        assert(r1.nextInt(10) == v);
+    assert(r1.nextInt(1073741825) == 220706724);
+    // all zero state is replaced
+    mclib::Xoroshiro z(0,0);
+    assert(z.getLo() != 0 || z.getHi() != 0);
+}
+
+static void test_positional()
+{
+    assert(mclib::_position_seed(1,2,3) == -33674130277896LL);
+    assert(mclib::_position_seed(-100,64,-2000) == -60651343671309LL);
+    uint8_t d[16];
+    mclib::_md5((const uint8_t*)"abc",3,d);
+    const uint8_t abc[16] = {0x90,0x01,0x50,0x98,0x3c,0xd2,0x4f,0xb0,
+            0xd6,0x96,0x3f,0x7d,0x28,0xe1,0x7f,0x72};
+    assert(memcmp(d,abc,16) == 0);
+    mclib::Xoroshiro r(42);
+    mclib::XoroshiroPositional p = r.forkPositional();
+    assert(p.at(1,2,3).nextLong() == -3901958205717205245LL);
+    assert(p.fromHashOf("minecraft:offset").nextLong()
+            == 2458873966747037180LL);
+    // fork takes two outputs
+    mclib::Xoroshiro a(7), b(7);
+    mclib::Xoroshiro f = a.fork();
+    int64_t l = b.nextLong(), h = b.nextLong();
+    mclib::Xoroshiro g(l,h);
+    assert(f.nextLong() == g.nextLong());
+    assert(a.nextLong() == b.nextLong());
+}
+
+template <size_t N>
+static void test_lanes()
+{
+    int64_t seeds[N];
+    mclib::Xoroshiro *scalar[N];
+    for (size_t i = 0; i < N; ++i)
+    {
+        seeds[i] = -3865984986348818578LL + (int64_t)i*7919;
+        scalar[i] = new mclib::Xoroshiro(seeds[i]);
+    }
+    mclib::XoroshiroLanes<N> lanes(seeds);
+    const int32_t bounds[] = {1, 10, 16, 1000, 1073741825, 0x7FFFFFFF};
+    int32_t ints[N];
+    int64_t longs[N];
+    float floats[N];
+    double doubles[N];
+    bool bools[N];
+    for (size_t round = 0; round < 2000; ++round)
+    {
+        lanes.nextInt(ints);
+        for (size_t i = 0; i < N; ++i)
+            assert(ints[i] == scalar[i]->nextInt());
+        for (int32_t n : bounds)
+        {
+            lanes.nextInt(ints,n);
+            for (size_t i = 0; i < N; ++i)
+                assert(ints[i] == scalar[i]->nextInt(n));
+        }
+        lanes.nextLong(longs);
+        for (size_t i = 0; i < N; ++i)
+            assert(longs[i] == scalar[i]->nextLong());
+        lanes.nextBool(bools);
+        for (size_t i = 0; i < N; ++i)
+            assert(bools[i] == scalar[i]->nextBool());
+        lanes.nextFloat(floats);
+        for (size_t i = 0; i < N; ++i)
+            assert(floats[i] == scalar[i]->nextFloat());
+        lanes.nextDouble(doubles);
+        for (size_t i = 0; i < N; ++i)
+            assert(doubles[i] == scalar[i]->nextDouble());
+    }
+    for (size_t i = 0; i < N; ++i)
+        delete scalar[i];
+}
+
+int main(int argc, char **argv)
+{
+    (void)argc;
+    (void)argv;
+    test_known_values();
+    test_positional();
+    test_lanes<4>();
+    test_lanes<8>();
+    test_lanes<16>();
+    std::cout << "xoroshiro tests passed" << std::endl;
+    return 0;
+}